@@ -15,13 +15,18 @@
 #include "./orchestrator/binary_log_channel.h"
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <csignal>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/base/internal/endian.h"
 #include "absl/status/status.h"
@@ -29,6 +34,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "./proto/binary_log_entry.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
 #include "./util/byte_io.h"
@@ -57,6 +63,17 @@ absl::Status ClearFlags(int fd, int flags) {
   return absl::OkStatus();
 }
 
+// Returns `entry` serialized and prefixed with its size, as it is sent over
+// the channel.
+std::string FrameEntry(const proto::BinaryLogEntry& entry) {
+  const size_t proto_size = entry.ByteSizeLong();
+  std::string framed(sizeof(uint64_t) + proto_size, '\0');
+  absl::little_endian::Store64(framed.data(), proto_size);
+  entry.SerializeWithCachedSizesToArray(
+      reinterpret_cast<uint8_t*>(framed.data() + sizeof(uint64_t)));
+  return framed;
+}
+
 // If 's' is okay, just returns it.  Otherwise, converts the status into
 // an internal error and adds a prefix to the message.
 absl::Status WrapConstructorError(absl::Status s) {
@@ -118,6 +135,161 @@ absl::Status BinaryLogProducer::SendSnapshotExecutionResult(
   return Send(entry);
 }
 
+AsyncBinaryLogProducer::AsyncBinaryLogProducer(int fd,
+                                               size_t max_buffered_bytes,
+                                               OverflowPolicy overflow_policy,
+                                               bool take_ownership,
+                                               absl::Duration max_block_time)
+    : fd_(fd),
+      take_ownership_(take_ownership),
+      max_buffered_bytes_(max_buffered_bytes),
+      overflow_policy_(overflow_policy),
+      max_block_time_(max_block_time) {
+  // See BinaryLogProducer.
+  IgnoreSignal(SIGPIPE);
+  constructor_status_ = WrapConstructorError(ClearFlags(fd, O_NONBLOCK));
+  if (constructor_status_.ok()) {
+    writer_ = std::thread(&AsyncBinaryLogProducer::WriterMain, this);
+  }
+}
+
+AsyncBinaryLogProducer::~AsyncBinaryLogProducer() {
+  if (writer_.joinable()) {
+    {
+      absl::MutexLock l(&mu_);
+      stopping_ = true;
+    }
+    writer_.join();
+  }
+  if (take_ownership_ && close(fd_) < 0) {
+    LOG_ERROR("Cannot close channel descriptor: ", ErrnoStr(errno));
+  }
+}
+
+absl::Status AsyncBinaryLogProducer::Send(const proto::BinaryLogEntry& entry) {
+  return Send(entry, overflow_policy_);
+}
+
+absl::Status AsyncBinaryLogProducer::Send(const proto::BinaryLogEntry& entry,
+                                          OverflowPolicy overflow_policy) {
+  RETURN_IF_NOT_OK(constructor_status_);
+  std::string framed = FrameEntry(entry);
+
+  absl::MutexLock l(&mu_);
+  const size_t size = framed.size();
+  auto has_room = [this, size]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return !status_.ok() || buffered_bytes_ == 0 ||
+           buffered_bytes_ + size <= max_buffered_bytes_;
+  };
+  if (!has_room()) {
+    if (overflow_policy == OverflowPolicy::kDrop) {
+      ++stats_.num_dropped_entries;
+      return absl::ResourceExhaustedError("Binary log queue is full");
+    }
+    if (!mu_.AwaitWithTimeout(absl::Condition(&has_room), max_block_time_)) {
+      ++stats_.num_dropped_entries;
+      ++stats_.num_timed_out_entries;
+      return absl::ResourceExhaustedError(
+          "Timed out waiting for room in the binary log queue");
+    }
+  }
+  RETURN_IF_NOT_OK(status_);
+  buffered_bytes_ += size;
+  stats_.max_buffered_bytes =
+      std::max<uint64_t>(stats_.max_buffered_bytes, buffered_bytes_);
+  queue_.push_back(std::move(framed));
+  return absl::OkStatus();
+}
+
+absl::Status AsyncBinaryLogProducer::Flush() {
+  RETURN_IF_NOT_OK(constructor_status_);
+  absl::MutexLock l(&mu_);
+  auto flushed = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return queue_.empty() && !writing_;
+  };
+  mu_.Await(absl::Condition(&flushed));
+  return status_;
+}
+
+AsyncBinaryLogProducer::Stats AsyncBinaryLogProducer::stats() const {
+  absl::MutexLock l(&mu_);
+  return stats_;
+}
+
+void AsyncBinaryLogProducer::WriterMain() {
+  std::vector<std::string> batch;
+  while (true) {
+    {
+      absl::MutexLock l(&mu_);
+      auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return !queue_.empty() || stopping_;
+      };
+      mu_.Await(absl::Condition(&has_work));
+      if (queue_.empty()) {
+        return;
+      }
+      batch.swap(queue_);
+      writing_ = true;
+    }
+
+    absl::Status status = WriteBatch(batch);
+
+    absl::MutexLock l(&mu_);
+    for (const std::string& framed : batch) {
+      buffered_bytes_ -= framed.size();
+    }
+    if (status.ok()) {
+      stats_.num_written_entries += batch.size();
+    } else if (status_.ok()) {
+      status_ = status;
+    }
+    batch.clear();
+    writing_ = false;
+    // Nothing more can be written after an error.
+    if (!status_.ok()) {
+      for (const std::string& framed : queue_) {
+        buffered_bytes_ -= framed.size();
+      }
+      queue_.clear();
+    }
+  }
+}
+
+absl::Status AsyncBinaryLogProducer::WriteBatch(
+    const std::vector<std::string>& batch) {
+  std::vector<struct iovec> iov(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    iov[i].iov_base = const_cast<char*>(batch[i].data());
+    iov[i].iov_len = batch[i].size();
+  }
+  struct iovec* next = iov.data();
+  struct iovec* const end = next + iov.size();
+  while (next != end) {
+    const int count = std::min<ptrdiff_t>(end - next, IOV_MAX);
+    const ssize_t written = writev(fd_, next, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EPIPE) return EndOfChannelError();
+      return absl::ErrnoToStatus(errno, "Cannot write BinaryLogEntry");
+    }
+    {
+      absl::MutexLock l(&mu_);
+      ++stats_.num_writes;
+    }
+    // Skip what was written, possibly ending in the middle of an entry.
+    size_t remaining = written;
+    while (next != end && remaining >= next->iov_len) {
+      remaining -= next->iov_len;
+      ++next;
+    }
+    if (next != end) {
+      next->iov_base = static_cast<char*>(next->iov_base) + remaining;
+      next->iov_len -= remaining;
+    }
+  }
+  return absl::OkStatus();
+}
+
 BinaryLogConsumer::BinaryLogConsumer(int fd, bool take_ownership)
     : fd_(fd), take_ownership_(take_ownership) {
   // We need a blocking file descriptor.
@@ -15,12 +15,18 @@
 #ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LOG_CHANNEL_H_
 #define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LOG_CHANNEL_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "./proto/binary_log_entry.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
 
@@ -89,6 +95,127 @@ class BinaryLogProducer {
   absl::Status constructor_status_;
 };
 
+// Like BinaryLogProducer but Send() only queues entries in memory. A writer
+// thread writes queued entries to the channel in batches with writev(2), so
+// a slow consumer does not block the sender.
+//
+// The queue is bounded by `max_buffered_bytes`. When it is full, Send()
+// either drops the entry or waits for the writer depending on the
+// OverflowPolicy, which can be chosen per entry. A waiting Send() gives up
+// after `max_block_time` and drops the entry, so a stuck consumer stalls the
+// sender for at most that long per entry. An entry is always accepted into an
+// empty queue, however large it is. Entries queued before the producer is
+// destroyed are written before the destructor returns.
+//
+// This class is thread-safe.
+class AsyncBinaryLogProducer {
+ public:
+  // What Send() does when the queue is full.
+  enum class OverflowPolicy {
+    // Drops the entry and returns ResourceExhaustedError.
+    kDrop,
+    // Waits until the writer makes room for the entry. Drops the entry and
+    // returns ResourceExhaustedError if that takes longer than
+    // `max_block_time`.
+    kBlock,
+  };
+
+  // Statistics of the producer.
+  struct Stats {
+    // Number of entries written to the channel.
+    uint64_t num_written_entries = 0;
+
+    // Number of entries dropped because the queue was full.
+    uint64_t num_dropped_entries = 0;
+
+    // Number of kBlock entries among num_dropped_entries, i.e. those dropped
+    // after waiting for `max_block_time`.
+    uint64_t num_timed_out_entries = 0;
+
+    // Number of writev(2) calls.
+    uint64_t num_writes = 0;
+
+    // Largest number of queued bytes observed.
+    uint64_t max_buffered_bytes = 0;
+  };
+
+  // Constructs a producer writing to file descriptor `fd`. If
+  // `take_ownership` is true, the object takes ownership of the descriptor.
+  AsyncBinaryLogProducer(
+      int fd, size_t max_buffered_bytes, OverflowPolicy overflow_policy,
+      bool take_ownership = true,
+      absl::Duration max_block_time = absl::InfiniteDuration());
+
+  // Writes all queued entries, stops the writer thread and closes the file
+  // descriptor if this owns it.
+  ~AsyncBinaryLogProducer();
+
+  // This cannot be copied or moved.
+  AsyncBinaryLogProducer(const AsyncBinaryLogProducer&) = delete;
+  AsyncBinaryLogProducer& operator=(const AsyncBinaryLogProducer&) = delete;
+  AsyncBinaryLogProducer(AsyncBinaryLogProducer&&) = delete;
+  AsyncBinaryLogProducer& operator=(AsyncBinaryLogProducer&&) = delete;
+
+  // Queues a binary log entry proto. Returns ResourceExhaustedError if the
+  // entry was dropped or the first error of the writer, e.g. an
+  // OutOfRangeError("EOC") status once the consumer closed its end of the
+  // channel. Entries are not queued after an error.
+  absl::Status Send(const proto::BinaryLogEntry& entry);
+
+  // Like Send() but handles a full queue according to `overflow_policy`
+  // instead of the policy passed to the constructor.
+  absl::Status Send(const proto::BinaryLogEntry& entry,
+                    OverflowPolicy overflow_policy);
+
+  // Waits until all entries queued so far are written. Returns the first
+  // error of the writer, if any.
+  absl::Status Flush();
+
+  // Returns the current statistics.
+  Stats stats() const;
+
+ private:
+  // Body of writer_.
+  void WriterMain();
+
+  // Writes `batch` of framed entries to the channel.
+  absl::Status WriteBatch(const std::vector<std::string>& batch);
+
+  // File descriptor of the log channel.
+  const int fd_;
+
+  // Whether this takes over ownership of fd_.
+  const bool take_ownership_;
+
+  const size_t max_buffered_bytes_;
+  const OverflowPolicy overflow_policy_;
+  const absl::Duration max_block_time_;
+
+  // error status set by constructor.
+  absl::Status constructor_status_;
+
+  mutable absl::Mutex mu_;
+
+  // Framed entries waiting for the writer.
+  std::vector<std::string> queue_ ABSL_GUARDED_BY(mu_);
+
+  // Bytes in queue_ and in the batch being written.
+  size_t buffered_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // True while the writer writes a batch.
+  bool writing_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Tells the writer to exit once queue_ is empty.
+  bool stopping_ ABSL_GUARDED_BY(mu_) = false;
+
+  // First error of the writer.
+  absl::Status status_ ABSL_GUARDED_BY(mu_);
+
+  Stats stats_ ABSL_GUARDED_BY(mu_);
+
+  std::thread writer_;
+};
+
 // This class is thread-safe.
 class BinaryLogConsumer {
  public:
@@ -19,6 +19,7 @@
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstdint>
 #include <string>
 #include <thread>  // NOLINT
 
@@ -26,6 +27,7 @@
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/time/time.h"
 #include "./proto/binary_log_entry.pb.h"
 #include "./proto/player_result.pb.h"
@@ -165,6 +167,134 @@ TEST_F(BinaryLogChannelTest, BadDescriptor) {
                                  StartsWith("Constructor failed")));
 }
 
+// Returns an entry for a snapshot with `snapshot_id`.
+proto::BinaryLogEntry SnapshotEntry(const std::string& snapshot_id) {
+  proto::BinaryLogEntry entry;
+  entry.mutable_snapshot_execution_result()->set_snapshot_id(snapshot_id);
+  return entry;
+}
+
+TEST_F(BinaryLogChannelTest, AsyncProducer) {
+  constexpr int kNumEntries = 1000;
+  std::thread producer_thread([this]() {
+    AsyncBinaryLogProducer producer(
+        ReleaseFD(WRITE_FD), 1 << 20,
+        AsyncBinaryLogProducer::OverflowPolicy::kBlock);
+    for (int i = 0; i < kNumEntries; ++i) {
+      ASSERT_OK(producer.Send(SnapshotEntry(absl::StrCat("snap_", i))));
+    }
+    // The destructor writes the remaining entries.
+  });
+  BinaryLogConsumer consumer(ReleaseFD(READ_FD));
+  for (int i = 0; i < kNumEntries; ++i) {
+    ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry entry, consumer.Receive());
+    EXPECT_EQ(entry.snapshot_execution_result().snapshot_id(),
+              absl::StrCat("snap_", i));
+  }
+  producer_thread.join();
+  EXPECT_TRUE(IsEndOfChannelError(consumer.Receive().status()));
+}
+
+TEST_F(BinaryLogChannelTest, AsyncProducerDropsWhenFull) {
+  // Nobody reads the pipe yet, so the writer blocks once the pipe is full.
+  const std::string snapshot_id(1000, 'x');
+  AsyncBinaryLogProducer producer(GetFD(WRITE_FD), 10000,
+                                  AsyncBinaryLogProducer::OverflowPolicy::kDrop,
+                                  /*take_ownership=*/false);
+  uint64_t num_sent = 0;
+  for (int i = 0; i < 1000; ++i) {
+    absl::Status status = producer.Send(SnapshotEntry(snapshot_id));
+    if (status.ok()) {
+      ++num_sent;
+    } else {
+      EXPECT_THAT(status, StatusIs(absl::StatusCode::kResourceExhausted));
+    }
+  }
+  AsyncBinaryLogProducer::Stats stats = producer.stats();
+  EXPECT_GT(stats.num_dropped_entries, 0);
+  EXPECT_EQ(num_sent + stats.num_dropped_entries, 1000);
+  EXPECT_LE(stats.max_buffered_bytes, 10000);
+
+  // Everything that was not dropped arrives.
+  std::thread consumer_thread([this, num_sent]() {
+    BinaryLogConsumer consumer(GetFD(READ_FD), /*take_ownership=*/false);
+    for (uint64_t i = 0; i < num_sent; ++i) {
+      ASSERT_OK(consumer.Receive().status());
+    }
+  });
+  ASSERT_OK(producer.Flush());
+  consumer_thread.join();
+  stats = producer.stats();
+  EXPECT_EQ(stats.num_written_entries, num_sent);
+  EXPECT_LE(stats.num_writes, num_sent);
+}
+
+TEST_F(BinaryLogChannelTest, AsyncProducerPolicyPerEntry) {
+  // Nobody reads the pipe yet, so the writer blocks once the pipe is full.
+  const std::string snapshot_id(1000, 'x');
+  AsyncBinaryLogProducer producer(
+      GetFD(WRITE_FD), 10000, AsyncBinaryLogProducer::OverflowPolicy::kBlock,
+      /*take_ownership=*/false);
+  absl::Status status;
+  do {
+    status = producer.Send(SnapshotEntry(snapshot_id),
+                           AsyncBinaryLogProducer::OverflowPolicy::kDrop);
+  } while (status.ok());
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kResourceExhausted));
+
+  // Entries sent with the default policy wait for the consumer instead.
+  std::thread consumer_thread([this]() {
+    BinaryLogConsumer consumer(GetFD(READ_FD), /*take_ownership=*/false);
+    while (true) {
+      absl::StatusOr<proto::BinaryLogEntry> entry = consumer.Receive();
+      ASSERT_OK(entry);
+      if (entry->snapshot_execution_result().snapshot_id() == "last") break;
+    }
+  });
+  ASSERT_OK(producer.Send(SnapshotEntry("last")));
+  ASSERT_OK(producer.Flush());
+  consumer_thread.join();
+  EXPECT_EQ(producer.stats().num_dropped_entries, 1);
+}
+
+TEST_F(BinaryLogChannelTest, AsyncProducerBlockTimesOut) {
+  // Nobody reads the pipe yet, so the writer blocks once the pipe is full.
+  const std::string snapshot_id(1000, 'x');
+  AsyncBinaryLogProducer producer(
+      GetFD(WRITE_FD), 10000, AsyncBinaryLogProducer::OverflowPolicy::kBlock,
+      /*take_ownership=*/false, absl::Milliseconds(10));
+  absl::Status status;
+  do {
+    status = producer.Send(SnapshotEntry(snapshot_id));
+  } while (status.ok());
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kResourceExhausted));
+  AsyncBinaryLogProducer::Stats stats = producer.stats();
+  EXPECT_EQ(stats.num_dropped_entries, 1);
+  EXPECT_EQ(stats.num_timed_out_entries, 1);
+
+  std::thread consumer_thread([this]() {
+    BinaryLogConsumer consumer(GetFD(READ_FD), /*take_ownership=*/false);
+    while (true) {
+      absl::StatusOr<proto::BinaryLogEntry> entry = consumer.Receive();
+      ASSERT_OK(entry);
+      if (entry->snapshot_execution_result().snapshot_id() == "last") break;
+    }
+  });
+  ASSERT_OK(producer.Send(SnapshotEntry("last")));
+  ASSERT_OK(producer.Flush());
+  consumer_thread.join();
+}
+
+TEST_F(BinaryLogChannelTest, AsyncProducerConsumerShutdown) {
+  AsyncBinaryLogProducer producer(
+      ReleaseFD(WRITE_FD), 1 << 20,
+      AsyncBinaryLogProducer::OverflowPolicy::kBlock);
+  CloseFD(READ_FD);
+  ASSERT_OK(producer.Send(SnapshotEntry("some_snapshot")));
+  EXPECT_TRUE(IsEndOfChannelError(producer.Flush()));
+  EXPECT_TRUE(IsEndOfChannelError(producer.Send(SnapshotEntry("another"))));
+}
+
 TEST_F(BinaryLogChannelTest, IgnoreSIGPIPE) {
   // Close the read end. Child should get a EPIPE on write.
   CloseFD(READ_FD);
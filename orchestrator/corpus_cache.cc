@@ -0,0 +1,170 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/corpus_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./util/cache_entry.h"
+#include "./util/checks.h"
+#include "./util/checksum.h"
+#include "./util/owned_file_descriptor.h"
+
+namespace silifuzz {
+
+namespace {
+
+constexpr uint64_t kEntryMagic = 0x6568636143504653;  // "SFPCache"
+
+// Payload of the metadata file of an entry.
+struct ImageMetadata {
+  uint64_t size;
+  uint64_t checksum;
+};
+
+// Read-only mapping of a whole file.
+class FileMapping {
+ public:
+  FileMapping() = default;
+  ~FileMapping() {
+    if (size_ > 0) munmap(addr_, size_);
+  }
+
+  // Not copyable or moveable.
+  FileMapping(const FileMapping&) = delete;
+  FileMapping& operator=(const FileMapping&) = delete;
+
+  // Maps file `fd`.
+  absl::Status Map(int fd) {
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0) {
+      return absl::ErrnoToStatus(errno, "fstat()");
+    }
+    if (stat_buf.st_size == 0) {
+      return absl::OkStatus();
+    }
+    void* addr = mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      return absl::ErrnoToStatus(errno, "mmap()");
+    }
+    addr_ = static_cast<uint8_t*>(addr);
+    size_ = stat_buf.st_size;
+    return absl::OkStatus();
+  }
+
+  const uint8_t* data() const { return addr_; }
+  size_t size() const { return size_; }
+
+ private:
+  uint8_t* addr_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+absl::StatusOr<std::string> CorpusCache::Key(int fd) {
+  FileMapping mapping;
+  RETURN_IF_NOT_OK(mapping.Map(fd));
+  const uint64_t checksum =
+      ComputeMemoryChecksum(mapping.data(), mapping.size(), kVersion);
+  return absl::StrCat(absl::Hex(checksum, absl::kZeroPad16), "_",
+                      mapping.size());
+}
+
+std::string CorpusCache::EntryPath(absl::string_view key) const {
+  return absl::StrCat(dir_, "/", key, ".v", kVersion, ".corpus");
+}
+
+std::string CorpusCache::MetadataPath(absl::string_view key) const {
+  return absl::StrCat(EntryPath(key), ".meta");
+}
+
+absl::StatusOr<OwnedFileDescriptor> CorpusCache::Read(
+    absl::string_view key) const {
+  const std::string path = EntryPath(key);
+  absl::StatusOr<std::string> metadata =
+      ReadCacheEntry(MetadataPath(key), kEntryMagic, kVersion);
+  if (absl::IsNotFound(metadata.status())) {
+    return absl::NotFoundError(path);
+  }
+  if (!metadata.ok() && !absl::IsDataLoss(metadata.status())) {
+    return metadata.status();
+  }
+  ImageMetadata image_metadata;
+  const bool valid_metadata =
+      metadata.ok() && metadata->size() == sizeof(image_metadata);
+  if (valid_metadata) {
+    memcpy(&image_metadata, metadata->data(), sizeof(image_metadata));
+  }
+
+  const int entry_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (entry_fd < 0 && errno != ENOENT) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  OwnedFileDescriptor entry =
+      entry_fd >= 0 ? WrapFileDescriptor(entry_fd) : nullptr;
+  struct stat stat_buf;
+  bool valid = valid_metadata && entry != nullptr &&
+               fstat(*entry, &stat_buf) == 0 &&
+               static_cast<uint64_t>(stat_buf.st_size) == image_metadata.size;
+  if (valid) {
+    // Check the image once here. A corrupted image may still be a
+    // structurally valid corpus, whose wrong end states would then be
+    // reported as CPU defects.
+    FileMapping image;
+    RETURN_IF_NOT_OK(image.Map(*entry));
+    valid = ComputeMemoryChecksum(image.data(), image.size()) ==
+            image_metadata.checksum;
+  }
+  if (!valid) {
+    // Remove the entry so that it gets written again.
+    unlink(MetadataPath(key).c_str());
+    unlink(path.c_str());
+    return absl::DataLossError(absl::StrCat("Invalid cache entry ", path));
+  }
+  return entry;
+}
+
+absl::Status CorpusCache::Write(absl::string_view key, int fd) const {
+  RETURN_IF_NOT_OK(MakeCacheDirectory(dir_));
+  FileMapping image;
+  RETURN_IF_NOT_OK(image.Map(fd));
+
+  // Write the image first, so that metadata never describes a missing image.
+  RETURN_IF_NOT_OK(
+      WriteFileAtomically(EntryPath(key), image.data(), image.size()));
+  const ImageMetadata image_metadata = {
+      .size = image.size(),
+      .checksum = ComputeMemoryChecksum(image.data(), image.size()),
+  };
+  return WriteCacheEntry(
+      MetadataPath(key), kEntryMagic, kVersion,
+      absl::string_view(reinterpret_cast<const char*>(&image_metadata),
+                        sizeof(image_metadata)));
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,85 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CORPUS_CACHE_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CORPUS_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "./util/owned_file_descriptor.h"
+
+namespace silifuzz {
+
+// On-disk cache of decompressed corpora, so that a restarted orchestrator
+// does not decompress the same corpora again.
+//
+// Entries are keyed by a checksum of the compressed file and the cache format
+// version. Each entry is the decompressed image as is, so that a cached
+// corpus is handed to the runners without copying it, plus a small metadata
+// file recording the image size and checksum. Read() verifies the checksum
+// once when it opens an entry. Both files are written to temp files that are
+// synced and renamed into place, the image first, so concurrent writers and
+// crashes never leave a partial image under its final name or metadata that
+// does not match the image.
+//
+// Entries are never evicted. The directory can be wiped at any time.
+//
+// This class is thread-safe.
+class CorpusCache {
+ public:
+  // Version of the entry format. Bump it when the format or the contents of
+  // the decompressed images change, e.g. when the decompression does.
+  static constexpr uint64_t kVersion = 1;
+
+  // Caches entries in `dir`, which is created if it does not exist.
+  explicit CorpusCache(absl::string_view dir) : dir_(dir) {}
+
+  // Copyable and movable by default.
+  CorpusCache(const CorpusCache&) = default;
+  CorpusCache& operator=(const CorpusCache&) = default;
+  CorpusCache(CorpusCache&&) = default;
+  CorpusCache& operator=(CorpusCache&&) = default;
+
+  // Returns the key of the compressed corpus file `fd`. Does not change the
+  // file offset.
+  static absl::StatusOr<std::string> Key(int fd);
+
+  // Returns a read-only descriptor of the cached decompressed image for `key`.
+  //
+  // RETURNS NotFoundError if there is no entry or DataLossError if the
+  // entry is invalid, e.g. the image does not match its checksum, in which
+  // case it is removed.
+  absl::StatusOr<OwnedFileDescriptor> Read(absl::string_view key) const;
+
+  // Writes the contents of file `fd` as the decompressed image for `key`,
+  // replacing any existing entry. Does not change the file offset.
+  absl::Status Write(absl::string_view key, int fd) const;
+
+  // Returns the path of the entry for `key`.
+  std::string EntryPath(absl::string_view key) const;
+
+  // Returns the path of the metadata of the entry for `key`.
+  std::string MetadataPath(absl::string_view key) const;
+
+ private:
+  std::string dir_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CORPUS_CACHE_H_
@@ -0,0 +1,143 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/corpus_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./util/byte_io.h"
+#include "./util/checks.h"
+#include "./util/owned_file_descriptor.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+
+namespace silifuzz {
+namespace {
+
+using silifuzz::testing::IsOkAndHolds;
+using silifuzz::testing::StatusIs;
+
+// Returns a new mem file with `contents`.
+OwnedFileDescriptor MemFile(absl::string_view contents) {
+  const int fd = memfd_create("CorpusCacheTest", MFD_CLOEXEC);
+  CHECK_NE(fd, -1);
+  CHECK_EQ(Write(fd, contents.data(), contents.size()), contents.size());
+  return WrapFileDescriptor(fd);
+}
+
+// Returns the contents of file `fd`.
+std::string Contents(int fd) {
+  struct stat stat_buf;
+  CHECK_EQ(fstat(fd, &stat_buf), 0);
+  std::string contents(stat_buf.st_size, 0);
+  CHECK_EQ(pread(fd, contents.data(), contents.size(), 0), contents.size());
+  return contents;
+}
+
+std::string TempDir(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(CorpusCache, Key) {
+  OwnedFileDescriptor a = MemFile("compressed corpus");
+  OwnedFileDescriptor b = MemFile("another compressed corpus");
+  ASSERT_OK_AND_ASSIGN(std::string key_a, CorpusCache::Key(*a));
+  ASSERT_OK_AND_ASSIGN(std::string key_b, CorpusCache::Key(*b));
+  EXPECT_NE(key_a, key_b);
+  EXPECT_THAT(CorpusCache::Key(*MemFile("compressed corpus")),
+              IsOkAndHolds(key_a));
+
+  // The offset does not matter.
+  EXPECT_EQ(lseek(*a, 0, SEEK_CUR), 17);
+  EXPECT_THAT(CorpusCache::Key(*a), IsOkAndHolds(key_a));
+}
+
+TEST(CorpusCache, ReadWrite) {
+  CorpusCache cache(TempDir("ReadWrite"));
+  EXPECT_THAT(cache.Read("key"), StatusIs(absl::StatusCode::kNotFound));
+
+  const std::string image(10000, 'x');
+  ASSERT_OK(cache.Write("key", *MemFile(image)));
+  ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor out, cache.Read("key"));
+  EXPECT_EQ(Contents(*out), image);
+
+  // The entry itself is returned, not a copy.
+  struct stat out_stat, entry_stat;
+  ASSERT_EQ(fstat(*out, &out_stat), 0);
+  ASSERT_EQ(stat(cache.EntryPath("key").c_str(), &entry_stat), 0);
+  EXPECT_EQ(out_stat.st_ino, entry_stat.st_ino);
+  EXPECT_EQ(fcntl(*out, F_GETFL) & O_ACCMODE, O_RDONLY);
+
+  // Entries can be replaced. Descriptors returned earlier keep the old image.
+  ASSERT_OK(cache.Write("key", *MemFile("new image")));
+  ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor out2, cache.Read("key"));
+  EXPECT_EQ(Contents(*out2), "new image");
+  EXPECT_EQ(Contents(*out), image);
+
+  // Empty images are fine.
+  ASSERT_OK(cache.Write("empty", *MemFile("")));
+  ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor out3, cache.Read("empty"));
+  EXPECT_EQ(Contents(*out3), "");
+}
+
+TEST(CorpusCache, InvalidEntry) {
+  CorpusCache cache(TempDir("InvalidEntry"));
+  ASSERT_OK(cache.Write("key", *MemFile("image")));
+
+  // Corrupt the metadata.
+  const std::string metadata_path = cache.MetadataPath("key");
+  const int fd = open(metadata_path.c_str(), O_WRONLY);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(pwrite(fd, "X", 1, 0), 1);
+  close(fd);
+  EXPECT_THAT(cache.Read("key"), StatusIs(absl::StatusCode::kDataLoss));
+
+  // The invalid entry is gone.
+  EXPECT_THAT(cache.Read("key"), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_NE(access(cache.EntryPath("key").c_str(), F_OK), 0);
+
+  // Truncated images are invalid too.
+  ASSERT_OK(cache.Write("key", *MemFile("image")));
+  ASSERT_EQ(truncate(cache.EntryPath("key").c_str(), 2), 0);
+  EXPECT_THAT(cache.Read("key"), StatusIs(absl::StatusCode::kDataLoss));
+
+  // So are images that do not match their checksum.
+  ASSERT_OK(cache.Write("key", *MemFile("image")));
+  const std::string entry_path = cache.EntryPath("key");
+  const int entry_fd = open(entry_path.c_str(), O_WRONLY);
+  ASSERT_NE(entry_fd, -1);
+  ASSERT_EQ(pwrite(entry_fd, "I", 1, 0), 1);
+  close(entry_fd);
+  EXPECT_THAT(cache.Read("key"), StatusIs(absl::StatusCode::kDataLoss));
+  EXPECT_NE(access(entry_path.c_str(), F_OK), 0);
+
+  // So are missing images.
+  ASSERT_OK(cache.Write("key", *MemFile("image")));
+  ASSERT_EQ(unlink(cache.EntryPath("key").c_str()), 0);
+  EXPECT_THAT(cache.Read("key"), StatusIs(absl::StatusCode::kDataLoss));
+}
+
+}  // namespace
+}  // namespace silifuzz
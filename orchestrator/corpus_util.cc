@@ -15,13 +15,18 @@
 #include "./orchestrator/corpus_util.h"
 
 #include <fcntl.h>
+#include <sched.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
@@ -29,6 +34,7 @@
 #include <vector>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/cord.h"
@@ -37,6 +43,7 @@
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "third_party/liblzma/lzma.h"
+#include "./orchestrator/corpus_cache.h"
 #include "./util/byte_io.h"
 #include "./util/checks.h"
 #include "./util/owned_file_descriptor.h"
@@ -58,26 +65,52 @@ absl::Status WriteCord(const absl::Cord& cord, int fd) {
   return absl::OkStatus();
 }
 
-// Returns contents for file with descriptor `fd` as a Cord or a status.
-// This reads starting from the current file offset.
-absl::StatusOr<absl::Cord> ReadCord(int fd) {
+// Copies the rest of file `in_fd` from its current offset to `out_fd`.
+absl::Status CopyFileContents(int in_fd, int out_fd) {
   constexpr size_t kChunkSize = 1 << 20;  // 1MB
-  std::string buffer(kChunkSize, 0);
+  std::vector<char> buffer(kChunkSize);
   ssize_t bytes_read;
-  absl::Cord cord;
-  while ((bytes_read = Read(fd, buffer.data(), buffer.size())) > 0) {
-    cord.Append(absl::string_view(buffer.data(), bytes_read));
+  while ((bytes_read = Read(in_fd, buffer.data(), buffer.size())) > 0) {
+    if (Write(out_fd, buffer.data(), bytes_read) != bytes_read) {
+      return absl::ErrnoToStatus(errno, "write()");
+    }
   }
   if (bytes_read < 0) {
-    // If Read() returns a negative number, there is an error.
     return absl::ErrnoToStatus(errno, "read()");
   }
-  return cord;
+  return absl::OkStatus();
 }
 
-}  // namespace
+// Creates an empty mem file that can be sealed. See WriteSharedMemoryFile().
+absl::StatusOr<OwnedFileDescriptor> CreateSharedMemoryFile(
+    absl::string_view name) {
+  int memfd = memfd_create(std::string(name).c_str(),
+                           O_RDWR | MFD_ALLOW_SEALING | MFD_CLOEXEC);
+  if (memfd == -1) {
+    return absl::ErrnoToStatus(errno, "memfd_create()");
+  }
+  return WrapFileDescriptor(memfd);
+}
 
-absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
+// Seals the mem file `fd` to prevent modification of its contents and seals
+// and moves its offset to the beginning.
+absl::Status SealSharedMemoryFile(int fd) {
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SEAL | F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+    return absl::ErrnoToStatus(errno, "fcntl(F_ADD_SEALS)");
+  }
+  if (lseek(fd, 0, SEEK_SET) != 0) {
+    return absl::ErrnoToStatus(errno, "lseek()");
+  }
+  return absl::OkStatus();
+}
+
+// Decompresses the lzma compressed file `input_fd` from its current offset
+// and passes the output to `consume` in chunks of up to 1MB. `path` is only
+// used in error messages.
+absl::Status DecompressXzipStream(
+    int input_fd, const std::string& path,
+    absl::FunctionRef<absl::Status(absl::string_view)> consume) {
   lzma_stream decompressed_stream = LZMA_STREAM_INIT;
   lzma_ret ret = lzma_stream_decoder(
       &decompressed_stream, lzma_easy_decoder_memusage(9 /* level */), 0);
@@ -85,6 +118,9 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
     return absl::InternalError(
         absl::StrCat("Failed to initialize decoder, return code =", ret));
   }
+  absl::Cleanup decoder_ender = [&decompressed_stream] {
+    lzma_end(&decompressed_stream);
+  };
 
   constexpr size_t kInputChunkSize = 1 << 20;
   std::vector<uint8_t> input_buffer(kInputChunkSize);
@@ -94,20 +130,6 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
   decompressed_stream.avail_out = output_buffer.size();
   decompressed_stream.next_out = output_buffer.data();
 
-  const int input_fd = open(path.c_str(), O_RDONLY);
-  absl::Cleanup clean_up([&decompressed_stream, input_fd]() {
-    lzma_end(&decompressed_stream);
-    if (input_fd >= 0) {
-      close(input_fd);
-    }
-  });
-
-  if (input_fd < 0) {
-    return absl::InternalError(
-        absl::StrCat("Failed to open compressed file ", path));
-  }
-
-  absl::Cord decompressed_data;
   bool input_eof_seen = false;
   do {
     // Refill input buffer if empty.
@@ -130,69 +152,304 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
     ret = lzma_code(&decompressed_stream,
                     input_eof_seen ? LZMA_FINISH : LZMA_RUN);
 
-    // Append data to cord if output buffer is full or if decompressed stream
-    // ends.
+    // Pass on output if output buffer is full or if decompressed stream ends.
     if (decompressed_stream.avail_out == 0 || ret == LZMA_STREAM_END) {
       absl::string_view chunk(
           reinterpret_cast<char*>(output_buffer.data()),
           output_buffer.size() - decompressed_stream.avail_out);
-      decompressed_data.Append(chunk);
+      RETURN_IF_NOT_OK(consume(chunk));
       decompressed_stream.avail_out = output_buffer.size();
       decompressed_stream.next_out = output_buffer.data();
     }
   } while (ret == LZMA_OK);
 
-  if (ret == LZMA_STREAM_END) {
-    return decompressed_data;
-  } else {
+  if (ret != LZMA_STREAM_END) {
     return absl::InternalError("Failed to decompress data");
   }
+  return absl::OkStatus();
 }
 
-absl::StatusOr<OwnedFileDescriptor> WriteSharedMemoryFile(
-    const absl::Cord& contents, absl::string_view name) {
-  int memfd = memfd_create(std::string(name).c_str(),
-                           O_RDWR | MFD_ALLOW_SEALING | MFD_CLOEXEC);
-  if (memfd == -1) {
-    return absl::ErrnoToStatus(errno, "memfd_create()");
+// Location of an xz block in the compressed file and of its output.
+struct XzipBlock {
+  uint64_t compressed_offset;
+  uint64_t unpadded_size;
+  uint64_t uncompressed_offset;
+  uint64_t uncompressed_size;
+};
+
+// Block layout of an xz file, read from its index.
+struct XzipIndex {
+  lzma_check check;
+  uint64_t uncompressed_size;
+  std::vector<XzipBlock> blocks;
+};
+
+// Reads the index of the xz file contents `input`. Only files with a single
+// stream are supported.
+absl::StatusOr<XzipIndex> ReadXzipIndex(absl::Span<const uint8_t> input) {
+  if (input.size() < 2 * LZMA_STREAM_HEADER_SIZE) {
+    return absl::InvalidArgumentError("file too small");
+  }
+  lzma_stream_flags header_flags, footer_flags;
+  if (lzma_stream_header_decode(&header_flags, input.data()) != LZMA_OK) {
+    return absl::InvalidArgumentError("bad stream header");
+  }
+  // This also rejects stream padding at the end of the file.
+  const size_t footer_offset = input.size() - LZMA_STREAM_HEADER_SIZE;
+  if (lzma_stream_footer_decode(&footer_flags, &input[footer_offset]) !=
+          LZMA_OK ||
+      lzma_stream_flags_compare(&header_flags, &footer_flags) != LZMA_OK) {
+    return absl::InvalidArgumentError("bad stream footer");
+  }
+  if (footer_flags.backward_size > footer_offset - LZMA_STREAM_HEADER_SIZE) {
+    return absl::InvalidArgumentError("bad index size");
   }
-  OwnedFileDescriptor owned_fd = WrapFileDescriptor(memfd);
-  RETURN_IF_NOT_OK(WriteCord(contents, *owned_fd));
 
-  // Seal file after write to prevent modification of its contents and seals.
-  if (fcntl(*owned_fd, F_ADD_SEALS,
-            F_SEAL_SEAL | F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
-    return absl::ErrnoToStatus(errno, "fcntl(F_ADD_SEALS)");
+  lzma_index* index = nullptr;
+  uint64_t memlimit = UINT64_MAX;
+  size_t in_pos = footer_offset - footer_flags.backward_size;
+  if (lzma_index_buffer_decode(&index, &memlimit, nullptr, input.data(),
+                               &in_pos, footer_offset) != LZMA_OK) {
+    return absl::InvalidArgumentError("bad index");
+  }
+  absl::Cleanup index_ender = [index] { lzma_index_end(index, nullptr); };
+  if (lzma_index_file_size(index) != input.size()) {
+    return absl::UnimplementedError("multiple streams");
   }
 
-  // Move file descriptor to beginning of file.
-  if (lseek(*owned_fd, 0, SEEK_SET) != 0) {
-    return absl::ErrnoToStatus(errno, "lseek()");
+  XzipIndex result = {
+      .check = header_flags.check,
+      .uncompressed_size = lzma_index_uncompressed_size(index),
+  };
+  lzma_index_iter iter;
+  lzma_index_iter_init(&iter, index);
+  while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK)) {
+    result.blocks.push_back({
+        .compressed_offset = iter.block.compressed_file_offset,
+        .unpadded_size = iter.block.unpadded_size,
+        .uncompressed_offset = iter.block.uncompressed_file_offset,
+        .uncompressed_size = iter.block.uncompressed_size,
+    });
   }
+  return result;
+}
 
+// Decodes `xz_block` of the xz file contents `input` to `output`.
+absl::Status DecodeXzipBlock(absl::Span<const uint8_t> input, lzma_check check,
+                             const XzipBlock& xz_block, uint8_t* output) {
+  if (xz_block.compressed_offset >= input.size() ||
+      xz_block.unpadded_size >
+          input.size() - xz_block.compressed_offset) {
+    return absl::InvalidArgumentError("block out of bounds");
+  }
+  const uint8_t* header = &input[xz_block.compressed_offset];
+  lzma_filter filters[LZMA_FILTERS_MAX + 1];
+  lzma_block block = {};
+  block.version = 0;
+  block.check = check;
+  block.filters = filters;
+  block.header_size = lzma_block_header_size_decode(header[0]);
+  if (block.header_size > xz_block.unpadded_size ||
+      lzma_block_header_decode(&block, nullptr, header) != LZMA_OK) {
+    return absl::InvalidArgumentError("bad block header");
+  }
+  absl::Cleanup filters_freer = [&filters] {
+    for (size_t i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i) {
+      free(filters[i].options);
+    }
+  };
+  if (lzma_block_compressed_size(&block, xz_block.unpadded_size) != LZMA_OK) {
+    return absl::InvalidArgumentError("bad block size");
+  }
+  block.uncompressed_size = xz_block.uncompressed_size;
+
+  size_t in_pos = xz_block.compressed_offset + block.header_size;
+  const size_t in_size = std::min<uint64_t>(
+      xz_block.compressed_offset + lzma_block_total_size(&block),
+      input.size());
+  size_t out_pos = 0;
+  if (lzma_block_buffer_decode(&block, nullptr, input.data(), &in_pos, in_size,
+                               output, &out_pos,
+                               xz_block.uncompressed_size) != LZMA_OK ||
+      out_pos != xz_block.uncompressed_size) {
+    return absl::InternalError("Failed to decompress data");
+  }
+  return absl::OkStatus();
+}
+
+// Decompresses the xz file `input_fd` into `output_fd` by decoding its blocks
+// straight into a mapping of `output_fd`, in parallel on up to `num_threads`
+// threads. Fails without reading `input_fd` if its layout is not supported.
+absl::Status DecompressXzipBlocks(int input_fd, int output_fd,
+                                  size_t num_threads) {
+  struct stat stat_buf;
+  if (fstat(input_fd, &stat_buf) != 0) {
+    return absl::ErrnoToStatus(errno, "fstat()");
+  }
+  const size_t input_size = stat_buf.st_size;
+  if (input_size == 0) {
+    return absl::InvalidArgumentError("empty file");
+  }
+  void* input_addr =
+      mmap(nullptr, input_size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+  if (input_addr == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap()");
+  }
+  absl::Cleanup input_unmapper = [input_addr, input_size] {
+    munmap(input_addr, input_size);
+  };
+  const absl::Span<const uint8_t> input(static_cast<uint8_t*>(input_addr),
+                                        input_size);
+  ASSIGN_OR_RETURN_IF_NOT_OK(XzipIndex index, ReadXzipIndex(input));
+  if (index.uncompressed_size == 0) {
+    return absl::OkStatus();
+  }
+
+  if (ftruncate(output_fd, index.uncompressed_size) != 0) {
+    return absl::ErrnoToStatus(errno, "ftruncate()");
+  }
+  void* output_addr = mmap(nullptr, index.uncompressed_size,
+                           PROT_READ | PROT_WRITE, MAP_SHARED, output_fd, 0);
+  if (output_addr == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap()");
+  }
+  absl::Cleanup output_unmapper = [output_addr, &index] {
+    munmap(output_addr, index.uncompressed_size);
+  };
+  uint8_t* output = static_cast<uint8_t*>(output_addr);
+
+  // Threads take blocks in file order until none are left.
+  num_threads = std::clamp<size_t>(num_threads, 1, index.blocks.size());
+  std::atomic<size_t> next_block = 0;
+  std::vector<absl::Status> statuses(num_threads);
+  auto decode_blocks = [&](absl::Status* status) {
+    for (size_t i = next_block++; i < index.blocks.size(); i = next_block++) {
+      const XzipBlock& block = index.blocks[i];
+      if (block.uncompressed_offset > index.uncompressed_size ||
+          block.uncompressed_size >
+              index.uncompressed_size - block.uncompressed_offset) {
+        *status = absl::InvalidArgumentError("block out of bounds");
+        return;
+      }
+      *status = DecodeXzipBlock(input, index.check, block,
+                                output + block.uncompressed_offset);
+      if (!status->ok()) return;
+    }
+  };
+  std::vector<std::thread> decoder_threads;
+  decoder_threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; ++i) {
+    decoder_threads.emplace_back(decode_blocks, &statuses[i]);
+  }
+  decode_blocks(&statuses[0]);
+  for (auto& thread : decoder_threads) {
+    thread.join();
+  }
+  for (const absl::Status& status : statuses) {
+    RETURN_IF_NOT_OK(status);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
+  const int input_fd = open(path.c_str(), O_RDONLY);
+  if (input_fd < 0) {
+    return absl::InternalError(
+        absl::StrCat("Failed to open compressed file ", path));
+  }
+  absl::Cleanup file_closer = [input_fd] { close(input_fd); };
+
+  absl::Cord decompressed_data;
+  RETURN_IF_NOT_OK(DecompressXzipStream(
+      input_fd, path, [&decompressed_data](absl::string_view chunk) {
+        decompressed_data.Append(chunk);
+        return absl::OkStatus();
+      }));
+  return decompressed_data;
+}
+
+absl::StatusOr<OwnedFileDescriptor> WriteSharedMemoryFile(
+    const absl::Cord& contents, absl::string_view name) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor owned_fd,
+                             CreateSharedMemoryFile(name));
+  RETURN_IF_NOT_OK(WriteCord(contents, *owned_fd));
+  RETURN_IF_NOT_OK(SealSharedMemoryFile(*owned_fd));
   return owned_fd;
 }
 
-absl::StatusOr<OwnedFileDescriptor> LoadCorpus(const std::string& path) {
-  absl::Cord contents;
-  if (absl::EndsWith(path, ".xz")) {
-    ASSIGN_OR_RETURN_IF_NOT_OK(contents, ReadXzipFile(path));
-  } else {
-    // Assume this is an uncompressed corpus.
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd < 0) {
-      return absl::ErrnoToStatus(errno, "open()");
+absl::StatusOr<OwnedFileDescriptor> LoadCorpus(const std::string& path,
+                                               size_t num_threads,
+                                               const CorpusCache* cache) {
+  const bool compressed = absl::EndsWith(path, ".xz");
+  const int input_fd = open(path.c_str(), O_RDONLY);
+  if (input_fd < 0) {
+    if (compressed) {
+      return absl::InternalError(
+          absl::StrCat("Failed to open compressed file ", path));
+    }
+    return absl::ErrnoToStatus(errno, "open()");
+  }
+  absl::Cleanup file_closer = [input_fd] { close(input_fd); };
+
+  // The cache is only an optimization. Carry on without it on any error.
+  std::string cache_key;
+  if (compressed && cache != nullptr) {
+    absl::StatusOr<std::string> cache_key_or = CorpusCache::Key(input_fd);
+    if (cache_key_or.ok()) {
+      cache_key = *std::move(cache_key_or);
+      // Hand out the cached image itself rather than a copy.
+      absl::StatusOr<OwnedFileDescriptor> cached_fd = cache->Read(cache_key);
+      if (cached_fd.ok()) {
+        VLOG_INFO(1, "Loaded ", path, " from ", cache->EntryPath(cache_key));
+        return cached_fd;
+      }
+      if (!absl::IsNotFound(cached_fd.status())) {
+        LOG_ERROR("Cannot read corpus cache: ", cached_fd.status().message());
+      }
+    } else {
+      LOG_ERROR("Cannot compute corpus cache key: ",
+                cache_key_or.status().message());
     }
-    absl::Cleanup file_closer = absl::MakeCleanup([fd] { close(fd); });
-    ASSIGN_OR_RETURN_IF_NOT_OK(contents, ReadCord(fd));
   }
 
   // Set linked name in /proc/self/fd/ for ease of debugging.
-  return WriteSharedMemoryFile(contents, std::string(Basename(path)));
+  ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor owned_fd,
+                             CreateSharedMemoryFile(Basename(path)));
+
+  if (!compressed) {
+    // Assume this is an uncompressed corpus.
+    RETURN_IF_NOT_OK(CopyFileContents(input_fd, *owned_fd));
+  } else if (absl::Status s =
+                 DecompressXzipBlocks(input_fd, *owned_fd, num_threads);
+             !s.ok()) {
+    // Fall back to decompressing the file as a stream, which also reports
+    // any error in the file.
+    VLOG_INFO(1, "Cannot decompress ", path, " by blocks: ", s.message());
+    if (ftruncate(*owned_fd, 0) != 0 || lseek(*owned_fd, 0, SEEK_SET) != 0) {
+      return absl::ErrnoToStatus(errno, "ftruncate()");
+    }
+    RETURN_IF_NOT_OK(DecompressXzipStream(
+        input_fd, path, [fd = *owned_fd](absl::string_view chunk) {
+          if (Write(fd, chunk.data(), chunk.size()) != chunk.size()) {
+            return absl::ErrnoToStatus(errno, "write()");
+          }
+          return absl::OkStatus();
+        }));
+  }
+  if (!cache_key.empty()) {
+    // The cache is only an optimization. Carry on without it.
+    if (absl::Status s = cache->Write(cache_key, *owned_fd); !s.ok()) {
+      LOG_ERROR("Cannot write corpus cache: ", s.message());
+    }
+  }
+  RETURN_IF_NOT_OK(SealSharedMemoryFile(*owned_fd));
+  return owned_fd;
 }
 
 absl::StatusOr<LoadCorporaResult> LoadCorpora(
-    const std::vector<std::string>& corpus_paths) {
+    const std::vector<std::string>& corpus_paths, const CorpusCache* cache) {
   // Cannot use construct owner_fds(size, init_value) because element type is
   // not copyable.
   std::vector<absl::StatusOr<OwnedFileDescriptor>> owned_fds(
@@ -202,15 +459,20 @@ absl::StatusOr<LoadCorporaResult> LoadCorpora(
   size_t num_threads = std::min<size_t>(std::thread::hardware_concurrency(),
                                         corpus_paths.size());
   CHECK_GT(num_threads, 0);
+  // Use spare CPUs to decompress blocks of the same corpus in parallel.
+  const size_t num_threads_per_corpus =
+      std::max<size_t>(std::thread::hardware_concurrency() / num_threads, 1);
 
   // Thread function to load a portion of corpus_paths and store
   // results in the corresponding portion of owned_fds.
   auto load_corpus_span =
-      [](absl::Span<const std::string> corpus_paths,
-         absl::Span<absl::StatusOr<OwnedFileDescriptor>> results) {
+      [num_threads_per_corpus, cache](
+          absl::Span<const std::string> corpus_paths,
+          absl::Span<absl::StatusOr<OwnedFileDescriptor>> results) {
         CHECK_EQ(corpus_paths.size(), results.size());
         for (size_t i = 0; i < corpus_paths.size(); ++i) {
-          results[i] = LoadCorpus(corpus_paths[i]);
+          results[i] =
+              LoadCorpus(corpus_paths[i], num_threads_per_corpus, cache);
         }
       };
 
@@ -232,11 +494,17 @@ absl::StatusOr<LoadCorporaResult> LoadCorpora(
   LoadCorporaResult result;
   result.file_descriptors.reserve(corpus_paths.size());
   result.file_descriptor_paths.reserve(corpus_paths.size());
+  result.file_sizes.reserve(corpus_paths.size());
   const pid_t pid = getpid();
   for (size_t i = 0; i < corpus_paths.size(); ++i) {
     RETURN_IF_NOT_OK(owned_fds[i].status());
     result.file_descriptor_paths.push_back(
         absl::StrCat("/proc/", pid, "/fd/", *(owned_fds[i].value())));
+    struct stat stat_buf;
+    if (fstat(*(owned_fds[i].value()), &stat_buf) != 0) {
+      return absl::ErrnoToStatus(errno, "fstat()");
+    }
+    result.file_sizes.push_back(stat_buf.st_size);
     result.file_descriptors.push_back(std::move(owned_fds[i].value()));
     VLOG_INFO(1, "Loaded corpus ", corpus_paths[i], " as ",
               result.file_descriptor_paths[i]);
@@ -244,4 +512,76 @@ absl::StatusOr<LoadCorporaResult> LoadCorpora(
   return result;
 }
 
+absl::StatusOr<OwnedFileDescriptor> CopySharedMemoryFile(
+    int fd, absl::string_view name) {
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) != 0) {
+    return absl::ErrnoToStatus(errno, "fstat()");
+  }
+  const size_t size = stat_buf.st_size;
+  ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor owned_fd,
+                             CreateSharedMemoryFile(name));
+  if (size > 0) {
+    if (ftruncate(*owned_fd, size) != 0) {
+      return absl::ErrnoToStatus(errno, "ftruncate()");
+    }
+    void* src = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (src == MAP_FAILED) {
+      return absl::ErrnoToStatus(errno, "mmap()");
+    }
+    absl::Cleanup src_unmapper = [src, size] { munmap(src, size); };
+    void* dst =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, *owned_fd, 0);
+    if (dst == MAP_FAILED) {
+      return absl::ErrnoToStatus(errno, "mmap()");
+    }
+    // Pages of the new file are allocated here, on first touch.
+    memcpy(dst, src, size);
+    munmap(dst, size);
+  }
+  RETURN_IF_NOT_OK(SealSharedMemoryFile(*owned_fd));
+  return owned_fd;
+}
+
+absl::StatusOr<LoadCorporaResult> CopyCorpora(const LoadCorporaResult& corpora,
+                                              const std::vector<int>& cpus) {
+  const size_t num_corpora = corpora.file_descriptors.size();
+  std::vector<absl::StatusOr<OwnedFileDescriptor>> owned_fds(num_corpora);
+  std::generate(owned_fds.begin(), owned_fds.end(),
+                []() { return absl::UnknownError("CopyCorpora"); });
+  absl::Status affinity_status;
+
+  // The affinity of the copying thread decides where memory is allocated.
+  std::thread copier([&]() {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &cpu_set);
+    }
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+      affinity_status = absl::ErrnoToStatus(errno, "sched_setaffinity()");
+      return;
+    }
+    for (size_t i = 0; i < num_corpora; ++i) {
+      owned_fds[i] =
+          CopySharedMemoryFile(*corpora.file_descriptors[i], "CorpusCopy");
+    }
+  });
+  copier.join();
+  RETURN_IF_NOT_OK(affinity_status);
+
+  LoadCorporaResult result;
+  result.file_descriptors.reserve(num_corpora);
+  result.file_descriptor_paths.reserve(num_corpora);
+  result.file_sizes = corpora.file_sizes;
+  const pid_t pid = getpid();
+  for (size_t i = 0; i < num_corpora; ++i) {
+    RETURN_IF_NOT_OK(owned_fds[i].status());
+    result.file_descriptor_paths.push_back(
+        absl::StrCat("/proc/", pid, "/fd/", *(owned_fds[i].value())));
+    result.file_descriptors.push_back(std::move(owned_fds[i].value()));
+  }
+  return result;
+}
+
 }  // namespace silifuzz
@@ -14,6 +14,8 @@
 
 #ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CORPUS_UTIL_H_
 #define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CORPUS_UTIL_H_
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -22,6 +24,7 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "./orchestrator/corpus_cache.h"
 #include "./util/owned_file_descriptor.h"
 
 namespace silifuzz {
@@ -46,7 +49,17 @@ absl::StatusOr<OwnedFileDescriptor> WriteSharedMemoryFile(
 // file descriptor of a temp file containing uncompressed corpus contents in
 // RAM. LoadCorpus determins the decompression algorithm to use based on
 // suffix of `path`. Currently only .gz and .xz are recognized.
-absl::StatusOr<OwnedFileDescriptor> LoadCorpus(const std::string& path);
+//
+// The contents are decompressed straight into the temp file without
+// buffering them in memory. The blocks of a multi-block .xz file are
+// decompressed in parallel on up to `num_threads` threads.
+//
+// If `cache` is not null, compressed corpora are read from and written to it.
+// A cached corpus is returned as a read-only descriptor of the cache entry
+// instead of a temp file. Cache errors are logged and otherwise ignored.
+absl::StatusOr<OwnedFileDescriptor> LoadCorpus(
+    const std::string& path, size_t num_threads = 1,
+    const CorpusCache* cache = nullptr);
 
 struct LoadCorporaResult {
   // File descriptors returned by LoadCorpora() below, in the same order
@@ -56,6 +69,10 @@ struct LoadCorporaResult {
   // Paths in /proc file system to access the elements of file_descriptors
   // above. Paths are in the same order as corresponding file descriptors.
   std::vector<std::string> file_descriptor_paths;
+
+  // Sizes of the uncompressed corpora in bytes, in the same order as the
+  // file descriptors above.
+  std::vector<uint64_t> file_sizes;
 };
 
 // Reads and decompresses gzipped relocatable Snap corpora whose paths are in
@@ -65,9 +82,29 @@ struct LoadCorporaResult {
 // descriptors and a vector of paths or an error status. See above for details
 // about LoadCorporaResult.
 //
+// If `cache` is not null, see LoadCorpus().
+//
 // REQUIRES: corpus_paths not empty.
 absl::StatusOr<LoadCorporaResult> LoadCorpora(
-    const std::vector<std::string>& corpus_paths);
+    const std::vector<std::string>& corpus_paths,
+    const CorpusCache* cache = nullptr);
+
+// Creates a sealed mem file with the same contents as the file `fd`. The
+// contents are written by the calling thread, so the pages of the new file are
+// allocated on the NUMA node of the calling thread under the default memory
+// policy. The `name` is purely for debugging.
+//
+// RETURNS a file descriptor for the new file. Caller owns the descriptor.
+absl::StatusOr<OwnedFileDescriptor> CopySharedMemoryFile(
+    int fd, absl::string_view name = "SharedMemoryFile");
+
+// Copies all corpora in `corpora` with CopySharedMemoryFile() from a thread
+// that only runs on `cpus`. Passing the CPUs of a NUMA node creates copies in
+// memory local to that node.
+//
+// RETURNS a LoadCorporaResult for the copies or an error status.
+absl::StatusOr<LoadCorporaResult> CopyCorpora(const LoadCorporaResult& corpora,
+                                              const std::vector<int>& cpus);
 
 }  // namespace silifuzz
 
@@ -0,0 +1,190 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark of corpus loading at orchestrator startup.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/orchestrator:corpus_util_benchmark
+//
+// Writes synthetic .xz corpora to --tmpdir and loads them the way the
+// orchestrator used to (decompress into a Cord, then copy into a mem file)
+// and with LoadCorpora(), which decompresses straight into the mem files.
+// The latter does not hold a second copy of a corpus in memory while it is
+// loaded. Reports the wall time and throughput of each way. Use
+// --corpus_size_mb and --num_corpora to match the corpora of interest.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "third_party/liblzma/lzma.h"
+#include "./orchestrator/corpus_util.h"
+#include "./util/byte_io.h"
+#include "./util/checks.h"
+#include "./util/owned_file_descriptor.h"
+
+ABSL_FLAG(size_t, corpus_size_mb, 64, "Uncompressed size of each corpus.");
+ABSL_FLAG(size_t, num_corpora, 2, "Number of corpora to load.");
+ABSL_FLAG(size_t, block_size_mb, 8,
+          "Uncompressed size of the .xz blocks of each corpus.");
+ABSL_FLAG(std::string, tmpdir, "/tmp", "Where to write the corpora.");
+
+namespace silifuzz {
+
+namespace {
+
+// Writes a corpus of `size` bytes that compresses about as well as a real
+// one to `path`, in .xz blocks of `block_size` bytes.
+absl::Status WriteCorpus(const std::string& path, uint64_t size,
+                         uint64_t block_size, uint64_t seed) {
+  std::string contents(size, 0);
+  uint64_t x = seed | 1;
+  for (size_t i = 0; i < size; i += 8) {
+    // Snaps are mostly zeros and small integers.
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    const uint64_t word = (x & 0xf) == 0 ? x : (x >> 58);
+    memcpy(&contents[i], &word, std::min<size_t>(8, size - i));
+  }
+
+  lzma_mt options = {};
+  options.threads = std::thread::hardware_concurrency();
+  options.block_size = block_size;
+  options.preset = 1;
+  options.check = LZMA_CHECK_CRC64;
+  lzma_stream stream = LZMA_STREAM_INIT;
+  if (lzma_stream_encoder_mt(&stream, &options) != LZMA_OK) {
+    return absl::InternalError("lzma_stream_encoder_mt()");
+  }
+  std::string compressed(lzma_stream_buffer_bound(size), 0);
+  stream.next_in = reinterpret_cast<const uint8_t*>(contents.data());
+  stream.avail_in = contents.size();
+  stream.next_out = reinterpret_cast<uint8_t*>(compressed.data());
+  stream.avail_out = compressed.size();
+  lzma_ret ret;
+  do {
+    ret = lzma_code(&stream, LZMA_FINISH);
+  } while (ret == LZMA_OK);
+  compressed.resize(stream.total_out);
+  lzma_end(&stream);
+  if (ret != LZMA_STREAM_END) {
+    return absl::InternalError("lzma_code()");
+  }
+
+  const int fd =
+      open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return absl::ErrnoToStatus(errno, "open()");
+  }
+  const bool written =
+      Write(fd, compressed.data(), compressed.size()) == compressed.size();
+  close(fd);
+  if (!written) {
+    return absl::ErrnoToStatus(errno, "write()");
+  }
+  return absl::OkStatus();
+}
+
+// Loads all `corpus_paths` via a Cord on the calling thread.
+absl::Status LoadCorporaViaCord(const std::vector<std::string>& corpus_paths) {
+  std::vector<OwnedFileDescriptor> fds;
+  for (const std::string& path : corpus_paths) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(absl::Cord contents, ReadXzipFile(path));
+    ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor fd,
+                               WriteSharedMemoryFile(contents));
+    fds.push_back(std::move(fd));
+  }
+  return absl::OkStatus();
+}
+
+// Loads all `corpus_paths` with LoadCorpus() on the calling thread.
+absl::Status LoadCorporaSerially(const std::vector<std::string>& corpus_paths) {
+  std::vector<OwnedFileDescriptor> fds;
+  for (const std::string& path : corpus_paths) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor fd, LoadCorpus(path));
+    fds.push_back(std::move(fd));
+  }
+  return absl::OkStatus();
+}
+
+template <typename LoadFunc>
+void RunBenchmark(const char* name, LoadFunc load,
+                  const std::vector<std::string>& corpus_paths,
+                  uint64_t total_size) {
+  const absl::Time start = absl::Now();
+  const absl::Status status = load(corpus_paths);
+  const absl::Duration elapsed = absl::Now() - start;
+  CHECK_STATUS(status);
+  LOG_INFO(name, ": ", absl::FormatDuration(elapsed), " ",
+           static_cast<uint64_t>((total_size >> 20) /
+                                 absl::ToDoubleSeconds(elapsed)),
+           " MiB/s");
+}
+
+int BenchmarkMain() {
+  const uint64_t corpus_size = absl::GetFlag(FLAGS_corpus_size_mb) << 20;
+  const uint64_t block_size = absl::GetFlag(FLAGS_block_size_mb) << 20;
+  const size_t num_corpora = absl::GetFlag(FLAGS_num_corpora);
+  std::vector<std::string> corpus_paths;
+  for (size_t i = 0; i < num_corpora; ++i) {
+    corpus_paths.push_back(absl::StrCat(absl::GetFlag(FLAGS_tmpdir),
+                                        "/corpus_util_benchmark_", i, ".xz"));
+    CHECK_STATUS(WriteCorpus(corpus_paths.back(), corpus_size, block_size, i));
+  }
+  LOG_INFO("Loading ", num_corpora, " corpora of ", corpus_size >> 20,
+           " MiB on ", std::thread::hardware_concurrency(), " CPUs");
+  const uint64_t total_size = corpus_size * num_corpora;
+
+  RunBenchmark(
+      "LoadCorpora",
+      [](const std::vector<std::string>& paths) {
+        return LoadCorpora(paths).status();
+      },
+      corpus_paths, total_size);
+  RunBenchmark("LoadCorpus, 1 thread", LoadCorporaSerially, corpus_paths,
+               total_size);
+  RunBenchmark("ReadXzipFile + WriteSharedMemoryFile", LoadCorporaViaCord,
+               corpus_paths, total_size);
+
+  for (const std::string& path : corpus_paths) {
+    unlink(path.c_str());
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+}  // namespace silifuzz
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  return silifuzz::BenchmarkMain();
+}
@@ -15,6 +15,7 @@
 #include "./orchestrator/corpus_util.h"
 
 #include <fcntl.h>
+#include <sched.h>
 #include <stddef.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -33,6 +34,8 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/str_cat.h"
+#include "third_party/liblzma/lzma.h"
+#include "./orchestrator/corpus_cache.h"
 #include "./util/byte_io.h"
 #include "./util/owned_file_descriptor.h"
 #include "./util/testing/status_macros.h"
@@ -65,6 +68,39 @@ absl::Status CheckFileContents(int fd, const std::string& expected_contents) {
   return absl::OkStatus();
 }
 
+// Compresses `contents` into a single .xz stream with blocks of up to
+// `block_size` bytes of uncompressed data and writes it to `path`.
+void WriteXzipFile(const std::string& path, const std::string& contents,
+                   uint64_t block_size) {
+  lzma_mt options = {};
+  options.threads = 1;
+  options.block_size = block_size;
+  options.preset = 1;
+  options.check = LZMA_CHECK_CRC64;
+  lzma_stream stream = LZMA_STREAM_INIT;
+  ASSERT_EQ(lzma_stream_encoder_mt(&stream, &options), LZMA_OK);
+
+  std::string compressed(lzma_stream_buffer_bound(contents.size()), 0);
+  stream.next_in = reinterpret_cast<const uint8_t*>(contents.data());
+  stream.avail_in = contents.size();
+  stream.next_out = reinterpret_cast<uint8_t*>(compressed.data());
+  stream.avail_out = compressed.size();
+  lzma_ret ret;
+  do {
+    ret = lzma_code(&stream, LZMA_FINISH);
+  } while (ret == LZMA_OK);
+  ASSERT_EQ(ret, LZMA_STREAM_END);
+  compressed.resize(stream.total_out);
+  lzma_end(&stream);
+
+  const int fd =
+      open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(Write(fd, compressed.data(), compressed.size()),
+            compressed.size());
+  ASSERT_EQ(close(fd), 0);
+}
+
 TEST(CorpusUtil, ReadXZipFile) {
   // What we expect to get from decompression.
   const std::string kContents = "Hello World.\n";
@@ -194,10 +230,12 @@ TEST(CorpusUtil, LoadCorpora) {
 
   EXPECT_EQ(owned_fds.size(), kCorporaSize);
   EXPECT_EQ(fd_paths.size(), kCorporaSize);
+  ASSERT_EQ(load_corpora_result.file_sizes.size(), kCorporaSize);
 
   for (size_t i = 0; i < kCorporaSize; ++i) {
     const int fd = *(owned_fds[i].get());
     EXPECT_OK(CheckFileContents(fd, corpus_contents[i]));
+    EXPECT_EQ(load_corpora_result.file_sizes[i], corpus_contents[i].size());
 
     // Check again using file descriptor path.
     const int fd2 = open(fd_paths[i].c_str(), O_RDONLY);
@@ -216,6 +254,62 @@ TEST(CorpusUtil, LoadCorporaFileNotFound) {
       StatusIs(absl::StatusCode::kInternal, HasSubstr("Failed to open")));
 }
 
+TEST(CorpusUtil, LoadCorpusMultiBlock) {
+  std::string contents(1 << 20, 0);
+  for (size_t i = 0; i < contents.size(); ++i) {
+    contents[i] = static_cast<char>((i * i) >> 7);
+  }
+  const std::string path = absl::StrCat(
+      std::string_view{getenv("TEST_TMPDIR")}, "/LoadCorpusMultiBlock.xz");
+  WriteXzipFile(path, contents, 64 << 10);
+
+  for (size_t num_threads : {1, 4}) {
+    SCOPED_TRACE(num_threads);
+    ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor fd,
+                         LoadCorpus(path, num_threads));
+    EXPECT_OK(CheckFileContents(*fd, contents));
+  }
+
+  // Corrupt files are rejected.
+  struct stat stat_buffer;
+  ASSERT_EQ(stat(path.c_str(), &stat_buffer), 0);
+  ASSERT_EQ(truncate(path.c_str(), stat_buffer.st_size - 1), 0);
+  EXPECT_THAT(LoadCorpus(path, 4), StatusIs(absl::StatusCode::kInternal,
+                                            HasSubstr("Failed to decompress")));
+}
+
+TEST(CorpusUtil, LoadCorporaWithCache) {
+  const std::string contents(100000, 'c');
+  const std::string path = absl::StrCat(
+      std::string_view{getenv("TEST_TMPDIR")}, "/LoadCorporaWithCache.xz");
+  WriteXzipFile(path, contents, 1 << 20);
+  CorpusCache cache(absl::StrCat(std::string_view{getenv("TEST_TMPDIR")},
+                                 "/LoadCorporaWithCache"));
+  ASSERT_OK_AND_ASSIGN(LoadCorporaResult cold, LoadCorpora({path}, &cache));
+  EXPECT_OK(CheckFileContents(*cold.file_descriptors[0], contents));
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  ASSERT_NE(fd, -1);
+  ASSERT_OK_AND_ASSIGN(std::string key, CorpusCache::Key(fd));
+  close(fd);
+  ASSERT_OK_AND_ASSIGN(LoadCorporaResult warm, LoadCorpora({path}, &cache));
+  EXPECT_OK(CheckFileContents(*warm.file_descriptors[0], contents));
+  // The warm load hands out the cache entry itself.
+  struct stat warm_stat, entry_stat;
+  ASSERT_EQ(fstat(*warm.file_descriptors[0], &warm_stat), 0);
+  ASSERT_EQ(stat(cache.EntryPath(key).c_str(), &entry_stat), 0);
+  EXPECT_EQ(warm_stat.st_ino, entry_stat.st_ino);
+
+  // Check that the entry is used by replacing it.
+  ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor cached,
+                       WriteSharedMemoryFile(absl::Cord("cached")));
+  ASSERT_OK(cache.Write(key, *cached));
+  ASSERT_OK_AND_ASSIGN(LoadCorporaResult replaced,
+                       LoadCorpora({path}, &cache));
+  EXPECT_OK(CheckFileContents(*replaced.file_descriptors[0], "cached"));
+  EXPECT_EQ(replaced.file_sizes[0], 6);
+}
+
 TEST(CorpusUtil, LoadCorporaUncompressed) {
   const std::vector<std::string> corpus_contents{"one\n", "two\n", "three\n"};
 
@@ -248,5 +342,32 @@ TEST(CorpusUtil, LoadCorporaUncompressed) {
   }
 }
 
+TEST(CorpusUtil, CopyCorpora) {
+  const std::vector<std::string> corpus_contents{"one\n", "", "three\n"};
+  LoadCorporaResult corpora;
+  for (const std::string& contents : corpus_contents) {
+    ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor fd,
+                         WriteSharedMemoryFile(absl::Cord(contents)));
+    corpora.file_sizes.push_back(contents.size());
+    corpora.file_descriptor_paths.push_back("unused");
+    corpora.file_descriptors.push_back(std::move(fd));
+  }
+
+  const int cpu = sched_getcpu();
+  ASSERT_GE(cpu, 0);
+  ASSERT_OK_AND_ASSIGN(LoadCorporaResult copies, CopyCorpora(corpora, {cpu}));
+  ASSERT_EQ(copies.file_descriptors.size(), corpus_contents.size());
+  EXPECT_EQ(copies.file_sizes, corpora.file_sizes);
+  for (size_t i = 0; i < corpus_contents.size(); ++i) {
+    EXPECT_NE(*copies.file_descriptors[i], *corpora.file_descriptors[i]);
+    EXPECT_OK(CheckFileContents(*copies.file_descriptors[i],
+                                corpus_contents[i]));
+    const int fd = open(copies.file_descriptor_paths[i].c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_OK(CheckFileContents(fd, corpus_contents[i]));
+    EXPECT_EQ(close(fd), 0);
+  }
+}
+
 }  // namespace
 }  // namespace silifuzz
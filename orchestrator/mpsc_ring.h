@@ -0,0 +1,148 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_MPSC_RING_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_MPSC_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "absl/numeric/bits.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+// A bounded lock-free multi-producer single-consumer queue of move-only
+// elements.
+//
+// Each slot carries a sequence number that tells producers and the consumer
+// whose turn it is. A producer claims a position with a single CAS on the
+// tail and publishes the element by bumping the slot sequence. The consumer
+// only touches the head. No operation blocks, so callers decide what to do
+// when the ring is full or empty.
+//
+// TryPush() is thread-safe. TryPop() must only be called by one thread at a
+// time.
+template <typename T>
+class MpscRing {
+ public:
+  // Creates a ring with at least `capacity` slots. The capacity is rounded up
+  // to a power of 2 and is at least 2, because with a single slot a full
+  // slot would look free to the next producer.
+  explicit MpscRing(size_t capacity)
+      : capacity_(absl::bit_ceil(std::max<size_t>(capacity, 2))),
+        mask_(capacity_ - 1),
+        slots_(new Slot[capacity_]),
+        head_(0),
+        tail_(0) {
+    CHECK_GT(capacity, 0);
+    for (size_t i = 0; i < capacity_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Not copyable or moveable.
+  MpscRing(const MpscRing &) = delete;
+  MpscRing &operator=(const MpscRing &) = delete;
+
+  // Appends `value` unless the ring is full. Returns true on success.
+  // `value` is left untouched on failure.
+  bool TryPush(T &&value) {
+    uint64_t position = tail_.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots_[position & mask_];
+      const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+      const int64_t diff =
+          static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+      if (diff == 0) {
+        // The slot is free. Claim it unless another producer got there first,
+        // in which case `position` is reloaded.
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The slot still holds an element from the previous lap.
+        return false;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value.emplace(std::move(value));
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves the oldest element into `*value` unless the ring is empty. Returns
+  // true on success.
+  bool TryPop(T *value) {
+    const uint64_t position = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[position & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+      return false;
+    }
+    *value = std::move(*slot.value);
+    slot.value.reset();
+    slot.sequence.store(position + capacity_, std::memory_order_release);
+    head_.store(position + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Returns the number of slots.
+  size_t capacity() const { return capacity_; }
+
+  // Returns the number of claimed slots. This includes slots that producers
+  // are still filling in, and is only a snapshot when called concurrently
+  // with other operations.
+  size_t size() const {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  // Returns true if the consumer would find nothing to pop.
+  bool empty() const {
+    const uint64_t position = head_.load(std::memory_order_relaxed);
+    return slots_[position & mask_].sequence.load(std::memory_order_acquire) !=
+           position + 1;
+  }
+
+ private:
+  // Slots are cache line aligned so that producers filling in adjacent slots
+  // do not contend.
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> sequence;
+    std::optional<T> value;
+  };
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Next position to pop. Written only by the consumer.
+  alignas(64) std::atomic<uint64_t> head_;
+
+  // Next position to push.
+  alignas(64) std::atomic<uint64_t> tail_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_MPSC_RING_H_
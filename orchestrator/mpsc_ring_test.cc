@@ -0,0 +1,100 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/mpsc_ring.h"
+
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(MpscRing, Capacity) {
+  MpscRing<int> ring(5);
+  EXPECT_EQ(ring.capacity(), 8);
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.size(), 0);
+  EXPECT_EQ(MpscRing<int>(1).capacity(), 2);
+}
+
+TEST(MpscRing, PushPop) {
+  MpscRing<int> ring(2);
+  int value = 0;
+  EXPECT_FALSE(ring.TryPop(&value));
+  // Go around the ring a few times.
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(ring.TryPush(2 * i));
+    EXPECT_TRUE(ring.TryPush(2 * i + 1));
+    EXPECT_FALSE(ring.TryPush(-1));
+    EXPECT_EQ(ring.size(), 2);
+    EXPECT_TRUE(ring.TryPop(&value));
+    EXPECT_EQ(value, 2 * i);
+    EXPECT_TRUE(ring.TryPop(&value));
+    EXPECT_EQ(value, 2 * i + 1);
+    EXPECT_TRUE(ring.empty());
+  }
+}
+
+TEST(MpscRing, MoveOnly) {
+  MpscRing<std::unique_ptr<int>> ring(2);
+  ASSERT_TRUE(ring.TryPush(std::make_unique<int>(1)));
+  ASSERT_TRUE(ring.TryPush(std::make_unique<int>(2)));
+  auto third = std::make_unique<int>(3);
+  ASSERT_FALSE(ring.TryPush(std::move(third)));
+  // A failed push leaves the value alone.
+  ASSERT_NE(third, nullptr);
+  std::unique_ptr<int> popped;
+  ASSERT_TRUE(ring.TryPop(&popped));
+  EXPECT_EQ(*popped, 1);
+}
+
+TEST(MpscRing, MultipleProducers) {
+  constexpr int kNumProducers = 4;
+  constexpr int kNumValuesPerProducer = 10000;
+  MpscRing<int> ring(16);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kNumProducers; ++p) {
+    producers.emplace_back([&ring, p]() {
+      for (int i = 0; i < kNumValuesPerProducer; ++i) {
+        while (!ring.TryPush(p * kNumValuesPerProducer + i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  // Values from each producer must arrive in order.
+  std::vector<int> next(kNumProducers, 0);
+  constexpr int kNumValues = kNumProducers * kNumValuesPerProducer;
+  for (int num_popped = 0; num_popped < kNumValues;) {
+    int value;
+    if (!ring.TryPop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    const int p = value / kNumValuesPerProducer;
+    ASSERT_EQ(value % kNumValuesPerProducer, next[p]);
+    ++next[p];
+    ++num_popped;
+  }
+  for (std::thread &producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(ring.empty());
+}
+
+}  // namespace
+}  // namespace silifuzz
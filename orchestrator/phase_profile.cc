@@ -0,0 +1,119 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/phase_profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/base/attributes.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "./util/itoa.h"
+#include "./util/misc_util.h"
+
+namespace silifuzz {
+
+template <>
+ABSL_CONST_INIT const char* EnumNameMap<OrchestratorPhase>[ToInt(
+    OrchestratorPhase::kNumPhases)] = {
+    "load_corpora", "spawn_runner", "wait_runner", "parse_output", "log_result",
+};
+
+size_t DurationHistogram::Bucket(absl::Duration duration) {
+  const int64_t us = absl::ToInt64Microseconds(duration);
+  if (us <= 1) {
+    return 0;
+  }
+  return std::min<size_t>(63 - __builtin_clzll(us), kNumBuckets - 1);
+}
+
+void DurationHistogram::Add(absl::Duration duration) {
+  ++count;
+  total += duration;
+  max = std::max(max, duration);
+  ++buckets[Bucket(duration)];
+}
+
+void DurationHistogram::Merge(const DurationHistogram& other) {
+  count += other.count;
+  total += other.total;
+  max = std::max(max, other.max);
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+}
+
+absl::Duration DurationHistogram::Quantile(double q) const {
+  if (count == 0) {
+    return absl::ZeroDuration();
+  }
+  const uint64_t rank = std::max<uint64_t>(1, q * count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets - 1; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return std::min(BucketStart(i + 1), max);
+    }
+  }
+  return max;
+}
+
+std::string DurationHistogram::DebugString() const {
+  if (count == 0) {
+    return "n=0";
+  }
+  return absl::StrCat("n=", count,
+                      " mean=", absl::FormatDuration(total / count),
+                      " p50=", absl::FormatDuration(Quantile(0.5)),
+                      " p99=", absl::FormatDuration(Quantile(0.99)),
+                      " max=", absl::FormatDuration(max),
+                      " total=", absl::FormatDuration(total));
+}
+
+void PhaseProfile::Record(OrchestratorPhase phase, absl::Duration duration) {
+  Phase& p = phases_[ToInt(phase)];
+  const uint64_t ns = std::max<int64_t>(absl::ToInt64Nanoseconds(duration), 0);
+  // There is a single writer, so plain loads and stores suffice.
+  auto add = [](std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  };
+  add(p.count, 1);
+  add(p.total_ns, ns);
+  if (ns > p.max_ns.load(std::memory_order_relaxed)) {
+    p.max_ns.store(ns, std::memory_order_relaxed);
+  }
+  add(p.buckets[DurationHistogram::Bucket(absl::Nanoseconds(ns))], 1);
+}
+
+void PhaseProfile::AddTo(PhaseHistograms& histograms) const {
+  for (size_t i = 0; i < histograms.size(); ++i) {
+    const Phase& p = phases_[i];
+    DurationHistogram histogram;
+    histogram.count = p.count.load(std::memory_order_relaxed);
+    histogram.total =
+        absl::Nanoseconds(p.total_ns.load(std::memory_order_relaxed));
+    histogram.max = absl::Nanoseconds(p.max_ns.load(std::memory_order_relaxed));
+    for (size_t b = 0; b < DurationHistogram::kNumBuckets; ++b) {
+      histogram.buckets[b] = p.buckets[b].load(std::memory_order_relaxed);
+    }
+    histograms[i].Merge(histogram);
+  }
+}
+
+}  // namespace silifuzz
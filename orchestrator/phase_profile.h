@@ -0,0 +1,156 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_PHASE_PROFILE_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_PHASE_PROFILE_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./util/itoa.h"
+#include "./util/misc_util.h"
+
+namespace silifuzz {
+
+// Phases of the orchestrator whose wall time is profiled.
+enum class OrchestratorPhase {
+  // Loading or reloading all corpora.
+  kLoadCorpora = 0,
+
+  // Starting a runner process or sending a command to a runner server.
+  kSpawnRunner,
+
+  // Waiting for a runner to finish, including reading its output.
+  kWaitRunner,
+
+  // Converting the output of a runner to results.
+  kParseOutput,
+
+  // Processing a single result in ResultCollector, including logging it.
+  kLogResult,
+
+  kNumPhases,
+};
+
+template <>
+extern const char* EnumNameMap<OrchestratorPhase>[ToInt(
+    OrchestratorPhase::kNumPhases)];
+
+// Histogram of durations. Bucket i counts durations in [2^i, 2^(i+1))
+// microseconds. The first bucket also counts shorter durations and the last
+// one longer durations.
+struct DurationHistogram {
+  static constexpr size_t kNumBuckets = 32;
+
+  // Returns the bucket counting `duration`.
+  static size_t Bucket(absl::Duration duration);
+
+  // Returns the lower bound of `bucket`.
+  static absl::Duration BucketStart(size_t bucket) {
+    return bucket == 0 ? absl::ZeroDuration()
+                       : absl::Microseconds(uint64_t{1} << bucket);
+  }
+
+  // Adds a sample.
+  void Add(absl::Duration duration);
+
+  // Adds the samples of `other`.
+  void Merge(const DurationHistogram& other);
+
+  // Returns the upper bound of the bucket holding the `q` quantile of the
+  // samples, capped at max, or zero if there are none.
+  absl::Duration Quantile(double q) const;
+
+  // Returns a one line summary, e.g. "n=10 mean=1ms p50=1.024ms ...".
+  std::string DebugString() const;
+
+  // Number of samples.
+  uint64_t count = 0;
+
+  // Sum and maximum of the samples.
+  absl::Duration total = absl::ZeroDuration();
+  absl::Duration max = absl::ZeroDuration();
+
+  // Sample counts.
+  uint64_t buckets[kNumBuckets] = {};
+};
+
+// Histograms of all OrchestratorPhases.
+using PhaseHistograms =
+    std::array<DurationHistogram, ToInt(OrchestratorPhase::kNumPhases)>;
+
+// Wall time spent in each OrchestratorPhase by one thread.
+//
+// Record() does not take locks or use atomic read-modify-write instructions,
+// so each phase must only be recorded by a single thread, e.g. the thread
+// that owns the profile. Any thread can call AddTo() at any time. It may see
+// some fields of a sample that is being recorded but not others.
+//
+// This class is thread-safe under the above restriction.
+class PhaseProfile {
+ public:
+  PhaseProfile() = default;
+
+  // Not copyable or moveable.
+  PhaseProfile(const PhaseProfile&) = delete;
+  PhaseProfile& operator=(const PhaseProfile&) = delete;
+
+  // Records that `phase` took `duration`.
+  void Record(OrchestratorPhase phase, absl::Duration duration);
+
+  // Adds the samples recorded so far to `histograms`.
+  void AddTo(PhaseHistograms& histograms) const;
+
+ private:
+  // Like DurationHistogram in nanoseconds.
+  struct Phase {
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> total_ns = 0;
+    std::atomic<uint64_t> max_ns = 0;
+    std::atomic<uint64_t> buckets[DurationHistogram::kNumBuckets] = {};
+  };
+
+  Phase phases_[ToInt(OrchestratorPhase::kNumPhases)];
+};
+
+// Times a scope and records it in a PhaseProfile, if any, when the scope
+// ends.
+class ScopedPhaseTimer {
+ public:
+  ScopedPhaseTimer(PhaseProfile* profile, OrchestratorPhase phase)
+      : profile_(profile), phase_(phase), start_(absl::Now()) {}
+  ~ScopedPhaseTimer() {
+    if (profile_ != nullptr) {
+      profile_->Record(phase_, absl::Now() - start_);
+    }
+  }
+
+  // Not copyable or moveable.
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+ private:
+  PhaseProfile* profile_;
+  OrchestratorPhase phase_;
+  absl::Time start_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_PHASE_PROFILE_H_
@@ -0,0 +1,110 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/phase_profile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "./util/itoa.h"
+#include "./util/misc_util.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(DurationHistogram, Buckets) {
+  EXPECT_EQ(DurationHistogram::Bucket(absl::ZeroDuration()), 0);
+  EXPECT_EQ(DurationHistogram::Bucket(absl::Nanoseconds(1500)), 0);
+  EXPECT_EQ(DurationHistogram::Bucket(absl::Microseconds(2)), 1);
+  EXPECT_EQ(DurationHistogram::Bucket(absl::Microseconds(1023)), 9);
+  EXPECT_EQ(DurationHistogram::Bucket(absl::Microseconds(1024)), 10);
+  EXPECT_EQ(DurationHistogram::Bucket(absl::Hours(1000)),
+            DurationHistogram::kNumBuckets - 1);
+  EXPECT_EQ(DurationHistogram::BucketStart(10), absl::Microseconds(1024));
+}
+
+TEST(DurationHistogram, AddMerge) {
+  DurationHistogram a;
+  EXPECT_EQ(a.Quantile(0.5), absl::ZeroDuration());
+  for (int i = 0; i < 99; ++i) {
+    a.Add(absl::Microseconds(100));
+  }
+  a.Add(absl::Seconds(1));
+  EXPECT_EQ(a.count, 100);
+  EXPECT_EQ(a.max, absl::Seconds(1));
+  EXPECT_EQ(a.total, absl::Microseconds(9900) + absl::Seconds(1));
+  EXPECT_EQ(a.Quantile(0.5), absl::Microseconds(128));
+  EXPECT_EQ(a.Quantile(1), absl::Seconds(1));
+
+  DurationHistogram b;
+  b.Add(absl::Milliseconds(2));
+  b.Merge(a);
+  EXPECT_EQ(b.count, 101);
+  EXPECT_EQ(b.max, absl::Seconds(1));
+  EXPECT_EQ(b.buckets[DurationHistogram::Bucket(absl::Milliseconds(2))], 1);
+  EXPECT_EQ(b.buckets[DurationHistogram::Bucket(absl::Microseconds(100))], 99);
+}
+
+TEST(PhaseProfile, RecordAddTo) {
+  EXPECT_STREQ(EnumStr(OrchestratorPhase::kLogResult), "log_result");
+
+  PhaseProfile profile;
+  profile.Record(OrchestratorPhase::kWaitRunner, absl::Milliseconds(3));
+  profile.Record(OrchestratorPhase::kWaitRunner, absl::Milliseconds(1));
+  { ScopedPhaseTimer timer(&profile, OrchestratorPhase::kLoadCorpora); }
+  { ScopedPhaseTimer timer(nullptr, OrchestratorPhase::kLoadCorpora); }
+
+  PhaseHistograms histograms;
+  profile.AddTo(histograms);
+  profile.AddTo(histograms);
+  const DurationHistogram& wait =
+      histograms[ToInt(OrchestratorPhase::kWaitRunner)];
+  EXPECT_EQ(wait.count, 4);
+  EXPECT_EQ(wait.total, absl::Milliseconds(8));
+  EXPECT_EQ(wait.max, absl::Milliseconds(3));
+  EXPECT_EQ(histograms[ToInt(OrchestratorPhase::kLoadCorpora)].count, 2);
+  EXPECT_EQ(histograms[ToInt(OrchestratorPhase::kSpawnRunner)].count, 0);
+}
+
+TEST(PhaseProfile, ConcurrentReads) {
+  constexpr uint64_t kNumSamples = 100000;
+  PhaseProfile profile;
+  std::atomic<bool> done = false;
+  std::thread writer([&] {
+    for (uint64_t i = 0; i < kNumSamples; ++i) {
+      profile.Record(OrchestratorPhase::kParseOutput, absl::Microseconds(10));
+    }
+    done = true;
+  });
+  uint64_t last_count = 0;
+  while (!done) {
+    PhaseHistograms histograms;
+    profile.AddTo(histograms);
+    const uint64_t count =
+        histograms[ToInt(OrchestratorPhase::kParseOutput)].count;
+    EXPECT_GE(count, last_count);
+    last_count = count;
+  }
+  writer.join();
+  PhaseHistograms histograms;
+  profile.AddTo(histograms);
+  EXPECT_EQ(histograms[ToInt(OrchestratorPhase::kParseOutput)].count,
+            kNumSamples);
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <cstddef>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -33,15 +34,20 @@
 #include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./orchestrator/binary_log_channel.h"
+#include "./orchestrator/phase_profile.h"
 #include "./player/player_result_proto.h"
 #include "./proto/binary_log_entry.pb.h"
 #include "./proto/corpus_metadata.pb.h"
+#include "./proto/player_result.pb.h"
 #include "./proto/session_summary.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
 #include "./runner/driver/runner_driver.h"
+#include "./runner/runner_stats.h"
 #include "./util/checks.h"
+#include "./util/checksum.h"
 #include "./util/hostname.h"
 #include "./util/itoa.h"
 
@@ -49,6 +55,13 @@ ABSL_FLAG(bool, enable_v1_compat_logging, false, "Enable V1-style logging");
 // TODO(b/233457080): [bug] Investigate the cause of EXECUTION_RUNAWAY errors.
 ABSL_FLAG(bool, report_runaways_as_errors, false,
           "Whether runaway snapshot should be reported as errors");
+ABSL_FLAG(uint64_t, max_logged_repeated_failures, 10,
+          "Number of times the same failure (snapshot, CPU, outcome and end "
+          "state) is logged in full. Later occurrences are only counted. 0 "
+          "logs every failure.");
+ABSL_FLAG(absl::Duration, repeated_failure_report_interval, absl::Minutes(1),
+          "How often to log the counts of failures that were not logged in "
+          "full.");
 
 namespace silifuzz {
 namespace {
@@ -106,6 +119,42 @@ absl::StatusOr<proto::BinaryLogEntry> RunResultToSnapshotExecutionResult(
   return entry;
 }
 
+// Returns a hash of the actual end state of `player_result` or 0 if there is
+// none. The endpoint, registers and memory are hashed in full, so that
+// failures with different corruptions are counted separately.
+uint64_t EndStateHash(const RunnerDriver::PlayerResult &player_result) {
+  if (!player_result.actual_end_state.has_value()) {
+    return 0;
+  }
+  const Snapshot::EndState &end_state = *player_result.actual_end_state;
+  MemoryChecksum checksum;
+  auto add_value = [&checksum](uint64_t value) {
+    checksum.AddData(&value, sizeof(value));
+  };
+  const Snapshot::Endpoint &endpoint = end_state.endpoint();
+  add_value(ToInt(endpoint.type()));
+  if (endpoint.type() == Snapshot::Endpoint::kInstruction) {
+    add_value(endpoint.instruction_address());
+  } else {
+    add_value(ToInt(endpoint.sig_num()));
+    add_value(ToInt(endpoint.sig_cause()));
+    add_value(endpoint.sig_address());
+    add_value(endpoint.sig_instruction_address());
+  }
+  const Snapshot::RegisterState &registers = end_state.registers();
+  add_value(registers.gregs().size());
+  checksum.AddData(registers.gregs().data(), registers.gregs().size());
+  add_value(registers.fpregs().size());
+  checksum.AddData(registers.fpregs().data(), registers.fpregs().size());
+  for (const Snapshot::MemoryBytes &memory_bytes : end_state.memory_bytes()) {
+    add_value(memory_bytes.start_address());
+    add_value(memory_bytes.num_bytes());
+    checksum.AddData(memory_bytes.byte_values().data(),
+                     memory_bytes.num_bytes());
+  }
+  return checksum.Value();
+}
+
 // Returns the number of CPUs available according to sched_getaffinity.
 int NumCpus() {
   cpu_set_t all_cpus;
@@ -172,21 +221,61 @@ void LogV1CompatSummary(const Summary &summary, absl::Duration elapsed) {
 
 ResultCollector::ResultCollector(int binary_log_channel_fd,
                                  absl::Time start_time)
-    : binary_log_producer_(nullptr), start_time_(start_time) {
+    : binary_log_producer_(nullptr),
+      start_time_(start_time),
+      max_logged_repeated_failures_(
+          absl::GetFlag(FLAGS_max_logged_repeated_failures)),
+      repeated_failure_report_interval_(
+          absl::GetFlag(FLAGS_repeated_failure_report_interval)),
+      last_repeated_failure_report_time_(start_time) {
   binary_log_producer_ =
       binary_log_channel_fd >= 0
-          ? std::make_unique<BinaryLogProducer>(binary_log_channel_fd)
+          ? std::make_unique<AsyncBinaryLogProducer>(
+                binary_log_channel_fd, kMaxBufferedBinaryLogBytes,
+                AsyncBinaryLogProducer::OverflowPolicy::kBlock,
+                /*take_ownership=*/true, kMaxBinaryLogBlockTime)
           : nullptr;
   session_id_ =
       absl::StrCat(ShortHostname(), "/", absl::ToUnixNanos(start_time_));
 }
 
+ResultCollector::~ResultCollector() {
+  if (binary_log_producer_ == nullptr) {
+    return;
+  }
+  if (absl::Status s = binary_log_producer_->Flush(); !s.ok()) {
+    LOG_ERROR(s.message());
+  }
+  const AsyncBinaryLogProducer::Stats stats = binary_log_producer_->stats();
+  if (stats.num_dropped_entries > 0) {
+    LOG_ERROR("Dropped ", stats.num_dropped_entries, " of ",
+              stats.num_dropped_entries + stats.num_written_entries,
+              " binary log entries, ", stats.num_timed_out_entries,
+              " of them after waiting for the consumer");
+  }
+}
+
 // Processes a single execution result.
 void ResultCollector::operator()(const RunnerDriver::RunResult &result) {
   static bool report_runaways_as_errors =
       absl::GetFlag(FLAGS_report_runaways_as_errors);
 
   ++summary_.play_count;
+  for (const std::string &id : result.skipped_snapshot_ids()) {
+    // Every runner skips the same snapshots, so only log each one once.
+    if (logged_skipped_snapshot_ids_.insert(id).second) {
+      LOG_ERROR("Runner skipped snapshot ", id,
+                " because of conflicting mappings");
+    }
+  }
+  if (result.stats().has_value()) {
+    const RunnerStats &stats = *result.stats();
+    summary_.num_snap_executions += stats.num_executions;
+    summary_.num_skipped_snapshots += stats.num_skipped_snaps;
+    for (int phase = 0; phase < RunnerStats::kNumPhases; ++phase) {
+      summary_.phase_ticks[phase] += stats.phase_ticks[phase];
+    }
+  }
   if (!result.success()) {
     if (result.player_result().outcome ==
         snapshot_types::PlaybackOutcome::kExecutionRunaway) {
@@ -194,27 +283,123 @@ void ResultCollector::operator()(const RunnerDriver::RunResult &result) {
       if (!report_runaways_as_errors) return;
     }
     ++summary_.num_failed_snapshots;
-    LogV1SingleSnapFailure(result);
-    absl::StatusOr<proto::BinaryLogEntry> entry_or =
-        RunResultToSnapshotExecutionResult(result, absl::Now(), session_id_);
-    if (entry_or.ok()) {
-      if (binary_log_producer_) {
-        if (absl::Status s = binary_log_producer_->Send(*entry_or); !s.ok()) {
-          LOG_ERROR(s.message());
+    if (ShouldLogFailure(result)) {
+      LogV1SingleSnapFailure(result);
+      absl::StatusOr<proto::BinaryLogEntry> entry_or =
+          RunResultToSnapshotExecutionResult(result, absl::Now(), session_id_);
+      if (entry_or.ok()) {
+        if (binary_log_producer_) {
+          if (absl::Status s = binary_log_producer_->Send(*entry_or);
+              !s.ok()) {
+            LOG_ERROR(s.message());
+          }
         }
+      } else {
+        LOG_ERROR(entry_or.status().message());
       }
-    } else {
-      LOG_ERROR(entry_or.status().message());
     }
   }
+  ReportRepeatedFailures(false);
   LogSummary();
 }
 
+bool ResultCollector::ShouldLogFailure(const RunnerDriver::RunResult &result) {
+  if (max_logged_repeated_failures_ == 0) {
+    return true;
+  }
+  const RunnerDriver::PlayerResult &player_result = result.player_result();
+  FailureKey key = {
+      .snapshot_id = result.snapshot_id(),
+      .cpu_id = player_result.cpu_id,
+      .outcome = player_result.outcome,
+      .end_state_hash = EndStateHash(player_result),
+  };
+  if (failures_.size() >= kMaxFailureKeys && !failures_.contains(key)) {
+    // Evict all keys. Their pending counts are reported first, so only the
+    // number of times each failure is logged in full restarts.
+    VLOG_INFO(1, "Evicting ", failures_.size(), " repeated failure keys");
+    ReportRepeatedFailures(true);
+    failures_.clear();
+    num_unreported_failure_keys_ = 0;
+  }
+  FailureCounts &counts = failures_[std::move(key)];
+  if (++counts.count <= max_logged_repeated_failures_) {
+    return true;
+  }
+  if (counts.num_unreported++ == 0) {
+    ++num_unreported_failure_keys_;
+  }
+  ++summary_.num_repeated_failures;
+  return false;
+}
+
+void ResultCollector::FlushRepeatedFailures() { ReportRepeatedFailures(true); }
+
+void ResultCollector::ReportRepeatedFailures(bool always) {
+  if (num_unreported_failure_keys_ == 0) {
+    return;
+  }
+  const absl::Time now = absl::Now();
+  if (!always &&
+      now < last_repeated_failure_report_time_ +
+                repeated_failure_report_interval_) {
+    return;
+  }
+  last_repeated_failure_report_time_ = now;
+  const std::string hostname(ShortHostname());
+  // Keys whose periodic report was dropped. They are reported again later.
+  size_t num_dropped_keys = 0;
+  for (auto &[key, counts] : failures_) {
+    if (counts.num_unreported == 0) {
+      continue;
+    }
+    const auto outcome = static_cast<proto::PlayerResult::Outcome>(key.outcome);
+    if (binary_log_producer_ != nullptr) {
+      proto::BinaryLogEntry entry;
+      entry.set_session_id(session_id_);
+      *entry.mutable_timestamp() = TimeToProto(now);
+      proto::RepeatedSnapshotFailure *failure =
+          entry.mutable_repeated_snapshot_failure();
+      failure->set_snapshot_id(key.snapshot_id);
+      failure->set_hostname(hostname);
+      failure->set_cpu_id(key.cpu_id);
+      failure->set_outcome(outcome);
+      failure->set_end_state_hash(key.end_state_hash);
+      failure->set_count(counts.num_unreported);
+      // Unlike failures, periodic reports are dropped when the log cannot
+      // keep up, because their counts are carried over to the next report.
+      const auto overflow_policy =
+          always ? AsyncBinaryLogProducer::OverflowPolicy::kBlock
+                 : AsyncBinaryLogProducer::OverflowPolicy::kDrop;
+      absl::Status s = binary_log_producer_->Send(entry, overflow_policy);
+      if (absl::IsResourceExhausted(s)) {
+        ++num_dropped_keys;
+        continue;
+      }
+      if (!s.ok()) {
+        LOG_ERROR(s.message());
+      }
+    }
+    LOG_INFO("Snapshot ", key.snapshot_id, " failed ", counts.num_unreported,
+             " more times on CPU ", key.cpu_id, " with ",
+             proto::PlayerResult::Outcome_Name(outcome));
+    counts.num_unreported = 0;
+  }
+  num_unreported_failure_keys_ = num_dropped_keys;
+}
+
 void ResultCollector::LogSummary(bool always) {
   absl::Time now = absl::Now();
   if (always || now > last_summary_log_time_ + log_interval_) {
     LogV1CompatSummary(summary_,
                        absl::Trunc(now - start_time_, absl::Seconds(1)));
+    const double elapsed_seconds = absl::ToDoubleSeconds(now - start_time_);
+    VLOG_INFO(1, "Snap executions: ", summary_.num_snap_executions, " (",
+              elapsed_seconds > 0
+                  ? summary_.num_snap_executions / elapsed_seconds
+                  : 0,
+              "/s) play_count: ", summary_.play_count,
+              " skipped: ", summary_.num_skipped_snapshots);
     last_summary_log_time_ = now;
     log_interval_ = std::min(log_interval_ * 2, absl::Minutes(1));
   }
@@ -244,6 +429,51 @@ absl::Status ResultCollector::LogSessionSummary(
   playback_summary->set_num_failed_snapshots(summary_.num_failed_snapshots);
   playback_summary->set_play_count(summary_.play_count);
   playback_summary->set_num_runaway_snapshots(summary_.num_runaway_snapshots);
+  playback_summary->set_num_snap_executions(summary_.num_snap_executions);
+  playback_summary->set_prepare_memory_ticks(
+      summary_.phase_ticks[RunnerStats::kPrepareMemory]);
+  playback_summary->set_run_ticks(summary_.phase_ticks[RunnerStats::kRun]);
+  playback_summary->set_verify_ticks(
+      summary_.phase_ticks[RunnerStats::kVerify]);
+  playback_summary->set_num_skipped_snapshots(summary_.num_skipped_snapshots);
+  playback_summary->set_useful_work_ratio(summary_.useful_work_ratio);
+  playback_summary->set_num_repeated_failures(summary_.num_repeated_failures);
+
+  const ResultQueueStats &queue_stats = summary_.result_queue;
+  auto result_queue = entry.mutable_session_summary()->mutable_result_queue();
+  result_queue->set_num_offers(queue_stats.num_offers);
+  result_queue->set_num_blocked_offers(queue_stats.num_blocked_offers);
+  result_queue->set_num_dropped_offers(queue_stats.num_dropped_offers);
+  result_queue->set_high_water_mark(queue_stats.high_water_mark);
+  *result_queue->mutable_max_enqueue_latency() =
+      DurationToProto(queue_stats.max_enqueue_latency);
+  *result_queue->mutable_total_enqueue_latency() =
+      DurationToProto(queue_stats.total_enqueue_latency);
+
+  for (const NumaNodeStats &node_stats : summary_.numa_nodes) {
+    auto numa_node = entry.mutable_session_summary()->add_numa_nodes();
+    numa_node->set_node(node_stats.node);
+    numa_node->set_num_cpus(node_stats.num_cpus);
+    numa_node->set_num_runner_invocations(node_stats.num_runner_invocations);
+    numa_node->set_num_snap_executions(node_stats.num_snap_executions);
+    numa_node->set_num_remote_corpus_runs(node_stats.num_remote_corpus_runs);
+  }
+
+  for (size_t i = 0; i < summary_.phases.size(); ++i) {
+    const DurationHistogram &histogram = summary_.phases[i];
+    auto phase = entry.mutable_session_summary()->add_phases();
+    phase->set_phase(EnumStr(static_cast<OrchestratorPhase>(i)));
+    phase->set_count(histogram.count);
+    *phase->mutable_total_time() = DurationToProto(histogram.total);
+    *phase->mutable_max_time() = DurationToProto(histogram.max);
+    size_t num_buckets = DurationHistogram::kNumBuckets;
+    while (num_buckets > 0 && histogram.buckets[num_buckets - 1] == 0) {
+      --num_buckets;
+    }
+    for (size_t b = 0; b < num_buckets; ++b) {
+      phase->add_buckets(histogram.buckets[b]);
+    }
+  }
 
   *entry.mutable_session_summary()->mutable_duration() =
       DurationToProto(now - start_time_);
@@ -259,6 +489,16 @@ absl::Status ResultCollector::LogSessionSummary(
 
   *entry.mutable_session_summary()->mutable_corpus_metadata() = corpus_metadata;
 
+  // Drain the queue so that the summary is not dropped and has the final
+  // statistics of the binary log.
+  RETURN_IF_NOT_OK(binary_log_producer_->Flush());
+  const AsyncBinaryLogProducer::Stats log_stats = binary_log_producer_->stats();
+  auto binary_log = entry.mutable_session_summary()->mutable_binary_log();
+  binary_log->set_num_written_entries(log_stats.num_written_entries);
+  binary_log->set_num_dropped_entries(log_stats.num_dropped_entries);
+  binary_log->set_num_timed_out_entries(log_stats.num_timed_out_entries);
+  binary_log->set_num_writes(log_stats.num_writes);
+  binary_log->set_max_buffered_bytes(log_stats.max_buffered_bytes);
   return binary_log_producer_->Send(entry);
 }
 
@@ -19,59 +19,231 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "./common/snapshot_enums.h"
 #include "./orchestrator/binary_log_channel.h"
+#include "./orchestrator/phase_profile.h"
 #include "./proto/corpus_metadata.pb.h"
 #include "./runner/driver/runner_driver.h"
+#include "./runner/runner_stats.h"
 
 namespace silifuzz {
 
+// Statistics of the queue that passes results from worker threads to the
+// ResultCollector. See ExecutionContext.
+struct ResultQueueStats {
+  // Number of runner invocations whose results were queued.
+  uint64_t num_offers = 0;
+
+  // Number of offers that had to wait for a free slot.
+  uint64_t num_blocked_offers = 0;
+
+  // Number of offers dropped because the queue was still full when the
+  // execution stopped.
+  uint64_t num_dropped_offers = 0;
+
+  // Largest number of occupied slots observed.
+  uint64_t high_water_mark = 0;
+
+  // Longest and total time spent posting results, including waiting.
+  absl::Duration max_enqueue_latency = absl::ZeroDuration();
+  absl::Duration total_enqueue_latency = absl::ZeroDuration();
+};
+
+// Statistics of the RunnerThreads on the CPUs of one NUMA node.
+struct NumaNodeStats {
+  // NUMA node id.
+  int node = -1;
+
+  // Number of CPUs of the node that ran RunnerThreads.
+  uint64_t num_cpus = 0;
+
+  // Number of runner invocations and Snap executions on the node.
+  uint64_t num_runner_invocations = 0;
+  uint64_t num_snap_executions = 0;
+
+  // Number of runner invocations that read a corpus from another node.
+  uint64_t num_remote_corpus_runs = 0;
+};
+
 // Execution summary.
 struct Summary {
   // Number of snapshots that failed.
   uint64_t num_failed_snapshots = 0;
 
+  // Number of failed snapshots that were not logged individually because
+  // the same failure was logged often enough already.
+  uint64_t num_repeated_failures = 0;
+
   // How many times a runner binary was executed.
   uint64_t play_count = 0;
 
   // Number of runaways detected.
   uint64_t num_runaway_snapshots = 0;
+
+  // Number of snapshot executions reported by runners that collect
+  // statistics. See RunnerOptions::collect_stats().
+  uint64_t num_snap_executions = 0;
+
+  // Time spent by the runners in each RunnerStats::Phase, in units of
+  // ReadTickCounter().
+  uint64_t phase_ticks[RunnerStats::kNumPhases] = {};
+
+  // Number of snapshots skipped by runners because their mappings conflict
+  // with the runner. Counted once per runner process.
+  uint64_t num_skipped_snapshots = 0;
+
+  // Statistics of the result queue as of the last set_result_queue_stats().
+  ResultQueueStats result_queue = {};
+
+  // Per NUMA node statistics as of the last set_numa_node_stats().
+  std::vector<NumaNodeStats> numa_nodes;
+
+  // Fraction of the runner invocation time spent executing Snaps as of the
+  // last set_useful_work_ratio(). See RunnerBudgets.
+  double useful_work_ratio = 0;
+
+  // Time the orchestrator spent in each OrchestratorPhase as of the last
+  // set_phase_histograms().
+  PhaseHistograms phases = {};
 };
 
 // ResultCollector handles execution results produced by worker threads. When
 // configured, also logs to the file descriptor passed to its c-tor.
 //
+// A bad core can fail the same snapshot in the same way over and over. Only
+// the first --max_logged_repeated_failures occurrences of a failure, keyed by
+// snapshot, CPU, outcome and end state, are logged in full. Later occurrences
+// are counted and reported in RepeatedSnapshotFailure entries every
+// --repeated_failure_report_interval and by FlushRepeatedFailures(). At most
+// kMaxFailureKeys failures are tracked at a time.
+//
 // This class is thread-compatible.
 class ResultCollector {
  public:
+  // Maximum number of distinct failures tracked for repeated failure
+  // detection. When a new failure does not fit, the pending counts of all
+  // tracked failures are reported and the failures are forgotten.
+  static constexpr size_t kMaxFailureKeys = 1 << 16;
+
   // If `binary_log_fd_channel` >= 0, will also log each result to the said
-  // file descriptor via BinaryLogProducer API. The instance of this class
-  // will also take ownership of the FD and close it upon destruction.
+  // file descriptor via AsyncBinaryLogProducer API. The instance of this class
+  // will also take ownership of the FD and close it upon destruction, after
+  // writing all logged results.
   ResultCollector(int binary_log_channel_fd, absl::Time start_time);
 
+  // Flushes the binary log and reports binary log entries that were dropped,
+  // if any.
+  ~ResultCollector();
+
   // Processes a single execution result.
   void operator()(const RunnerDriver::RunResult &result);
   // Current execution summary.
   const Summary &summary() const { return summary_; }
 
+  // Records statistics of the queue that delivers results to this collector.
+  void set_result_queue_stats(const ResultQueueStats &stats) {
+    summary_.result_queue = stats;
+  }
+
+  // Records per NUMA node statistics of the worker threads.
+  void set_numa_node_stats(const std::vector<NumaNodeStats> &stats) {
+    summary_.numa_nodes = stats;
+  }
+
+  // Records the fraction of the runner invocation time spent executing Snaps.
+  void set_useful_work_ratio(double ratio) {
+    summary_.useful_work_ratio = ratio;
+  }
+
+  // Records the time the orchestrator spent in each OrchestratorPhase.
+  void set_phase_histograms(const PhaseHistograms &phases) {
+    summary_.phases = phases;
+  }
+
   // Logs the current execution summary to stderr. When `always` is true,
   // disables time-based throttling.
   void LogSummary(bool always = false);
 
+  // Logs the counts of repeated failures that were not reported yet. Call at
+  // the end of the session, before LogSessionSummary().
+  void FlushRepeatedFailures();
+
   // Logs session summary to binary_log_channel (if any).
   absl::Status LogSessionSummary(const proto::CorpusMetadata &corpus_metadata,
                                  absl::string_view orchestrator_version);
 
  private:
-  std::unique_ptr<BinaryLogProducer> binary_log_producer_;
+  // Identifies repeated failures.
+  struct FailureKey {
+    std::string snapshot_id;
+    int64_t cpu_id;
+    snapshot_types::PlaybackOutcome outcome;
+    uint64_t end_state_hash;
+
+    bool operator==(const FailureKey &other) const {
+      return snapshot_id == other.snapshot_id && cpu_id == other.cpu_id &&
+             outcome == other.outcome &&
+             end_state_hash == other.end_state_hash;
+    }
+
+    template <typename H>
+    friend H AbslHashValue(H h, const FailureKey &key) {
+      return H::combine(std::move(h), key.snapshot_id, key.cpu_id, key.outcome,
+                        key.end_state_hash);
+    }
+  };
+
+  // Occurrences of a failure.
+  struct FailureCounts {
+    // Number of occurrences.
+    uint64_t count = 0;
+
+    // Number of occurrences that were neither logged nor reported yet.
+    uint64_t num_unreported = 0;
+  };
+
+  // Returns true if `result` should be logged in full. Otherwise counts it
+  // as a repeated failure.
+  bool ShouldLogFailure(const RunnerDriver::RunResult &result);
+
+  // Logs RepeatedSnapshotFailure entries for the unreported repeated failures.
+  // When `always` is false, only does so every
+  // repeated_failure_report_interval_.
+  void ReportRepeatedFailures(bool always);
+
+  // When the consumer of the binary log cannot keep up, failures stall the
+  // result processing rather than get lost, but for at most
+  // kMaxBinaryLogBlockTime each so that a stuck consumer cannot stop the
+  // orchestrator. Periodic reports of repeated failures are dropped instead,
+  // their counts are reported again later.
+  static constexpr size_t kMaxBufferedBinaryLogBytes = 16 << 20;
+  static constexpr absl::Duration kMaxBinaryLogBlockTime = absl::Seconds(1);
+  std::unique_ptr<AsyncBinaryLogProducer> binary_log_producer_;
   absl::Time last_summary_log_time_ = absl::InfinitePast();
   absl::Duration log_interval_ = absl::Seconds(1);
   Summary summary_ = {};
   absl::Time start_time_;
   std::string session_id_;
+
+  // See --max_logged_repeated_failures. 0 logs all failures.
+  uint64_t max_logged_repeated_failures_;
+  absl::Duration repeated_failure_report_interval_;
+  absl::Time last_repeated_failure_report_time_;
+  absl::flat_hash_map<FailureKey, FailureCounts> failures_;
+
+  // Number of entries of failures_ with num_unreported > 0.
+  size_t num_unreported_failure_keys_ = 0;
+
+  // IDs of the snapshots reported as skipped by any runner so far.
+  absl::flat_hash_set<std::string> logged_skipped_snapshot_ids_;
 };
 
 }  // namespace silifuzz
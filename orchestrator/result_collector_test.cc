@@ -16,13 +16,18 @@
 
 #include <unistd.h>
 
+#include <string>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
+#include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./orchestrator/binary_log_channel.h"
 #include "./proto/binary_log_entry.pb.h"
+#include "./proto/player_result.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
 #include "./runner/driver/runner_driver.h"
 #include "./util/testing/status_macros.h"
@@ -62,6 +67,84 @@ TEST(ResultCollector, BinaryLogging) {
   ASSERT_EQ(fd_log_entry.snapshot_execution_result().snapshot_id(), "snap_id");
 }
 
+TEST(ResultCollector, RepeatedFailures) {
+  int pipefd[2] = {-1, -1};
+  ASSERT_EQ(pipe(pipefd), 0);
+  {
+    ResultCollector collector(pipefd[1], absl::Now());
+    RunnerDriver::PlayerResult result = {
+        .outcome = PlaybackOutcome::kMemoryMismatch, .cpu_id = 3};
+    for (int i = 0; i < 15; ++i) {
+      collector(RunnerDriver::RunResult(result, "snap_id"));
+    }
+    // Failures on another CPU are logged separately.
+    result.cpu_id = 4;
+    collector(RunnerDriver::RunResult(result, "snap_id"));
+    EXPECT_EQ(collector.summary().num_failed_snapshots, 16);
+    EXPECT_EQ(collector.summary().num_repeated_failures, 5);
+    collector.FlushRepeatedFailures();
+  }
+  BinaryLogConsumer consumer(pipefd[0]);
+  for (int i = 0; i < 11; ++i) {
+    ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry entry, consumer.Receive());
+    ASSERT_TRUE(entry.has_snapshot_execution_result());
+    EXPECT_EQ(entry.snapshot_execution_result().player_result().cpu_id(),
+              i < 10 ? 3 : 4);
+  }
+  ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry entry, consumer.Receive());
+  ASSERT_TRUE(entry.has_repeated_snapshot_failure());
+  EXPECT_EQ(entry.repeated_snapshot_failure().snapshot_id(), "snap_id");
+  EXPECT_EQ(entry.repeated_snapshot_failure().cpu_id(), 3);
+  EXPECT_EQ(entry.repeated_snapshot_failure().outcome(),
+            proto::PlayerResult::MEMORY_MISMATCH);
+  EXPECT_EQ(entry.repeated_snapshot_failure().count(), 5);
+  EXPECT_TRUE(IsEndOfChannelError(consumer.Receive().status()));
+}
+
+TEST(ResultCollector, RepeatedFailuresDistinctEndStates) {
+  ResultCollector collector(-1, absl::Now());
+  // The end states differ far into their memory, so they are counted as two
+  // different failures, each below the repeated failure threshold.
+  for (char corrupted_value : {'a', 'b'}) {
+    std::string byte_values(4096, 0);
+    byte_values[4000] = corrupted_value;
+    Snapshot::EndState end_state(Snapshot::Endpoint(0x1000),
+                                 Snapshot::RegisterState("", ""));
+    end_state.add_memory_bytes(Snapshot::MemoryBytes(0x10000, byte_values));
+    RunnerDriver::PlayerResult result = {
+        .outcome = PlaybackOutcome::kMemoryMismatch,
+        .actual_end_state = end_state,
+        .cpu_id = 3};
+    for (int i = 0; i < 10; ++i) {
+      collector(RunnerDriver::RunResult(result, "snap_id"));
+    }
+  }
+  EXPECT_EQ(collector.summary().num_failed_snapshots, 20);
+  EXPECT_EQ(collector.summary().num_repeated_failures, 0);
+}
+
+TEST(ResultCollector, RepeatedFailuresEviction) {
+  ResultCollector collector(-1, absl::Now());
+  RunnerDriver::PlayerResult result = {
+      .outcome = PlaybackOutcome::kMemoryMismatch, .cpu_id = 3};
+  for (int i = 0; i < 15; ++i) {
+    collector(RunnerDriver::RunResult(result, "snap_id"));
+  }
+  EXPECT_EQ(collector.summary().num_repeated_failures, 5);
+
+  // Fill up the tracked failures and add one more.
+  for (size_t i = 0; i < ResultCollector::kMaxFailureKeys; ++i) {
+    collector(RunnerDriver::RunResult(result, absl::StrCat("other_", i)));
+  }
+  EXPECT_EQ(collector.summary().num_repeated_failures, 5);
+
+  // The first failure was forgotten, so it is logged in full again.
+  for (int i = 0; i < 11; ++i) {
+    collector(RunnerDriver::RunResult(result, "snap_id"));
+  }
+  EXPECT_EQ(collector.summary().num_repeated_failures, 6);
+}
+
 }  // namespace
 
 }  // namespace silifuzz
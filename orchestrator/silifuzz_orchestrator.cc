@@ -14,20 +14,43 @@
 
 #include "./orchestrator/silifuzz_orchestrator.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
 #include <cstdint>
+#include <fstream>
 #include <functional>
-#include <random>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
+#include "absl/cleanup/cleanup.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./orchestrator/phase_profile.h"
 #include "./runner/driver/runner_driver.h"
+#include "./runner/runner_stats.h"
 #include "./util/checks.h"
+#include "./util/cpu_id.h"
+#include "./util/itoa.h"
 #include "./util/path_util.h"
 
 namespace silifuzz {
@@ -35,21 +58,74 @@ namespace silifuzz {
 namespace {
 // Returns a string representation of StatusOr<RunResult>.
 std::string RunResultToDebugString(
-    const absl::StatusOr<RunnerDriver::RunResult> &run_result_or) {
-  if (run_result_or.ok()) {
-    if (run_result_or->success()) {
+    const absl::StatusOr<std::vector<RunnerDriver::RunResult>>
+        &run_results_or) {
+  if (run_results_or.ok()) {
+    if (run_results_or->front().success()) {
       return "ok";
-    } else {
+    } else if (run_results_or->size() == 1) {
       return "snap_fail";
+    } else {
+      return absl::StrCat("snap_fail x", run_results_or->size());
     }
   } else {
     return "internal_error";
   }
 }
+
+// Keeps up to `capacity` runner servers, one per corpus, and evicts the least
+// recently used one when a server for another corpus is needed.
+//
+// This class is thread-compatible.
+class RunnerServerPool {
+ public:
+  RunnerServerPool(const std::string &runner, size_t capacity)
+      : runner_(runner), capacity_(capacity), use_count_(0) {}
+
+  // Returns a live server for `corpus_name`, starting one if needed.
+  absl::StatusOr<RunnerServer *> Get(const std::string &corpus_name,
+                                     const RunnerOptions &runner_options) {
+    ++use_count_;
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->corpus_name != corpus_name) continue;
+      if (it->server->alive()) {
+        it->last_use = use_count_;
+        return it->server.get();
+      }
+      // Servers die on CPU time limits and fatal errors. Replace them.
+      entries_.erase(it);
+      break;
+    }
+    if (entries_.size() >= capacity_) {
+      auto lru = entries_.begin();
+      for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->last_use < lru->last_use) lru = it;
+      }
+      entries_.erase(lru);
+    }
+    RunnerDriver driver = RunnerDriver::ReadingRunner(runner_, corpus_name);
+    absl::StatusOr<std::unique_ptr<RunnerServer>> server_or =
+        driver.StartServer(runner_options);
+    RETURN_IF_NOT_OK(server_or.status());
+    entries_.push_back({corpus_name, *std::move(server_or), use_count_});
+    return entries_.back().server.get();
+  }
+
+ private:
+  struct Entry {
+    std::string corpus_name;
+    std::unique_ptr<RunnerServer> server;
+    uint64_t last_use;
+  };
+
+  const std::string runner_;
+  const size_t capacity_;
+  uint64_t use_count_;
+  std::vector<Entry> entries_;
+};
 }  // namespace
 
 ExecutionContext::~ExecutionContext() {
-  absl::MutexLock l(&mu_);
   if (!invocation_results_.empty()) {
     absl::string_view error =
         "The result queue is not empty. Did you call ProcessResultQueue()?";
@@ -61,82 +137,353 @@ ExecutionContext::~ExecutionContext() {
   }
 }
 
-// Attempts to post RunResult on the result queue. Returns true if the element
-// was added, false otherwise.
 bool ExecutionContext::OfferRunResult(
     absl::StatusOr<RunnerDriver::RunResult> &&result) {
-  absl::MutexLock l(&mu_);
   if (!result.ok()) {
-    // Currently, no-Ok() results are not reported to the result queue. It is
-    // important however this code executed with mu_ held b/c this allows
-    // EventLoop() to wake up and catch deadline events sooner.
+    // Currently, no-Ok() results are not reported to the result queue. Waking
+    // up EventLoop() allows it to catch deadline events sooner.
+    WakeUpEventLoop();
     return true;
   }
+  std::vector<RunnerDriver::RunResult> results;
+  results.push_back(*std::move(result));
+  return Enqueue(std::move(results));
+}
+
+bool ExecutionContext::OfferRunResults(
+    absl::StatusOr<std::vector<RunnerDriver::RunResult>> &&results) {
+  if (!results.ok()) {
+    // See OfferRunResult().
+    WakeUpEventLoop();
+    return true;
+  }
+  return Enqueue(*std::move(results));
+}
+
+bool ExecutionContext::Enqueue(std::vector<RunnerDriver::RunResult> &&results) {
+  const absl::Time start_time = absl::Now();
+  bool blocked = false;
+  while (!invocation_results_.TryPush(std::move(results))) {
+    // EventLoop() returns once the execution stops and the queue is only
+    // drained again after all worker threads are joined. Waiting any longer
+    // could deadlock.
+    if (ShouldStop()) {
+      ++num_dropped_offers_;
+      return false;
+    }
+    if (!blocked) {
+      blocked = true;
+      ++num_blocked_offers_;
+    }
+    WakeUpEventLoop();
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  WakeUpEventLoop();
 
-  // Allow at most 1 result slot per thread.
-  if (invocation_results_.size() >= num_threads_) {
-    return false;
+  ++num_offers_;
+  const uint64_t size = invocation_results_.size();
+  uint64_t high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+  while (size > high_water_mark &&
+         !high_water_mark_.compare_exchange_weak(high_water_mark, size,
+                                                 std::memory_order_relaxed)) {
+  }
+  const int64_t latency_ns = absl::ToInt64Nanoseconds(absl::Now() - start_time);
+  total_enqueue_latency_ns_ += latency_ns;
+  int64_t max_latency_ns =
+      max_enqueue_latency_ns_.load(std::memory_order_relaxed);
+  while (latency_ns > max_latency_ns &&
+         !max_enqueue_latency_ns_.compare_exchange_weak(
+             max_latency_ns, latency_ns, std::memory_order_relaxed)) {
   }
-  invocation_results_.emplace_back(*result);
   return true;
 }
 
+void ExecutionContext::WakeUpEventLoop() {
+  // Pairs with the fence in EventLoop(). Either EventLoop() sees the newly
+  // queued results or this thread sees that it is sleeping.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (event_loop_sleeping_.load(std::memory_order_relaxed)) {
+    absl::MutexLock l(&mu_);
+    wake_up_cv_.Signal();
+  }
+}
+
+ResultQueueStats ExecutionContext::result_queue_stats() const {
+  return {
+      .num_offers = num_offers_.load(),
+      .num_blocked_offers = num_blocked_offers_.load(),
+      .num_dropped_offers = num_dropped_offers_.load(),
+      .high_water_mark = high_water_mark_.load(),
+      .max_enqueue_latency = absl::Nanoseconds(max_enqueue_latency_ns_.load()),
+      .total_enqueue_latency =
+          absl::Nanoseconds(total_enqueue_latency_ns_.load()),
+  };
+}
+
 // Runs the orchestrator event loop.
 // NOTE: This method is not reentrant. Must be called by the main thread.
 void ExecutionContext::EventLoop() {
-  absl::Duration delay = absl::Seconds(10);
+  // Stop() must be async-signal-safe and cannot signal wake_up_cv_. Wake up
+  // periodically to notice it.
+  absl::Duration delay = absl::Milliseconds(100);
   while (!ShouldStop()) {
-    std::vector<RunnerDriver::RunResult> current_results;
-    current_results.reserve(num_threads_);
-    {
-      bool timed_out = mu_.LockWhenWithTimeout(
-          absl::Condition(this, &ExecutionContext::ShouldWakeUp), delay);
+    if (DrainResultQueue() > 0) {
+      continue;
+    }
+    absl::MutexLock l(&mu_);
+    event_loop_sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (invocation_results_.empty() && !ShouldStop()) {
+      bool timed_out = wake_up_cv_.WaitWithTimeout(&mu_, delay);
       VLOG_INFO(2, "Result processor woke up, queue size = ",
                 invocation_results_.size(), " due to timeout? = ", timed_out);
-      if (invocation_results_.empty()) {
-        mu_.Unlock();
-        continue;
-      }
-      invocation_results_.swap(current_results);
-      mu_.Unlock();
     }
-
-    ProcessResultQueueImpl(current_results);
+    event_loop_sleeping_.store(false, std::memory_order_relaxed);
   }
 }
 
 // Processes the event queue on the calling thread.
 // This method needs to be called to process any late-arriving events after
 // all worker thread have been joined.
-void ExecutionContext::ProcessResultQueue() {
-  absl::MutexLock l(&mu_);
-  ProcessResultQueueImpl(invocation_results_);
-  invocation_results_.clear();
+void ExecutionContext::ProcessResultQueue() { DrainResultQueue(); }
+
+size_t ExecutionContext::DrainResultQueue() {
+  size_t num_invocations = 0;
+  std::vector<RunnerDriver::RunResult> results;
+  while (invocation_results_.TryPop(&results)) {
+    for (const auto &result : results) {
+      result_cb_(result);
+    }
+    ++num_invocations;
+  }
+  return num_invocations;
 }
 
-void ExecutionContext::ProcessResultQueueImpl(
-    const std::vector<RunnerDriver::RunResult> &results) {
-  for (const auto &result : results) {
-    result_cb_(result);
+CorpusScheduler::CorpusScheduler(const std::vector<std::string> &corpora,
+                                 const std::vector<uint64_t> &weights,
+                                 bool sequential_mode)
+    : corpora_(corpora),
+      sequential_mode_(sequential_mode),
+      strides_(corpora.size(), 1.0),
+      passes_(corpora.size(), 0.0),
+      pick_counts_(corpora.size(), 0) {
+  CHECK(!corpora_.empty());
+  if (!weights.empty()) {
+    CHECK_EQ(weights.size(), corpora_.size());
+    for (size_t i = 0; i < corpora_.size(); ++i) {
+      // An empty corpus still gets picked once in a while.
+      strides_[i] = 1.0 / std::max<uint64_t>(weights[i], 1);
+    }
   }
 }
 
-std::string NextCorpusGenerator::operator()() {
+std::string CorpusScheduler::Next(int thread_idx) {
+  std::optional<size_t> picked = NextIndex(thread_idx);
+  return picked.has_value() ? corpora_[*picked] : "";
+}
+
+std::optional<size_t> CorpusScheduler::NextIndex(int thread_idx) {
+  absl::MutexLock l(&mu_);
+  const size_t num_corpora = corpora_.size();
+  ThreadState &state = thread_states_[thread_idx];
+  if (state.last_pick.empty()) {
+    state.last_pick.resize(num_corpora, -1);
+  }
+  // Start at a different corpus for each thread. This spreads out the
+  // sequential mode and breaks ties differently for different threads.
+  const size_t start = static_cast<unsigned>(thread_idx) % num_corpora;
+
+  size_t picked;
   if (sequential_mode_) {
-    return next_index_ < corpora_.size() ? corpora_[next_index_++] : "";
+    if (state.num_picks >= num_corpora) {
+      return std::nullopt;
+    }
+    picked = (start + state.num_picks) % num_corpora;
   } else {
-    return corpora_[random_() % corpora_.size()];
+    double best_key = std::numeric_limits<double>::infinity();
+    picked = start;
+    for (size_t n = 0; n < num_corpora; ++n) {
+      const size_t i = (start + n) % num_corpora;
+      double key = passes_[i];
+      if (state.last_pick[i] >= 0) {
+        // Push back corpora this thread ran recently by up to one stride.
+        // The penalty is gone once the thread picked num_corpora others.
+        const uint64_t age = state.num_picks - state.last_pick[i];
+        if (age < num_corpora) {
+          key += strides_[i] * (num_corpora - age) / num_corpora;
+        }
+      }
+      if (key < best_key) {
+        best_key = key;
+        picked = i;
+      }
+    }
+    passes_[picked] += strides_[picked];
+  }
+  state.last_pick[picked] = state.num_picks++;
+  ++pick_counts_[picked];
+  return picked;
+}
+
+uint64_t CorpusScheduler::pick_count(size_t i) const {
+  absl::MutexLock l(&mu_);
+  return pick_counts_[i];
+}
+
+RunnerBudgets::RunnerBudgets(absl::Duration min_budget,
+                             absl::Duration max_budget, double target_ratio)
+    : min_budget_(absl::Ceil(min_budget, absl::Seconds(1))),
+      max_budget_(std::max(min_budget_, max_budget)),
+      target_ratio_(target_ratio) {
+  CHECK_GE(target_ratio_, 0.0);
+  CHECK_LT(target_ratio_, 1.0);
+}
+
+absl::Duration RunnerBudgets::Budget(const std::string &path) const {
+  absl::MutexLock l(&mu_);
+  auto it = corpora_.find(path);
+  return it != corpora_.end() ? it->second.budget : min_budget_;
+}
+
+void RunnerBudgets::Record(const std::string &path, absl::Duration elapsed,
+                           uint64_t total_ticks, uint64_t useful_ticks) {
+  if (total_ticks == 0) {
+    return;
+  }
+  useful_ticks = std::min(useful_ticks, total_ticks);
+  const absl::Duration overhead =
+      elapsed * (static_cast<double>(total_ticks - useful_ticks) / total_ticks);
+
+  absl::MutexLock l(&mu_);
+  total_ticks_ += total_ticks;
+  useful_ticks_ += useful_ticks;
+  auto [it, inserted] = corpora_.try_emplace(path);
+  Corpus &corpus = it->second;
+  // Weigh the latest invocation by 1/4. This smooths out the noise of
+  // individual invocations while following changes of the machine load
+  // within a few invocations.
+  corpus.overhead =
+      inserted ? overhead : corpus.overhead * 0.75 + overhead * 0.25;
+  const absl::Duration budget = std::clamp(
+      absl::Ceil(corpus.overhead / (1 - target_ratio_), absl::Seconds(1)),
+      min_budget_, max_budget_);
+  if (inserted || budget != corpus.budget) {
+    VLOG_INFO(1, "Runner budget of ", Basename(path), ": ",
+              absl::FormatDuration(budget), " overhead: ",
+              absl::FormatDuration(corpus.overhead));
   }
+  corpus.budget = budget;
+}
+
+double RunnerBudgets::useful_ratio() const {
+  absl::MutexLock l(&mu_);
+  return total_ticks_ > 0 ? static_cast<double>(useful_ticks_) / total_ticks_
+                          : 0.0;
 }
 
 // The main worker thread. Each such thread executes runners with corpora in a
 // loop until it is told to stop.
+namespace {
+
+// Runs `corpus_name` with one runner per CPU in `cpus`, which form a
+// co-scheduling group. The first member runs in this thread and records its
+// times in `times`. Returns the results of each member in the order of
+// `cpus`, or a single error if the group cannot be formed.
+std::vector<absl::StatusOr<std::vector<RunnerDriver::RunResult>>>
+RunCoschedGroup(const std::string &runner, const std::string &corpus_name,
+                const RunnerOptions &runner_options,
+                const std::vector<int> &cpus, RunnerDriver::RunTimes *times) {
+  absl::StatusOr<std::string> group_path = CreateTempFile("cosched_group");
+  if (!group_path.ok()) {
+    return {group_path.status()};
+  }
+  absl::Cleanup group_file_remover = [&group_path] {
+    unlink(group_path->c_str());
+  };
+  // A zero-filled page is a new group.
+  if (truncate(group_path->c_str(), getpagesize()) != 0) {
+    return {absl::ErrnoToStatus(errno,
+                                absl::StrCat("truncate(", *group_path, ")"))};
+  }
+
+  std::vector<absl::StatusOr<std::vector<RunnerDriver::RunResult>>> results(
+      cpus.size());
+  auto run_member = [&](size_t index, RunnerDriver::RunTimes *member_times) {
+    RunnerOptions member_options = runner_options;
+    member_options.set_cpu(cpus[index])
+        .set_cosched_group(*group_path, cpus.size(), index);
+    RunnerDriver driver = RunnerDriver::ReadingRunner(runner, corpus_name);
+    results[index] = driver.RunAll(member_options, member_times);
+  };
+  std::vector<std::thread> members;
+  members.reserve(cpus.size() - 1);
+  for (size_t i = 1; i < cpus.size(); ++i) {
+    members.emplace_back(run_member, i, nullptr);
+  }
+  run_member(0, times);
+  for (std::thread &member : members) {
+    member.join();
+  }
+  return results;
+}
+
+}  // namespace
+
 void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args) {
   VLOG_INFO(0, "T", args.thread_idx, " started");
-  NextCorpusGenerator next_corpus_generator(
-      args.corpora, args.runner_options.sequential_mode(), args.thread_idx);
+  CHECK(args.corpus_source != nullptr);
+  std::unique_ptr<RunnerServerPool> server_pool;
+  if (args.runner_server_pool_size > 0) {
+    CHECK(!args.runner_options.sequential_mode());
+  }
+  if (!args.cosched_cpus.empty()) {
+    CHECK_EQ(args.runner_server_pool_size, 0);
+    CHECK(!args.runner_options.sequential_mode());
+    CHECK_EQ(args.cosched_cpus.front(), args.runner_options.cpu());
+  }
+  if (args.pin_to_cpu) {
+    CHECK_NE(args.runner_options.cpu(), kAnyCPUId);
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(args.runner_options.cpu(), &cpu_set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (err != 0) {
+      LOG_ERROR("T", args.thread_idx, " cannot pin to CPU ",
+                args.runner_options.cpu(), ": ", ErrnoStr(err));
+    }
+  }
+
+  // The generation of corpora in use and what this thread reads of it.
+  // Holding on to the generation keeps its corpus files open while runners
+  // use them.
+  std::shared_ptr<CorpusGeneration> generation;
+  const std::vector<std::string> *corpora = nullptr;
+  const std::vector<int> *corpus_numa_nodes = nullptr;
 
   while (!ctx->ShouldStop()) {
+    if (std::shared_ptr<CorpusGeneration> current =
+            args.corpus_source->Current();
+        current != generation) {
+      if (generation != nullptr) {
+        VLOG_INFO(0, "T", args.thread_idx, " switching to new corpora");
+      }
+      generation = std::move(current);
+      auto local_it = generation->local_corpora.find(args.numa_node);
+      const bool local = local_it != generation->local_corpora.end();
+      corpora = local ? &local_it->second : nullptr;
+      auto nodes_it =
+          generation->corpus_numa_nodes.find(local ? args.numa_node : -1);
+      corpus_numa_nodes = nodes_it != generation->corpus_numa_nodes.end()
+                              ? &nodes_it->second
+                              : nullptr;
+      // Servers of the old corpora must not be reused. Paths of the new
+      // corpora may even be the same.
+      if (args.runner_server_pool_size > 0) {
+        server_pool = std::make_unique<RunnerServerPool>(
+            args.runner, args.runner_server_pool_size);
+      }
+    }
+
     absl::Time start_time = absl::Now();
     absl::Duration time_budget = ctx->deadline() - start_time;
     if (time_budget <= absl::ZeroDuration()) {
@@ -144,31 +491,124 @@ void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args) {
     }
     RunnerOptions runner_options = args.runner_options;
     runner_options.set_wall_time_bugdet(time_budget);
-    VLOG_INFO(1, "T", args.thread_idx, " time budget ",
-              absl::FormatDuration(time_budget));
-    std::string corpus_name = next_corpus_generator();
-    if (corpus_name.empty()) {
+    std::optional<size_t> corpus_idx =
+        generation->scheduler.NextIndex(args.thread_idx);
+    if (!corpus_idx.has_value()) {
       VLOG_INFO(0, "T", args.thread_idx,
                 " Reached end of stream in sequential mode");
       break;
     }
-    RunnerDriver driver = RunnerDriver::ReadingRunner(args.runner, corpus_name);
-    absl::StatusOr<RunnerDriver::RunResult> run_result_or =
-        driver.Run(runner_options);
+    const std::string &corpus_name =
+        corpora != nullptr ? (*corpora)[*corpus_idx]
+                           : generation->scheduler.corpus(*corpus_idx);
+    const std::string *corpus_path =
+        args.runner_budgets != nullptr && !generation->corpus_paths.empty()
+            ? &generation->corpus_paths[*corpus_idx]
+            : nullptr;
+    if (corpus_path != nullptr) {
+      runner_options.set_cpu_time_bugdet(
+          args.runner_budgets->Budget(*corpus_path));
+    }
+    VLOG_INFO(1, "T", args.thread_idx, " time budget ",
+              absl::FormatDuration(time_budget), " CPU time budget ",
+              absl::FormatDuration(runner_options.cpu_time_budget()));
+    const uint64_t start_ticks = ReadTickCounter();
+    absl::StatusOr<std::vector<RunnerDriver::RunResult>> run_results_or;
+    // Results of the other members of the co-scheduling group, if any.
+    std::vector<absl::StatusOr<std::vector<RunnerDriver::RunResult>>>
+        cosched_results;
+    RunnerDriver::RunTimes run_times;
+    if (!args.cosched_cpus.empty()) {
+      cosched_results = RunCoschedGroup(args.runner, corpus_name,
+                                        runner_options, args.cosched_cpus,
+                                        &run_times);
+      run_results_or = std::move(cosched_results.front());
+      cosched_results.erase(cosched_results.begin());
+    } else if (server_pool != nullptr) {
+      const absl::Time get_server_time = absl::Now();
+      absl::StatusOr<RunnerServer *> server_or =
+          server_pool->Get(corpus_name, runner_options);
+      // Starting a new server counts as spawning a runner.
+      run_times.start = absl::Now() - get_server_time;
+      if (server_or.ok()) {
+        RunnerDriver::RunTimes server_times;
+        run_results_or =
+            (*server_or)->Run(runner_options.cpu_time_budget(),
+                              runner_options.wall_time_budget(), &server_times);
+        run_times.start += server_times.start;
+        run_times.wait = server_times.wait;
+        run_times.parse = server_times.parse;
+      } else {
+        run_results_or = server_or.status();
+      }
+    } else {
+      RunnerDriver driver =
+          RunnerDriver::ReadingRunner(args.runner, corpus_name);
+      run_results_or = driver.RunAll(runner_options, &run_times);
+    }
 
-    int64_t elapsed_time = absl::ToInt64Seconds(absl::Now() - start_time);
+    const uint64_t total_ticks = ReadTickCounter() - start_ticks;
+    const absl::Duration elapsed = absl::Now() - start_time;
+    if (args.phase_profile != nullptr) {
+      // Error paths leave the phases they did not reach at zero. Do not let
+      // those skew the profile.
+      for (auto [phase, duration] :
+           {std::make_pair(OrchestratorPhase::kSpawnRunner, run_times.start),
+            std::make_pair(OrchestratorPhase::kWaitRunner, run_times.wait),
+            std::make_pair(OrchestratorPhase::kParseOutput, run_times.parse)}) {
+        if (duration > absl::ZeroDuration()) {
+          args.phase_profile->Record(phase, duration);
+        }
+      }
+    }
+    int64_t elapsed_time = absl::ToInt64Seconds(elapsed);
+    // Only the first result carries stats.
+    const std::optional<RunnerStats> *stats =
+        run_results_or.ok() ? &run_results_or->front().stats() : nullptr;
+    if (corpus_path != nullptr && stats != nullptr && stats->has_value()) {
+      uint64_t useful_ticks = 0;
+      for (uint64_t ticks : (*stats)->phase_ticks) {
+        useful_ticks += ticks;
+      }
+      args.runner_budgets->Record(*corpus_path, elapsed, total_ticks,
+                                  useful_ticks);
+    }
 
-    std::string exit_status = RunResultToDebugString(run_result_or);
+    std::string exit_status = RunResultToDebugString(run_results_or);
     VLOG_INFO(0, "T", args.thread_idx, " corpus: ", Basename(corpus_name),
               " time: ", elapsed_time, " exit_status: ", exit_status);
-    if (!run_result_or.ok()) {
-      LOG_ERROR(run_result_or.status().message());
+    if (!run_results_or.ok()) {
+      LOG_ERROR(run_results_or.status().message());
+    }
+    if (NumaNodeCounters *counters = args.numa_node_counters;
+        counters != nullptr) {
+      ++counters->num_runner_invocations;
+      if (corpus_numa_nodes != nullptr) {
+        const int corpus_node = (*corpus_numa_nodes)[*corpus_idx];
+        if (args.numa_node >= 0 && corpus_node >= 0 &&
+            corpus_node != args.numa_node) {
+          ++counters->num_remote_corpus_runs;
+        }
+      }
+      if (stats != nullptr && stats->has_value()) {
+        counters->num_snap_executions += (*stats)->num_executions;
+      }
+    }
+
+    for (auto &member_results_or : cosched_results) {
+      if (!member_results_or.ok()) {
+        LOG_ERROR(member_results_or.status().message());
+      }
     }
 
-    if (!ctx->OfferRunResult(std::move(run_result_or))) {
-      LOG_ERROR(
-          "T", args.thread_idx,
-          " Result processing queue is stuck, some results won't be logged");
+    bool offered = ctx->OfferRunResults(std::move(run_results_or));
+    for (auto &member_results_or : cosched_results) {
+      offered &= ctx->OfferRunResults(std::move(member_results_or));
+    }
+    if (!offered) {
+      LOG_ERROR("T", args.thread_idx,
+                " Result processing queue is full at shutdown, some results "
+                "won't be logged");
     }
   }
 
@@ -176,4 +616,84 @@ void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args) {
   VLOG_INFO(0, "T", args.thread_idx, " stopped");
 }
 
+absl::StatusOr<std::vector<std::string>> ReadCorpusManifest(
+    const std::string &path) {
+  std::ifstream manifest(path);
+  if (!manifest.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Cannot open ", path));
+  }
+  std::vector<std::string> corpora;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    absl::string_view corpus = absl::StripAsciiWhitespace(line);
+    if (corpus.empty() || absl::StartsWith(corpus, "#")) {
+      continue;
+    }
+    corpora.emplace_back(corpus);
+  }
+  if (manifest.bad()) {
+    return absl::InternalError(absl::StrCat("Cannot read ", path));
+  }
+  if (corpora.empty()) {
+    return absl::InvalidArgumentError(absl::StrCat("No corpora in ", path));
+  }
+  return corpora;
+}
+
+std::pair<ino_t, absl::Time> FileVersion(const std::string &path) {
+  struct stat stat_buf;
+  if (stat(path.c_str(), &stat_buf) != 0) {
+    return {0, absl::InfinitePast()};
+  }
+  return {stat_buf.st_ino, absl::TimeFromTimespec(stat_buf.st_mtim)};
+}
+
+void CorpusReloader(
+    ExecutionContext *ctx, CorpusSource *source,
+    const std::vector<std::string> &corpora, const std::string &manifest,
+    absl::Duration poll_interval,
+    const std::function<absl::StatusOr<std::shared_ptr<CorpusGeneration>>(
+        const std::vector<std::string> &)> &load_corpora,
+    std::atomic<bool> *reload_requested) {
+  auto manifest_version = FileVersion(manifest);
+  absl::Time next_poll = absl::Now() + poll_interval;
+  while (!ctx->ShouldStop()) {
+    absl::SleepFor(absl::Milliseconds(100));
+    bool reload = reload_requested->exchange(false);
+    if (!manifest.empty() && absl::Now() >= next_poll) {
+      next_poll = absl::Now() + poll_interval;
+      if (auto version = FileVersion(manifest); version != manifest_version) {
+        manifest_version = version;
+        reload = true;
+      }
+    }
+    if (!reload) {
+      continue;
+    }
+
+    const absl::Time start_time = absl::Now();
+    std::vector<std::string> paths = corpora;
+    if (!manifest.empty()) {
+      absl::StatusOr<std::vector<std::string>> paths_or =
+          ReadCorpusManifest(manifest);
+      if (!paths_or.ok()) {
+        LOG_ERROR("Cannot read corpus manifest: ", paths_or.status().message());
+        continue;
+      }
+      paths = *std::move(paths_or);
+    }
+    LOG_INFO("Reloading ", paths.size(), " corpora");
+    absl::StatusOr<std::shared_ptr<CorpusGeneration>> generation_or =
+        load_corpora(paths);
+    if (!generation_or.ok()) {
+      LOG_ERROR("Cannot reload corpora, keeping the old ones: ",
+                generation_or.status().message());
+      continue;
+    }
+    source->Replace(*std::move(generation_or));
+    LOG_INFO("Reloaded corpora in ",
+             absl::FormatDuration(absl::Now() - start_time));
+  }
+}
+
 }  // namespace silifuzz
@@ -15,22 +15,45 @@
 #ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SILIFUZZ_ORCHESTRATOR_H_
 #define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SILIFUZZ_ORCHESTRATOR_H_
 
+#include <sys/types.h>
+
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <random>
+#include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./orchestrator/mpsc_ring.h"
+#include "./orchestrator/phase_profile.h"
+#include "./orchestrator/result_collector.h"
 #include "./runner/driver/runner_driver.h"
 #include "./runner/driver/runner_options.h"
 
 namespace silifuzz {
 
+class CorpusSource;   // fwd declaration, see below.
+class RunnerBudgets;  // fwd declaration, see below.
+
+// Counters shared by all RunnerThreads on the CPUs of one NUMA node.
+struct NumaNodeCounters {
+  // Number of runner invocations and Snap executions on the node.
+  std::atomic<uint64_t> num_runner_invocations = 0;
+  std::atomic<uint64_t> num_snap_executions = 0;
+
+  // Number of runner invocations that read a corpus from another node.
+  std::atomic<uint64_t> num_remote_corpus_runs = 0;
+};
+
 // Arguments for RunnerThread.
 struct RunnerThreadArgs {
   // Opaque thread identifier. Must be unique.
@@ -39,11 +62,43 @@ struct RunnerThreadArgs {
   // Path to a reading runner.
   std::string runner = "";
 
-  // All available corpora
-  std::vector<std::string> corpora = {};
+  // Provides the corpora to run. Shared by all threads.
+  CorpusSource *corpus_source = nullptr;
+
+  // NUMA node of the thread's CPU or -1 if unknown. Selects the corpus copies
+  // the runners read, see CorpusGeneration.
+  int numa_node = -1;
+
+  // Counters of the thread's NUMA node, if any.
+  NumaNodeCounters *numa_node_counters = nullptr;
+
+  // Adapts the CPU time budget of each runner invocation to its corpus.
+  // Shared by all threads. If nullptr, runner_options.cpu_time_budget() is
+  // used as is.
+  RunnerBudgets *runner_budgets = nullptr;
+
+  // Records how long the thread spends in each phase of a runner invocation.
+  // Owned by the thread. If nullptr, nothing is recorded.
+  PhaseProfile *phase_profile = nullptr;
+
+  // If true, the thread pins itself to runner_options.cpu() so that memory
+  // it allocates for the runners is local to the runners.
+  bool pin_to_cpu = false;
 
   // Additional paramaters passed to each runner binary.
   RunnerOptions runner_options = RunnerOptions::Default();
+
+  // Maximum number of persistent runner servers kept alive by the thread,
+  // at most one per corpus. When 0, each run starts a new runner process.
+  // Not supported in sequential mode.
+  size_t runner_server_pool_size = 0;
+
+  // If not empty, the CPUs of a co-scheduling group, starting with
+  // runner_options.cpu(). Each run then starts one runner per CPU that runs
+  // its slice of the corpus in lock-step with the others, see
+  // runner/cosched_group.h. Not supported with runner servers or in
+  // sequential mode.
+  std::vector<int> cosched_cpus = {};
 };
 
 // Orchestrator execution context.
@@ -52,6 +107,11 @@ struct RunnerThreadArgs {
 // execution results). Worker threads publish their results via OfferRunResult()
 // in a while (!ShouldStop()) {} loop.
 //
+// The queue is a lock-free ring with one slot per runner invocation, so
+// worker threads do not contend on a lock to post results. When the ring is
+// full, workers wait for the event loop to catch up instead of dropping
+// results.
+//
 // This class is thread-safe.
 class ExecutionContext {
  public:
@@ -59,6 +119,9 @@ class ExecutionContext {
   // threads.
   using ResultCallback = std::function<void(const RunnerDriver::RunResult &)>;
 
+  // Number of result queue slots per worker thread.
+  static constexpr size_t kResultSlotsPerThread = 4;
+
   // Constructs an ExecutionContext with the given deadline. Once the deadline
   // is reached ShouldStop() will return true.
   // num_threads is a hint used to size internal data structures.
@@ -71,9 +134,8 @@ class ExecutionContext {
         result_cb_(result_cb),
         mu_(),
         stop_execution_(false),
-        invocation_results_() {
-    invocation_results_.reserve(num_threads);
-  }
+        event_loop_sleeping_(false),
+        invocation_results_(num_threads * kResultSlotsPerThread) {}
 
   // Not copyable or moveable -- not just a data holder.
   ExecutionContext(const ExecutionContext &) = delete;
@@ -83,10 +145,16 @@ class ExecutionContext {
 
   ~ExecutionContext();
 
-  // Attempts to post RunResult on the result queue. Returns true if the element
-  // was added, false otherwise.
+  // Posts RunResult on the result queue. Waits while the queue is full.
+  // Returns true if the element was added, false if the queue stayed full
+  // after the execution was told to stop.
   bool OfferRunResult(absl::StatusOr<RunnerDriver::RunResult> &&result);
 
+  // Like OfferRunResult() but posts all results of a single runner invocation
+  // (see RunnerDriver::RunAll()). The results are either all added or none.
+  bool OfferRunResults(
+      absl::StatusOr<std::vector<RunnerDriver::RunResult>> &&results);
+
   // Returns true if the execution should stop.
   bool ShouldStop() const { return stop_execution_ || absl::Now() > deadline_; }
 
@@ -105,56 +173,269 @@ class ExecutionContext {
 
   absl::Time deadline() const { return deadline_; }
 
+  // Returns the number of slots in the result queue.
+  size_t result_queue_capacity() const {
+    return invocation_results_.capacity();
+  }
+
+  // Returns statistics of the result queue so far.
+  ResultQueueStats result_queue_stats() const;
+
  private:
-  void ProcessResultQueueImpl(
-      const std::vector<RunnerDriver::RunResult> &results);
+  // Posts `results` of one runner invocation. See OfferRunResult().
+  bool Enqueue(std::vector<RunnerDriver::RunResult> &&results);
 
-  // EventLoop() helper. Returns true iif the EventLoop() should wake up.
-  bool ShouldWakeUp() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-    return !invocation_results_.empty() || ShouldStop();
-  }
+  // Wakes up EventLoop() if it is waiting for results.
+  void WakeUpEventLoop();
+
+  // Passes all queued results to result_cb_. Returns the number of runner
+  // invocations processed. Must only be called by the thread that runs
+  // EventLoop().
+  size_t DrainResultQueue();
 
   // C-tor parameters.
   const absl::Time deadline_;
   const int num_threads_;
   ResultCallback result_cb_;
 
-  // Mutex guarding all mutable state of this class.
+  // Mutex EventLoop() sleeps on while the result queue is empty.
   mutable absl::Mutex mu_;
+  absl::CondVar wake_up_cv_;
 
   // Global atomic flag to indicate that the orchestrator should stop.
   std::atomic<bool> stop_execution_;
 
-  // A queue of execution results.
-  std::vector<RunnerDriver::RunResult> invocation_results_ ABSL_GUARDED_BY(mu_);
+  // True while EventLoop() waits on wake_up_cv_ or is about to. Producers
+  // only take mu_ to signal when this is set.
+  std::atomic<bool> event_loop_sleeping_;
+
+  // A queue of execution results, one slot per runner invocation.
+  MpscRing<std::vector<RunnerDriver::RunResult>> invocation_results_;
+
+  // Result queue statistics. See ResultQueueStats.
+  std::atomic<uint64_t> num_offers_ = 0;
+  std::atomic<uint64_t> num_blocked_offers_ = 0;
+  std::atomic<uint64_t> num_dropped_offers_ = 0;
+  std::atomic<uint64_t> high_water_mark_ = 0;
+  std::atomic<int64_t> max_enqueue_latency_ns_ = 0;
+  std::atomic<int64_t> total_enqueue_latency_ns_ = 0;
+};
+
+// Picks the corpus each RunnerThread runs next.
+//
+// In sequential mode, each thread gets every corpus exactly once. Threads
+// start at different corpora so that they do not all load the same corpus
+// at the same time.
+//
+// Otherwise, corpora are picked by stride scheduling: over time each corpus
+// is picked in proportion to its weight. With corpus sizes as weights, every
+// Snap gets about the same coverage no matter which shard it is in. A corpus
+// that a thread ran recently is pushed back for that thread, so that each
+// thread cycles through the corpora instead of repeating one that happens to
+// be due.
+//
+// This class is thread-safe.
+class CorpusScheduler {
+ public:
+  // Schedules `corpora` with relative `weights`, e.g. their sizes in bytes.
+  // If `weights` is empty, all corpora have the same weight.
+  CorpusScheduler(const std::vector<std::string> &corpora,
+                  const std::vector<uint64_t> &weights, bool sequential_mode);
+
+  // Not copyable or moveable.
+  CorpusScheduler(const CorpusScheduler &) = delete;
+  CorpusScheduler &operator=(const CorpusScheduler &) = delete;
+
+  // Returns the next corpus file name for the thread with `thread_idx` or ""
+  // to stop.
+  std::string Next(int thread_idx);
+
+  // Like Next() but returns the index of the corpus or nullopt to stop.
+  std::optional<size_t> NextIndex(int thread_idx);
+
+  // Returns corpora[i].
+  const std::string &corpus(size_t i) const { return corpora_[i]; }
+
+  // Returns how many times Next() returned corpora[i].
+  uint64_t pick_count(size_t i) const;
+
+ private:
+  // Scheduling state of a single thread.
+  struct ThreadState {
+    // Number of corpora picked for this thread.
+    uint64_t num_picks = 0;
+
+    // num_picks when each corpus was last picked for this thread or -1.
+    std::vector<int64_t> last_pick;
+  };
+
+  const std::vector<std::string> corpora_;
+  const bool sequential_mode_;
+
+  // How much a pick advances the pass of each corpus. Inversely proportional
+  // to its weight.
+  std::vector<double> strides_;
+
+  mutable absl::Mutex mu_;
+
+  // Virtual time of each corpus. The corpus with the lowest pass is due.
+  std::vector<double> passes_ ABSL_GUARDED_BY(mu_);
+
+  std::vector<uint64_t> pick_counts_ ABSL_GUARDED_BY(mu_);
+
+  absl::flat_hash_map<int, ThreadState> thread_states_ ABSL_GUARDED_BY(mu_);
 };
 
-// Helper class to generate the next corpus file name.
-class NextCorpusGenerator {
+// Picks the CPU time budget of runner invocations per corpus, so that runners
+// spend a target fraction of their time executing Snaps.
+//
+// Each invocation has some overhead besides executing Snaps: starting the
+// process, relocating and mapping the corpus and tearing it all down. The
+// overhead grows with the size of the corpus, so a single budget for all
+// corpora is either too short for large corpora or churns processes for
+// small ones. RunnerBudgets tracks a moving average of the overhead of each
+// corpus and picks the shortest budget that keeps the overhead below
+// 1 - target_ratio of the invocation.
+//
+// This class is thread-safe.
+class RunnerBudgets {
  public:
-  NextCorpusGenerator(const std::vector<std::string> &corpora,
-                      bool sequential_mode, int seed)
-      : corpora_(corpora),
-        sequential_mode_(sequential_mode),
-        random_(seed),
-        next_index_(0) {}
-  NextCorpusGenerator(const NextCorpusGenerator &) = default;
-  NextCorpusGenerator(NextCorpusGenerator &&) = default;
-  NextCorpusGenerator &operator=(const NextCorpusGenerator &) = default;
-  NextCorpusGenerator &operator=(NextCorpusGenerator &&) = default;
-  // Returns the next corpus file name or "" to stop.
-  std::string operator()();
+  // Budgets are rounded up to whole seconds, which is the precision of the
+  // CPU time limit, and stay within [min_budget, max_budget].
+  RunnerBudgets(absl::Duration min_budget, absl::Duration max_budget,
+                double target_ratio);
+
+  // Not copyable or moveable.
+  RunnerBudgets(const RunnerBudgets &) = delete;
+  RunnerBudgets &operator=(const RunnerBudgets &) = delete;
+
+  // Returns the budget of the next invocation with the corpus at `path`.
+  absl::Duration Budget(const std::string &path) const;
+
+  // Records an invocation with the corpus at `path` that took `elapsed` and
+  // `total_ticks` of ReadTickCounter(), of which the runner spent
+  // `useful_ticks` executing Snaps.
+  void Record(const std::string &path, absl::Duration elapsed,
+              uint64_t total_ticks, uint64_t useful_ticks);
+
+  // Returns the fraction of the recorded invocation time spent executing
+  // Snaps or 0 if nothing was recorded.
+  double useful_ratio() const;
 
  private:
-  std::vector<std::string> corpora_;
-  bool sequential_mode_;
-  std::mt19937_64 random_;
-  int next_index_;
+  // State of a single corpus.
+  struct Corpus {
+    // Moving average of the overhead per invocation.
+    absl::Duration overhead = absl::ZeroDuration();
+
+    // Current budget.
+    absl::Duration budget;
+  };
+
+  const absl::Duration min_budget_;
+  const absl::Duration max_budget_;
+  const double target_ratio_;
+
+  mutable absl::Mutex mu_;
+
+  // Keyed by corpus path. Corpora without any invocation get min_budget.
+  absl::flat_hash_map<std::string, Corpus> corpora_ ABSL_GUARDED_BY(mu_);
+
+  // Totals of all recorded invocations.
+  uint64_t total_ticks_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t useful_ticks_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+// A set of loaded corpora that RunnerThreads run. Only the scheduler changes
+// once the generation is passed to a CorpusSource.
+struct CorpusGeneration {
+  CorpusGeneration(const std::vector<std::string> &corpora,
+                   const std::vector<uint64_t> &weights, bool sequential_mode)
+      : scheduler(corpora, weights, sequential_mode) {}
+
+  // Not copyable or moveable.
+  CorpusGeneration(const CorpusGeneration &) = delete;
+  CorpusGeneration &operator=(const CorpusGeneration &) = delete;
+
+  // Picks corpora to run.
+  CorpusScheduler scheduler;
+
+  // Paths the scheduler's corpora were loaded from, in the same order. These
+  // identify a corpus across generations, see RunnerBudgets. May be empty.
+  std::vector<std::string> corpus_paths;
+
+  // Copies of the scheduler's corpora in the same order, keyed by the NUMA
+  // node they are local to. Threads on other nodes read the scheduler's
+  // corpora.
+  absl::flat_hash_map<int, std::vector<std::string>> local_corpora;
+
+  // NUMA node holding each corpus or -1 if unknown, in the scheduler's order.
+  // Keyed like local_corpora, with key -1 for the scheduler's corpora. Runs of
+  // corpora on another node than the thread's are counted as remote.
+  absl::flat_hash_map<int, std::vector<int>> corpus_numa_nodes;
+
+  // Released with the generation, e.g. owns the corpus files.
+  std::shared_ptr<const void> resources;
+};
+
+// Holds the current CorpusGeneration. RunnerThreads switch to a new
+// generation between runs. An old generation is released once no thread
+// uses it any more.
+//
+// This class is thread-safe.
+class CorpusSource {
+ public:
+  explicit CorpusSource(std::shared_ptr<CorpusGeneration> generation)
+      : current_(std::move(generation)) {}
+
+  // Not copyable or moveable.
+  CorpusSource(const CorpusSource &) = delete;
+  CorpusSource &operator=(const CorpusSource &) = delete;
+
+  // Returns the current generation.
+  std::shared_ptr<CorpusGeneration> Current() const {
+    absl::MutexLock l(&mu_);
+    return current_;
+  }
+
+  // Makes `generation` the current generation.
+  void Replace(std::shared_ptr<CorpusGeneration> generation) {
+    absl::MutexLock l(&mu_);
+    current_ = std::move(generation);
+  }
+
+ private:
+  mutable absl::Mutex mu_;
+  std::shared_ptr<CorpusGeneration> current_ ABSL_GUARDED_BY(mu_);
 };
 
 // Worker thread main function.
 void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args);
 
+// Reads corpus paths from the manifest file `path`, one per line. Empty lines
+// and lines starting with '#' are ignored.
+absl::StatusOr<std::vector<std::string>> ReadCorpusManifest(
+    const std::string &path);
+
+// Identifies a version of the file at `path`. Files are usually replaced by
+// renaming a new file into place, which changes the inode. Returns
+// {0, absl::InfinitePast()} if there is no such file.
+std::pair<ino_t, absl::Time> FileVersion(const std::string &path);
+
+// Reloads the corpora into `source` with `load_corpora` until `ctx` stops.
+// Reloads when `*reload_requested` is set, e.g. by a SIGHUP handler, and, if
+// `manifest` is not empty, when the manifest changes, which is checked every
+// `poll_interval`. The new corpora are read from the manifest or are
+// `corpora`. Worker threads keep running the old corpora while the new ones
+// are loaded.
+void CorpusReloader(
+    ExecutionContext *ctx, CorpusSource *source,
+    const std::vector<std::string> &corpora, const std::string &manifest,
+    absl::Duration poll_interval,
+    const std::function<absl::StatusOr<std::shared_ptr<CorpusGeneration>>(
+        const std::vector<std::string> &)> &load_corpora,
+    std::atomic<bool> *reload_requested);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SILIFUZZ_ORCHESTRATOR_H_
@@ -37,29 +37,54 @@
 // so we redirect stdout to an actual file.
 //
 // Assumption: Runner closes stdin.
+//
+// The corpora can be replaced without restarting the orchestrator. On SIGHUP,
+// or when the --corpus_manifest file changes, the new corpora are loaded in
+// the background and runner threads switch to them before their next run.
 
+#include <dirent.h>
 #include <errno.h>
 #include <sched.h>
 #include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <random>
+#include <set>
 #include <string>
 #include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
-#include "absl/functional/bind_front.h"
 #include "absl/log/flags.h"
 #include "absl/log/initialize.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./orchestrator/corpus_cache.h"
 #include "./orchestrator/corpus_util.h"
+#include "./orchestrator/phase_profile.h"
 #include "./orchestrator/result_collector.h"
 #include "./orchestrator/silifuzz_orchestrator.h"
 #include "./proto/corpus_metadata.pb.h"
@@ -67,6 +92,7 @@
 #include "./runner/driver/runner_options.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
+#include "./util/owned_file_descriptor.h"
 #include "./util/proto_util.h"
 
 ABSL_FLAG(absl::Duration, duration, absl::InfiniteDuration(),
@@ -75,6 +101,15 @@ ABSL_FLAG(size_t, max_cpus, 0,
           "Number of concurrent jobs. When 0 (default) use all available CPUs");
 ABSL_FLAG(absl::Duration, per_runner_cpu_time_budget, absl::Seconds(10),
           "Per-runner cpu time budget");
+ABSL_FLAG(absl::Duration, max_per_runner_cpu_time_budget, absl::Seconds(60),
+          "Upper bound of the per-runner cpu time budget when budgets are "
+          "adapted to corpora with a large startup overhead. When not above "
+          "--per_runner_cpu_time_budget, all runners get that budget.");
+ABSL_FLAG(double, target_useful_work_ratio, 0.9,
+          "Fraction of each runner invocation that should be spent executing "
+          "snapshots rather than starting up. Runner budgets of corpora with "
+          "a larger overhead are raised up to "
+          "--max_per_runner_cpu_time_budget.");
 ABSL_FLAG(absl::Duration, worker_thread_delay, absl::ZeroDuration(),
           "Delay between starting consecutive worker threads.");
 ABSL_FLAG(std::string, runner, "",
@@ -99,6 +134,33 @@ ABSL_FLAG(std::string, orchestrator_version, "",
 ABSL_FLAG(absl::Duration, watchdog_allowed_overrun, absl::ZeroDuration(),
           "When > 0, a watchdog thread will terminate this process after "
           "exceeding duration+overrun");
+ABSL_FLAG(uint64_t, runner_max_failures, 1,
+          "Number of failed snapshots after which a runner stops. When > 1, "
+          "runners continue after a failure and report all failures.");
+ABSL_FLAG(size_t, runner_server_pool_size, 0,
+          "Number of persistent runner processes per worker thread that are "
+          "reused across runs of the same corpus. 0 starts a new runner for "
+          "every run. Ignored in sequential mode.");
+ABSL_FLAG(std::string, corpus_cache_dir, "",
+          "If not empty, a directory to cache decompressed corpora in across "
+          "restarts. Created if it does not exist.");
+ABSL_FLAG(std::string, corpus_manifest, "",
+          "If not empty, a file listing the corpora to run, one per line, "
+          "instead of the corpus arguments. The corpora are reloaded when the "
+          "file changes.");
+ABSL_FLAG(absl::Duration, corpus_manifest_poll_interval, absl::Seconds(30),
+          "How often to check --corpus_manifest for changes.");
+ABSL_FLAG(bool, numa_local_corpora, false,
+          "If true and --max_cpus is 0, pins worker threads to their CPUs and "
+          "gives each NUMA node a copy of the corpora in its local memory.");
+ABSL_FLAG(absl::Duration, phase_profile_log_interval, absl::InfiniteDuration(),
+          "How often to log how long the orchestrator spends in each phase of "
+          "its work. The profile is always logged at exit and included in "
+          "the session summary.");
+ABSL_FLAG(bool, cosched_smt_siblings, false,
+          "If true and --max_cpus is 0, runs the SMT siblings of each core as "
+          "one co-scheduling group, so that Snaps of the runners on a core "
+          "execute at the same time. Disables --runner_server_pool_size.");
 
 namespace silifuzz {
 
@@ -125,6 +187,135 @@ std::vector<int> AvailableCpus() {
   return available_cpus;
 }
 
+// Returns the NUMA node of `cpu` or -1 if unknown.
+int NumaNodeOfCpu(int cpu) {
+  const std::string cpu_dir =
+      absl::StrCat("/sys/devices/system/cpu/cpu", cpu);
+  DIR *dir = opendir(cpu_dir.c_str());
+  if (dir == nullptr) {
+    return -1;
+  }
+  int node = -1;
+  while (const struct dirent *entry = readdir(dir)) {
+    absl::string_view name = entry->d_name;
+    if (absl::ConsumePrefix(&name, "node") && absl::SimpleAtoi(name, &node)) {
+      break;
+    }
+    node = -1;
+  }
+  closedir(dir);
+  return node;
+}
+
+// Returns the SMT siblings of `cpu`, including `cpu`, in ascending order.
+// Returns just `cpu` if the siblings are unknown.
+std::vector<int> SmtSiblingsOfCpu(int cpu) {
+  const std::string path = absl::StrCat(
+      "/sys/devices/system/cpu/cpu", cpu, "/topology/thread_siblings_list");
+  std::ifstream file(path);
+  std::string list;
+  if (!std::getline(file, list)) {
+    return {cpu};
+  }
+  // The list is like "0,64" or "0-1".
+  std::vector<int> siblings;
+  for (absl::string_view range :
+       absl::StrSplit(absl::StripAsciiWhitespace(list), ',')) {
+    std::pair<absl::string_view, absl::string_view> bounds =
+        absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first, last;
+    if (!absl::SimpleAtoi(bounds.first, &first)) {
+      return {cpu};
+    }
+    if (bounds.second.empty()) {
+      last = first;
+    } else if (!absl::SimpleAtoi(bounds.second, &last)) {
+      return {cpu};
+    }
+    for (int sibling = first; sibling <= last; ++sibling) {
+      siblings.push_back(sibling);
+    }
+  }
+  std::sort(siblings.begin(), siblings.end());
+  if (!std::binary_search(siblings.begin(), siblings.end(), cpu)) {
+    return {cpu};
+  }
+  return siblings;
+}
+
+// Partitions `cpus` into groups of available SMT siblings. Each group starts
+// with its lowest CPU.
+std::vector<std::vector<int>> SmtSiblingGroups(const std::vector<int> &cpus) {
+  const std::set<int> available(cpus.begin(), cpus.end());
+  std::set<int> grouped;
+  std::vector<std::vector<int>> groups;
+  for (int cpu : available) {
+    if (grouped.count(cpu) > 0) {
+      continue;
+    }
+    std::vector<int> group;
+    for (int sibling : SmtSiblingsOfCpu(cpu)) {
+      if (available.count(sibling) > 0 && grouped.insert(sibling).second) {
+        group.push_back(sibling);
+      }
+    }
+    groups.push_back(std::move(group));
+  }
+  return groups;
+}
+
+// Returns the NUMA node holding most of the sampled pages of the shared
+// memory file `fd` or -1 if unknown.
+int NumaNodeOfSharedMemoryFile(int fd) {
+  constexpr size_t kMaxSampledPages = 64;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    return -1;
+  }
+  const size_t page_size = getpagesize();
+  const size_t num_pages = (st.st_size + page_size - 1) / page_size;
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    return -1;
+  }
+  const size_t num_samples = std::min(num_pages, kMaxSampledPages);
+  std::vector<void *> pages(num_samples);
+  for (size_t i = 0; i < num_samples; ++i) {
+    char *page =
+        static_cast<char *>(addr) + (i * num_pages / num_samples) * page_size;
+    // move_pages(2) only reports pages mapped by this process.
+    *static_cast<volatile char *>(page);
+    pages[i] = page;
+  }
+  std::vector<int> status(num_samples, -1);
+  std::map<int, size_t> pages_per_node;
+  if (syscall(SYS_move_pages, 0, num_samples, pages.data(), nullptr,
+              status.data(), 0) == 0) {
+    for (int node : status) {
+      if (node >= 0) ++pages_per_node[node];
+    }
+  }
+  munmap(addr, st.st_size);
+  int node = -1;
+  size_t max_pages = 0;
+  for (const auto &[n, num_node_pages] : pages_per_node) {
+    if (num_node_pages > max_pages) {
+      node = n;
+      max_pages = num_node_pages;
+    }
+  }
+  return node;
+}
+
+// Returns NumaNodeOfSharedMemoryFile() of each corpus in `corpora`.
+std::vector<int> CorpusNumaNodes(const LoadCorporaResult &corpora) {
+  std::vector<int> nodes;
+  for (const OwnedFileDescriptor &fd : corpora.file_descriptors) {
+    nodes.push_back(NumaNodeOfSharedMemoryFile(*fd));
+  }
+  return nodes;
+}
+
 // Initializes the orchestrator environment.
 ExecutionContext *OrchestratorInit(
     absl::Time deadline, int num_threads,
@@ -153,6 +344,66 @@ ExecutionContext *OrchestratorInit(
   return &ctx;
 }
 
+// Loads `corpora` into a new CorpusGeneration. With `numa_local_corpora`,
+// each NUMA node in `numa_node_cpus` also gets a copy of the corpora.
+absl::StatusOr<std::shared_ptr<CorpusGeneration>> LoadCorpusGeneration(
+    const std::vector<std::string> &corpora, const CorpusCache *cache,
+    bool sequential_mode, const std::map<int, std::vector<int>> &numa_node_cpus,
+    bool numa_local_corpora) {
+  // Corpus files of the generation.
+  struct CorpusFiles {
+    LoadCorporaResult corpora;
+    std::vector<LoadCorporaResult> copies;
+  };
+  auto files = std::make_shared<CorpusFiles>();
+  ASSIGN_OR_RETURN_IF_NOT_OK(files->corpora, LoadCorpora(corpora, cache));
+  auto generation = std::make_shared<CorpusGeneration>(
+      files->corpora.file_descriptor_paths, files->corpora.file_sizes,
+      sequential_mode);
+  generation->corpus_paths = corpora;
+  if (numa_local_corpora && numa_node_cpus.size() > 1) {
+    for (const auto &[node, node_cpus] : numa_node_cpus) {
+      absl::StatusOr<LoadCorporaResult> copies_or =
+          CopyCorpora(files->corpora, node_cpus);
+      if (!copies_or.ok()) {
+        return absl::Status(copies_or.status().code(),
+                            absl::StrCat("Cannot copy corpora to NUMA node ",
+                                         node, ": ",
+                                         copies_or.status().message()));
+      }
+      generation->local_corpora[node] = copies_or->file_descriptor_paths;
+      generation->corpus_numa_nodes[node] = CorpusNumaNodes(*copies_or);
+      files->copies.push_back(*std::move(copies_or));
+    }
+    LOG_INFO("Copied corpora to ", files->copies.size(), " NUMA nodes");
+  }
+  if (!numa_node_cpus.empty()) {
+    generation->corpus_numa_nodes[-1] = CorpusNumaNodes(files->corpora);
+  }
+  generation->resources = std::move(files);
+  return generation;
+}
+
+// Set by SIGHUP to reload the corpora.
+std::atomic<bool> reload_requested = false;
+
+// Returns the histograms of all `profiles` combined.
+PhaseHistograms MergePhaseProfiles(const std::vector<PhaseProfile> &profiles) {
+  PhaseHistograms histograms = {};
+  for (const PhaseProfile &profile : profiles) {
+    profile.AddTo(histograms);
+  }
+  return histograms;
+}
+
+// Logs `histograms`, one phase per line.
+void LogPhaseHistograms(const PhaseHistograms &histograms) {
+  for (size_t i = 0; i < histograms.size(); ++i) {
+    LOG_INFO("Phase ", EnumStr(static_cast<OrchestratorPhase>(i)), ": ",
+             histograms[i].DebugString());
+  }
+}
+
 absl::Status LogSessionSummary(ResultCollector &result_collector) {
   VLOG_INFO(0, "Logging session summary");
   std::string corpus_metadata_file = absl::GetFlag(FLAGS_corpus_metadata_file);
@@ -169,60 +420,186 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
 
   const absl::Time start_time = absl::Now();
   absl::Time deadline = start_time + absl::GetFlag(FLAGS_duration);
-  // Load corpora and exit if there is any error.
-  // File descriptors of the uncompressed corpora are kept open
-  // until corpus_fds goes out of scope.
-  const absl::StatusOr<LoadCorporaResult> load_corpora_result_or =
-      LoadCorpora(corpora);
-  if (!load_corpora_result_or.ok()) {
-    LOG_ERROR("Cannot load corpora: ",
-              load_corpora_result_or.status().message());
-    return EXIT_FAILURE;
-  }
-
-  const std::vector<std::string> &uncompressed_corpus_paths =
-      load_corpora_result_or.value().file_descriptor_paths;
 
   size_t num_threads = absl::GetFlag(FLAGS_max_cpus);
   const absl::Duration runner_cpu_time_budget =
       absl::GetFlag(FLAGS_per_runner_cpu_time_budget);
   bool sequential_mode = absl::GetFlag(FLAGS_sequential_mode);
+  const uint64_t runner_max_failures = absl::GetFlag(FLAGS_runner_max_failures);
+  size_t runner_server_pool_size = absl::GetFlag(FLAGS_runner_server_pool_size);
+  bool cosched_smt_siblings = absl::GetFlag(FLAGS_cosched_smt_siblings);
   if (sequential_mode) {
     LOG_INFO("Running in sequential mode");
     num_threads = 1;
+    runner_server_pool_size = 0;
+    cosched_smt_siblings = false;
   }
-  std::vector<RunnerThreadArgs> thread_args;
+  if (cosched_smt_siblings && num_threads != 0) {
+    LOG_ERROR("--cosched_smt_siblings requires --max_cpus=0");
+    return EXIT_FAILURE;
+  }
+  if (cosched_smt_siblings && runner_server_pool_size > 0) {
+    LOG_INFO("Runner servers are disabled for co-scheduling groups");
+    runner_server_pool_size = 0;
+  }
+
+  // CPUs of each NUMA node and their counters. Only used when threads are
+  // bound to CPUs.
+  std::vector<int> cpus;
+  std::map<int, int> cpu_nodes;
+  std::map<int, std::vector<int>> numa_node_cpus;
+  std::map<int, NumaNodeCounters> numa_node_counters;
   if (num_threads == 0) {
-    std::vector<int> cpus = AvailableCpus();
+    cpus = AvailableCpus();
     num_threads = cpus.size();
     for (int cpu : cpus) {
+      cpu_nodes[cpu] = NumaNodeOfCpu(cpu);
+      numa_node_cpus[cpu_nodes[cpu]].push_back(cpu);
+    }
+  }
+  const bool numa_local_corpora =
+      !cpus.empty() && absl::GetFlag(FLAGS_numa_local_corpora);
+
+  // A runner in sequential mode runs each Snap once, however long it takes.
+  const double target_useful_work_ratio =
+      absl::GetFlag(FLAGS_target_useful_work_ratio);
+  std::optional<RunnerBudgets> runner_budgets;
+  if (!sequential_mode) {
+    if (target_useful_work_ratio < 0 || target_useful_work_ratio >= 1) {
+      LOG_ERROR("--target_useful_work_ratio must be in [0, 1)");
+      return EXIT_FAILURE;
+    }
+    runner_budgets.emplace(runner_cpu_time_budget,
+                           absl::GetFlag(FLAGS_max_per_runner_cpu_time_budget),
+                           target_useful_work_ratio);
+  }
+  RunnerBudgets *runner_budgets_ptr =
+      runner_budgets.has_value() ? &*runner_budgets : nullptr;
+
+  // One profile per worker thread, one for loading corpora and one for the
+  // thread that processes results, so that each has a single writer.
+  std::vector<PhaseProfile> phase_profiles(num_threads + 2);
+  PhaseProfile &load_profile = phase_profiles[num_threads];
+  PhaseProfile &result_profile = phase_profiles[num_threads + 1];
+
+  const std::string corpus_cache_dir = absl::GetFlag(FLAGS_corpus_cache_dir);
+  std::optional<CorpusCache> corpus_cache;
+  if (!corpus_cache_dir.empty()) {
+    corpus_cache.emplace(corpus_cache_dir);
+  }
+  // Corpora are loaded first by this thread and later by CorpusReloader,
+  // never concurrently.
+  auto load_corpora = [&](const std::vector<std::string> &paths) {
+    ScopedPhaseTimer timer(&load_profile, OrchestratorPhase::kLoadCorpora);
+    return LoadCorpusGeneration(
+        paths, corpus_cache.has_value() ? &*corpus_cache : nullptr,
+        sequential_mode, numa_node_cpus, numa_local_corpora);
+  };
+
+  // Each thread runs each corpus once in sequential mode. There is nothing
+  // to reload. Otherwise handle SIGHUP before loading the corpora, which can
+  // take long, so that it does not kill the orchestrator. A SIGHUP received
+  // in the meantime triggers a reload once CorpusReloader starts.
+  if (!sequential_mode) {
+    struct sigaction sigact = {};
+    sigact.sa_handler = [](int) { reload_requested = true; };
+    sigaction(SIGHUP, &sigact, nullptr);
+  }
+
+  // Load corpora and exit if there is any error. The corpus files are kept
+  // open while the generation is in use.
+  const std::string corpus_manifest = absl::GetFlag(FLAGS_corpus_manifest);
+  std::vector<std::string> corpus_paths = corpora;
+  if (!corpus_manifest.empty()) {
+    absl::StatusOr<std::vector<std::string>> paths_or =
+        ReadCorpusManifest(corpus_manifest);
+    if (!paths_or.ok()) {
+      LOG_ERROR("Cannot read corpus manifest: ", paths_or.status().message());
+      return EXIT_FAILURE;
+    }
+    corpus_paths = *std::move(paths_or);
+  }
+  absl::StatusOr<std::shared_ptr<CorpusGeneration>> generation_or =
+      load_corpora(corpus_paths);
+  if (!generation_or.ok()) {
+    LOG_ERROR("Cannot load corpora: ", generation_or.status().message());
+    return EXIT_FAILURE;
+  }
+  CorpusSource corpus_source(*std::move(generation_or));
+
+  std::vector<RunnerThreadArgs> thread_args;
+  if (!cpus.empty()) {
+    // Each co-scheduling group is driven by the thread of its first CPU.
+    std::vector<std::vector<int>> cpu_groups;
+    if (cosched_smt_siblings) {
+      cpu_groups = SmtSiblingGroups(cpus);
+      LOG_INFO("Running ", cpus.size(), " CPUs in ", cpu_groups.size(),
+               " co-scheduling groups");
+    } else {
+      for (int cpu : cpus) {
+        cpu_groups.push_back({cpu});
+      }
+    }
+    for (const std::vector<int> &cpu_group : cpu_groups) {
+      const int cpu = cpu_group.front();
       RunnerOptions runner_options = RunnerOptions::Default();
       runner_options.set_cpu(cpu)
           .set_cpu_time_bugdet(runner_cpu_time_budget)
+          .set_collect_stats(true)
+          .set_max_failures(runner_max_failures)
           .set_extra_argv(runner_extra_argv);
-      thread_args.push_back({.thread_idx = cpu,
-                             .runner = runner,
-                             .corpora = uncompressed_corpus_paths,
-                             .runner_options = runner_options});
+      thread_args.push_back({
+          .thread_idx = cpu,
+          .runner = runner,
+          .corpus_source = &corpus_source,
+          .numa_node = cpu_nodes[cpu],
+          .numa_node_counters = &numa_node_counters[cpu_nodes[cpu]],
+          .runner_budgets = runner_budgets_ptr,
+          .pin_to_cpu = numa_local_corpora,
+          .runner_options = runner_options,
+          .runner_server_pool_size = runner_server_pool_size,
+          .cosched_cpus = cpu_group.size() > 1 ? cpu_group : std::vector<int>(),
+      });
     }
   } else {
     for (int thread_idx = 0; thread_idx < num_threads; ++thread_idx) {
       RunnerOptions runner_options = RunnerOptions::Default();
       runner_options.set_cpu_time_bugdet(runner_cpu_time_budget)
           .set_sequential_mode(sequential_mode)
+          .set_collect_stats(true)
+          .set_max_failures(runner_max_failures)
           .set_extra_argv(runner_extra_argv);
       thread_args.push_back({.thread_idx = thread_idx,
                              .runner = runner,
-                             .corpora = uncompressed_corpus_paths,
-                             .runner_options = runner_options});
+                             .corpus_source = &corpus_source,
+                             .runner_budgets = runner_budgets_ptr,
+                             .runner_options = runner_options,
+                             .runner_server_pool_size =
+                                 runner_server_pool_size});
     }
   }
 
+  for (size_t i = 0; i < thread_args.size(); ++i) {
+    thread_args[i].phase_profile = &phase_profiles[i];
+  }
+
   ResultCollector result_collector(absl::GetFlag(FLAGS_binary_log_fd),
                                    start_time);
+  const absl::Duration phase_profile_log_interval =
+      absl::GetFlag(FLAGS_phase_profile_log_interval);
+  absl::Time next_phase_profile_log = start_time + phase_profile_log_interval;
   ExecutionContext *ctx = OrchestratorInit(
-      deadline, num_threads,
-      absl::bind_front(&ResultCollector::operator(), &result_collector));
+      deadline, num_threads, [&](const RunnerDriver::RunResult &result) {
+        {
+          ScopedPhaseTimer timer(&result_profile,
+                                 OrchestratorPhase::kLogResult);
+          result_collector(result);
+        }
+        if (absl::Now() >= next_phase_profile_log) {
+          next_phase_profile_log = absl::Now() + phase_profile_log_interval;
+          LogPhaseHistograms(MergePhaseProfiles(phase_profiles));
+        }
+      });
 
   absl::Duration staggering_delay = absl::GetFlag(FLAGS_worker_thread_delay);
   // Create worker threads.
@@ -236,8 +613,20 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
     absl::SleepFor(staggering_delay);
   }
 
+  std::thread reloader;
+  if (!sequential_mode) {
+    reloader = std::thread(CorpusReloader, ctx, &corpus_source, corpora,
+                           corpus_manifest,
+                           absl::GetFlag(FLAGS_corpus_manifest_poll_interval),
+                           load_corpora, &reload_requested);
+  }
+
   ctx->EventLoop();
 
+  if (reloader.joinable()) {
+    reloader.join();
+  }
+
   // Join worker threads.
   for (size_t thread_idx = 0; thread_idx < threads.size(); ++thread_idx) {
     if (threads[thread_idx].joinable()) {
@@ -246,6 +635,35 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
     }
   }
   ctx->ProcessResultQueue();
+  result_collector.set_result_queue_stats(ctx->result_queue_stats());
+  std::vector<NumaNodeStats> numa_node_stats;
+  const double elapsed_seconds =
+      absl::ToDoubleSeconds(absl::Now() - start_time);
+  for (const auto &[node, counters] : numa_node_counters) {
+    NumaNodeStats stats = {
+        .node = node,
+        .num_cpus = numa_node_cpus[node].size(),
+        .num_runner_invocations = counters.num_runner_invocations,
+        .num_snap_executions = counters.num_snap_executions,
+        .num_remote_corpus_runs = counters.num_remote_corpus_runs,
+    };
+    LOG_INFO("NUMA node ", node, ": cpus: ", stats.num_cpus,
+             " snap executions/s: ",
+             static_cast<uint64_t>(stats.num_snap_executions /
+                                   std::max(elapsed_seconds, 1.0)),
+             " runs: ", stats.num_runner_invocations,
+             " remote corpus runs: ", stats.num_remote_corpus_runs);
+    numa_node_stats.push_back(stats);
+  }
+  result_collector.set_numa_node_stats(numa_node_stats);
+  if (runner_budgets.has_value()) {
+    LOG_INFO("Useful work ratio: ", runner_budgets->useful_ratio());
+    result_collector.set_useful_work_ratio(runner_budgets->useful_ratio());
+  }
+  const PhaseHistograms phase_histograms = MergePhaseProfiles(phase_profiles);
+  LogPhaseHistograms(phase_histograms);
+  result_collector.set_phase_histograms(phase_histograms);
+  result_collector.FlushRepeatedFailures();
   result_collector.LogSummary(true);
   double log_session_summary_probability =
       absl::GetFlag(FLAGS_log_session_summary_probability);
@@ -292,8 +710,14 @@ int main(int argc, char **argv) {
   for (size_t i = 1; i < remaining_args.size(); ++i) {
     corpora.push_back(remaining_args[i]);
   }
-  if (corpora.empty()) {
-    std::cerr << "At least one corpus file must be preset" << std::endl;
+  if (absl::GetFlag(FLAGS_corpus_manifest).empty()) {
+    if (corpora.empty()) {
+      std::cerr << "At least one corpus file must be preset" << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (!corpora.empty()) {
+    std::cerr << "Corpus files cannot be used with --corpus_manifest"
+              << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -14,21 +14,41 @@
 
 #include "./orchestrator/silifuzz_orchestrator.h"
 
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
 #include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./orchestrator/result_collector.h"
 #include "./runner/driver/runner_driver.h"
+#include "./util/testing/status_matchers.h"
 
 namespace silifuzz {
 namespace {
-using testing::Contains;
-using testing::ElementsAre;
-using testing::IsSupersetOf;
+using silifuzz::testing::IsOkAndHolds;
+using silifuzz::testing::StatusIs;
+using ::testing::Contains;
+using ::testing::ElementsAre;
+using ::testing::IsSupersetOf;
 
 TEST(ExecutionContext, Simple) {
   int results_processed = 0;
@@ -52,9 +72,59 @@ TEST(ExecutionContext, Expired) {
 TEST(ExecutionContext, QueueSizeLimit) {
   ExecutionContext ctx(absl::InfiniteFuture(), 1,
                        [](const RunnerDriver::RunResult& r) {});
-  ASSERT_TRUE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
+  EXPECT_EQ(ctx.result_queue_capacity(),
+            ExecutionContext::kResultSlotsPerThread);
+  for (size_t i = 0; i < ctx.result_queue_capacity(); ++i) {
+    ASSERT_TRUE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
+  }
+  // A full queue only drops results once the execution stops.
+  ctx.Stop();
   ASSERT_FALSE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
   ctx.ProcessResultQueue();
+  ResultQueueStats stats = ctx.result_queue_stats();
+  EXPECT_EQ(stats.num_offers, ctx.result_queue_capacity());
+  EXPECT_EQ(stats.num_dropped_offers, 1);
+  EXPECT_EQ(stats.high_water_mark, ctx.result_queue_capacity());
+}
+
+TEST(ExecutionContext, Backpressure) {
+  int results_processed = 0;
+  ExecutionContext ctx(absl::InfiniteFuture(), 1,
+                       [&results_processed](const RunnerDriver::RunResult& r) {
+                         results_processed++;
+                       });
+  const size_t num_offers = 3 * ctx.result_queue_capacity();
+  std::thread worker([&ctx, num_offers]() {
+    for (size_t i = 0; i < num_offers; ++i) {
+      ASSERT_TRUE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
+    }
+    ctx.Stop();
+  });
+  ctx.EventLoop();
+  worker.join();
+  ctx.ProcessResultQueue();
+  // Nothing is dropped while the event loop is running.
+  EXPECT_EQ(results_processed, num_offers);
+  ResultQueueStats stats = ctx.result_queue_stats();
+  EXPECT_EQ(stats.num_offers, num_offers);
+  EXPECT_EQ(stats.num_dropped_offers, 0);
+  EXPECT_LE(stats.high_water_mark, ctx.result_queue_capacity());
+}
+
+TEST(ExecutionContext, MultipleResults) {
+  int results_processed = 0;
+  ExecutionContext ctx(absl::InfiniteFuture(), 1,
+                       [&results_processed](const RunnerDriver::RunResult& r) {
+                         results_processed++;
+                       });
+  std::vector<RunnerDriver::RunResult> results(
+      3, RunnerDriver::RunResult::Successful());
+  // Each invocation takes a single slot regardless of its number of results.
+  ASSERT_TRUE(ctx.OfferRunResults(results));
+  ASSERT_TRUE(ctx.OfferRunResults(results));
+  EXPECT_EQ(ctx.result_queue_stats().high_water_mark, 2);
+  ctx.ProcessResultQueue();
+  EXPECT_EQ(results_processed, 6);
 }
 
 TEST(ExecutionContext, Multithreaded) {
@@ -85,22 +155,39 @@ TEST(ExecutionContext, Multithreaded) {
   ASSERT_GT(posted, 0);
 }
 
-TEST(NextCorpusGenerator, Sequential) {
-  NextCorpusGenerator gen({"1", "2", "3"}, true, 0);
+TEST(CorpusScheduler, Sequential) {
+  CorpusScheduler scheduler({"1", "2", "3"}, {}, true);
   std::vector<std::string> actual;
   for (int i = 0; i < 5; ++i) {
-    actual.push_back(gen());
+    actual.push_back(scheduler.Next(0));
   }
   ASSERT_THAT(actual, ElementsAre("1", "2", "3", "", ""));
+
+  // Every thread gets each corpus once, starting at a different one.
+  actual.clear();
+  for (int i = 0; i < 4; ++i) {
+    actual.push_back(scheduler.Next(1));
+  }
+  ASSERT_THAT(actual, ElementsAre("2", "3", "1", ""));
+}
+
+TEST(CorpusScheduler, NextIndex) {
+  CorpusScheduler scheduler({"1", "2", "3"}, {}, true);
+  std::vector<std::optional<size_t>> actual;
+  for (int i = 0; i < 4; ++i) {
+    actual.push_back(scheduler.NextIndex(2));
+  }
+  ASSERT_THAT(actual, ElementsAre(2, 0, 1, std::nullopt));
+  EXPECT_EQ(scheduler.corpus(2), "3");
+  EXPECT_EQ(scheduler.pick_count(2), 1);
 }
 
-TEST(NextCorpusGenerator, Random) {
+TEST(CorpusScheduler, Random) {
   std::vector<std::string> src = {"1", "2", "3"};
   std::vector<std::string> result;
-  NextCorpusGenerator gen(src, false, 0);
-  std::vector<std::string> actual;
+  CorpusScheduler scheduler(src, {}, false);
   for (int i = 0; i < 100; ++i) {
-    std::string v = gen();
+    std::string v = scheduler.Next(i % 4);
     result.push_back(v);
     ASSERT_THAT(src, Contains(v));
   }
@@ -109,6 +196,194 @@ TEST(NextCorpusGenerator, Random) {
          "of the source at least once";
 }
 
+TEST(CorpusScheduler, Weighted) {
+  CorpusScheduler scheduler({"1", "2", "3"}, {100, 200, 700}, false);
+  for (int i = 0; i < 1000; ++i) {
+    scheduler.Next(i % 8);
+  }
+  // Picks are proportional to weights.
+  EXPECT_NEAR(scheduler.pick_count(0), 100, 2);
+  EXPECT_NEAR(scheduler.pick_count(1), 200, 2);
+  EXPECT_NEAR(scheduler.pick_count(2), 700, 2);
+}
+
+TEST(CorpusScheduler, SingleThreadCyclesThroughCorpora) {
+  CorpusScheduler scheduler({"1", "2", "3"}, {}, false);
+  std::vector<std::string> actual;
+  for (int i = 0; i < 6; ++i) {
+    actual.push_back(scheduler.Next(0));
+  }
+  ASSERT_THAT(actual, ElementsAre("1", "2", "3", "1", "2", "3"));
+}
+
+TEST(RunnerBudgets, Adapt) {
+  RunnerBudgets budgets(absl::Seconds(10), absl::Seconds(60), 0.9);
+  EXPECT_EQ(budgets.Budget("small"), absl::Seconds(10));
+  EXPECT_EQ(budgets.useful_ratio(), 0.0);
+
+  // 0.1s of overhead fits in the minimum budget.
+  budgets.Record("small", absl::Seconds(10), 1000, 990);
+  EXPECT_EQ(budgets.Budget("small"), absl::Seconds(10));
+
+  // 2.5s of overhead needs 25s.
+  budgets.Record("large", absl::Seconds(10), 1000, 750);
+  EXPECT_EQ(budgets.Budget("large"), absl::Seconds(25));
+  EXPECT_EQ(budgets.Budget("small"), absl::Seconds(10));
+  EXPECT_DOUBLE_EQ(budgets.useful_ratio(), (990.0 + 750) / 2000);
+
+  // The overhead is averaged over invocations.
+  budgets.Record("large", absl::Seconds(25), 1000, 1000);
+  EXPECT_EQ(budgets.Budget("large"), absl::Seconds(19));
+
+  // Budgets are capped.
+  budgets.Record("huge", absl::Seconds(100), 1000, 0);
+  EXPECT_EQ(budgets.Budget("huge"), absl::Seconds(60));
+}
+
+TEST(CorpusSource, Replace) {
+  auto first = std::make_shared<CorpusGeneration>(
+      std::vector<std::string>{"1"}, std::vector<uint64_t>{}, false);
+  auto resources = std::make_shared<int>(0);
+  first->resources = resources;
+  CorpusSource source(first);
+  EXPECT_EQ(source.Current()->scheduler.Next(0), "1");
+
+  // Threads keep the old generation alive until they switch.
+  std::shared_ptr<CorpusGeneration> in_use = source.Current();
+  first.reset();
+  source.Replace(std::make_shared<CorpusGeneration>(
+      std::vector<std::string>{"2", "3"}, std::vector<uint64_t>{}, false));
+  EXPECT_EQ(source.Current()->scheduler.Next(0), "2");
+  EXPECT_EQ(in_use->scheduler.Next(0), "1");
+  EXPECT_EQ(resources.use_count(), 2);
+  in_use.reset();
+  EXPECT_EQ(resources.use_count(), 1);
+}
+
+// Writes `contents` to a temp file and renames it to `path`.
+void ReplaceFile(const std::string& path, absl::string_view contents) {
+  const std::string temp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream file(temp_path);
+    file << contents;
+  }
+  ASSERT_EQ(rename(temp_path.c_str(), path.c_str()), 0);
+}
+
+std::string TempPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(ReadCorpusManifest, Simple) {
+  const std::string path = TempPath("ReadCorpusManifest");
+  EXPECT_THAT(ReadCorpusManifest(path),
+              StatusIs(absl::StatusCode::kNotFound));
+
+  ReplaceFile(path, "# Corpora\n/a.xz\n\n  /b.xz \n# /c.xz\n");
+  EXPECT_THAT(ReadCorpusManifest(path),
+              IsOkAndHolds(ElementsAre("/a.xz", "/b.xz")));
+
+  ReplaceFile(path, "# No corpora\n\n");
+  EXPECT_THAT(ReadCorpusManifest(path),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(FileVersion, Simple) {
+  const std::string path = TempPath("FileVersion");
+  const auto missing = FileVersion(path);
+  EXPECT_EQ(missing, std::make_pair(ino_t{0}, absl::InfinitePast()));
+
+  ReplaceFile(path, "1");
+  const auto first = FileVersion(path);
+  EXPECT_NE(first, missing);
+  EXPECT_EQ(FileVersion(path), first);
+
+  // Renaming a new file into place is a new version.
+  ReplaceFile(path, "2");
+  EXPECT_NE(FileVersion(path), first);
+}
+
+// Waits up to 10 seconds for `condition` to hold.
+bool WaitFor(const std::function<bool()>& condition) {
+  const absl::Time deadline = absl::Now() + absl::Seconds(10);
+  while (!condition()) {
+    if (absl::Now() > deadline) return false;
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  return true;
+}
+
+TEST(CorpusReloader, Simple) {
+  ExecutionContext ctx(absl::InfiniteFuture(), 1,
+                       [](const RunnerDriver::RunResult& r) {});
+  CorpusSource source(std::make_shared<CorpusGeneration>(
+      std::vector<std::string>{"initial"}, std::vector<uint64_t>{}, false));
+  const std::string manifest = TempPath("CorpusReloader");
+  ReplaceFile(manifest, "first\n");
+  std::atomic<int> num_loads = 0;
+  auto load_corpora = [&num_loads](const std::vector<std::string>& paths)
+      -> absl::StatusOr<std::shared_ptr<CorpusGeneration>> {
+    ++num_loads;
+    if (paths.front() == "bad") {
+      return absl::InternalError("Cannot load");
+    }
+    auto generation = std::make_shared<CorpusGeneration>(
+        paths, std::vector<uint64_t>{}, false);
+    generation->corpus_paths = paths;
+    return generation;
+  };
+  auto current_path = [&source] {
+    const std::vector<std::string>& paths = source.Current()->corpus_paths;
+    return paths.empty() ? std::string() : paths.front();
+  };
+  std::atomic<bool> reload_requested = false;
+  std::thread reloader(CorpusReloader, &ctx, &source,
+                       std::vector<std::string>{"flag"}, manifest,
+                       absl::Milliseconds(10), load_corpora,
+                       &reload_requested);
+
+  // The manifest is read on request even if it has not changed.
+  reload_requested = true;
+  EXPECT_TRUE(WaitFor([&] { return current_path() == "first"; }));
+  EXPECT_FALSE(reload_requested);
+
+  // Changes of the manifest are picked up.
+  ReplaceFile(manifest, "second\n");
+  EXPECT_TRUE(WaitFor([&] { return current_path() == "second"; }));
+
+  // The old corpora are kept if the new ones cannot be loaded.
+  const int num_good_loads = num_loads;
+  ReplaceFile(manifest, "bad\n");
+  EXPECT_TRUE(WaitFor([&] { return num_loads > num_good_loads; }));
+  EXPECT_EQ(current_path(), "second");
+
+  ctx.Stop();
+  reloader.join();
+}
+
+TEST(CorpusReloader, WithoutManifest) {
+  ExecutionContext ctx(absl::InfiniteFuture(), 1,
+                       [](const RunnerDriver::RunResult& r) {});
+  CorpusSource source(std::make_shared<CorpusGeneration>(
+      std::vector<std::string>{"initial"}, std::vector<uint64_t>{}, false));
+  std::atomic<bool> reload_requested = true;
+  std::thread reloader(
+      CorpusReloader, &ctx, &source, std::vector<std::string>{"flag"}, "",
+      absl::Milliseconds(10),
+      [](const std::vector<std::string>& paths)
+          -> absl::StatusOr<std::shared_ptr<CorpusGeneration>> {
+        return std::make_shared<CorpusGeneration>(
+            paths, std::vector<uint64_t>{}, false);
+      },
+      &reload_requested);
+  // The corpora passed to the reloader are loaded again.
+  EXPECT_TRUE(WaitFor([&] {
+    return source.Current()->scheduler.Next(0) == "flag";
+  }));
+  ctx.Stop();
+  reloader.join();
+}
+
 }  // namespace
 
 }  // namespace silifuzz
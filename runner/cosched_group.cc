@@ -0,0 +1,125 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/cosched_group.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include "./runner/runner_stats.h"
+#include "./util/checks.h"
+#include "./util/itoa.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Tells the CPU that this is a spin-wait loop. On an SMT core this also gives
+// execution resources to the sibling hyperthread.
+inline void CpuRelax() {
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+#error "Unsupported architecture"
+#endif
+}
+
+}  // namespace
+
+CoschedGroup* MapCoschedGroupFile(const char* path) {
+  int fd = open(path, O_RDWR);
+  if (fd < 0) {
+    LOG_ERROR("open(", path, "): ", ErrnoStr(errno));
+    return nullptr;
+  }
+  void* addr = mmap(nullptr, sizeof(CoschedGroup), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file is closed.
+  CHECK_EQ(close(fd), 0);
+  if (addr == MAP_FAILED) {
+    LOG_ERROR("mmap(", path, "): ", ErrnoStr(errno));
+    return nullptr;
+  }
+  return reinterpret_cast<CoschedGroup*>(addr);
+}
+
+bool CoschedGroupWait(CoschedGroup* group, size_t group_size,
+                      uint64_t timeout_ticks) {
+  if (__atomic_load_n(&group->broken, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  // The generation must be read before arriving. Once the last member
+  // arrives, it may start the next generation at any time.
+  const uint32_t generation =
+      __atomic_load_n(&group->generation, __ATOMIC_ACQUIRE);
+  const uint32_t num_arrived =
+      __atomic_add_fetch(&group->num_arrived, 1, __ATOMIC_ACQ_REL);
+  if (num_arrived == group_size) {
+    __atomic_store_n(&group->num_arrived, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&group->generation, generation + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  const uint64_t deadline_ticks = ReadTickCounter() + timeout_ticks;
+  while (__atomic_load_n(&group->generation, __ATOMIC_ACQUIRE) == generation) {
+    if (__atomic_load_n(&group->broken, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    if (ReadTickCounter() >= deadline_ticks) {
+      CoschedGroupLeave(group);
+      return false;
+    }
+    CpuRelax();
+  }
+  return true;
+}
+
+void CoschedGroupLeave(CoschedGroup* group) {
+  __atomic_store_n(&group->broken, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t TickCounterFrequency() {
+#if defined(__x86_64__)
+  auto now_ns = []() -> uint64_t {
+    struct timespec ts;
+    CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+    return ts.tv_sec * uint64_t{1000000000} + ts.tv_nsec;
+  };
+  constexpr uint64_t kCalibrationNs = 10000000;
+  const uint64_t start_ns = now_ns();
+  const uint64_t start_ticks = ReadTickCounter();
+  uint64_t elapsed_ns;
+  do {
+    elapsed_ns = now_ns() - start_ns;
+  } while (elapsed_ns < kCalibrationNs);
+  const uint64_t elapsed_ticks = ReadTickCounter() - start_ticks;
+  return elapsed_ticks * 1000000000 / elapsed_ns;
+#elif defined(__aarch64__)
+  uint64_t frequency;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+  return frequency;
+#else
+#error "Unsupported architecture"
+#endif
+}
+
+}  // namespace silifuzz
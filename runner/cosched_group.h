@@ -0,0 +1,75 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_COSCHED_GROUP_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_COSCHED_GROUP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace silifuzz {
+
+// State shared by a group of runner processes that execute Snaps at the same
+// time, typically on sibling hyperthreads of one physical core. Each member
+// runs a disjoint slice of the corpus and the members meet at a spin barrier
+// before every batch, so that Snaps of different members contend for the same
+// core. Members are separate processes, so their Snap memory never conflicts.
+//
+// The struct lives in a page shared by all members. A zero-filled page is a
+// valid initial state, so the parent only needs to create and size the file.
+struct CoschedGroup {
+  // Number of members that reached the barrier in the current generation.
+  uint32_t num_arrived;
+
+  // Incremented by the last member to reach the barrier, which releases the
+  // others.
+  uint32_t generation;
+
+  // Set once a member leaves the group early or gives up waiting. From then
+  // on the barrier does not block and members run independently.
+  uint32_t broken;
+
+  // Make the unused space in this struct explicit.
+  uint32_t padding;
+};
+
+// The members share a single page.
+static_assert(sizeof(CoschedGroup) <= 4096);
+
+// Maps the first page of the file at `path` as a shared CoschedGroup. Returns
+// nullptr and logs an error on failure.
+//
+// This makes syscalls and must be called before entering the seccomp sandbox.
+CoschedGroup* MapCoschedGroupFile(const char* path);
+
+// Waits until all `group_size` members of `group` call this function or
+// until `timeout_ticks` ReadTickCounter() ticks pass. Returns true if all
+// members arrived. Returns false if the group is broken, in which case the
+// caller should continue without waiting for the others. A timeout breaks the
+// group for all members.
+bool CoschedGroupWait(CoschedGroup* group, size_t group_size,
+                      uint64_t timeout_ticks);
+
+// Breaks `group` so that the other members stop waiting for this one.
+void CoschedGroupLeave(CoschedGroup* group);
+
+// Returns the number of ReadTickCounter() ticks per second. On x86_64, this
+// measures the TSC against CLOCK_MONOTONIC, which takes about 10ms.
+//
+// This makes syscalls and must be called before entering the seccomp sandbox.
+uint64_t TickCounterFrequency();
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_COSCHED_GROUP_H_
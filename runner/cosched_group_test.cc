@@ -0,0 +1,72 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/cosched_group.h"
+
+#include <cstdint>
+
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+
+// ========================================================================= //
+
+namespace silifuzz {
+namespace {
+
+TEST(CoschedGroup, SingleMember) {
+  CoschedGroup group = {};
+  for (int i = 0; i < 3; ++i) {
+    CHECK(CoschedGroupWait(&group, 1, /*timeout_ticks=*/0));
+  }
+  CHECK_EQ(group.generation, 3);
+  CHECK_EQ(group.num_arrived, 0);
+}
+
+TEST(CoschedGroup, LastMemberReleasesOthers) {
+  CoschedGroup group = {};
+  // Pretend the other member is already waiting.
+  group.num_arrived = 1;
+  CHECK(CoschedGroupWait(&group, 2, /*timeout_ticks=*/0));
+  CHECK_EQ(group.generation, 1);
+  CHECK_EQ(group.num_arrived, 0);
+  CHECK_EQ(group.broken, 0);
+}
+
+TEST(CoschedGroup, TimeoutBreaksGroup) {
+  CoschedGroup group = {};
+  CHECK(!CoschedGroupWait(&group, 2, /*timeout_ticks=*/1000));
+  CHECK_EQ(group.broken, 1);
+  // A broken group does not block any more.
+  group.num_arrived = 1;
+  CHECK(!CoschedGroupWait(&group, 2, /*timeout_ticks=*/0));
+  CHECK_EQ(group.generation, 0);
+}
+
+TEST(CoschedGroup, Leave) {
+  CoschedGroup group = {};
+  CoschedGroupLeave(&group);
+  CHECK(!CoschedGroupWait(&group, 1, /*timeout_ticks=*/0));
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+// ========================================================================= //
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(CoschedGroup, SingleMember);
+  RUN_TEST(CoschedGroup, LastMemberReleasesOthers);
+  RUN_TEST(CoschedGroup, TimeoutBreaksGroup);
+  RUN_TEST(CoschedGroup, Leave);
+})
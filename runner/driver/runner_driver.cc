@@ -15,15 +15,22 @@
 #include "./runner/driver/runner_driver.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <optional>
 #include <string>
@@ -31,35 +38,657 @@
 #include <vector>
 
 #include "google/protobuf/text_format.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/cleanup/cleanup.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "./common/harness_tracer.h"
 #include "./common/snapshot.h"
 #include "./player/player_result_proto.h"
 #include "./proto/player_result.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
+#include "./runner/cosched_group.h"
 #include "./runner/driver/runner_options.h"
+#include "./runner/runner_fork_server_protocol.h"
+#include "./runner/runner_result_protocol.h"
+#include "./runner/runner_server_protocol.h"
+#include "./runner/runner_stats.h"
 #include "./snap/gen/relocatable_snap_generator.h"
 #include "./util/byte_io.h"
 #include "./util/checks.h"
+#include "./util/misc_util.h"
 #include "./util/mmapped_memory_ptr.h"
 #include "./util/subprocess.h"
 
 namespace silifuzz {
 
+// A RunnerStats page shared with a runner process. The runner opens the
+// memfd by path, in the same way as RunnerDriverFromSnapshot() passes the
+// corpus.
+class SharedRunnerStats {
+ public:
+  // Creates a zero-filled shared page.
+  static absl::StatusOr<std::unique_ptr<SharedRunnerStats>> Create() {
+    int memfd = memfd_create("runner_stats", O_RDWR | MFD_CLOEXEC);
+    if (memfd == -1) {
+      return absl::ErrnoToStatus(errno, "memfd_create");
+    }
+    auto shared_stats = absl::WrapUnique(new SharedRunnerStats(memfd));
+    if (ftruncate(memfd, sizeof(RunnerStats)) != 0) {
+      return absl::ErrnoToStatus(errno, "ftruncate");
+    }
+    void* addr = mmap(nullptr, sizeof(RunnerStats), PROT_READ, MAP_SHARED,
+                      memfd, 0);
+    if (addr == MAP_FAILED) {
+      return absl::ErrnoToStatus(errno, "mmap");
+    }
+    shared_stats->stats_ = reinterpret_cast<const RunnerStats*>(addr);
+    return shared_stats;
+  }
+
+  ~SharedRunnerStats() {
+    if (stats_ != nullptr) {
+      munmap(const_cast<RunnerStats*>(stats_), sizeof(RunnerStats));
+    }
+    close(memfd_);
+  }
+
+  // Not copyable or movable.
+  SharedRunnerStats(const SharedRunnerStats&) = delete;
+  SharedRunnerStats& operator=(const SharedRunnerStats&) = delete;
+
+  // Returns a path the runner can open to access the shared page.
+  std::string path() const {
+    return absl::StrCat("/proc/", getpid(), "/fd/", memfd_);
+  }
+
+  // Returns a copy of the current contents if the runner initialized them.
+  std::optional<RunnerStats> Snapshot() const {
+    RunnerStats copy = *stats_;
+    if (!copy.IsValid()) {
+      return std::nullopt;
+    }
+    return copy;
+  }
+
+ private:
+  explicit SharedRunnerStats(int memfd) : memfd_(memfd), stats_(nullptr) {}
+
+  int memfd_;
+  const RunnerStats* stats_;
+};
+
+// A file that a runner reports binary results in. See
+// runner_result_protocol.h. Like SharedRunnerStats, the runner opens the memfd
+// by path. The file is mapped for reading, so that results are decoded where
+// the runner wrote them.
+class RunnerResultsFile {
+ public:
+  // Creates an empty file.
+  static absl::StatusOr<std::unique_ptr<RunnerResultsFile>> Create() {
+    int memfd = memfd_create("runner_results", O_RDWR | MFD_CLOEXEC);
+    if (memfd == -1) {
+      return absl::ErrnoToStatus(errno, "memfd_create");
+    }
+    return absl::WrapUnique(new RunnerResultsFile(memfd));
+  }
+
+  ~RunnerResultsFile() {
+    Unmap();
+    close(memfd_);
+  }
+
+  // Not copyable or movable.
+  RunnerResultsFile(const RunnerResultsFile&) = delete;
+  RunnerResultsFile& operator=(const RunnerResultsFile&) = delete;
+
+  // Returns a path the runner can open to write results.
+  std::string path() const {
+    return absl::StrCat("/proc/", getpid(), "/fd/", memfd_);
+  }
+
+  // Returns the results written since the previous call or Clear(). The
+  // returned data stays valid until the next call of either.
+  absl::StatusOr<absl::string_view> ReadNew() {
+    struct stat stat_buf;
+    if (fstat(memfd_, &stat_buf) != 0) {
+      return absl::ErrnoToStatus(errno, "fstat");
+    }
+    const size_t size = stat_buf.st_size;
+    if (size <= consumed_) {
+      return absl::string_view();
+    }
+    Unmap();
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, memfd_, 0);
+    if (addr == MAP_FAILED) {
+      return absl::ErrnoToStatus(errno, "mmap");
+    }
+    mapping_ = static_cast<const char*>(addr);
+    mapping_size_ = size;
+    absl::string_view new_results(mapping_ + consumed_, size - consumed_);
+    consumed_ = size;
+    return new_results;
+  }
+
+  // Discards all results, so that the file does not grow over the lifetime
+  // of a runner server. The runner must be idle and must have opened the file
+  // with O_APPEND, so that it writes at the new end. Invalidates the data
+  // returned by ReadNew().
+  absl::Status Clear() {
+    Unmap();
+    consumed_ = 0;
+    if (ftruncate(memfd_, 0) != 0) {
+      return absl::ErrnoToStatus(errno, "ftruncate");
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  explicit RunnerResultsFile(int memfd) : memfd_(memfd) {}
+
+  void Unmap() {
+    if (mapping_ != nullptr) {
+      munmap(const_cast<char*>(mapping_), mapping_size_);
+      mapping_ = nullptr;
+    }
+  }
+
+  int memfd_;
+
+  // Read-only mapping of the file as of the last ReadNew().
+  const char* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
+  // Number of bytes returned by ReadNew() so far.
+  size_t consumed_ = 0;
+};
+
+namespace {
+
+// Returns TickCounterFrequency(), which is measured only once.
+uint64_t CachedTickCounterFrequency() {
+  static const uint64_t frequency = TickCounterFrequency();
+  return frequency;
+}
+
+// Breaks the co-scheduling group in the file at `path` so that its remaining
+// members stop waiting. Logs errors.
+void LeaveCoschedGroupFile(const std::string& path) {
+  CoschedGroup* group = MapCoschedGroupFile(path.c_str());
+  if (group == nullptr) {
+    return;
+  }
+  CoschedGroupLeave(group);
+  munmap(group, sizeof(*group));
+}
+
+// Returns the counters of `stats` accumulated since `base`.
+RunnerStats RunnerStatsSince(const RunnerStats& stats,
+                             const RunnerStats& base) {
+  RunnerStats delta = stats;
+  delta.start_ticks = base.last_update_ticks;
+  delta.num_executions -= base.num_executions;
+  delta.num_lazily_mapped_snaps -= base.num_lazily_mapped_snaps;
+  delta.num_skipped_snaps -= base.num_skipped_snaps;
+  delta.cosched_wait_ticks -= base.cosched_wait_ticks;
+  for (int i = 0; i < RunnerStats::kNumPhases; ++i) {
+    delta.phase_ticks[i] -= base.phase_ticks[i];
+  }
+  for (int i = 0; i < RunnerStats::kNumOutcomes; ++i) {
+    delta.outcome_counts[i] -= base.outcome_counts[i];
+  }
+  for (int i = 0; i < RunnerStats::kNumHistogramBuckets; ++i) {
+    delta.run_ticks_histogram[i] -= base.run_ticks_histogram[i];
+  }
+  return delta;
+}
+
+// Reads exactly `size` bytes from `fd` into `buffer`, waiting until
+// `deadline` at most. Returns OutOfRangeError on EOF.
+absl::Status ReadExactly(int fd, void* buffer, size_t size,
+                         absl::Time deadline) {
+  char* data = static_cast<char*>(buffer);
+  while (size > 0) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+    int timeout_ms = -1;
+    if (deadline != absl::InfiniteFuture()) {
+      timeout_ms = std::max<int64_t>(
+          0, absl::ToInt64Milliseconds(deadline - absl::Now()));
+    }
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready == -1) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "poll");
+    }
+    if (ready == 0) {
+      return absl::DeadlineExceededError("Runner server did not respond");
+    }
+    ssize_t n = read(fd, data, size);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "read");
+    }
+    if (n == 0) {
+      return absl::OutOfRangeError("Runner server closed its output");
+    }
+    data += n;
+    size -= n;
+  }
+  return absl::OkStatus();
+}
+
+// A runner process in fork server mode. See runner_fork_server_protocol.h.
+//
+// This class is thread-compatible.
+class RunnerForkServer {
+ public:
+  // Starts a fork server of the runner binary at `binary_path`.
+  static absl::StatusOr<std::unique_ptr<RunnerForkServer>> Start(
+      const std::string& binary_path, bool map_stderr_to_dev_null) {
+    Subprocess::Options options = Subprocess::Options::Default();
+    // Fork servers outlive the thread that started them, so they do not get
+    // a parent death signal, which is tied to that thread. They exit when the
+    // driver process closes their stdin instead.
+    options.DisableAslr(true).PipeStdin(true);
+    if (map_stderr_to_dev_null) {
+      options.MapStderr(Subprocess::kMapToDevNull);
+    }
+    auto server = absl::WrapUnique(new RunnerForkServer(options));
+    RETURN_IF_NOT_OK(server->process_.Start({binary_path, "--fork_server"}));
+    return server;
+  }
+
+  ~RunnerForkServer() {
+    if (!healthy_) {
+      kill(process_.pid(), SIGKILL);
+    }
+    std::string server_stdout;
+    // Communicate() closes stdin, which tells a live server to exit.
+    process_.Communicate(&server_stdout);
+  }
+
+  // Not copyable or movable.
+  RunnerForkServer(const RunnerForkServer&) = delete;
+  RunnerForkServer& operator=(const RunnerForkServer&) = delete;
+
+  // Returns false after a protocol error. The server must not be used then.
+  bool healthy() const { return healthy_; }
+
+  // Starts a runner with command line arguments `args`, without argv[0].
+  // Like Subprocess::Options::SetRLimit() in RunAllImpl(), the runner is
+  // soft-capped at `cpu_time_budget` of CPU time and hard-capped 1 second
+  // later. Returns the pid of the runner, which must be passed to Wait()
+  // next. Returns UnavailableError if the runner could not be started.
+  absl::StatusOr<pid_t> Fork(const std::vector<std::string>& args,
+                             absl::Duration cpu_time_budget) {
+    CHECK(healthy_);
+    std::string request(sizeof(RunnerForkRequest), '\0');
+    for (const std::string& arg : args) {
+      request.append(arg);
+      request.push_back('\0');
+    }
+    const RunnerForkRequest header = {.args_size =
+                                          request.size() - sizeof(header)};
+    if (header.args_size > kMaxForkRequestArgsSize) {
+      return absl::UnavailableError("Runner command line is too long");
+    }
+    memcpy(request.data(), &header, sizeof(header));
+    if (Write(process_.stdin_fd(), request.data(), request.size()) !=
+        static_cast<ssize_t>(request.size())) {
+      healthy_ = false;
+      return absl::UnavailableError("Cannot send request to fork server");
+    }
+    uint64_t pid;
+    if (absl::Status status =
+            ReadExactly(process_.stdout_fd(), &pid, sizeof(pid),
+                        absl::Now() + kResponseTimeout);
+        !status.ok()) {
+      healthy_ = false;
+      return absl::UnavailableError(
+          absl::StrCat("Fork server did not start a runner: ",
+                       status.message()));
+    }
+    if (cpu_time_budget != absl::InfiniteDuration()) {
+      const int64_t soft_limit = absl::ToInt64Seconds(cpu_time_budget);
+      struct rlimit limit = {.rlim_cur = static_cast<rlim_t>(soft_limit),
+                             .rlim_max = static_cast<rlim_t>(soft_limit + 1)};
+      if (prlimit(pid, RLIMIT_CPU, &limit, nullptr) != 0) {
+        const absl::Status status = absl::ErrnoToStatus(errno, "prlimit");
+        kill(pid, SIGKILL);
+        Wait(pid, absl::InfiniteDuration()).IgnoreError();
+        return absl::UnavailableError(status.ToString());
+      }
+    }
+    // The runner stops itself before it does anything.
+    if (kill(pid, SIGCONT) != 0) {
+      healthy_ = false;
+      return absl::UnavailableError(
+          absl::ErrnoToStatus(errno, "Cannot resume runner").ToString());
+    }
+    return pid;
+  }
+
+  // Waits for the runner with `pid` started by Fork() to exit and returns its
+  // wait(2) status. Like Subprocess::Options::SetITimer() in RunAllImpl(),
+  // sends SIGALRM to the runner after `wall_time_budget`. Kills the runner if
+  // it does not exit soon after.
+  absl::StatusOr<int> Wait(pid_t pid, absl::Duration wall_time_budget) {
+    CHECK(healthy_);
+    uint64_t wait_status;
+    auto read_wait_status = [this, &wait_status](absl::Time deadline) {
+      return ReadExactly(process_.stdout_fd(), &wait_status,
+                         sizeof(wait_status), deadline);
+    };
+    absl::Status status = read_wait_status(
+        wall_time_budget == absl::InfiniteDuration()
+            ? absl::InfiniteFuture()
+            : absl::Now() + wall_time_budget);
+    if (absl::IsDeadlineExceeded(status)) {
+      kill(pid, SIGALRM);
+      status = read_wait_status(absl::Now() + kResponseTimeout);
+    }
+    if (absl::IsDeadlineExceeded(status)) {
+      kill(pid, SIGKILL);
+      status = read_wait_status(absl::InfiniteFuture());
+    }
+    if (!status.ok()) {
+      healthy_ = false;
+      kill(pid, SIGKILL);
+      return status;
+    }
+    return static_cast<int>(wait_status);
+  }
+
+ private:
+  // Time in which the server must respond when it is not waiting for a
+  // runner.
+  static constexpr absl::Duration kResponseTimeout = absl::Seconds(10);
+
+  explicit RunnerForkServer(const Subprocess::Options& options)
+      : process_(options) {}
+
+  Subprocess process_;
+  bool healthy_ = true;
+};
+
+// Idle RunnerForkServers shared by all RunnerDrivers of the process.
+//
+// This class is thread-safe.
+class RunnerForkServerPool {
+ public:
+  static RunnerForkServerPool& Get() {
+    static RunnerForkServerPool* pool = new RunnerForkServerPool();
+    return *pool;
+  }
+
+  // Returns an idle fork server of the runner binary at `binary_path` or
+  // starts a new one.
+  absl::StatusOr<std::unique_ptr<RunnerForkServer>> Acquire(
+      const std::string& binary_path, bool map_stderr_to_dev_null) {
+    {
+      absl::MutexLock lock(&mu_);
+      std::vector<std::unique_ptr<RunnerForkServer>>& idle =
+          idle_[{binary_path, map_stderr_to_dev_null}];
+      if (!idle.empty()) {
+        std::unique_ptr<RunnerForkServer> server = std::move(idle.back());
+        idle.pop_back();
+        return server;
+      }
+    }
+    return RunnerForkServer::Start(binary_path, map_stderr_to_dev_null);
+  }
+
+  // Returns `server` acquired for the same arguments to the pool unless it
+  // is unhealthy.
+  void Release(const std::string& binary_path, bool map_stderr_to_dev_null,
+               std::unique_ptr<RunnerForkServer> server) {
+    if (!server->healthy()) {
+      return;
+    }
+    absl::MutexLock lock(&mu_);
+    idle_[{binary_path, map_stderr_to_dev_null}].push_back(std::move(server));
+  }
+
+ private:
+  RunnerForkServerPool() = default;
+
+  absl::Mutex mu_;
+  absl::flat_hash_map<std::pair<std::string, bool>,
+                      std::vector<std::unique_ptr<RunnerForkServer>>>
+      idle_ ABSL_GUARDED_BY(mu_);
+};
+
+// Runs the runner command line `argv` in a child of a pooled fork server
+// with the budgets of `runner_options`. Sets `*wait_time` once the runner
+// runs and returns its wait(2) status. Returns UnavailableError if the
+// runner could not be started, e.g. because the fork server died.
+absl::StatusOr<int> RunForked(const std::vector<std::string>& argv,
+                              const RunnerOptions& runner_options,
+                              absl::Time* wait_time) {
+  RunnerForkServerPool& pool = RunnerForkServerPool::Get();
+  const std::string& binary_path = argv.front();
+  const bool map_stderr_to_dev_null = runner_options.map_stderr_to_dev_null();
+  absl::StatusOr<std::unique_ptr<RunnerForkServer>> server =
+      pool.Acquire(binary_path, map_stderr_to_dev_null);
+  if (!server.ok()) {
+    return absl::UnavailableError(server.status().ToString());
+  }
+  absl::Cleanup release = [&] {
+    pool.Release(binary_path, map_stderr_to_dev_null, *std::move(server));
+  };
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      pid_t pid,
+      (*server)->Fork({argv.begin() + 1, argv.end()},
+                      runner_options.cpu_time_budget()));
+  *wait_time = absl::Now();
+  return (*server)->Wait(pid, runner_options.wall_time_budget());
+}
+
+// Parses a single proto.SnapshotExecutionResult text proto reported by a
+// runner that exited with `exit_status`. When `snapshot_id` is not empty, the
+// result must be for that snapshot.
+absl::StatusOr<RunnerDriver::RunResult> ParseRunnerResult(
+    absl::string_view text, int exit_status, absl::string_view snapshot_id) {
+  google::protobuf::TextFormat::Parser parser;
+  proto::SnapshotExecutionResult exec_result_proto;
+  if (!parser.ParseFromString(std::string(text), &exec_result_proto)) {
+    return absl::InternalError(
+        absl::StrCat("couldn't parse [", text,
+                     "] as proto::SnapshotExecutionResult. Exit status = ",
+                     HexStr(exit_status)));
+  }
+  if (!snapshot_id.empty() && exec_result_proto.snapshot_id() != snapshot_id) {
+    // This catches all runner crashes due to mmap errors etc.
+    return absl::InternalError(absl::StrCat("Runner misbehaved: got id [",
+                                            exec_result_proto.snapshot_id(),
+                                            "] expected ", snapshot_id));
+  }
+  absl::StatusOr<RunnerDriver::PlayerResult> player_result_or =
+      PlayerResultProto::FromProto(exec_result_proto.player_result());
+  RETURN_IF_NOT_OK_PLUS(player_result_or.status(),
+                        "PlayerResultProto::FromProto: ");
+  if (!player_result_or->actual_end_state.has_value()) {
+    return absl::InternalError(absl::StrCat(exec_result_proto.DebugString(),
+                                            " has no actual_end_state"));
+  }
+  return RunnerDriver::RunResult(*player_result_or,
+                                 exec_result_proto.snapshot_id());
+}
+
+// Returns the Endpoint described by `header`.
+absl::StatusOr<Snapshot::Endpoint> DecodeEndpoint(
+    const RunnerResultHeader& header) {
+  switch (static_cast<RunnerResultEndpointType>(header.endpoint_type)) {
+    case RunnerResultEndpointType::kInstruction:
+      return Snapshot::Endpoint(header.instruction_address);
+    case RunnerResultEndpointType::kSignal: {
+      // Same checks as SnapshotProto::FromProto().
+      using SigNum = Snapshot::Endpoint::SigNum;
+      using SigCause = Snapshot::Endpoint::SigCause;
+      if (header.sig_num < ToInt(SigNum::kSigSegv) ||
+          header.sig_num > ToInt(SigNum::kSigBus)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Bad sig_num ", header.sig_num));
+      }
+      if (header.sig_cause < ToInt(SigCause::kGenericSigCause) ||
+          header.sig_cause > ToInt(SigCause::kSegvGeneralProtection)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Bad sig_cause ", header.sig_cause));
+      }
+      const auto sig_num = static_cast<SigNum>(header.sig_num);
+      const auto sig_cause = static_cast<SigCause>(header.sig_cause);
+      if ((sig_cause != SigCause::kGenericSigCause) !=
+          (sig_num == SigNum::kSigSegv)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("sig_cause ", header.sig_cause,
+                         " is incompatible with sig_num ", header.sig_num));
+      }
+      return Snapshot::Endpoint(sig_num, sig_cause, header.sig_address,
+                                header.instruction_address);
+    }
+    default:
+      return absl::InvalidArgumentError("Runner reported no endpoint");
+  }
+}
+
+// Decodes the binary result record at the start of `*records`, see
+// runner_result_protocol.h, and removes it from `*records`. Otherwise like
+// ParseRunnerResult(). Registers and memory contents are copied from
+// `*records` into the result without any intermediate representation.
+absl::StatusOr<RunnerDriver::RunResult> DecodeRunnerResult(
+    absl::string_view* records, absl::string_view snapshot_id) {
+  RunnerResultHeader header;
+  if (records->size() < sizeof(header)) {
+    return absl::InternalError("Truncated runner result header");
+  }
+  memcpy(&header, records->data(), sizeof(header));
+  if (header.magic != kRunnerResultMagic) {
+    return absl::InternalError(
+        absl::StrCat("Bad runner result magic ", HexStr(header.magic)));
+  }
+  if (header.record_size < sizeof(header) ||
+      header.record_size % kRunnerResultAlignment != 0 ||
+      header.record_size > records->size()) {
+    return absl::InternalError(
+        absl::StrCat("Truncated runner result: expected ", header.record_size,
+                     " bytes, got ", records->size()));
+  }
+  absl::string_view record = records->substr(0, header.record_size);
+  records->remove_prefix(header.record_size);
+  record.remove_prefix(sizeof(header));
+
+  // Removes the next item of `size` bytes and its padding from `record` and
+  // returns the item. Sets `truncated` if the record is too short.
+  bool truncated = false;
+  auto next_item = [&record, &truncated](uint64_t size) {
+    if (truncated || size > record.size() ||
+        RunnerResultPadded(size) > record.size()) {
+      truncated = true;
+      return absl::string_view();
+    }
+    absl::string_view item = record.substr(0, size);
+    record.remove_prefix(RunnerResultPadded(size));
+    return item;
+  };
+  const absl::string_view id = next_item(header.snapshot_id_size);
+  const absl::string_view gregs = next_item(header.gregs_size);
+  const absl::string_view fpregs = next_item(header.fpregs_size);
+  if (truncated) {
+    return absl::InternalError("Runner result items exceed the record");
+  }
+  if (!snapshot_id.empty() && id != snapshot_id) {
+    // This catches all runner crashes due to mmap errors etc.
+    return absl::InternalError(absl::StrCat("Runner misbehaved: got id [", id,
+                                            "] expected ", snapshot_id));
+  }
+  if (header.outcome < ToInt(PlaybackOutcome::kAsExpected) ||
+      header.outcome > ToInt(PlaybackOutcome::kExecutionMisbehave)) {
+    return absl::InternalError(
+        absl::StrCat("Bad runner result outcome ", header.outcome));
+  }
+  absl::StatusOr<Snapshot::Endpoint> endpoint_or = DecodeEndpoint(header);
+  RETURN_IF_NOT_OK_PLUS(endpoint_or.status(), "Bad Endpoint: ");
+  Snapshot::EndState end_state(
+      *endpoint_or,
+      Snapshot::RegisterState(std::string(gregs), std::string(fpregs)));
+  for (uint64_t i = 0; i < header.num_memory_ranges; ++i) {
+    const absl::string_view range_header =
+        next_item(sizeof(RunnerResultMemoryRange));
+    if (truncated) {
+      return absl::InternalError("Runner result items exceed the record");
+    }
+    RunnerResultMemoryRange range;
+    memcpy(&range, range_header.data(), sizeof(range));
+    Snapshot::ByteData byte_values(next_item(range.num_bytes));
+    if (truncated) {
+      return absl::InternalError("Runner result items exceed the record");
+    }
+    RETURN_IF_NOT_OK_PLUS(
+        Snapshot::MemoryBytes::CanConstruct(range.start_address, byte_values),
+        "Bad MemoryBytes: ");
+    Snapshot::MemoryBytes memory_bytes(range.start_address,
+                                       std::move(byte_values));
+    RETURN_IF_NOT_OK_PLUS(end_state.can_add_memory_bytes(memory_bytes),
+                          "Can't add MemoryBytes: ");
+    end_state.add_memory_bytes(std::move(memory_bytes));
+  }
+
+  RunnerDriver::PlayerResult player_result = {
+      .outcome = static_cast<PlaybackOutcome>(header.outcome),
+      .actual_end_state = std::move(end_state),
+      .cpu_usage = absl::ZeroDuration(),
+      .cpu_id = header.cpu_id,
+  };
+  return RunnerDriver::RunResult(player_result, id);
+}
+
+// Decodes the skip records at the start of `*records`, see
+// runner_result_protocol.h, and removes them from `*records`. Returns the
+// IDs of the skipped snapshots.
+absl::StatusOr<std::vector<std::string>> DecodeSkipRecords(
+    absl::string_view* records) {
+  std::vector<std::string> skipped_ids;
+  RunnerSkipHeader header;
+  while (records->size() >= sizeof(header)) {
+    memcpy(&header, records->data(), sizeof(header));
+    if (header.magic != kRunnerSkipMagic) break;
+    if (header.record_size !=
+            sizeof(header) + RunnerResultPadded(header.snapshot_id_size) ||
+        header.record_size > records->size()) {
+      return absl::InternalError(
+          absl::StrCat("Bad runner skip record of ", header.record_size,
+                       " bytes, got ", records->size()));
+    }
+    skipped_ids.emplace_back(
+        records->substr(sizeof(header), header.snapshot_id_size));
+    records->remove_prefix(header.record_size);
+  }
+  return skipped_ids;
+}
+
+}  // namespace
+
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::PlayOne(
     absl::string_view snap_id) const {
   CHECK(!snap_id.empty());
-  return RunImpl(RunnerOptions::PlayOptions(snap_id), snap_id);
+  return RunImpl(
+      RunnerOptions::PlayOptions(snap_id).set_use_fork_server(use_fork_server_),
+      snap_id);
 }
 
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::MakeOne(
-    absl::string_view snap_id) const {
+    absl::string_view snap_id, int max_pages_to_add) const {
   CHECK(!snap_id.empty());
-  return RunImpl(RunnerOptions::MakeOptions(snap_id), snap_id);
+  return RunImpl(RunnerOptions::MakeOptions(snap_id, max_pages_to_add)
+                     .set_use_fork_server(use_fork_server_),
+                 snap_id);
 }
 
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::TraceOne(
@@ -72,6 +701,7 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::VerifyOneRepeatedly(
     absl::string_view snap_id, int num_attempts) const {
   CHECK(!snap_id.empty());
   auto opts = RunnerOptions::VerifyOptions(snap_id);
+  opts.set_use_fork_server(use_fork_server_);
   for (int i = 0; i < num_attempts - 1; ++i) {
     RETURN_IF_NOT_OK(RunImpl(opts, snap_id).status());
   }
@@ -83,11 +713,59 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::Run(
   return RunImpl(runner_options);
 }
 
-// Generic entry point for all methods that need to execute the runner binary
-// and handle its output.
+absl::StatusOr<std::vector<RunnerDriver::RunResult>> RunnerDriver::RunAll(
+    const RunnerOptions& runner_options, RunTimes* times) const {
+  return RunAllImpl(runner_options, "", std::nullopt, times);
+}
+
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::RunImpl(
     const RunnerOptions& runner_options, absl::string_view snap_id,
     std::optional<HarnessTracer::Callback> trace_cb) const {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::vector<RunResult> results,
+                             RunAllImpl(runner_options, snap_id, trace_cb));
+  return std::move(results.front());
+}
+
+std::vector<std::string> RunnerDriver::RunnerArgv(
+    const RunnerOptions& runner_options,
+    const SharedRunnerStats* shared_stats,
+    const RunnerResultsFile* results_file) const {
+  std::vector<std::string> argv;
+  if (runner_options.cpu() != kAnyCPUId) {
+    argv.push_back(absl::StrCat("--cpu=", runner_options.cpu()));
+  }
+  if (shared_stats != nullptr) {
+    argv.push_back(absl::StrCat("--stats_path=", shared_stats->path()));
+  }
+  if (results_file != nullptr) {
+    argv.push_back(absl::StrCat("--results_path=", results_file->path()));
+  }
+  if (runner_options.max_failures() > 1) {
+    argv.push_back(
+        absl::StrCat("--max_failures=", runner_options.max_failures()));
+  }
+  if (!runner_options.cosched_group_path().empty()) {
+    argv.push_back(absl::StrCat("--cosched_group_path=",
+                                runner_options.cosched_group_path()));
+    argv.push_back(absl::StrCat("--cosched_group_size=",
+                                runner_options.cosched_group_size()));
+    argv.push_back(absl::StrCat("--cosched_group_index=",
+                                runner_options.cosched_group_index()));
+  }
+  for (const std::string& extra : runner_options.extra_argv()) {
+    argv.push_back(extra);
+  }
+  return argv;
+}
+
+// Generic entry point for all methods that need to execute the runner binary
+// and handle its output.
+absl::StatusOr<std::vector<RunnerDriver::RunResult>> RunnerDriver::RunAllImpl(
+    const RunnerOptions& runner_options, absl::string_view snap_id,
+    std::optional<HarnessTracer::Callback> trace_cb, RunTimes* times) const {
+  RunTimes local_times;
+  if (times == nullptr) times = &local_times;
+  const absl::Time start_time = absl::Now();
   std::vector<std::string> argv = {binary_path_};
   Subprocess::Options options = Subprocess::Options::Default();
   options.DisableAslr(runner_options.disable_aslr())
@@ -103,15 +781,20 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::RunImpl(
       wall_time_budget != absl::InfiniteDuration()) {
     options.SetITimer(ITIMER_REAL, wall_time_budget);
   }
-  if (runner_options.cpu() != kAnyCPUId) {
-    argv.push_back(absl::StrCat("--cpu=", runner_options.cpu()));
-  }
   if (runner_options.sequential_mode()) {
     argv.push_back("--sequential_mode");
   }
-  for (const std::string& extra : runner_options.extra_argv()) {
-    argv.push_back(extra);
+  std::unique_ptr<SharedRunnerStats> shared_stats;
+  if (runner_options.collect_stats()) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(shared_stats, SharedRunnerStats::Create());
   }
+  std::unique_ptr<RunnerResultsFile> results_file;
+  if (!runner_options.text_results()) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(results_file, RunnerResultsFile::Create());
+  }
+  std::vector<std::string> common_argv =
+      RunnerArgv(runner_options, shared_stats.get(), results_file.get());
+  argv.insert(argv.end(), common_argv.begin(), common_argv.end());
 
   if (!corpus_path_.empty()) {
     argv.push_back(corpus_path_);
@@ -121,33 +804,95 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::RunImpl(
     options.MapStderr(Subprocess::kMapToDevNull);
   }
 
-  Subprocess runner_proc(options);
-  RETURN_IF_NOT_OK(runner_proc.Start(argv));
-
-  std::unique_ptr<HarnessTracer> tracer = nullptr;
-  if (trace_cb.has_value()) {
-    tracer = std::make_unique<HarnessTracer>(
-        runner_proc.pid(), HarnessTracer::Mode::kSingleStep, trace_cb.value());
-    tracer->Attach();
+  std::string runner_stdout;
+  int exit_status = 0;
+  absl::Time wait_time;
+  bool forked = false;
+  // Forked runners can only report results in binary, because their stdout
+  // is the fork server's.
+  if (runner_options.use_fork_server() && runner_options.disable_aslr() &&
+      results_file != nullptr && !trace_cb.has_value()) {
+    absl::StatusOr<int> forked_status =
+        RunForked(argv, runner_options, &wait_time);
+    if (forked_status.ok()) {
+      exit_status = *forked_status;
+      forked = true;
+    } else if (absl::IsUnavailable(forked_status.status())) {
+      VLOG_INFO(1, "Starting runner without fork server: ",
+                forked_status.status().message());
+    } else {
+      return forked_status.status();
+    }
   }
 
-  std::string runner_stdout;
-  int exit_status = runner_proc.Communicate(&runner_stdout);
-  std::optional<int> tracee_exit_status;
-  if (tracer != nullptr) {
-    tracee_exit_status = tracer->Join();
-    // Because there's a race between the tracer and the Subprocess we need to
-    // grab the exit status from the whoever calls waitpid first.
-    if (tracee_exit_status.has_value()) {
-      exit_status = tracee_exit_status.value();
+  if (!forked) {
+    Subprocess runner_proc(options);
+    RETURN_IF_NOT_OK(runner_proc.Start(argv));
+    wait_time = absl::Now();
+
+    std::unique_ptr<HarnessTracer> tracer = nullptr;
+    if (trace_cb.has_value()) {
+      tracer = std::make_unique<HarnessTracer>(
+          runner_proc.pid(), HarnessTracer::Mode::kSingleStep,
+          trace_cb.value());
+      tracer->Attach();
+    }
+
+    exit_status = runner_proc.Communicate(&runner_stdout);
+    std::optional<int> tracee_exit_status;
+    if (tracer != nullptr) {
+      tracee_exit_status = tracer->Join();
+      // Because there's a race between the tracer and the Subprocess we need
+      // to grab the exit status from the whoever calls waitpid first.
+      if (tracee_exit_status.has_value()) {
+        exit_status = tracee_exit_status.value();
+      }
     }
   }
-  return HandleRunnerOutput(runner_stdout, exit_status, snap_id);
+  if (!runner_options.cosched_group_path().empty()) {
+    // A runner that was killed or crashed did not leave its group. Leave on
+    // its behalf so that the other members stop waiting for it.
+    LeaveCoschedGroupFile(runner_options.cosched_group_path());
+  }
+  times->start = wait_time - start_time;
+  const absl::Time parse_time = absl::Now();
+  times->wait = parse_time - wait_time;
+  std::optional<RunnerStats> stats;
+  if (shared_stats != nullptr) {
+    stats = shared_stats->Snapshot();
+  }
+  absl::Cleanup parse_timer = [times, parse_time] {
+    times->parse = absl::Now() - parse_time;
+  };
+  absl::string_view runner_output = runner_stdout;
+  ResultFormat format = ResultFormat::kText;
+  std::vector<std::string> skipped_ids;
+  if (results_file != nullptr) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(runner_output, results_file->ReadNew());
+    ASSIGN_OR_RETURN_IF_NOT_OK(skipped_ids, DecodeSkipRecords(&runner_output));
+    format = ResultFormat::kBinary;
+  }
+  std::vector<RunResult> results;
+  if (runner_options.max_failures() > 1) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        results, HandleRunnerRecords(runner_output, format, exit_status,
+                                     snap_id, stats));
+  } else {
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        RunResult result, HandleRunnerOutput(runner_output, format,
+                                             exit_status, snap_id, stats));
+    results.push_back(std::move(result));
+  }
+  if (stats.has_value()) {
+    results.front().set_stats(*stats);
+  }
+  results.front().set_skipped_snapshot_ids(std::move(skipped_ids));
+  return results;
 }
 
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
-    absl::string_view runner_stdout, int exit_status,
-    absl::string_view snapshot_id) const {
+    absl::string_view runner_output, ResultFormat format, int exit_status,
+    absl::string_view snapshot_id, const std::optional<RunnerStats>& stats) {
   if (WIFSIGNALED(exit_status)) {
     int sig_num = WTERMSIG(exit_status);
     if (sig_num == SIGINT) {
@@ -159,7 +904,10 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
       // The process died with SIGSYS because an unexpected syscall was made.
       return absl::InternalError("Snapshot made a syscall");
     }
-    return absl::InternalError(
+    // The runner handles the signals raised by the snapshot, so any other
+    // signal comes from outside, e.g. the OOM killer or a resource limit. The
+    // snapshot may well succeed when run again.
+    return absl::AbortedError(
         absl::StrCat("Runner killed by signal ", sig_num));
   }
   if (WIFEXITED(exit_status)) {
@@ -168,48 +916,288 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
     if (exit_code == ExitCode::kSuccess) {
       return RunResult::Successful();
     }
-    // Graceful shutdown due to timeout. Convert this to success with the
-    // caveat that this can hide runners that are not making progress.
-    //
-    // TODO(ksteuck): [as-needed] Change the API of the runner to provide some
-    // sort of heartbeat signal (via a new FD, shared memory or the existing
-    // stdout logging). The idea is that instead of blindly converting exit
-    // code 2 into Successful() we should also be checking that some progress
-    // was made.
+    if (exit_code == ExitCode::kSnapSkipped) {
+      // The runner cannot map the snapshot, so there is no result to report.
+      return absl::FailedPreconditionError(
+          absl::StrCat("Snapshot ", snapshot_id,
+                       " skipped: its mappings conflict with the runner"));
+    }
+    // Graceful shutdown due to timeout. Convert this to success. The caller
+    // attaches the statistics, if any, whose execution count tells whether
+    // the runner made progress.
     if (exit_code == ExitCode::kTimeout && snapshot_id.empty()) {
       VLOG_INFO(1, "Runner process timed out");
+      if (stats.has_value() && stats->num_executions == 0) {
+        VLOG_INFO(1, "Runner timed out without executing any snapshot");
+      }
       return RunResult::Successful();
     }
-    google::protobuf::TextFormat::Parser parser;
-    proto::SnapshotExecutionResult exec_result_proto;
-    if (!parser.ParseFromString(std::string(runner_stdout),
-                                &exec_result_proto)) {
-      return absl::InternalError(
-          absl::StrCat("couldn't parse [", runner_stdout,
-                       "] as proto::SnapshotExecutionResult. Exit status = ",
-                       HexStr(exit_status)));
-    }
-    if (!snapshot_id.empty() &&
-        exec_result_proto.snapshot_id() != snapshot_id) {
-      // This catches all runner crashes due to mmap errors etc.
-      return absl::InternalError(absl::StrCat("Runner misbehaved: got id [",
-                                              exec_result_proto.snapshot_id(),
-                                              "] expected ", snapshot_id));
-    }
-    absl::StatusOr<PlayerResult> player_result_or =
-        PlayerResultProto::FromProto(exec_result_proto.player_result());
-    RETURN_IF_NOT_OK_PLUS(player_result_or.status(),
-                          "PlayerResultProto::FromProto: ");
-    if (!player_result_or->actual_end_state.has_value()) {
-      return absl::InternalError(absl::StrCat(exec_result_proto.DebugString(),
-                                              " has no actual_end_state"));
-    }
-    return RunResult(*player_result_or, exec_result_proto.snapshot_id());
+    if (format == ResultFormat::kBinary) {
+      return DecodeRunnerResult(&runner_output, snapshot_id);
+    }
+    return ParseRunnerResult(runner_output, exit_status, snapshot_id);
   }
   return absl::InternalError(
       absl::StrCat("Unknown runner exit status ", exit_status));
 }
 
+absl::StatusOr<std::vector<RunnerDriver::RunResult>>
+RunnerDriver::HandleRunnerRecords(
+    absl::string_view runner_output, ResultFormat format, int exit_status,
+    absl::string_view snapshot_id, const std::optional<RunnerStats>& stats) {
+  std::vector<RunResult> results;
+  absl::string_view remaining = runner_output;
+  while (!remaining.empty()) {
+    if (format == ResultFormat::kBinary) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(RunResult result,
+                                 DecodeRunnerResult(&remaining, snapshot_id));
+      results.push_back(std::move(result));
+      continue;
+    }
+    uint64_t size;
+    if (remaining.size() < sizeof(size)) {
+      return absl::InternalError("Truncated runner record header");
+    }
+    // The runner writes record sizes in little-endian. See LogRecordToStdout().
+    memcpy(&size, remaining.data(), sizeof(size));
+    remaining.remove_prefix(sizeof(size));
+    if (remaining.size() < size) {
+      return absl::InternalError(
+          absl::StrCat("Truncated runner record: expected ", size,
+                       " bytes, got ", remaining.size()));
+    }
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        RunResult result,
+        ParseRunnerResult(remaining.substr(0, size), exit_status, snapshot_id));
+    results.push_back(std::move(result));
+    remaining.remove_prefix(size);
+  }
+
+  // A runner that reported failures exits with kFailure unless it was stopped
+  // by a timeout or a signal after the last one.
+  if (WIFEXITED(exit_status) &&
+      static_cast<ExitCode>(WEXITSTATUS(exit_status)) == ExitCode::kFailure) {
+    if (results.empty()) {
+      return absl::InternalError("Runner failed without reporting a result");
+    }
+    return results;
+  }
+  absl::StatusOr<RunResult> final_result =
+      HandleRunnerOutput("", format, exit_status, snapshot_id, stats);
+  if (results.empty()) {
+    RETURN_IF_NOT_OK(final_result.status());
+    results.push_back(*std::move(final_result));
+  } else if (!final_result.ok()) {
+    // Do not lose the failures reported so far.
+    LOG_ERROR("Runner reported ", results.size(),
+              " failures and then stopped with: ",
+              final_result.status().message());
+  }
+  return results;
+}
+
+absl::StatusOr<std::unique_ptr<RunnerServer>> RunnerDriver::StartServer(
+    const RunnerOptions& runner_options) const {
+  if (runner_options.sequential_mode()) {
+    return absl::InvalidArgumentError(
+        "Runner servers do not support sequential mode");
+  }
+  Subprocess::Options options = Subprocess::Options::Default();
+  options.DisableAslr(runner_options.disable_aslr())
+      .SetParentDeathSignal(SIGKILL)
+      .PipeStdin(true);
+  if (runner_options.map_stderr_to_dev_null()) {
+    options.MapStderr(Subprocess::kMapToDevNull);
+  }
+  std::unique_ptr<SharedRunnerStats> shared_stats;
+  if (runner_options.collect_stats()) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(shared_stats, SharedRunnerStats::Create());
+  }
+  std::unique_ptr<RunnerResultsFile> results_file;
+  if (!runner_options.text_results()) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(results_file, RunnerResultsFile::Create());
+  }
+  std::vector<std::string> argv = {binary_path_, "--server"};
+  std::vector<std::string> common_argv =
+      RunnerArgv(runner_options, shared_stats.get(), results_file.get());
+  argv.insert(argv.end(), common_argv.begin(), common_argv.end());
+  if (!corpus_path_.empty()) {
+    argv.push_back(corpus_path_);
+  }
+
+  auto server = absl::WrapUnique(new RunnerServer(
+      options, std::move(shared_stats), std::move(results_file)));
+  RETURN_IF_NOT_OK(server->process_.Start(argv));
+  server->alive_ = true;
+  return server;
+}
+
+RunnerServer::RunnerServer(const Subprocess::Options& options,
+                           std::unique_ptr<SharedRunnerStats> shared_stats,
+                           std::unique_ptr<RunnerResultsFile> results_file)
+    : process_(options),
+      shared_stats_(std::move(shared_stats)),
+      results_file_(std::move(results_file)),
+      alive_(false) {}
+
+RunnerServer::~RunnerServer() {
+  if (alive_) {
+    Shutdown();
+  }
+}
+
+int RunnerServer::Shutdown() {
+  alive_ = false;
+  std::string runner_stdout;
+  // Communicate() closes stdin, which tells a live server to exit.
+  return process_.Communicate(&runner_stdout);
+}
+
+absl::Status RunnerServer::SetCpuTimeBudget(absl::Duration cpu_time_budget) {
+  clockid_t clock_id;
+  if (int error = clock_getcpuclockid(process_.pid(), &clock_id); error != 0) {
+    return absl::ErrnoToStatus(error, "clock_getcpuclockid");
+  }
+  struct timespec cpu_time;
+  if (clock_gettime(clock_id, &cpu_time) != 0) {
+    return absl::ErrnoToStatus(errno, "clock_gettime");
+  }
+  // Like RunAllImpl(), soft-cap at the budget and hard-cap +1 second. Round
+  // up to whole seconds so that the budget is never shortened.
+  const int64_t soft_limit = absl::ToInt64Seconds(
+      absl::Ceil(absl::DurationFromTimespec(cpu_time) + cpu_time_budget,
+                 absl::Seconds(1)));
+  struct rlimit limit = {.rlim_cur = static_cast<rlim_t>(soft_limit),
+                         .rlim_max = static_cast<rlim_t>(soft_limit + 1)};
+  if (prlimit(process_.pid(), RLIMIT_CPU, &limit, nullptr) != 0) {
+    return absl::ErrnoToStatus(errno, "prlimit");
+  }
+  return absl::OkStatus();
+}
+
+std::optional<RunnerStats> RunnerServer::LiveStats() const {
+  if (shared_stats_ == nullptr) {
+    return std::nullopt;
+  }
+  return shared_stats_->Snapshot();
+}
+
+absl::StatusOr<std::vector<RunnerDriver::RunResult>> RunnerServer::Run(
+    absl::Duration cpu_time_budget, absl::Duration wall_time_budget,
+    RunnerDriver::RunTimes* times) {
+  CHECK(alive_);
+  RunnerDriver::RunTimes local_times;
+  if (times == nullptr) times = &local_times;
+  const absl::Time start_time = absl::Now();
+  const absl::Duration time_budget =
+      std::min(cpu_time_budget, wall_time_budget);
+  RunnerServerCommand command = {};
+  if (time_budget != absl::InfiniteDuration()) {
+    command.deadline_ticks =
+        ReadTickCounter() +
+        absl::ToDoubleSeconds(time_budget) * CachedTickCounterFrequency();
+  }
+  if (cpu_time_budget != absl::InfiniteDuration()) {
+    RETURN_IF_NOT_OK(SetCpuTimeBudget(cpu_time_budget));
+  }
+  if (write(process_.stdin_fd(), &command, sizeof(command)) !=
+      sizeof(command)) {
+    int exit_status = Shutdown();
+    return absl::InternalError(
+        absl::StrCat("Cannot send command to runner server, exit status = ",
+                     HexStr(exit_status)));
+  }
+
+  const absl::Time wait_time = absl::Now();
+  times->start = wait_time - start_time;
+
+  // Give the server some slack to finish the schedule in progress before
+  // declaring it stuck.
+  const absl::Time deadline = time_budget == absl::InfiniteDuration()
+                                  ? absl::InfiniteFuture()
+                                  : absl::Now() + time_budget +
+                                        absl::Seconds(10);
+  // Complete text records, including their length prefixes. Binary records go
+  // to results_file_ instead.
+  std::string records;
+  absl::Status status;
+  uint64_t exit_code = 0;
+  while (true) {
+    uint64_t size;
+    status = ReadExactly(process_.stdout_fd(), &size, sizeof(size), deadline);
+    if (!status.ok()) break;
+    if (size == kEndOfResponse) {
+      status = ReadExactly(process_.stdout_fd(), &exit_code,
+                           sizeof(exit_code), deadline);
+      break;
+    }
+    std::string record(size, '\0');
+    status = ReadExactly(process_.stdout_fd(), record.data(), size, deadline);
+    if (!status.ok()) break;
+    records.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    records.append(record);
+  }
+
+  const absl::Time parse_time = absl::Now();
+  times->wait = parse_time - wait_time;
+  absl::Cleanup parse_timer = [times, parse_time] {
+    times->parse = absl::Now() - parse_time;
+  };
+  int exit_status = W_EXITCODE(exit_code, 0);
+  if (absl::IsDeadlineExceeded(status)) {
+    kill(process_.pid(), SIGKILL);
+    Shutdown();
+    return status;
+  } else if (absl::IsOutOfRange(status)) {
+    // The server died, e.g. after running out of CPU time.
+    exit_status = Shutdown();
+  } else if (!status.ok()) {
+    kill(process_.pid(), SIGKILL);
+    Shutdown();
+    return status;
+  }
+
+  std::optional<RunnerStats> stats;
+  if (shared_stats_ != nullptr) {
+    stats = shared_stats_->Snapshot();
+    if (stats.has_value() && last_stats_.has_value()) {
+      RunnerStats current = *stats;
+      stats = RunnerStatsSince(current, *last_stats_);
+      last_stats_ = current;
+    } else {
+      last_stats_ = stats;
+    }
+  }
+  // The server is idle until the next command. Results are decoded into
+  // copies by then. Records that fail to decode are cleared too, so that
+  // later commands do not decode them again.
+  absl::Cleanup results_clearer = [this] {
+    if (results_file_ == nullptr) return;
+    if (absl::Status s = results_file_->Clear(); !s.ok()) {
+      LOG_ERROR(s.message());
+    }
+  };
+  absl::string_view runner_output = records;
+  RunnerDriver::ResultFormat format = RunnerDriver::ResultFormat::kText;
+  std::vector<std::string> skipped_ids;
+  if (results_file_ != nullptr) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(runner_output, results_file_->ReadNew());
+    // Skip records are written at startup and thus come with the results of
+    // the first command.
+    ASSIGN_OR_RETURN_IF_NOT_OK(skipped_ids, DecodeSkipRecords(&runner_output));
+    format = RunnerDriver::ResultFormat::kBinary;
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      std::vector<RunnerDriver::RunResult> results,
+      RunnerDriver::HandleRunnerRecords(runner_output, format, exit_status, "",
+                                        stats));
+  if (stats.has_value()) {
+    results.front().set_stats(*stats);
+  }
+  results.front().set_skipped_snapshot_ids(std::move(skipped_ids));
+  return results;
+}
+
 absl::StatusOr<RunnerDriver> RunnerDriverFromSnapshot(
     const Snapshot& snapshot, absl::string_view runner_path) {
   std::vector<Snapshot> corpus;
@@ -24,16 +24,23 @@
 
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "./common/harness_tracer.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./runner/driver/runner_options.h"
+#include "./runner/runner_stats.h"
+#include "./util/subprocess.h"
 
 namespace silifuzz {
 
 using snapshot_types::PlaybackOutcome;
 using snapshot_types::PlaybackResult;
 
+class RunnerServer;       // fwd declaration for friendship below.
+class SharedRunnerStats;  // defined in runner_driver.cc.
+class RunnerResultsFile;  // defined in runner_driver.cc.
+
 // RunnerDriver wraps a SiliFuzz runner (aka v2 player) binary and provides
 // helpers to Play()/Make()/Trace() individual snapshots contained in the
 // binary.
@@ -90,6 +97,22 @@ class RunnerDriver {
       return *player_result_;
     }
 
+    // Execution statistics reported by the runner. Only present when
+    // RunnerOptions::collect_stats() was set and the runner started
+    // executing snapshots.
+    const std::optional<RunnerStats>& stats() const { return stats_; }
+    void set_stats(const RunnerStats& stats) { stats_ = stats; }
+
+    // IDs of the snapshots that the runner skipped at startup because their
+    // mappings conflict with the runner itself. Only reported when results
+    // are binary, see RunnerOptions::text_results().
+    const std::vector<std::string>& skipped_snapshot_ids() const {
+      return skipped_snapshot_ids_;
+    }
+    void set_skipped_snapshot_ids(std::vector<std::string> ids) {
+      skipped_snapshot_ids_ = std::move(ids);
+    }
+
    private:
     // Constructs a new RunResult with the given success status and no
     // associated `player_result`.
@@ -104,6 +127,12 @@ class RunnerDriver {
 
     // Snapshot id (if any).
     std::string snapshot_id_;
+
+    // See stats().
+    std::optional<RunnerStats> stats_;
+
+    // See skipped_snapshot_ids().
+    std::vector<std::string> skipped_snapshot_ids_;
   };
 
   // Creates a RunnerDriver for a binary with baked-in corpus.
@@ -128,12 +157,22 @@ class RunnerDriver {
   RunnerDriver& operator=(RunnerDriver&& other) = default;
   ~RunnerDriver() = default;
 
+  // If true, the *One() methods below start the runner with a fork server
+  // when they can (see RunnerOptions::use_fork_server()). Run() and RunAll()
+  // follow the options they are passed instead.
+  void set_use_fork_server(bool use_fork_server) {
+    use_fork_server_ = use_fork_server;
+  }
+
   // Runs `snap_id` in play mode.
   // REQUIRES snap_id is not empty.
   absl::StatusOr<RunResult> PlayOne(absl::string_view snap_id) const;
 
-  // Runs `snap_id` in make mode (see comments in runner.cc).
-  absl::StatusOr<RunResult> MakeOne(absl::string_view snap_id) const;
+  // Runs `snap_id` in make mode (see comments in runner.cc). The runner adds
+  // up to `max_pages_to_add` writable pages to repair page faults and reports
+  // them in the actual end state memory.
+  absl::StatusOr<RunResult> MakeOne(absl::string_view snap_id,
+                                    int max_pages_to_add = 0) const;
 
   // Traces `snap_id` in single-step mode and invokes the provided callback for
   // every instruction of the snapshot.
@@ -149,9 +188,41 @@ class RunnerDriver {
   //
   // Unlike the *One() family of methods above this is a more generic way of
   // calling the binary that is intended for screening.
+  //
+  // If the runner reports more than one failure (see
+  // RunnerOptions::max_failures()), only the first one is returned.
   absl::StatusOr<RunResult> Run(const RunnerOptions& runner_options) const;
 
+  // Wall time spent in the phases of a runner invocation.
+  struct RunTimes {
+    // Starting the runner process or sending it a command.
+    absl::Duration start = absl::ZeroDuration();
+
+    // Waiting for the runner to finish, including reading its output.
+    absl::Duration wait = absl::ZeroDuration();
+
+    // Converting the runner output to RunResults.
+    absl::Duration parse = absl::ZeroDuration();
+  };
+
+  // Like Run() but returns every failure reported by the runner, in the order
+  // they happened. If there were no failures, the result contains a single
+  // successful RunResult. Only the first RunResult carries stats().
+  // If `times` is not nullptr, stores how long each phase took there.
+  absl::StatusOr<std::vector<RunResult>> RunAll(
+      const RunnerOptions& runner_options, RunTimes* times = nullptr) const;
+
+  // Starts the runner binary in server mode. Only the options that apply to
+  // the whole process are used: cpu, extra_argv, disable_aslr,
+  // map_stderr_to_dev_null, collect_stats and max_failures. Time budgets are
+  // passed to RunnerServer::Run() instead.
+  // REQUIRES: !runner_options.sequential_mode()
+  absl::StatusOr<std::unique_ptr<RunnerServer>> StartServer(
+      const RunnerOptions& runner_options) const;
+
  private:
+  friend class RunnerServer;  // for HandleRunnerRecords().
+
   // Wraps the binary at `binary_path`. When `corpus_path` not empty, it will
   // be passed as the last argument to the binary.
   explicit RunnerDriver(absl::string_view binary_path,
@@ -176,24 +247,66 @@ class RunnerDriver {
     kTrace,
   };
 
+  // Encoding of the results reported by a runner. See
+  // RunnerOptions::text_results().
+  enum class ResultFormat {
+    // proto.SnapshotExecutionResult text protos on stdout.
+    kText,
+
+    // Records of runner_result_protocol.h in a RunnerResultsFile.
+    kBinary,
+  };
+
   // Exit codes supported by the runner.
   enum class ExitCode : int {
     kSuccess = 0,
     kFailure = 1,
+    // See RunnerMainOptions::kTimeoutExitCode.
     kTimeout = 2,
+    // See RunnerMainOptions::kSnapSkippedExitCode.
+    kSnapSkipped = 3,
   };
   absl::StatusOr<RunResult> RunImpl(
       const RunnerOptions& runner_options, absl::string_view snap_id = "",
       std::optional<HarnessTracer::Callback> trace_cb = std::nullopt) const;
 
-  absl::StatusOr<RunResult> HandleRunnerOutput(
-      absl::string_view runner_stdout, int exit_status,
-      absl::string_view snapshot_id = "") const;
+  // Like RunImpl() but returns all results. See RunAll().
+  absl::StatusOr<std::vector<RunResult>> RunAllImpl(
+      const RunnerOptions& runner_options, absl::string_view snap_id = "",
+      std::optional<HarnessTracer::Callback> trace_cb = std::nullopt,
+      RunTimes* times = nullptr) const;
+
+  // Returns the command line for running the binary with `runner_options`
+  // except for the corpus path. `shared_stats` is nullptr unless
+  // runner_options.collect_stats() is set. `results_file` is nullptr if
+  // runner_options.text_results() is set.
+  std::vector<std::string> RunnerArgv(
+      const RunnerOptions& runner_options,
+      const SharedRunnerStats* shared_stats,
+      const RunnerResultsFile* results_file) const;
+
+  // Converts the output of a finished runner to a RunResult. `runner_output`
+  // holds the results reported in `format`. `stats` is the final contents of
+  // the runner's RunnerStats, if any.
+  static absl::StatusOr<RunResult> HandleRunnerOutput(
+      absl::string_view runner_output, ResultFormat format, int exit_status,
+      absl::string_view snapshot_id = "",
+      const std::optional<RunnerStats>& stats = std::nullopt);
+
+  // Like HandleRunnerOutput() for a runner that reports failures as
+  // records. See RunnerMainOptions::max_failures.
+  static absl::StatusOr<std::vector<RunResult>> HandleRunnerRecords(
+      absl::string_view runner_output, ResultFormat format, int exit_status,
+      absl::string_view snapshot_id = "",
+      const std::optional<RunnerStats>& stats = std::nullopt);
 
   // C-tor parameters.
   std::string binary_path_;
   std::string corpus_path_;
 
+  // See set_use_fork_server().
+  bool use_fork_server_ = false;
+
   // Cleanup callback handle. Wraps the user-provided `cleanup` std::function in
   // a container with "at most once" cleanup semantics. When an instance of this
   // class is moved, the handle is moved with it and the moved-from
@@ -203,6 +316,73 @@ class RunnerDriver {
   std::unique_ptr<RunnerDriver, std::function<void(RunnerDriver*)>> cleanup_;
 };
 
+// A runner process in server mode (see RunnerServerMain()). The process maps
+// its corpus once and then executes snapshots for each call to Run(), so the
+// cost of starting a runner and mapping the corpus is amortized across runs.
+// Use RunnerDriver::StartServer() to create an instance.
+//
+// This class is thread-compatible.
+class RunnerServer {
+ public:
+  // Closes the command channel and waits for the process to exit.
+  ~RunnerServer();
+
+  // Not copyable or movable, has I/O state.
+  RunnerServer(const RunnerServer&) = delete;
+  RunnerServer& operator=(const RunnerServer&) = delete;
+  RunnerServer(RunnerServer&&) = delete;
+  RunnerServer& operator=(RunnerServer&&) = delete;
+
+  // Executes snapshots from the corpus for up to `cpu_time_budget` and
+  // `wall_time_budget`, whichever ends first, and returns the results like
+  // RunnerDriver::RunAll(). Exceeding the budgets counts as a graceful
+  // timeout like for RunnerDriver::Run(). If the process dies, alive()
+  // becomes false and the results reported so far or an error are returned.
+  // If `times` is not nullptr, stores how long each phase took there.
+  // REQUIRES: alive()
+  absl::StatusOr<std::vector<RunnerDriver::RunResult>> Run(
+      absl::Duration cpu_time_budget, absl::Duration wall_time_budget,
+      RunnerDriver::RunTimes* times = nullptr);
+
+  // Returns true if the process can accept more Run() calls.
+  bool alive() const { return alive_; }
+
+  // Returns the statistics the process has accumulated since it started,
+  // including those of a Run() in progress, or std::nullopt unless it collects
+  // statistics. The shared page is read without a syscall, so this can be
+  // polled from another thread to observe the live throughput. The reading
+  // may lag the process by a few executions.
+  std::optional<RunnerStats> LiveStats() const;
+
+ private:
+  friend class RunnerDriver;  // for the c-tor.
+
+  RunnerServer(const Subprocess::Options& options,
+               std::unique_ptr<SharedRunnerStats> shared_stats,
+               std::unique_ptr<RunnerResultsFile> results_file);
+
+  // Extends the CPU time limit of the process by `cpu_time_budget`.
+  absl::Status SetCpuTimeBudget(absl::Duration cpu_time_budget);
+
+  // Marks the process as dead and collects its exit status.
+  int Shutdown();
+
+  Subprocess process_;
+
+  // Shared RunnerStats of the process or nullptr.
+  std::unique_ptr<SharedRunnerStats> shared_stats_;
+
+  // Contents of the shared RunnerStats after the previous Run().
+  std::optional<RunnerStats> last_stats_;
+
+  // File the process reports binary results in or nullptr if it reports
+  // text on stdout.
+  std::unique_ptr<RunnerResultsFile> results_file_;
+
+  // See alive().
+  bool alive_;
+};
+
 // Compiles `snapshot` into a runner binary containing exactly one snap.
 // RETURNS RunnerDriver wrapping the runner executable file or a status.
 absl::StatusOr<RunnerDriver> RunnerDriverFromSnapshot(
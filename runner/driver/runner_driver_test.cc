@@ -14,20 +14,31 @@
 
 #include "./runner/driver/runner_driver.h"
 
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/user.h>
+#include <unistd.h>
 
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "./common/snapshot_enums.h"
+#include "./runner/driver/runner_options.h"
 #include "./runner/runner_provider.h"
+#include "./runner/runner_stats.h"
 #include "./snap/testing/snap_test_snaps.h"
 #include "./snap/testing/snap_test_types.h"
+#include "./util/file_util.h"
 #include "./util/path_util.h"
 #include "./util/testing/status_macros.h"
 #include "./util/testing/status_matchers.h"
@@ -36,7 +47,9 @@ namespace silifuzz {
 namespace {
 using silifuzz::testing::StatusIs;
 using snapshot_types::PlaybackOutcome;
+using ::testing::Contains;
 using ::testing::HasSubstr;
+using ::testing::Property;
 
 RunnerDriver HelperDriver() {
   return RunnerDriver::BakedRunner(RunnerTestHelperLocation());
@@ -55,6 +68,200 @@ TEST(RunnerDriver, BasicRun) {
               StatusIs(absl::StatusCode::kInternal, HasSubstr("syscall")));
 }
 
+TEST(RunnerDriver, CollectStats) {
+  RunnerDriver driver = HelperDriver();
+  Snap endAsExpectedSnap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  RunnerOptions runner_options =
+      RunnerOptions::PlayOptions(endAsExpectedSnap.id);
+  runner_options.set_collect_stats(true);
+  auto run_result_or = driver.Run(runner_options);
+  ASSERT_OK(run_result_or);
+  ASSERT_TRUE(run_result_or->success());
+  ASSERT_TRUE(run_result_or->stats().has_value());
+  const RunnerStats& stats = *run_result_or->stats();
+  EXPECT_EQ(stats.num_executions, 3);
+  // All executions end with RunSnapOutcome::kAsExpected.
+  EXPECT_EQ(stats.outcome_counts[0], 3);
+  EXPECT_GT(stats.phase_ticks[RunnerStats::kRun], 0);
+}
+
+TEST(RunnerDriver, LazyMapping) {
+  RunnerDriver driver = HelperDriver();
+  Snap endAsExpectedSnap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  RunnerOptions runner_options = RunnerOptions::Default();
+  runner_options.set_collect_stats(true).set_extra_argv(
+      {"--snap_id", endAsExpectedSnap.id, "--num_iterations", "3",
+       "--lazy_mapping"});
+  auto run_result_or = driver.Run(runner_options);
+  ASSERT_OK(run_result_or);
+  ASSERT_TRUE(run_result_or->success());
+  ASSERT_TRUE(run_result_or->stats().has_value());
+  const RunnerStats& stats = *run_result_or->stats();
+  EXPECT_EQ(stats.num_executions, 3);
+  // The single snap is set up once on its first execution.
+  EXPECT_EQ(stats.num_lazily_mapped_snaps, 1);
+  EXPECT_GT(stats.map_corpus_rss_bytes, 0);
+}
+
+TEST(RunnerDriver, MultipleFailures) {
+  RunnerDriver driver = HelperDriver();
+  Snap regsMismatchSnap = GetSnapRunnerTestSnap(TestSnapshot::kRegsMismatch);
+  // PlayOptions() runs the snap 3 times.
+  RunnerOptions runner_options =
+      RunnerOptions::PlayOptions(regsMismatchSnap.id);
+  runner_options.set_max_failures(10);
+  auto run_results_or = driver.RunAll(runner_options);
+  ASSERT_OK(run_results_or);
+  ASSERT_EQ(run_results_or->size(), 3);
+  for (const auto& result : *run_results_or) {
+    ASSERT_FALSE(result.success());
+    EXPECT_EQ(result.snapshot_id(), regsMismatchSnap.id);
+    EXPECT_EQ(result.player_result().outcome,
+              PlaybackOutcome::kRegisterStateMismatch);
+  }
+
+  // The runner stops at the failure cap.
+  runner_options.set_max_failures(2);
+  run_results_or = driver.RunAll(runner_options);
+  ASSERT_OK(run_results_or);
+  EXPECT_EQ(run_results_or->size(), 2);
+}
+
+TEST(RunnerDriver, TextResults) {
+  RunnerDriver driver = HelperDriver();
+  Snap memMismatchSnap = GetSnapRunnerTestSnap(TestSnapshot::kMemoryMismatch);
+  RunnerOptions runner_options = RunnerOptions::PlayOptions(memMismatchSnap.id);
+  runner_options.set_max_failures(10);
+  auto binary_results_or = driver.RunAll(runner_options);
+  ASSERT_OK(binary_results_or);
+  runner_options.set_text_results(true);
+  auto text_results_or = driver.RunAll(runner_options);
+  ASSERT_OK(text_results_or);
+
+  // Both encodings report the same results.
+  ASSERT_EQ(binary_results_or->size(), text_results_or->size());
+  for (size_t i = 0; i < binary_results_or->size(); ++i) {
+    const RunnerDriver::RunResult& binary = (*binary_results_or)[i];
+    const RunnerDriver::RunResult& text = (*text_results_or)[i];
+    ASSERT_FALSE(binary.success());
+    EXPECT_EQ(binary.snapshot_id(), text.snapshot_id());
+    EXPECT_EQ(binary.player_result().outcome, text.player_result().outcome);
+    ASSERT_TRUE(binary.player_result().actual_end_state.has_value());
+    ASSERT_TRUE(text.player_result().actual_end_state.has_value());
+    EXPECT_EQ(*binary.player_result().actual_end_state,
+              *text.player_result().actual_end_state);
+  }
+}
+
+TEST(RunnerDriver, ForkServer) {
+  RunnerDriver driver = HelperDriver();
+  Snap memMismatchSnap = GetSnapRunnerTestSnap(TestSnapshot::kMemoryMismatch);
+  RunnerOptions runner_options = RunnerOptions::PlayOptions(memMismatchSnap.id);
+  runner_options.set_use_fork_server(false);
+  auto exec_result_or = driver.Run(runner_options);
+  ASSERT_OK(exec_result_or);
+  ASSERT_FALSE(exec_result_or->success());
+  ASSERT_TRUE(exec_result_or->player_result().actual_end_state.has_value());
+
+  // Forked runners report the same results, also when the fork server is
+  // reused.
+  runner_options.set_use_fork_server(true);
+  for (int i = 0; i < 3; ++i) {
+    auto forked_result_or = driver.Run(runner_options);
+    ASSERT_OK(forked_result_or);
+    ASSERT_FALSE(forked_result_or->success());
+    EXPECT_EQ(forked_result_or->player_result().outcome,
+              exec_result_or->player_result().outcome);
+    ASSERT_TRUE(forked_result_or->player_result().actual_end_state.has_value());
+    EXPECT_EQ(*forked_result_or->player_result().actual_end_state,
+              *exec_result_or->player_result().actual_end_state);
+  }
+
+  Snap endAsExpectedSnap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  auto success_result_or = driver.PlayOne(endAsExpectedSnap.id);
+  ASSERT_OK(success_result_or);
+  EXPECT_TRUE(success_result_or->success());
+}
+
+TEST(RunnerDriver, ServerMode) {
+  RunnerDriver driver = HelperDriver();
+  Snap endAsExpectedSnap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  RunnerOptions runner_options =
+      RunnerOptions::PlayOptions(endAsExpectedSnap.id);
+  runner_options.set_collect_stats(true);
+  auto server_or = driver.StartServer(runner_options);
+  ASSERT_OK(server_or);
+  RunnerServer& server = **server_or;
+  // Each run reports only the executions since the previous one.
+  for (int i = 0; i < 2; ++i) {
+    auto run_results_or =
+        server.Run(absl::InfiniteDuration(), absl::InfiniteDuration());
+    ASSERT_OK(run_results_or);
+    ASSERT_EQ(run_results_or->size(), 1);
+    const RunnerDriver::RunResult& result = run_results_or->front();
+    ASSERT_TRUE(result.success());
+    ASSERT_TRUE(result.stats().has_value());
+    EXPECT_EQ(result.stats()->num_executions, 3);
+    EXPECT_TRUE(server.alive());
+  }
+}
+
+TEST(RunnerDriver, ServerModeLiveStats) {
+  RunnerDriver driver = HelperDriver();
+  Snap endAsExpectedSnap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  RunnerOptions runner_options = RunnerOptions::Default();
+  // Keep executing the snapshot until the time budget runs out.
+  runner_options.set_extra_argv({"--snap_id", endAsExpectedSnap.id})
+      .set_collect_stats(true);
+  auto server_or = driver.StartServer(runner_options);
+  ASSERT_OK(server_or);
+  RunnerServer& server = **server_or;
+
+  absl::StatusOr<std::vector<RunnerDriver::RunResult>> run_results_or;
+  std::thread run_thread([&server, &run_results_or] {
+    run_results_or = server.Run(absl::Seconds(2), absl::Seconds(2));
+  });
+  // Executions show up while the run is in progress.
+  uint64_t live_executions = 0;
+  const absl::Time poll_deadline = absl::Now() + absl::Seconds(1);
+  while (live_executions == 0 && absl::Now() < poll_deadline) {
+    std::optional<RunnerStats> live_stats = server.LiveStats();
+    if (live_stats.has_value()) {
+      live_executions = live_stats->num_executions;
+    }
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  run_thread.join();
+  EXPECT_GT(live_executions, 0);
+  ASSERT_OK(run_results_or);
+  ASSERT_TRUE(run_results_or->front().stats().has_value());
+  EXPECT_GE(run_results_or->front().stats()->num_executions, live_executions);
+}
+
+TEST(RunnerDriver, ServerModeFailures) {
+  RunnerDriver driver = HelperDriver();
+  Snap memMismatchSnap = GetSnapRunnerTestSnap(TestSnapshot::kMemoryMismatch);
+  RunnerOptions runner_options = RunnerOptions::PlayOptions(memMismatchSnap.id);
+  runner_options.set_max_failures(10);
+  auto server_or = driver.StartServer(runner_options);
+  ASSERT_OK(server_or);
+  RunnerServer& server = **server_or;
+  // The results file is emptied after each run. Each run reports only its
+  // own failures.
+  for (int i = 0; i < 3; ++i) {
+    auto run_results_or =
+        server.Run(absl::InfiniteDuration(), absl::InfiniteDuration());
+    ASSERT_OK(run_results_or);
+    ASSERT_EQ(run_results_or->size(), 3);
+    for (const auto& result : *run_results_or) {
+      ASSERT_FALSE(result.success());
+      EXPECT_EQ(result.snapshot_id(), memMismatchSnap.id);
+      EXPECT_EQ(result.player_result().outcome,
+                PlaybackOutcome::kMemoryMismatch);
+    }
+  }
+}
+
 TEST(RunnerDriver, BasicMake) {
   RunnerDriver driver = HelperDriver();
   Snap sigSegvReadSnap = GetSnapRunnerTestSnap(TestSnapshot::kSigSegvRead);
@@ -66,6 +273,41 @@ TEST(RunnerDriver, BasicMake) {
   ASSERT_EQ(make_result_or->snapshot_id(), sigSegvReadSnap.id);
 }
 
+TEST(RunnerDriver, MakeAddsPages) {
+  RunnerDriver driver = HelperDriver();
+  Snap sigSegvReadSnap = GetSnapRunnerTestSnap(TestSnapshot::kSigSegvRead);
+  ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult fault_result,
+                       driver.MakeOne(sigSegvReadSnap.id));
+  ASSERT_TRUE(fault_result.player_result().actual_end_state.has_value());
+  const Snapshot::Endpoint& fault =
+      fault_result.player_result().actual_end_state->endpoint();
+  ASSERT_EQ(fault.type(), Snapshot::Endpoint::kSignal);
+  ASSERT_EQ(fault.sig_cause(), snapshot_types::SigCause::kSegvCantRead);
+
+  // The runner repairs the fault and reports the zero-filled page it added.
+  ASSERT_OK_AND_ASSIGN(
+      RunnerDriver::RunResult make_result,
+      driver.MakeOne(sigSegvReadSnap.id, /*max_pages_to_add=*/1));
+  ASSERT_TRUE(make_result.player_result().actual_end_state.has_value());
+  const Snapshot::EndState& end_state =
+      *make_result.player_result().actual_end_state;
+  // sig_cause() is only defined for signal endpoints.
+  if (end_state.endpoint().type() == Snapshot::Endpoint::kSignal) {
+    EXPECT_NE(end_state.endpoint().sig_cause(),
+              snapshot_types::SigCause::kSegvCantRead);
+  }
+  const Snapshot::Address page_address =
+      fault.sig_address() / getpagesize() * getpagesize();
+  EXPECT_THAT(end_state.memory_bytes(),
+              Contains(Property(&Snapshot::MemoryBytes::start_address,
+                                page_address)));
+
+  // Signals of the child processes reach the driver.
+  Snap syscallSnap = GetSnapRunnerTestSnap(TestSnapshot::kSyscall);
+  EXPECT_THAT(driver.MakeOne(syscallSnap.id, /*max_pages_to_add=*/1),
+              StatusIs(absl::StatusCode::kInternal, HasSubstr("syscall")));
+}
+
 TEST(RunnerDriver, BasicTrace) {
   RunnerDriver driver = HelperDriver();
   Snap endAsExpectedSnap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
@@ -85,6 +327,18 @@ TEST(RunnerDriver, BasicTrace) {
   ASSERT_TRUE(hit_initial_snap_rip);
 }
 
+TEST(RunnerDriver, KilledBySignal) {
+  // A "runner" that is killed from outside.
+  auto tmp_binary = CreateTempFile("killed_runner");
+  ASSERT_OK(tmp_binary);
+  ASSERT_TRUE(SetContents(*tmp_binary, "#!/bin/sh\nkill -KILL $$\n"));
+  ASSERT_EQ(chmod(tmp_binary->c_str(), 0755), 0);
+  RunnerDriver driver = RunnerDriver::BakedRunner(
+      *tmp_binary, [&] { std::filesystem::remove(*tmp_binary); });
+  EXPECT_THAT(driver.PlayOne("some_snap"),
+              StatusIs(absl::StatusCode::kAborted, HasSubstr("signal 9")));
+}
+
 TEST(RunnerDriver, Cleanup) {
   auto tmp_binary = CreateTempFile("binary");
   ASSERT_OK(tmp_binary);
@@ -14,6 +14,11 @@
 
 #include "./runner/driver/runner_options.h"
 
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "./util/checks.h"
 
 namespace silifuzz {
@@ -44,11 +49,16 @@ RunnerOptions RunnerOptions::PlayOptions(absl::string_view snap_id) {
                        "--num_iterations", "3"});
 }
 
-RunnerOptions RunnerOptions::MakeOptions(absl::string_view snap_id) {
+RunnerOptions RunnerOptions::MakeOptions(absl::string_view snap_id,
+                                         int max_pages_to_add) {
+  std::vector<std::string> extra_argv = {"--snap_id", std::string(snap_id),
+                                         "--num_iterations", "1", "--make"};
+  if (max_pages_to_add > 0) {
+    extra_argv.push_back(absl::StrCat("--max_pages_to_add=", max_pages_to_add));
+  }
   return RunnerOptions()
       .set_cpu_time_bugdet(kPerSnapPlayCpuTimeBudget)
-      .set_extra_argv({"--snap_id", std::string(snap_id), "--num_iterations",
-                       "1", "--make"})
+      .set_extra_argv(extra_argv)
       // Discard human-readable failure details in stderr.
       // Failures are expected during making.
       .set_map_stderr_to_dev_null(true);
@@ -15,6 +15,8 @@
 #ifndef THIRD_PARTY_SILIFUZZ_RUNNER_DRIVER_RUNNER_OPTIONS_H_
 #define THIRD_PARTY_SILIFUZZ_RUNNER_DRIVER_RUNNER_OPTIONS_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -64,6 +66,36 @@ class RunnerOptions {
     return *this;
   }
 
+  RunnerOptions& set_collect_stats(bool collect_stats) {
+    this->collect_stats_ = collect_stats;
+    return *this;
+  }
+
+  RunnerOptions& set_max_failures(uint64_t max_failures) {
+    this->max_failures_ = max_failures;
+    return *this;
+  }
+
+  RunnerOptions& set_text_results(bool text_results) {
+    this->text_results_ = text_results;
+    return *this;
+  }
+
+  RunnerOptions& set_use_fork_server(bool use_fork_server) {
+    this->use_fork_server_ = use_fork_server;
+    return *this;
+  }
+
+  // Makes the runner member `index` of the co-scheduling group of `size`
+  // runners that share the group file at `path`. See runner/cosched_group.h.
+  RunnerOptions& set_cosched_group(absl::string_view path, size_t size,
+                                   size_t index) {
+    this->cosched_group_path_ = std::string(path);
+    this->cosched_group_size_ = size;
+    this->cosched_group_index_ = index;
+    return *this;
+  }
+
   int cpu() const { return cpu_; }
   absl::Duration cpu_time_budget() const { return cpu_time_budget_; }
   absl::Duration wall_time_budget() const { return wall_time_budget_; }
@@ -72,6 +104,13 @@ class RunnerOptions {
   bool disable_aslr() const { return disable_aslr_; }
   bool sequential_mode() const { return sequential_mode_; }
   bool map_stderr_to_dev_null() const { return map_stderr_to_dev_null_; }
+  bool collect_stats() const { return collect_stats_; }
+  uint64_t max_failures() const { return max_failures_; }
+  bool text_results() const { return text_results_; }
+  bool use_fork_server() const { return use_fork_server_; }
+  const std::string& cosched_group_path() const { return cosched_group_path_; }
+  size_t cosched_group_size() const { return cosched_group_size_; }
+  size_t cosched_group_index() const { return cosched_group_index_; }
 
   RunnerOptions(const RunnerOptions&) = default;
   RunnerOptions(RunnerOptions&&) = default;
@@ -79,9 +118,12 @@ class RunnerOptions {
   RunnerOptions& operator=(RunnerOptions&&) = default;
 
   // Returns a default instance of RunnerOptions suitable for Playing/Making/etc
-  // for `snap_id`.
+  // for `snap_id`. MakeOptions() lets the runner add up to `max_pages_to_add`
+  // writable pages to repair page faults. See
+  // RunnerMainOptions::max_pages_to_add.
   static RunnerOptions PlayOptions(absl::string_view snap_id);
-  static RunnerOptions MakeOptions(absl::string_view snap_id);
+  static RunnerOptions MakeOptions(absl::string_view snap_id,
+                                   int max_pages_to_add = 0);
   static RunnerOptions VerifyOptions(absl::string_view snap_id);
   static RunnerOptions TraceOptions(absl::string_view snap_id);
 
@@ -115,6 +157,36 @@ class RunnerOptions {
 
   // If true, map runner's stderr to /dev/null.
   bool map_stderr_to_dev_null_ = false;
+
+  // If true, the runner maintains execution statistics in memory shared with
+  // RunnerDriver. See RunnerDriver::RunResult::stats().
+  bool collect_stats_ = false;
+
+  // Number of failed snapshot executions after which the runner stops. When
+  // greater than 1, RunnerDriver::RunAll() can return multiple failures from
+  // a single runner invocation.
+  uint64_t max_failures_ = 1;
+
+  // If true, the runner reports results as text protos on stdout. This is
+  // much slower for snapshots with large writable memory and only meant for
+  // debugging. Otherwise, results are passed in the binary format of
+  // runner_result_protocol.h through a dedicated file.
+  bool text_results_ = false;
+
+  // If true, the runner is forked by a runner in fork server mode (see
+  // runner_fork_server_protocol.h) instead of being exec'd, when the other
+  // options allow it. This saves the cost of exec'ing the runner binary for
+  // each run, which matters to callers that start many short runs, like the
+  // snapshot maker. Runs with ASLR, text results or a tracer are always
+  // exec'd.
+  bool use_fork_server_ = false;
+
+  // If not empty, the file shared by the runners of a co-scheduling group,
+  // which run in lock-step. This runner is member `cosched_group_index_` of
+  // `cosched_group_size_` members.
+  std::string cosched_group_path_ = "";
+  size_t cosched_group_size_ = 1;
+  size_t cosched_group_index_ = 0;
 };
 
 }  // namespace silifuzz
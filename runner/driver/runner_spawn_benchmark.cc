@@ -0,0 +1,88 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark of starting runners from RunnerDriver.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/runner/driver:runner_spawn_benchmark
+//
+// Plays a single snapshot repeatedly with runners that are exec'd for each
+// run and with runners forked by a fork server (see
+// runner_fork_server_protocol.h), and reports the mean latency of a run along
+// with the part of it spent starting the runner (RunnerDriver::RunTimes).
+// The first forked run includes starting the fork server.
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./runner/driver/runner_driver.h"
+#include "./runner/driver/runner_options.h"
+#include "./runner/runner_provider.h"
+#include "./snap/testing/snap_test_snaps.h"
+#include "./snap/testing/snap_test_types.h"
+#include "./util/checks.h"
+
+ABSL_FLAG(int, num_runs, 1000, "Number of runs per configuration.");
+
+namespace silifuzz {
+
+namespace {
+
+void RunBenchmark(const char* name, const RunnerDriver& driver,
+                  const RunnerOptions& runner_options, int num_runs) {
+  RunnerDriver::RunTimes total_times;
+  const absl::Time start = absl::Now();
+  for (int i = 0; i < num_runs; ++i) {
+    RunnerDriver::RunTimes times;
+    auto results = driver.RunAll(runner_options, &times);
+    CHECK_STATUS(results.status());
+    CHECK(results->front().success());
+    total_times.start += times.start;
+    total_times.wait += times.wait;
+  }
+  const absl::Duration elapsed = absl::Now() - start;
+  LOG_INFO(name, ": ", absl::FormatDuration(elapsed / num_runs),
+           " per run, start ",
+           absl::FormatDuration(total_times.start / num_runs), " wait ",
+           absl::FormatDuration(total_times.wait / num_runs));
+}
+
+int BenchmarkMain() {
+  const int num_runs = absl::GetFlag(FLAGS_num_runs);
+  RunnerDriver driver = RunnerDriver::BakedRunner(RunnerTestHelperLocation());
+  const Snap& snap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  RunnerOptions runner_options = RunnerOptions::PlayOptions(snap.id);
+  LOG_INFO("Playing snapshot ", snap.id, " ", num_runs, " times");
+
+  runner_options.set_use_fork_server(false);
+  RunBenchmark("exec", driver, runner_options, num_runs);
+  runner_options.set_use_fork_server(true);
+  RunBenchmark("fork server", driver, runner_options, num_runs);
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+}  // namespace silifuzz
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  return silifuzz::BenchmarkMain();
+}
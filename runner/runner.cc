@@ -14,9 +14,11 @@
 
 #include "./runner/runner.h"
 
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #include <ucontext.h>
 #include <unistd.h>
 
@@ -32,12 +34,17 @@
 
 #include "third_party/lss/lss/linux_syscall_support.h"
 #include "./common/snapshot_enums.h"
+#include "./runner/cosched_group.h"
+#include "./runner/runner_result_protocol.h"
+#include "./runner/runner_server_protocol.h"
 #include "./runner/runner_util.h"
 #include "./runner/snap_runner_util.h"
 #include "./snap/exit_sequence.h"
 #include "./snap/snap.h"
+#include "./util/byte_io.h"
 #include "./util/cache.h"
 #include "./util/checks.h"
+#include "./util/checksum.h"
 #include "./util/cpu_id.h"
 #include "./util/itoa.h"
 #include "./util/logging_util.h"
@@ -54,7 +61,11 @@
 //  stdout:   a single silifuzz.proto.SnapshotExecutionResult formatted as
 //            text proto. In "run" mode this happens for the first failed snap,
 //            in "make" mode the proto is always printed. This is intended to
-//            be machine-readable.
+//            be machine-readable. With --max_failures > 1 and in "server"
+//            mode each result is a length-prefixed record instead. See
+//            RunnerMainOptions::max_failures and runner_server_protocol.h.
+//            With --results_path, results are written to that file as binary
+//            records instead. See runner_result_protocol.h.
 //  stderr:   human-readable log messages. The verbosity is controlled by --v
 //            with the following levels.
 //             0: Quiet (default).
@@ -66,7 +77,11 @@
 //               iterations and all snapshots passed.
 //             1 for any snap failure (stdout will contain the machine-readable
 //               result).
-//             2 graceful shutdown due to timeout.
+//             2 graceful shutdown due to timeout, see
+//               RunnerMainOptions::kTimeoutExitCode.
+//             3 the Snap requested with --snap_id was skipped because its
+//               mappings conflict with the runner, see
+//               RunnerMainOptions::kSnapSkippedExitCode.
 //
 //             TODO(ksteuck): [impl] an exit code for internal process failure
 //               (mapping conflict, unmappable region, etc).
@@ -127,7 +142,7 @@ constexpr int kInitialMappingProtection = PROT_READ | PROT_WRITE;
 void SigAction(int signal, siginfo_t* siginfo, void* uc) {
   // SIGALRM signals deadline from the orchestrator. Exit immediately.
   if (signal == SIGALRM) {
-    _exit(2);
+    _exit(RunnerMainOptions::kTimeoutExitCode);
   }
   if (IsInsideSnap()) {
     // The signal arrived while executing a snapshot -- blame it on the
@@ -136,11 +151,11 @@ void SigAction(int signal, siginfo_t* siginfo, void* uc) {
     __builtin_unreachable();
   }
   // A signal was not caused by any snapshot. If it is one of the
-  // timeout signals we _exit(2). Otherwise crash.
+  // timeout signals we exit with kTimeoutExitCode. Otherwise crash.
   ASS_LOG_INFO("Received signal ", IntStr(signal),
                " while outside of snap. Exiting");
   if (signal == SIGXCPU) {
-    _exit(2);
+    _exit(RunnerMainOptions::kTimeoutExitCode);
   }
   // A signal occurred while executing the runner code. Most likely indicates
   // a bug in the runner or a signal from the environment (keyboard, RLIMIT).
@@ -157,6 +172,39 @@ bool VerifyMemoryBytes(const Snap::MemoryBytes& memory_bytes) {
              : MemEq(address, memory_bytes.data.byte_values.elements, size);
 }
 
+// Returns true iff `memory_bytes` overlaps `memory_mapping`.
+bool Overlaps(const Snap::MemoryBytes& memory_bytes,
+              const Snap::MemoryMapping& memory_mapping) {
+  return memory_bytes.start_address <
+             memory_mapping.start_address + memory_mapping.num_bytes &&
+         memory_mapping.start_address <
+             memory_bytes.start_address + memory_bytes.size();
+}
+
+// Returns true iff the current contents of the end state memory bytes of
+// `snap` within `memory_mapping` match the precomputed end state checksum of
+// the mapping. This reads only the live memory, not the expected byte values.
+// Returns false if `memory_mapping` has no checksum.
+bool VerifyEndStateMappingChecksum(const Snap& snap,
+                                   const Snap::MemoryMapping& memory_mapping) {
+  if (memory_mapping.end_state_checksum == 0) {
+    return false;
+  }
+  const uint64_t mapping_limit =
+      memory_mapping.start_address + memory_mapping.num_bytes;
+  MemoryChecksum checksum;
+  for (const auto& memory_bytes : snap.end_state_memory_bytes) {
+    const uint64_t start =
+        std::max(memory_bytes.start_address, memory_mapping.start_address);
+    const uint64_t limit = std::min(
+        memory_bytes.start_address + memory_bytes.size(), mapping_limit);
+    if (start < limit) {
+      checksum.AddData(AsPtr(start), limit - start);
+    }
+  }
+  return checksum.Value() == memory_mapping.end_state_checksum;
+}
+
 // Copies memory bytes from Snap to runtime address.
 void SetupMemoryBytes(const Snap::MemoryBytes& memory_bytes) {
   void* target_address = AsPtr(memory_bytes.start_address);
@@ -169,6 +217,76 @@ void SetupMemoryBytes(const Snap::MemoryBytes& memory_bytes) {
   }
 }
 
+// Per-Snap flags of a lazily mapped corpus. Element i is non-zero once
+// read-only contents of the i-th Snap have been set up. This is nullptr if
+// the corpus was mapped eagerly. See MapCorpus().
+uint8_t* lazy_snap_ready = nullptr;
+size_t num_lazy_snaps = 0;
+
+// Writable alias of the read-only mappings of a lazily mapped corpus. These
+// mappings are shared mappings of a temporary file that is also mapped here,
+// so their contents can be set up without mprotect(2), which the seccomp
+// sandbox does not allow. Element i of `lazy_alias_offsets` is the offset in
+// the alias of the first such mapping of the i-th Snap. The mappings of a
+// Snap follow each other in order. See MappedThroughAlias().
+uint8_t* lazy_alias = nullptr;
+uint64_t* lazy_alias_offsets = nullptr;
+
+// File descriptor that read-only mapping images are mapped from or -1 if
+// images are not used. See MapCorpus().
+int mapping_image_fd = -1;
+
+// Returns true iff `memory_mapping` is mapped from its image.
+bool MappedFromImage(const Snap::MemoryMapping& memory_mapping) {
+  return mapping_image_fd >= 0 && memory_mapping.image_offset != 0;
+}
+
+// Returns true iff `memory_mapping` is mapped from the temporary file of a
+// lazily mapped corpus when it is mapped lazily, which applies to all
+// read-only mappings that do not have an image.
+bool MappedThroughAlias(const Snap::MemoryMapping& memory_mapping) {
+  return !MappedFromImage(memory_mapping) &&
+         (memory_mapping.perms & PROT_WRITE) == 0;
+}
+
+// Returns true iff `memory_bytes` of `snap` are inside a mapping that is
+// mapped from its image and therefore already has the right contents.
+bool InMappingImage(const Snap& snap, const Snap::MemoryBytes& memory_bytes) {
+  if (mapping_image_fd < 0) return false;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (MappedFromImage(memory_mapping) &&
+        memory_bytes.start_address >= memory_mapping.start_address &&
+        memory_bytes.start_address + memory_bytes.size() <=
+            memory_mapping.start_address + memory_mapping.num_bytes) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Zero-filled writable pages added by MakerMain() to repair page faults of
+// the Snap. See RunnerMainOptions::max_pages_to_add.
+struct AddedPages {
+  uint64_t start_addresses[RunnerMainOptions::kMaxPagesToAdd];
+  size_t size = 0;
+};
+
+AddedPages added_pages;
+
+// Calls `f(start_address, num_bytes)` for each writable memory range of
+// `snap`, including the pages added by MakerMain().
+template <typename F>
+void ForEachWritableRange(const Snap& snap, F&& f) {
+  for (const auto& memory_bytes : snap.memory_bytes) {
+    if (memory_bytes.writable()) {
+      f(memory_bytes.start_address, memory_bytes.size());
+    }
+  }
+  for (size_t i = 0; i < added_pages.size; ++i) {
+    f(added_pages.start_addresses[i], getpagesize());
+  }
+}
+
 }  // namespace
 
 void InstallSigHandler() {
@@ -227,16 +345,18 @@ void SetupReadOnlySnapContents(const Snap& snap) {
   VLOG_INFO(2, "Setting up r/o content for ", snap.id);
   // Copy read-only memory contents.
   for (const auto& memory_bytes : snap.memory_bytes) {
-    if (!memory_bytes.writable()) {
+    if (!memory_bytes.writable() && !InMappingImage(snap, memory_bytes)) {
       // TODO(ksteuck): [bug] This MemCopy segfaults if two snaps map the same
       // read-only page.
       SetupMemoryBytes(memory_bytes);
     }
   }
 
-  // mprotect all pages that are something other than RW.
+  // mprotect all pages that are something other than RW. Mappings from
+  // images already have their final protection.
   for (const auto& memory_mapping : snap.memory_mappings) {
-    if (memory_mapping.perms != kInitialMappingProtection) {
+    if (memory_mapping.perms != kInitialMappingProtection &&
+        !MappedFromImage(memory_mapping)) {
       const uint64_t start_address = memory_mapping.start_address;
       VLOG_INFO(2, "mprotect mapping ", HexStr(start_address));
       DCHECK_LE(start_address, start_address + memory_mapping.num_bytes);
@@ -256,6 +376,70 @@ void SetupReadOnlySnapContents(const Snap& snap) {
   }
 }
 
+// Like SetupReadOnlySnapContents() for the `index`-th Snap of a lazily mapped
+// corpus. Writes the contents of read-only mappings through `lazy_alias`.
+// Other mappings already have their final protection.
+void SetupReadOnlySnapContentsThroughAlias(const Snap& snap, size_t index) {
+  VLOG_INFO(2, "Setting up r/o content for ", snap.id, " through alias");
+  uint8_t* alias = lazy_alias + lazy_alias_offsets[index];
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (!MappedThroughAlias(memory_mapping)) continue;
+    const uint64_t start_address = memory_mapping.start_address;
+    const uint64_t limit_address = start_address + memory_mapping.num_bytes;
+    for (const auto& memory_bytes : snap.memory_bytes) {
+      if (memory_bytes.start_address < start_address ||
+          memory_bytes.start_address + memory_bytes.size() > limit_address) {
+        continue;
+      }
+      void* target = alias + (memory_bytes.start_address - start_address);
+      if (memory_bytes.repeating()) {
+        MemSet(target, memory_bytes.data.byte_run.value, memory_bytes.size());
+      } else {
+        MemCopy(target, memory_bytes.data.byte_values.elements,
+                memory_bytes.size());
+      }
+    }
+    // Cache maintenance by virtual address applies to the physical pages, so
+    // the alias can be used even if the mapping is not readable.
+    if (memory_mapping.perms & PROT_EXEC) {
+      sync_instruction_cache(alias, memory_mapping.num_bytes);
+    }
+    alias += memory_mapping.num_bytes;
+  }
+}
+
+// Creates a temporary file of `size` bytes for the read-only mappings of a
+// lazily mapped corpus and maps `lazy_alias` from it. Returns the file
+// descriptor or -1 and logs if the file cannot be created.
+int CreateLazyAliasFile(size_t size) {
+  // O_TMPFILE creates an unnamed file that is gone when the runner exits.
+  int fd = open("/dev/shm", O_TMPFILE | O_RDWR, 0600);
+  if (fd < 0) {
+    LOG_ERROR("open(/dev/shm, O_TMPFILE): ", ErrnoStr(errno));
+    return -1;
+  }
+  // Extend the file without ftruncate(2), which the runner does not wrap.
+  if (lseek(fd, size - 1, SEEK_SET) < 0 || Write(fd, "", 1) != 1) {
+    LOG_FATAL("Cannot extend lazy mapping file: ", ErrnoStr(errno));
+  }
+  // Like corpus images, executable mappings fail on noexec mounts.
+  void* probe = mmap(nullptr, getpagesize(), PROT_READ | PROT_EXEC,
+                     MAP_SHARED, fd, 0);
+  if (probe == MAP_FAILED) {
+    LOG_ERROR("Cannot map lazy mapping file: ", ErrnoStr(errno));
+    CHECK_EQ(close(fd), 0);
+    return -1;
+  }
+  CHECK_EQ(munmap(probe, getpagesize()), 0);
+  void* alias =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (alias == MAP_FAILED) {
+    LOG_FATAL("mmap() failed: ", ErrnoStr(errno));
+  }
+  lazy_alias = static_cast<uint8_t*>(alias);
+  return fd;
+}
+
 // ApplyProcMapsFixups manipulates this process' memory mappings. Resizes the
 // [stack] mapping to occupy the maximum allowed stack size. Unmaps [vdso] and
 // [vvar] mappings.
@@ -284,14 +468,157 @@ void ApplyProcMapsFixups(ProcMapsEntry proc_maps_entries[],
   }
 }
 
+// Writes `size` bytes at `data` followed by zero padding up to
+// RunnerResultPadded(size) to `fd`.
+void WritePadded(int fd, const void* data, size_t size) {
+  static constexpr char kZeros[kRunnerResultAlignment] = {};
+  CHECK_EQ(Write(fd, data, size), size);
+  const size_t padding = RunnerResultPadded(size) - size;
+  CHECK_EQ(Write(fd, kZeros, padding), padding);
+}
+
+// Reports to `fd` that `snap` was skipped as a skip record in the binary
+// format of runner_result_protocol.h.
+void WriteSnapSkipRecord(const Snap& snap, int fd) {
+  RunnerSkipHeader header = {
+      .magic = kRunnerSkipMagic,
+      .snapshot_id_size = strlen(snap.id),
+  };
+  header.record_size =
+      sizeof(header) + RunnerResultPadded(header.snapshot_id_size);
+  WritePadded(fd, &header, sizeof(header));
+  WritePadded(fd, snap.id, header.snapshot_id_size);
+}
+
+// Returns true iff `memory_mapping` of the `index`-th Snap of `corpus` may
+// replace the overlapping mappings of the Snaps before it. The corpus
+// partitioner only allows writable mappings with the same permissions to
+// overlap, since writable memory is set up before each execution anyway.
+bool MayReplaceMappings(const SnapCorpus& corpus, size_t index,
+                        const Snap::MemoryMapping& memory_mapping) {
+  if (!memory_mapping.writable()) return false;
+  const uint64_t limit_address =
+      memory_mapping.start_address + memory_mapping.num_bytes;
+  bool overlaps = false;
+  for (size_t i = 0; i < index; ++i) {
+    for (const auto& other : corpus.snaps[i]->memory_mappings) {
+      if (other.start_address < limit_address &&
+          memory_mapping.start_address <
+              other.start_address + other.num_bytes) {
+        if (other.perms != memory_mapping.perms) return false;
+        overlaps = true;
+      }
+    }
+  }
+  // Otherwise the existing mapping does not belong to the corpus.
+  return overlaps;
+}
+
+// Maps `memory_mapping` of the `index`-th Snap of `corpus` with mmap(2)
+// arguments `prot`, `flags`, `fd` and `offset`. The same overlap policy
+// applies to all kinds of mappings: an existing mapping is only replaced if
+// MayReplaceMappings() allows it. Otherwise, replacing a read-only mapping of
+// another Snap would go unnoticed when it is mapped from an image or through
+// the alias of a lazily mapped corpus, whose contents are not written again.
+// Returns the mapped address like mmap(2).
+void* MapSnapMemory(const SnapCorpus& corpus, size_t index,
+                    const Snap::MemoryMapping& memory_mapping, int prot,
+                    int flags, int fd, off_t offset) {
+  void* target_address = AsPtr(memory_mapping.start_address);
+  void* mapped_address =
+      mmap(target_address, memory_mapping.num_bytes, prot,
+           flags | MAP_FIXED_NOREPLACE, fd, offset);
+  if (mapped_address != MAP_FAILED && mapped_address != target_address) {
+    // Kernels before 4.17 treat MAP_FIXED_NOREPLACE as a hint.
+    CHECK_EQ(munmap(mapped_address, memory_mapping.num_bytes), 0);
+    mapped_address = MAP_FAILED;
+    errno = EEXIST;
+  }
+  if (mapped_address == MAP_FAILED && errno == EEXIST &&
+      MayReplaceMappings(corpus, index, memory_mapping)) {
+    mapped_address = mmap(target_address, memory_mapping.num_bytes, prot,
+                          flags | MAP_FIXED, fd, offset);
+  }
+  return mapped_address;
+}
+
 // MapCorpus establishes memory mappings for all snaps in 'corpus'. If a
 // snap uses a memory mapping that conflicts with the runner itself (binary,
 // stack, heap and VDSO), it can crash the runner. Therefore, it performs
 // range checks before adding memory mappings into the runners address
-// space and dies if a conflict is detected.
-void MapCorpus(const SnapCorpus& corpus) {
+// space and skips snaps for which a conflict is detected.
+const SnapCorpus* MapCorpus(const SnapCorpus& corpus, bool lazy, int corpus_fd,
+                            int results_fd) {
   CHECK(corpus.IsArch<Host>());
 
+  // Everything the runner maps for itself must exist before /proc/self/maps
+  // is read below. Otherwise a Snap overlapping it is not skipped, and
+  // MapSnapMemory() fails on it later. Sizes are not known until Snaps are
+  // skipped, so allocations are sized for the whole corpus.
+  if (corpus_fd >= 0) {
+    // Executable file mappings fail on noexec mounts. Check once up front
+    // instead of failing half way through. Fall back to copying if needed.
+    void* probe = mmap(nullptr, getpagesize(), PROT_READ | PROT_EXEC,
+                       MAP_PRIVATE, corpus_fd, 0);
+    if (probe == MAP_FAILED) {
+      LOG_INFO("Cannot map corpus images, copying instead: ",
+               ErrnoStr(errno));
+    } else {
+      CHECK_EQ(munmap(probe, getpagesize()), 0);
+      mapping_image_fd = corpus_fd;
+    }
+  }
+
+  // Snaps that do not conflict with the runner. The runner has no heap, so
+  // the array is mmap()'ed. It is only kept if some Snaps are skipped.
+  const size_t active_snaps_size = corpus.snaps.size * sizeof(const Snap*);
+  void* active_snaps_memory =
+      mmap(nullptr, active_snaps_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (active_snaps_memory == MAP_FAILED) {
+    LOG_FATAL("mmap() failed: ", ErrnoStr(errno));
+  }
+  const Snap** active_snaps = static_cast<const Snap**>(active_snaps_memory);
+  size_t num_active_snaps = 0;
+
+  // In lazy mode, read-only mappings without images are shared mappings of a
+  // temporary file, and all other mappings get their final protection right
+  // away. Then no mprotect(2) is needed after entering the sandbox. The file
+  // is sparse, so space reserved for skipped Snaps costs no memory.
+  int alias_fd = -1;
+  if (lazy) {
+    size_t alias_size = 0;
+    for (const auto& snap : corpus.snaps) {
+      for (const auto& memory_mapping : snap->memory_mappings) {
+        if (MappedThroughAlias(memory_mapping)) {
+          alias_size += memory_mapping.num_bytes;
+        }
+      }
+    }
+    if (alias_size > 0) {
+      alias_fd = CreateLazyAliasFile(alias_size);
+      if (alias_fd < 0) {
+        LOG_INFO("Mapping the corpus eagerly");
+        lazy = false;
+      }
+    }
+  }
+  if (lazy) {
+    // The flags and offsets cannot be allocated later as the runner has no
+    // heap. Allocating an empty array would fail.
+    const size_t num_snaps = corpus.snaps.size;
+    void* flags = mmap(nullptr, num_snaps + 1, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* offsets =
+        mmap(nullptr, (num_snaps + 1) * sizeof(uint64_t),
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (flags == MAP_FAILED || offsets == MAP_FAILED) {
+      LOG_FATAL("mmap() failed: ", ErrnoStr(errno));
+    }
+    lazy_snap_ready = static_cast<uint8_t*>(flags);
+    lazy_alias_offsets = static_cast<uint64_t*>(offsets);
+  }
+
   // On x86_64, we should only need 8 entries to describe all memory ranges when
   // running a fully static runner. 20 is more than enough to avoid overflow.
   constexpr size_t kMaxProcMapsEntries = 20;
@@ -308,22 +635,50 @@ void MapCorpus(const SnapCorpus& corpus) {
   }
   ApplyProcMapsFixups(proc_maps_entries, num_proc_maps_entries);
 
-  // Set up memory mappings and read-only memory contents.
-  // This is a two-pass process. First, we map all memory pages with write
-  // permission. Then for each snap, we copy read-only contents to memory and
-  // then protect the read-only pages afterwards.  If there are any conflicting
-  // read-only mappings between two snaps, we will get a SEGV fault we write
-  // read-only contents of the second snap.
-  VLOG_INFO(1, "Creating memory mappings");
   for (const auto& snap : corpus.snaps) {
-    // TODO(dougkwan): [impl] Make this fail more gracefully. We can skip
-    // conflicting snaps. To do that we need space to store the passing
-    // snaps. One possible way to do that without additional memory
-    // allocation at runtime is to make 'corpus' writable and remove
-    // conflicting snaps found here.
     if (SnapOverlapsWithProcMapsEntries(*snap, proc_maps_entries,
                                         num_proc_maps_entries)) {
-      LOG_FATAL("Cannot handle overlapping mappings");
+      // Running the rest of the corpus is better than running nothing.
+      LOG_ERROR("Skipping snapshot ", snap->id,
+                " because of conflicting mappings");
+      if (results_fd != -1) {
+        WriteSnapSkipRecord(*snap, results_fd);
+      }
+      continue;
+    }
+    active_snaps[num_active_snaps++] = snap;
+  }
+  const SnapCorpus* active_corpus = &corpus;
+  if (num_active_snaps < corpus.snaps.size) {
+    LOG_ERROR("Skipped ", IntStr(corpus.snaps.size - num_active_snaps),
+              " of ", IntStr(corpus.snaps.size), " snapshots");
+    // Like CommonMain() does for a single snap, create a corpus over the
+    // remaining Snaps.
+    static SnapCorpus remaining_snaps_corpus = {};
+    memcpy(&remaining_snaps_corpus, &corpus, sizeof(remaining_snaps_corpus));
+    remaining_snaps_corpus.snaps.size = num_active_snaps;
+    remaining_snaps_corpus.snaps.elements = active_snaps;
+    active_corpus = &remaining_snaps_corpus;
+  } else {
+    CHECK_EQ(munmap(active_snaps_memory, active_snaps_size), 0);
+  }
+  if (lazy) {
+    num_lazy_snaps = active_corpus->snaps.size;
+  }
+
+  // Set up memory mappings and read-only memory contents.
+  // Unless the corpus is mapped lazily, this is a two-pass process. First, we
+  // map all memory pages with write permission. Then for each snap, we copy
+  // read-only contents to memory and then protect the read-only pages
+  // afterwards. Conflicting mappings between two snaps are detected when
+  // they are mapped, see MapSnapMemory().
+  VLOG_INFO(1, "Creating memory mappings");
+  size_t num_image_bytes = 0;
+  uint64_t alias_offset = 0;
+  for (size_t i = 0; i < active_corpus->snaps.size; ++i) {
+    const Snap* snap = active_corpus->snaps[i];
+    if (lazy) {
+      lazy_alias_offsets[i] = alias_offset;
     }
 
     // Maps all pages used by this snap.
@@ -333,25 +688,67 @@ void MapCorpus(const SnapCorpus& corpus) {
       DCHECK_LE(start_address, start_address + memory_mapping.num_bytes);
 
       void* target_address = AsPtr(start_address);
-      void* mapped_address = mmap(
-          target_address, memory_mapping.num_bytes, kInitialMappingProtection,
-          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+      int prot = lazy ? memory_mapping.perms : kInitialMappingProtection;
+      int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      int fd = -1;
+      off_t offset = 0;
+      if (MappedFromImage(memory_mapping)) {
+        // Private file mappings share page cache pages with other runners
+        // until written, which read-only mappings never are.
+        prot = memory_mapping.perms;
+        flags = MAP_PRIVATE;
+        fd = mapping_image_fd;
+        offset = memory_mapping.image_offset;
+        num_image_bytes += memory_mapping.num_bytes;
+      } else if (lazy && MappedThroughAlias(memory_mapping)) {
+        // The mapping is never written through, so sharing it with the
+        // alias is invisible to the Snap.
+        flags = MAP_SHARED;
+        fd = alias_fd;
+        offset = alias_offset;
+        alias_offset += memory_mapping.num_bytes;
+      }
+      void* mapped_address = MapSnapMemory(*active_corpus, i, memory_mapping,
+                                           prot, flags, fd, offset);
+      if (mapped_address == MAP_FAILED && errno == EEXIST) {
+        LOG_FATAL("Snapshot ", snap->id, " conflicts with another mapping at ",
+                  HexStr(start_address));
+      }
       if (mapped_address == MAP_FAILED) {
         LOG_FATAL("mmap(", HexStr(AsInt(target_address)),
                   ") failed: ", ErrnoStr(errno));
       }
-      if (mapped_address != target_address) {
-        LOG_FATAL("mmap failed: got ", HexStr(AsInt(mapped_address)), " want ",
-                  HexStr(AsInt(target_address)));
-      }
     }
   }
-  VLOG_INFO(1, "Done creating memory mappings");
+  VLOG_INFO(1, "Done creating memory mappings, ", IntStr(num_image_bytes),
+            " bytes mapped from images");
+  if (alias_fd >= 0) {
+    // The mappings stay valid after the file is closed.
+    CHECK_EQ(close(alias_fd), 0);
+  }
+
+  if (lazy) {
+    // Defer the second pass to SetupSnapOnFirstUse().
+    return active_corpus;
+  }
 
   // Second pass: Copy read-only contents and then protect read-only pages.
-  for (const auto& snap : corpus.snaps) {
+  for (const auto& snap : active_corpus->snaps) {
     SetupReadOnlySnapContents(*snap);
   }
+  return active_corpus;
+}
+
+void SetupSnapOnFirstUse(const SnapCorpus& corpus, size_t index,
+                         RunnerStats* stats) {
+  if (lazy_snap_ready == nullptr) return;
+  CHECK_LT(index, num_lazy_snaps);
+  if (lazy_snap_ready[index] != 0) return;
+  SetupReadOnlySnapContentsThroughAlias(*corpus.snaps[index], index);
+  lazy_snap_ready[index] = 1;
+  if (stats != nullptr) {
+    ++stats->num_lazily_mapped_snaps;
+  }
 }
 
 RunSnapOutcome EndSpotToOutcome(const Snap& snap, const EndSpot& end_spot) {
@@ -369,12 +766,22 @@ RunSnapOutcome EndSpotToOutcome(const Snap& snap, const EndSpot& end_spot) {
     return RunSnapOutcome::kRegisterStateMismatch;
   }
 
-  // Verify writable memory contents after execution.
-  for (const auto& memory_bytes : snap.end_state_memory_bytes) {
-    CHECK(memory_bytes.writable());
-    if (!VerifyMemoryBytes(memory_bytes)) {
-      VLOG_INFO(1, "Memory mismatch at ", HexStr(memory_bytes.start_address));
-      return RunSnapOutcome::kMemoryMismatch;
+  // Verify writable memory contents after execution, one mapping at a time.
+  // A matching checksum is sufficient. Otherwise compare the byte values
+  // within the mapping directly to confirm and locate the mismatch.
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (!memory_mapping.writable() ||
+        VerifyEndStateMappingChecksum(snap, memory_mapping)) {
+      continue;
+    }
+    for (const auto& memory_bytes : snap.end_state_memory_bytes) {
+      if (!Overlaps(memory_bytes, memory_mapping)) continue;
+      CHECK(memory_bytes.writable());
+      if (!VerifyMemoryBytes(memory_bytes)) {
+        VLOG_INFO(1, "Memory mismatch at ",
+                  HexStr(memory_bytes.start_address));
+        return RunSnapOutcome::kMemoryMismatch;
+      }
     }
   }
 
@@ -384,21 +791,38 @@ RunSnapOutcome EndSpotToOutcome(const Snap& snap, const EndSpot& end_spot) {
 // Copies read/writable memory contents needed to run the snap.
 void PrepareSnapMemory(const Snap& snap) {
   for (const auto& memory_bytes : snap.memory_bytes) {
-    // Read-only contents are set up in runner initialization.
+    // Read-only contents are set up in runner initialization or by
+    // SetupSnapOnFirstUse().
     if (memory_bytes.writable()) {
       SetupMemoryBytes(memory_bytes);
     }
   }
 }
 
-RunSnapResult RunSnap(const Snap& snap) {
+static_assert(ToInt(RunSnapOutcome::kExecutionMisbehave) <
+              RunnerStats::kNumOutcomes);
+
+RunSnapResult RunSnap(const Snap& snap, const RunnerMainOptions& options) {
+  // Tick counter reads cost cycles and constrain instruction scheduling
+  // around the snap, so only take them when collecting stats.
+  const bool collect_stats = options.stats != nullptr;
+  const uint64_t start_ticks = collect_stats ? ReadTickCounter() : 0;
   PrepareSnapMemory(snap);
+  const uint64_t prepared_ticks = collect_stats ? ReadTickCounter() : 0;
   int64_t cpu_id = GetCPUIdNoSyscall();
   EndSpot end_spot = RunSnap(*snap.registers);
   if (cpu_id != GetCPUIdNoSyscall()) {
     cpu_id = kUnknownCPUId;
   }
+  const uint64_t run_ticks = collect_stats ? ReadTickCounter() : 0;
   RunSnapOutcome outcome = EndSpotToOutcome(snap, end_spot);
+  if (collect_stats) {
+    const uint64_t verified_ticks = ReadTickCounter();
+    options.stats->RecordExecution({prepared_ticks - start_ticks,
+                                    run_ticks - prepared_ticks,
+                                    verified_ticks - run_ticks},
+                                   ToInt(outcome));
+  }
   return {.end_spot = end_spot, .outcome = outcome, .cpu_id = cpu_id};
 }
 
@@ -410,18 +834,14 @@ RunSnapResult RunSnap(const Snap& snap) {
 void LogSnapMemoryBytes(const Snap& snap,
                         class TextProtoPrinter::Message& end_state_m) {
   const size_t kPageSize = getpagesize();
-  for (const auto& memory_bytes : snap.memory_bytes) {
-    if (!memory_bytes.writable()) {
-      continue;
-    }
-    VLOG_INFO(2, "Logging memory bytes at ",
-              HexStr(memory_bytes.start_address));
+  ForEachWritableRange(snap, [&](uint64_t range_start, size_t num_bytes) {
+    VLOG_INFO(2, "Logging memory bytes at ", HexStr(range_start));
     // Convert the memory bytes to page-sized chunks to avoid overflowing
     // TextProtoPrinter::Bytes buffer which can only hold a page-ful of escaped
     // bytes. The consumer may choose to normalize.
     const char* start_address =
-        reinterpret_cast<const char*>(AsPtr(memory_bytes.start_address));
-    const char* limit_address = start_address + memory_bytes.size();
+        reinterpret_cast<const char*>(AsPtr(range_start));
+    const char* limit_address = start_address + num_bytes;
     for (; start_address < limit_address; start_address += kPageSize) {
       auto memory_bytes_m = end_state_m->Message("memory_bytes");
       size_t bytes_to_log =
@@ -429,13 +849,73 @@ void LogSnapMemoryBytes(const Snap& snap,
       memory_bytes_m->Hex("start_address", AsInt(start_address));
       memory_bytes_m->Bytes("byte_values", start_address, bytes_to_log);
     }
+  });
+}
+
+// Writes the run result of `snap` to `fd` as a record in the binary format of
+// runner_result_protocol.h. Memory contents are written directly from the
+// live mappings of `snap` and the pages added by MakerMain().
+void WriteSnapRunResult(const Snap& snap, const RunSnapResult& run_result,
+                        int fd) {
+  Serialized<decltype(run_result.end_spot.gregs)> serialized_gregs;
+  CHECK(SerializeGRegs(run_result.end_spot.gregs, &serialized_gregs));
+  Serialized<decltype(run_result.end_spot.fpregs)> serialized_fpregs;
+  CHECK(SerializeFPRegs(run_result.end_spot.fpregs, &serialized_fpregs));
+
+  RunnerResultHeader header = {
+      .magic = kRunnerResultMagic,
+      .outcome = ToInt(run_result.outcome),
+      .cpu_id = run_result.cpu_id,
+      .endpoint_type = ToInt(RunnerResultEndpointType::kNone),
+      .snapshot_id_size = strlen(snap.id),
+      .gregs_size = serialized_gregs.size,
+      .fpregs_size = serialized_fpregs.size,
+  };
+  std::optional<Endpoint> endpoint = EndSpotToEndpoint(run_result.end_spot);
+  if (endpoint.has_value()) {
+    if (endpoint->type() == EndpointType::kSignal) {
+      header.endpoint_type = ToInt(RunnerResultEndpointType::kSignal);
+      header.sig_num = ToInt(endpoint->sig_num());
+      header.sig_cause = ToInt(endpoint->sig_cause());
+      header.sig_address = endpoint->sig_address();
+      header.instruction_address = endpoint->sig_instruction_address();
+    } else {
+      header.endpoint_type = ToInt(RunnerResultEndpointType::kInstruction);
+      header.instruction_address = endpoint->instruction_address();
+    }
   }
+  header.record_size = sizeof(header) +
+                       RunnerResultPadded(header.snapshot_id_size) +
+                       RunnerResultPadded(header.gregs_size) +
+                       RunnerResultPadded(header.fpregs_size);
+  ForEachWritableRange(snap, [&header](uint64_t, size_t num_bytes) {
+    ++header.num_memory_ranges;
+    header.record_size +=
+        sizeof(RunnerResultMemoryRange) + RunnerResultPadded(num_bytes);
+  });
+
+  WritePadded(fd, &header, sizeof(header));
+  WritePadded(fd, snap.id, header.snapshot_id_size);
+  WritePadded(fd, serialized_gregs.data, serialized_gregs.size);
+  WritePadded(fd, serialized_fpregs.data, serialized_fpregs.size);
+  ForEachWritableRange(snap, [fd](uint64_t start_address, size_t num_bytes) {
+    const RunnerResultMemoryRange range = {
+        .start_address = start_address,
+        .num_bytes = num_bytes,
+    };
+    WritePadded(fd, &range, sizeof(range));
+    WritePadded(fd, AsPtr(start_address), num_bytes);
+  });
 }
 
 // Logs the run result of `snap` to stdout formatted as
-// proto.SnapshotExecutionResult text proto. Additionally, logs execution
-// result in human-readable format to stderr.
-void LogSnapRunResult(const Snap& snap, const RunSnapResult& run_result) {
+// proto.SnapshotExecutionResult text proto or, if options.results_fd is set,
+// writes it there in binary. Additionally, logs execution result in
+// human-readable format to stderr. If `as_record` is true, the text proto is
+// written as a length-prefixed record. See RunnerMainOptions::max_failures.
+void LogSnapRunResult(const Snap& snap, const RunSnapResult& run_result,
+                      const RunnerMainOptions& options,
+                      bool as_record = false) {
   if (run_result.outcome != RunSnapOutcome::kAsExpected) {
     LOG_ERROR("Snapshot [", snap.id,
               "] failed, outcome = ", IntStr(ToInt(run_result.outcome)));
@@ -463,6 +943,10 @@ void LogSnapRunResult(const Snap& snap, const RunSnapResult& run_result) {
       run_result.end_spot.Log();
     }
   }
+  if (options.results_fd != -1) {
+    WriteSnapRunResult(snap, run_result, options.results_fd);
+    return;
+  }
   // The root message is proto.SnapshotExecutionResult
   TextProtoPrinter snapshot_execution_result;
   {
@@ -504,7 +988,35 @@ void LogSnapRunResult(const Snap& snap, const RunSnapResult& run_result) {
     }
     LogSnapMemoryBytes(snap, actual_end_state);
   }
-  LogToStdout(snapshot_execution_result.c_str());
+  if (as_record) {
+    LogRecordToStdout(snapshot_execution_result.c_str());
+  } else {
+    LogToStdout(snapshot_execution_result.c_str());
+  }
+}
+
+// Returns true if RunnerMain() or RunnerMainSequential() can continue after
+// a failed execution of `snap`. `num_failures` is the number of failures so
+// far including this one.
+//
+// Writable memory of a Snap is restored before each of its executions, so a
+// failure that clobbered it does not affect later executions. Read-only
+// memory cannot be written to by a Snap, but it cannot be re-applied either
+// as mprotect(2) is not allowed in the seccomp sandbox. It is checked here
+// instead and the runner stops if it is damaged.
+bool ContinueAfterFailure(const Snap& snap, uint64_t num_failures,
+                          const RunnerMainOptions& options) {
+  if (num_failures >= options.max_failures) {
+    return false;
+  }
+  for (const auto& memory_bytes : snap.memory_bytes) {
+    if (!memory_bytes.writable() && !VerifyMemoryBytes(memory_bytes)) {
+      LOG_ERROR("Snapshot [", snap.id, "] read-only memory at ",
+                HexStr(memory_bytes.start_address), " is damaged");
+      return false;
+    }
+  }
+  return true;
 }
 
 const SnapCorpus* CommonMain(const RunnerMainOptions& options) {
@@ -520,8 +1032,34 @@ const SnapCorpus* CommonMain(const RunnerMainOptions& options) {
 
   InitSnapExit(&SnapExitImpl);
 
-  auto corpus = [&options]() -> const SnapCorpus* {
+  auto requested_corpus = [&options]() -> const SnapCorpus* {
     static SnapCorpus one_snap_corpus = {};
+    static SnapCorpus member_corpus = {};
+    if (options.cosched_group != nullptr) {
+      // Members of a co-scheduling group run disjoint slices of the corpus.
+      const size_t num_snaps = options.corpus->snaps.size;
+      const size_t group_size = options.cosched_group_size;
+      const size_t index = options.cosched_group_index;
+      CHECK_LT(index, group_size);
+      const size_t begin = num_snaps * index / group_size;
+      const size_t end = num_snaps * (index + 1) / group_size;
+      if (begin == end) {
+        // The corpus has fewer snaps than the group has members. There is
+        // nothing to run, so leave the group to let the other members run
+        // independently rather than wait for this one.
+        VLOG_INFO(1, "Co-scheduling group member ", IntStr(index), " of ",
+                  IntStr(group_size), " has no snaps to run");
+        CoschedGroupLeave(options.cosched_group);
+        _exit(EXIT_SUCCESS);
+      }
+      VLOG_INFO(1, "Co-scheduling group member ", IntStr(index), " of ",
+                IntStr(group_size), " runs snaps [", IntStr(begin), ", ",
+                IntStr(end), ")");
+      memcpy(&member_corpus, options.corpus, sizeof(member_corpus));
+      member_corpus.snaps.size = end - begin;
+      member_corpus.snaps.elements = &options.corpus->snaps[begin];
+      return &member_corpus;
+    }
     if (options.snap_id == nullptr) {
       return options.corpus;
     }
@@ -537,7 +1075,34 @@ const SnapCorpus* CommonMain(const RunnerMainOptions& options) {
     }
     LOG_FATAL("Snap ", options.snap_id, " not found in the corpus");
   }();
-  MapCorpus(*corpus);
+  const uint64_t map_start_ticks = ReadTickCounter();
+  const SnapCorpus* corpus =
+      MapCorpus(*requested_corpus, options.lazy_mapping, options.corpus_fd,
+                options.results_fd);
+  const uint64_t map_corpus_ticks = ReadTickCounter() - map_start_ticks;
+  // Reading /proc costs a few syscalls, so only do it if someone looks.
+  const size_t rss_bytes = options.stats != nullptr || VLOG_IS_ON(1)
+                               ? ReadResidentSetSize()
+                               : 0;
+  const size_t num_skipped_snaps =
+      requested_corpus->snaps.size - corpus->snaps.size;
+  VLOG_INFO(1, options.lazy_mapping ? "Lazily mapped " : "Mapped ",
+            IntStr(corpus->snaps.size), " snaps in ", IntStr(map_corpus_ticks),
+            " ticks, RSS = ", IntStr(rss_bytes), " bytes, skipped ",
+            IntStr(num_skipped_snaps), " snaps");
+  if (options.stats != nullptr) {
+    options.stats->map_corpus_ticks = map_corpus_ticks;
+    options.stats->map_corpus_rss_bytes = rss_bytes;
+    options.stats->num_skipped_snaps = num_skipped_snaps;
+  }
+  if (corpus->snaps.size == 0 && requested_corpus->snaps.size > 0) {
+    if (options.snap_id != nullptr) {
+      // Skipping the requested Snap is a property of the Snap, not a runner
+      // failure. Let the driver tell the two apart.
+      _exit(RunnerMainOptions::kSnapSkippedExitCode);
+    }
+    LOG_FATAL("All snapshots have conflicting mappings");
+  }
   InstallSigHandler();
 
   return corpus;
@@ -548,22 +1113,99 @@ RunSnapResult RunSnapWithOpts(const Snap& snap,
   if (options.enable_tracer) {
     CHECK_EQ(kill(options.pid, SIGSTOP), 0);
   }
-  RunSnapResult run_result = RunSnap(snap);
+  RunSnapResult run_result = RunSnap(snap, options);
   if (options.enable_tracer) {
     CHECK_EQ(kill(options.pid, SIGSTOP), 0);
   }
   return run_result;
 }
 
-int MakerMain(const RunnerMainOptions& options) {
-  const SnapCorpus* corpus = CommonMain(options);
+namespace {
+
+// Shared between MakerMain() and the processes it forks to run the Snap.
+struct MakerPageRequest {
+  // Set by a process that stopped at a page fault that a page containing
+  // `address` may repair.
+  bool add_page;
+  uint64_t address;
+};
 
+// Returns the faulting address if `run_result` ended with a page fault that
+// adding a writable page may repair, like SnapMaker::MakeLoop() does.
+std::optional<uint64_t> RepairablePageFault(const RunSnapResult& run_result) {
+  if (run_result.outcome != RunSnapOutcome::kExecutionMisbehave) {
+    return std::nullopt;
+  }
+  std::optional<Endpoint> endpoint = EndSpotToEndpoint(run_result.end_spot);
+  if (!endpoint.has_value() || endpoint->type() != EndpointType::kSignal ||
+      endpoint->sig_num() != snapshot_types::SigNum::kSigSegv) {
+    return std::nullopt;
+  }
+  if (endpoint->sig_cause() != snapshot_types::SigCause::kSegvCantRead &&
+      endpoint->sig_cause() != snapshot_types::SigCause::kSegvCantWrite) {
+    return std::nullopt;
+  }
+  return endpoint->sig_address();
+}
+
+// Maps a zero-filled writable page containing `address` and records it in
+// `added_pages`. Returns false if the page would replace an existing mapping
+// of the runner or the Snap or cannot be mapped at all.
+bool AddPageFor(uint64_t address) {
+  const size_t page_size = getpagesize();
+  void* page = AsPtr(address / page_size * page_size);
+  void* mapped_address =
+      mmap(page, page_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (mapped_address == MAP_FAILED) {
+    VLOG_INFO(1, "Cannot add a page for ", HexStr(address), ": ",
+              ErrnoStr(errno));
+    return false;
+  }
+  if (mapped_address != page) {
+    // Kernels before 4.17 treat MAP_FIXED_NOREPLACE as a hint.
+    CHECK_EQ(munmap(mapped_address, page_size), 0);
+    return false;
+  }
+  added_pages.start_addresses[added_pages.size++] = AsInt(page);
+  return true;
+}
+
+// Terminates the current process the same way as the child process that
+// `wait_status` was reported for or returns its exit code.
+int ExitLikeChild(int wait_status) {
+  if (WIFSIGNALED(wait_status)) {
+    // The driver tells runaways and syscalls apart by the signal, so
+    // re-raise it without SigAction(). This fails harmlessly for SIGKILL.
+    const int signal = WTERMSIG(wait_status);
+    struct kernel_sigaction action = {};
+    action.sa_handler_ = SIG_DFL;
+    sys_sigaction(signal, &action, nullptr);
+    kill(getpid(), signal);
+    return EXIT_FAILURE;
+  }
+  return WEXITSTATUS(wait_status);
+}
+
+// Runs the Snap of `corpus` once in the seccomp sandbox and reports the
+// result like MakerMain(). If `page_request` is not nullptr, a repairable page
+// fault is reported there instead.
+int MakeOnce(const SnapCorpus& corpus, const RunnerMainOptions& options,
+             MakerPageRequest* page_request) {
   EnterSeccompStrictMode(options.enable_tracer);
 
-  const Snap& snap = *corpus->snaps.at(0);
+  const Snap& snap = *corpus.snaps.at(0);
   RunSnapResult run_result = RunSnapWithOpts(snap, options);
+  if (page_request != nullptr) {
+    if (std::optional<uint64_t> address = RepairablePageFault(run_result);
+        address.has_value()) {
+      page_request->address = *address;
+      page_request->add_page = true;
+      return EXIT_FAILURE;
+    }
+  }
 
-  LogSnapRunResult(snap, run_result);
+  LogSnapRunResult(snap, run_result, options);
   if (run_result.outcome != RunSnapOutcome::kAsExpected) {
     return EXIT_FAILURE;
   }
@@ -571,74 +1213,282 @@ int MakerMain(const RunnerMainOptions& options) {
   return 0;
 }
 
-int RunnerMain(const RunnerMainOptions& options) {
-  CHECK(!options.sequential_mode);
+}  // namespace
+
+int MakerMain(const RunnerMainOptions& options) {
+  CHECK(options.cosched_group == nullptr);
   const SnapCorpus* corpus = CommonMain(options);
-  CHECK_GT(corpus->snaps.size, 0);
+  SetupSnapOnFirstUse(*corpus, 0, options.stats);
+  if (options.max_pages_to_add == 0) {
+    return MakeOnce(*corpus, options, nullptr);
+  }
 
-  EnterSeccompStrictMode(options.enable_tracer);
+  // Pages cannot be mapped in the seccomp sandbox, so each execution happens
+  // in a child process and pages are added here between executions. The
+  // children inherit the mapped Snap, so this is much cheaper than starting
+  // a runner for each execution.
+  CHECK(!options.enable_tracer);
+  CHECK_LE(options.max_pages_to_add, RunnerMainOptions::kMaxPagesToAdd);
+  void* shared_memory =
+      mmap(nullptr, sizeof(MakerPageRequest), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared_memory == MAP_FAILED) {
+    LOG_FATAL("mmap() failed: ", ErrnoStr(errno));
+  }
+  MakerPageRequest* page_request =
+      static_cast<MakerPageRequest*>(shared_memory);
+
+  // SigAction() must not mistake the end of a child for a Snap signal.
+  struct kernel_sigaction default_action = {};
+  default_action.sa_handler_ = SIG_DFL;
+  CHECK_EQ(sys_sigaction(SIGCHLD, &default_action, nullptr), 0);
+
+  bool can_add_pages = true;
+  while (true) {
+    page_request->add_page = false;
+    const bool allow_page_request =
+        can_add_pages && added_pages.size < options.max_pages_to_add;
+    const pid_t pid = fork();
+    if (pid < 0) {
+      LOG_FATAL("fork() failed: ", ErrnoStr(errno));
+    }
+    if (pid == 0) {
+      return MakeOnce(*corpus, options,
+                      allow_page_request ? page_request : nullptr);
+    }
+    int wait_status;
+    if (waitpid(pid, &wait_status, 0) != pid) {
+      LOG_FATAL("waitpid() failed: ", ErrnoStr(errno));
+    }
+    if (!page_request->add_page || !WIFEXITED(wait_status)) {
+      return ExitLikeChild(wait_status);
+    }
+    VLOG_INFO(1, "Adding a page for ", HexStr(page_request->address));
+    // If the page cannot be added, run once more to report the fault.
+    can_add_pages = AddPageFor(page_request->address);
+  }
+}
+
+namespace {
+
+// Limits on the size of Snap batches in RunnerMain() and RunnerServerMain().
+struct BatchLimits {
+  size_t max_batch_size;
+  size_t footprint_budget;
+};
+
+// Returns batch limits for `options`. The L2 cache size is read from sysfs,
+// so this must be called before entering the seccomp sandbox.
+BatchLimits GetBatchLimits(const RunnerMainOptions& options) {
+  BatchLimits limits = {.max_batch_size = options.batch_size,
+                        .footprint_budget = 0};
+  if (options.schedule_policy != SchedulePolicy::kUniform) {
+    limits.max_batch_size = RunnerMainOptions::kMaxBatchSize;
+    size_t l2_cache_size = GetL2CacheSize(options.cpu);
+    if (l2_cache_size == 0) {
+      LOG_INFO("Cannot determine L2 cache size, using default");
+      l2_cache_size = RunnerMainOptions::kDefaultL2CacheSize;
+    }
+    limits.footprint_budget =
+        l2_cache_size * options.l2_cache_fraction_percent / 100;
+    VLOG_INFO(1, "L2 cache size = ", IntStr(l2_cache_size),
+              " batch footprint budget = ", IntStr(limits.footprint_budget));
+  }
+  CHECK_LE(limits.max_batch_size, RunnerMainOptions::kMaxBatchSize);
+  return limits;
+}
+
+// Leaves a co-scheduling group when it goes out of scope, so that the other
+// members stop waiting for this one however RunSchedule() returns.
+class ScopedCoschedGroupMembership {
+ public:
+  explicit ScopedCoschedGroupMembership(CoschedGroup* group) : group_(group) {}
+  ~ScopedCoschedGroupMembership() {
+    if (group_ != nullptr) {
+      CoschedGroupLeave(group_);
+    }
+  }
+
+  // Not copyable or movable.
+  ScopedCoschedGroupMembership(const ScopedCoschedGroupMembership&) = delete;
+  ScopedCoschedGroupMembership& operator=(const ScopedCoschedGroupMembership&) =
+      delete;
+
+ private:
+  CoschedGroup* group_;
+};
 
-  std::mt19937_64 gen(options.seed);  // 64-bit Mersenne Twister engine
-  VLOG_INFO(1, "Seed = ", IntStr(options.seed));
+// Waits for the other members of `*group` unless it is nullptr. Sets `*group`
+// to nullptr if the group is broken, so that the caller runs independently.
+void WaitForCoschedGroup(CoschedGroup** group,
+                         const RunnerMainOptions& options) {
+  if (*group == nullptr) {
+    return;
+  }
+  const uint64_t start_ticks = ReadTickCounter();
+  if (!CoschedGroupWait(*group, options.cosched_group_size,
+                        options.cosched_group_timeout_ticks)) {
+    LOG_ERROR("Co-scheduling group is broken, running independently");
+    *group = nullptr;
+  }
+  if (options.stats != nullptr) {
+    options.stats->cosched_wait_ticks += ReadTickCounter() - start_ticks;
+  }
+}
+
+// Executes up to `num_iterations` Snaps from `corpus` scheduled in batches
+// according to `options` and `limits` using `seed`. Stops early when
+// ReadTickCounter() reaches `deadline_ticks` unless it is 0. Failures are
+// reported as records if `as_records` is true. Returns an exit code as
+// described at the top of this file.
+int RunSchedule(const SnapCorpus& corpus, const RunnerMainOptions& options,
+                const BatchLimits& limits, uint64_t seed,
+                uint64_t num_iterations, uint64_t deadline_ticks,
+                bool as_records) {
+  std::mt19937_64 gen(seed);  // 64-bit Mersenne Twister engine
+  VLOG_INFO(1, "Seed = ", IntStr(seed));
+  VLOG_INFO(1, "Schedule policy = ",
+            SchedulePolicyName(options.schedule_policy));
+  SnapBatchScheduler scheduler(corpus, options.schedule_policy,
+                               limits.max_batch_size, limits.footprint_budget,
+                               gen);
   size_t snap_execution_count = 0;
-  while (snap_execution_count < options.num_iterations) {
+  uint64_t num_failures = 0;
+  CoschedGroup* cosched_group = options.cosched_group;
+  ScopedCoschedGroupMembership cosched_group_membership(cosched_group);
+  while (snap_execution_count < num_iterations) {
     // Generate Snap batch
     size_t batch[RunnerMainOptions::kMaxBatchSize];
-    size_t batch_size = options.batch_size;
-    CHECK_LE(batch_size, RunnerMainOptions::kMaxBatchSize);
-    std::uniform_int_distribution<size_t> dist(0, corpus->snaps.size - 1);
+    const size_t batch_size = scheduler.NextBatch(batch);
+    VLOG_INFO(2, "Batch of ", IntStr(batch_size), " snaps, footprint = ",
+              IntStr(scheduler.last_batch_footprint()));
     for (size_t i = 0; i < batch_size; ++i) {
-      batch[i] = dist(gen);
+      SetupSnapOnFirstUse(corpus, batch[i], options.stats);
     }
+    WaitForCoschedGroup(&cosched_group, options);
 
-    // Adjust schedule size to honor options.num_iterations.
-    size_t remaining_iterations = options.num_iterations - snap_execution_count;
+    // Adjust schedule size to honor num_iterations.
+    size_t remaining_iterations = num_iterations - snap_execution_count;
     size_t schedule_size =
         std::min<size_t>(options.schedule_size, remaining_iterations);
 
-    std::uniform_int_distribution<size_t> schedule_dist(0, batch_size - 1);
     for (size_t i = 0; i < schedule_size; ++i, ++snap_execution_count) {
       if ((snap_execution_count & (snap_execution_count - 1)) == 0) {
         VLOG_INFO(1, "iter #", IntStr(snap_execution_count), " of ",
-                  IntStr(options.num_iterations));
+                  IntStr(num_iterations));
       }
-      const Snap& snap = *(corpus->snaps[batch[schedule_dist(gen)]]);
+      const Snap& snap =
+          *(corpus.snaps[batch[scheduler.PickFromBatch(i, batch_size)]]);
       VLOG_INFO(3, "#", IntStr(snap_execution_count), " Running ", snap.id);
       RunSnapResult run_result = RunSnapWithOpts(snap, options);
       if (run_result.outcome != RunSnapOutcome::kAsExpected) {
-        LogSnapRunResult(snap, run_result);
-        LOG_ERROR("Seed = ", IntStr(options.seed), " iteration #",
+        LogSnapRunResult(snap, run_result, options, as_records);
+        LOG_ERROR("Seed = ", IntStr(seed), " iteration #",
                   IntStr(snap_execution_count));
-        return EXIT_FAILURE;
+        if (!ContinueAfterFailure(snap, ++num_failures, options)) {
+          return EXIT_FAILURE;
+        }
       }
     }
+    // Check the deadline once per schedule to keep it off the hot path.
+    if (deadline_ticks != 0 && ReadTickCounter() >= deadline_ticks) {
+      VLOG_INFO(1, "Deadline reached after ", IntStr(snap_execution_count),
+                " iterations");
+      return num_failures > 0 ? EXIT_FAILURE
+                              : RunnerMainOptions::kTimeoutExitCode;
+    }
   }
 
-  return EXIT_SUCCESS;
+  return num_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int RunnerMain(const RunnerMainOptions& options) {
+  CHECK(!options.sequential_mode);
+  const SnapCorpus* corpus = CommonMain(options);
+  CHECK_GT(corpus->snaps.size, 0);
+  const BatchLimits limits = GetBatchLimits(options);
+
+  EnterSeccompStrictMode(options.enable_tracer);
+
+  if (options.stats != nullptr) {
+    options.stats->start_ticks = ReadTickCounter();
+  }
+  return RunSchedule(*corpus, options, limits, options.seed,
+                     options.num_iterations, /*deadline_ticks=*/0,
+                     options.max_failures > 1);
+}
+
+int RunnerServerMain(const RunnerMainOptions& options) {
+  CHECK(!options.sequential_mode);
+  // Members of a group would have to run commands in lock-step.
+  CHECK(options.cosched_group == nullptr);
+  const SnapCorpus* corpus = CommonMain(options);
+  CHECK_GT(corpus->snaps.size, 0);
+  const BatchLimits limits = GetBatchLimits(options);
+
+  EnterSeccompStrictMode(options.enable_tracer, /*allow_stdin_read=*/true);
+  VLOG_INFO(1, "Running in server mode");
+
+  if (options.stats != nullptr) {
+    options.stats->start_ticks = ReadTickCounter();
+  }
+  for (uint64_t num_commands = 0;; ++num_commands) {
+    RunnerServerCommand command;
+    const ssize_t bytes_read = Read(STDIN_FILENO, &command, sizeof(command));
+    if (bytes_read == 0) {
+      // The client closed the command channel.
+      VLOG_INFO(1, "Served ", IntStr(num_commands), " commands");
+      return EXIT_SUCCESS;
+    }
+    if (bytes_read != sizeof(command)) {
+      LOG_FATAL("Cannot read command: ", IntStr(bytes_read), " bytes read");
+    }
+    // Derive distinct seeds for consecutive commands without a seed.
+    const uint64_t seed =
+        command.seed != 0 ? command.seed : options.seed + num_commands;
+    const uint64_t num_iterations = command.num_iterations != 0
+                                        ? command.num_iterations
+                                        : options.num_iterations;
+    const uint64_t exit_code =
+        RunSchedule(*corpus, options, limits, seed, num_iterations,
+                    command.deadline_ticks, /*as_records=*/true);
+    const uint64_t end_of_response[] = {kEndOfResponse, exit_code};
+    Write(STDOUT_FILENO, end_of_response, sizeof(end_of_response));
+  }
 }
 
 int RunnerMainSequential(const RunnerMainOptions& options) {
   CHECK(options.sequential_mode);
+  CHECK(options.cosched_group == nullptr);
   const SnapCorpus* corpus = CommonMain(options);
 
   EnterSeccompStrictMode(options.enable_tracer);
   VLOG_INFO(1, "Running in sequential mode");
+  if (options.stats != nullptr) {
+    options.stats->start_ticks = ReadTickCounter();
+  }
 
+  uint64_t num_failures = 0;
   for (size_t i = 0; i < corpus->snaps.size; ++i) {
     const Snap& snap = *(corpus->snaps[i]);
     if ((i & (i - 1)) == 0) {
       VLOG_INFO(1, "iter #", IntStr(i), " of ", IntStr(corpus->snaps.size));
     }
     VLOG_INFO(3, "#", IntStr(i), " Running ", snap.id);
+    SetupSnapOnFirstUse(*corpus, i, options.stats);
     RunSnapResult run_result = RunSnapWithOpts(snap, options);
     if (run_result.outcome != RunSnapOutcome::kAsExpected) {
-      LogSnapRunResult(snap, run_result);
+      LogSnapRunResult(snap, run_result, options, options.max_failures > 1);
       LOG_ERROR("Id = ", snap.id, " Iteration #", IntStr(i));
-      return EXIT_FAILURE;
+      if (!ContinueAfterFailure(snap, ++num_failures, options)) {
+        return EXIT_FAILURE;
+      }
     }
   }
 
-  return EXIT_SUCCESS;
+  return num_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 }  // namespace silifuzz
@@ -20,6 +20,9 @@
 #include <cstddef>
 
 #include "./common/snapshot_enums.h"
+#include "./runner/cosched_group.h"
+#include "./runner/runner_stats.h"
+#include "./runner/snap_batch_scheduler.h"
 #include "./snap/snap.h"
 #include "./util/cpu_id.h"
 
@@ -64,6 +67,12 @@ struct RunnerMainOptions {
   // A corpus of Snaps to be executed.
   const SnapCorpus* corpus;
 
+  // File descriptor of the relocatable corpus file `corpus` was loaded from
+  // or -1. If set, read-only memory mappings that have images in the corpus
+  // are mapped from this file instead of being copied, so that all runners
+  // using the same corpus file share physical pages.
+  int corpus_fd = -1;
+
   // Number of main loop iterations, in each of which a Snap from the corpus is
   // picked an executed. In sequential mode, this is ignored.
   size_t num_iterations = 1000000;
@@ -109,32 +118,133 @@ struct RunnerMainOptions {
   // We impose maximum a batch size because runner cannot do dynamic
   // allocation.
   //
+  // The footprint-aware schedule policies size batches by the number of bytes
+  // the Snaps touch instead of using a fixed batch size. The byte budget is a
+  // percentage of the L2 cache size probed at startup. If the L2 cache size
+  // cannot be determined, kDefaultL2CacheSize is used.
+  //
   // TODO(dougkwan): [perf] These values are chosen by hand arbitrarily. We
   // need to tune the values.
   inline static constexpr uint64_t kDefaultBatchSize = 10;
   inline static constexpr uint64_t kMaxBatchSize = 100;
   inline static constexpr uint64_t kDefaultScheduleSize = 100;
+  inline static constexpr uint64_t kDefaultL2CacheSize = 1 << 20;
+  inline static constexpr uint64_t kDefaultL2CacheFractionPercent = 50;
 
   // Number of Snap in a batch.  Must be between [1, kMaxBatchSize].
-  // In sequential mode this is ignored.
+  // In sequential mode this is ignored. With footprint-aware schedule
+  // policies, this is ignored and batches have up to kMaxBatchSize Snaps.
   uint64_t batch_size = kDefaultBatchSize;
 
   // Number of Snap executions in a schedule. Must be greater than 0.
   // In sequential mode this is ignored.
   uint64_t schedule_size = kDefaultScheduleSize;
 
+  // How Snaps are picked into batches. In sequential mode this is ignored.
+  SchedulePolicy schedule_policy = SchedulePolicy::kUniform;
+
+  // Percentage of the L2 cache size used as batch byte budget by
+  // footprint-aware schedule policies. Must be between [1, 100].
+  uint64_t l2_cache_fraction_percent = kDefaultL2CacheFractionPercent;
+
   // If true, runner sequentially goes through all Snaps once. Batch and
   // schedule sizes in options are ignored. This is used for Snap verification.
   bool sequential_mode = false;
+
+  // If not null, execution statistics are accumulated here. This usually
+  // points to a page shared with the parent process. See runner_stats.h.
+  RunnerStats* stats = nullptr;
+
+  // Number of failed Snap executions after which RunnerMain() and
+  // RunnerMainSequential() stop. Must be greater than 0.
+  //
+  // When greater than 1, the runner continues after a failure and reports
+  // each failure on stdout as a record consisting of a 64-bit little-endian
+  // byte count followed by that many bytes of proto.SnapshotExecutionResult
+  // formatted as text. Otherwise, the single failure is reported as plain
+  // text without the byte count.
+  uint64_t max_failures = 1;
+
+  // If not -1, results are appended to this file descriptor in the binary
+  // format of runner_result_protocol.h instead of being printed to stdout as
+  // text. Each result is a self-delimiting record regardless of
+  // max_failures.
+  int results_fd = -1;
+
+  // In make mode, the maximum number of zero-filled writable pages the runner
+  // adds to repair page faults of the Snap, like SnapMaker::Make(). Pages
+  // cannot be mapped in the seccomp sandbox, so each execution of the Snap
+  // then happens in a forked child process and pages are added between
+  // executions. Added pages are reported as part of the actual end state
+  // memory. Must not exceed kMaxPagesToAdd. Not supported with
+  // enable_tracer.
+  inline static constexpr size_t kMaxPagesToAdd = 64;
+  size_t max_pages_to_add = 0;
+
+  // If true, read-only contents of a Snap are set up when the Snap is first
+  // picked for execution instead of for all Snaps at startup. Memory mappings
+  // are still created up front, so conflicts with the runner are detected
+  // early, but pages are only populated when touched. This makes startup
+  // cheaper for large corpora when a run executes a fraction of the Snaps.
+  // Read-only mappings are then backed by a temporary file in /dev/shm whose
+  // contents are written through a writable alias, so that the seccomp
+  // sandbox need not allow mprotect(2). Falls back to eager mapping if the
+  // file cannot be created.
+  bool lazy_mapping = false;
+
+  // If not null, this runner is member `cosched_group_index` of a group of
+  // `cosched_group_size` runners that execute Snaps at the same time, usually
+  // pinned to sibling hyperthreads. Each member maps and runs only its own
+  // slice of the corpus, so members never share Snap memory, and waits for
+  // the others before each batch. A member whose slice is empty because the
+  // corpus is smaller than the group leaves the group and exits successfully.
+  // See cosched_group.h. Not supported in sequential and make modes.
+  CoschedGroup* cosched_group = nullptr;
+  size_t cosched_group_size = 1;
+  size_t cosched_group_index = 0;
+
+  // How long, in ReadTickCounter() ticks, a member of `cosched_group` waits
+  // for the others before it breaks up the group.
+  uint64_t cosched_group_timeout_ticks = 0;
+
+  // Default timeout of cosched_group waits. It is generous because another
+  // member may be running a batch of slow Snaps.
+  inline static constexpr uint64_t kCoschedGroupTimeoutSeconds = 10;
+
+  // Exit code of a runner that stopped because it ran out of time, e.g. when
+  // it received SIGALRM or SIGXCPU or reached the deadline of a server
+  // command.
+  inline static constexpr int kTimeoutExitCode = 2;
+
+  // Exit code of a runner whose `snap_id` was skipped because its mappings
+  // conflict with the runner itself. See MapCorpus().
+  inline static constexpr int kSnapSkippedExitCode = 3;
 };
 
-// Establishes memory mappings in 'corpus'.
-void MapCorpus(const SnapCorpus& corpus);
+// Establishes memory mappings in 'corpus'. If `lazy` is true, read-only
+// contents are not set up. SetupSnapOnFirstUse() must then be called
+// before executing a Snap. If `corpus_fd` is not -1, read-only mappings with
+// images are mapped from it. See RunnerMainOptions::corpus_fd.
+//
+// Snaps with mappings that conflict with the runner itself are skipped and
+// logged. If `results_fd` is not -1, each skipped Snap is also reported there
+// as a skip record, see runner_result_protocol.h. Returns the corpus of Snaps
+// that were mapped, which is `corpus` itself if nothing was skipped and may
+// be empty.
+const SnapCorpus* MapCorpus(const SnapCorpus& corpus, bool lazy = false,
+                            int corpus_fd = -1, int results_fd = -1);
+
+// Sets up read-only contents of the `index`-th Snap of the corpus returned by
+// MapCorpus() unless that was done already. Does nothing unless the corpus
+// was mapped lazily. Updates `stats` if it is not nullptr.
+void SetupSnapOnFirstUse(const SnapCorpus& corpus, size_t index,
+                         RunnerStats* stats);
 
-// Executes 'snap' and returns the execution result.
+// Executes 'snap' according to 'options' and returns the execution result.
+// Only options affecting a single execution (e.g. stats) are used.
 // REQUIRES: the runtime environment, including memory mapping used by 'snap'
 // must be properly initialized.
-RunSnapResult RunSnap(const Snap& snap);
+RunSnapResult RunSnap(const Snap& snap, const RunnerMainOptions& options = {});
 
 // Executes Snaps from a corpus according to 'options' and returns an exit code
 // that can be passed to _exit(). This is intended to be used for implementing
@@ -155,9 +265,15 @@ int RunnerMain(const RunnerMainOptions& options);
 // FLAGS_sequential_mode for details.
 int RunnerMainSequential(const RunnerMainOptions& options);
 
-// Similar to RunnerMain() but runs in "make" mode. See FLAGS_make for details.
+// Similar to RunnerMain() but runs in "make" mode. See FLAGS_make and
+// RunnerMainOptions::max_pages_to_add for details.
 int MakerMain(const RunnerMainOptions& options);
 
+// Similar to RunnerMain() but runs in "server" mode: the corpus is mapped once
+// and Snaps are executed for each command read from stdin until EOF. See
+// runner_server_protocol.h for details.
+int RunnerServerMain(const RunnerMainOptions& options);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_H_
@@ -36,7 +36,20 @@ bool FLAGS_make = false;
 bool FLAGS_enable_tracer = false;
 size_t FLAGS_batch_size = RunnerMainOptions::kDefaultBatchSize;
 size_t FLAGS_schedule_size = RunnerMainOptions::kDefaultScheduleSize;
+SchedulePolicy FLAGS_schedule_policy = SchedulePolicy::kUniform;
+uint64_t FLAGS_l2_cache_fraction_percent =
+    RunnerMainOptions::kDefaultL2CacheFractionPercent;
 bool FLAGS_sequential_mode = false;
+const char* FLAGS_stats_path = nullptr;
+uint64_t FLAGS_max_failures = 1;
+const char* FLAGS_results_path = nullptr;
+uint64_t FLAGS_max_pages_to_add = 0;
+bool FLAGS_server = false;
+bool FLAGS_fork_server = false;
+bool FLAGS_lazy_mapping = false;
+const char* FLAGS_cosched_group_path = nullptr;
+uint64_t FLAGS_cosched_group_size = 1;
+uint64_t FLAGS_cosched_group_index = 0;
 
 // Print all flags and exit.
 void ShowUsage(const char* program_name) {
@@ -55,7 +68,39 @@ void ShowUsage(const char* program_name) {
   LOG_INFO("  --enable_tracer\tEnable ptrace cooperation.");
   LOG_INFO("  --batch_size [size]\tSnap execution batch size.");
   LOG_INFO("  --schedule_size [size]\tSnap execution schedule size.");
+  LOG_INFO(
+      "  --schedule_policy [uniform|footprint|round_robin]\tHow Snaps are "
+      "picked into batches.");
+  LOG_INFO(
+      "  --l2_cache_fraction_percent [value]\tPercentage of L2 cache used "
+      "by footprint-aware batches.");
   LOG_INFO("  --sequential_mode\tRun Snaps sequentially once.");
+  LOG_INFO(
+      "  --stats_path [path]\tMaintain execution statistics in a shared "
+      "mapping of this file.");
+  LOG_INFO(
+      "  --max_failures [value]\tStop after this many failed snap "
+      "executions.");
+  LOG_INFO(
+      "  --results_path [path]\tReport results in binary to this file instead "
+      "of on stdout as text.");
+  LOG_INFO(
+      "  --max_pages_to_add [value]\tIn make mode, add up to this many "
+      "writable pages to repair page faults.");
+  LOG_INFO("  --server\tExecute Snaps for commands read from stdin.");
+  LOG_INFO("  --fork_server\tStart runners for requests read from stdin.");
+  LOG_INFO(
+      "  --lazy_mapping\tSet up read-only Snap contents when a Snap is "
+      "first used.");
+  LOG_INFO(
+      "  --cosched_group_path [path]\tRun in lock-step with other runners "
+      "sharing a mapping of this file.");
+  LOG_INFO(
+      "  --cosched_group_size [size]\tNumber of runners in the co-scheduling "
+      "group.");
+  LOG_INFO(
+      "  --cosched_group_index [index]\tIndex of this runner in the "
+      "co-scheduling group.");
   LOG_INFO("  --help\tPrint usage information.");
 }
 
@@ -129,9 +174,68 @@ int ParseRunnerFlags(int argc, char* argv[]) {
         return -1;
       }
       FLAGS_schedule_size = schedule_size;
+    } else if (matcher.Match("schedule_policy",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!SchedulePolicyFromName(matcher.optarg(), &FLAGS_schedule_policy)) {
+        LOG_ERROR("Invalid schedule_policy ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("l2_cache_fraction_percent",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      uint64_t percent;
+      if (!DecToU64(matcher.optarg(), &percent) || percent == 0 ||
+          percent > 100) {
+        LOG_ERROR("Invalid l2_cache_fraction_percent ", matcher.optarg());
+        return -1;
+      }
+      FLAGS_l2_cache_fraction_percent = percent;
     } else if (matcher.Match("sequential_mode",
                              CommandLineFlagMatcher::kNoArgument)) {
       FLAGS_sequential_mode = true;
+    } else if (matcher.Match("stats_path",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_stats_path = matcher.optarg();
+    } else if (matcher.Match("max_failures",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_max_failures) ||
+          FLAGS_max_failures == 0) {
+        LOG_ERROR("Invalid max_failures ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("results_path",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_results_path = matcher.optarg();
+    } else if (matcher.Match("max_pages_to_add",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_max_pages_to_add) ||
+          FLAGS_max_pages_to_add > RunnerMainOptions::kMaxPagesToAdd) {
+        LOG_ERROR("Invalid max_pages_to_add ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("server", CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_server = true;
+    } else if (matcher.Match("fork_server",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_fork_server = true;
+    } else if (matcher.Match("lazy_mapping",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_lazy_mapping = true;
+    } else if (matcher.Match("cosched_group_path",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_cosched_group_path = matcher.optarg();
+    } else if (matcher.Match("cosched_group_size",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_cosched_group_size) ||
+          FLAGS_cosched_group_size == 0) {
+        LOG_ERROR("Invalid cosched_group_size ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("cosched_group_index",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_cosched_group_index)) {
+        LOG_ERROR("Invalid cosched_group_index ", matcher.optarg());
+        return -1;
+      }
     } else {
       // Exit loop if argument is not recognized.
       break;
@@ -17,6 +17,8 @@
 
 #include <cstdint>
 
+#include "./runner/snap_batch_scheduler.h"
+
 //
 // Runner command line flags
 //
@@ -59,9 +61,53 @@ extern uint64_t FLAGS_batch_size;
 // Snap execution schedule size.
 extern uint64_t FLAGS_schedule_size;
 
+// Policy for picking Snaps into batches.
+extern SchedulePolicy FLAGS_schedule_policy;
+
+// Percentage of L2 cache size used as the batch byte budget by
+// footprint-aware schedule policies.
+extern uint64_t FLAGS_l2_cache_fraction_percent;
+
 // If true, execute Snaps sequentially once.
 extern bool FLAGS_sequential_mode;
 
+// If set, the runner maps the first page of this file and maintains execution
+// statistics there. See runner_stats.h.
+extern const char* FLAGS_stats_path;
+
+// Number of failed snap executions after which the runner stops. See
+// RunnerMainOptions::max_failures for details.
+extern uint64_t FLAGS_max_failures;
+
+// If set, the runner reports results in this file in binary instead of on
+// stdout as text. See RunnerMainOptions::results_fd for details.
+extern const char* FLAGS_results_path;
+
+// In make mode, add up to this many writable pages to repair page faults. See
+// RunnerMainOptions::max_pages_to_add for details.
+extern uint64_t FLAGS_max_pages_to_add;
+
+// If true, run in server mode. See RunnerServerMain() for details.
+extern bool FLAGS_server;
+
+// If true, run as a fork server that starts runners for requests read from
+// stdin. See runner_fork_server_protocol.h for details.
+extern bool FLAGS_fork_server;
+
+// If true, set up read-only Snap contents on first use. See
+// RunnerMainOptions::lazy_mapping for details.
+extern bool FLAGS_lazy_mapping;
+
+// If set, the runner joins the co-scheduling group whose state is in the first
+// page of this file. See RunnerMainOptions::cosched_group for details.
+extern const char* FLAGS_cosched_group_path;
+
+// Number of runners in the co-scheduling group.
+extern uint64_t FLAGS_cosched_group_size;
+
+// Index of this runner in the co-scheduling group.
+extern uint64_t FLAGS_cosched_group_index;
+
 // Parses command line flags of runner and sets flags accordingly. 'argv[]' is
 // an array of 'argc' command line argument passed to main(). Parsing starts
 // at 'argv[1]' and stops at the first non-flag argument or end of 'argv[]'.
@@ -0,0 +1,49 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_FORK_SERVER_PROTOCOL_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_FORK_SERVER_PROTOCOL_H_
+
+#include <cstdint>
+
+namespace silifuzz {
+
+// Protocol between a runner in fork server mode (--fork_server) and
+// RunnerDriver.
+//
+// A fork server starts a runner process for each request without exec'ing
+// the runner binary again. It reads requests from stdin until it sees EOF.
+// A request is a RunnerForkRequest followed by args_size bytes of runner
+// command line arguments, i.e. argv[1..] of an equivalent runner invocation,
+// each terminated by a NUL byte. For each request the server forks a child
+// that stops itself with SIGSTOP before it parses the arguments. Once the
+// child has stopped, the server writes the child's pid to stdout. The driver
+// then applies resource limits to the child and resumes it with SIGCONT. When
+// the child terminates, the server writes its wait(2) status to stdout. The
+// child runs exactly like a runner started with the same arguments, except
+// that its stdout goes to stderr, so it must report results through
+// --results_path. pids and statuses are 64-bit integers. All integers are
+// little-endian.
+
+struct RunnerForkRequest {
+  // Size of the command line arguments following the request.
+  uint64_t args_size;
+};
+
+// Maximum RunnerForkRequest::args_size.
+inline constexpr uint64_t kMaxForkRequestArgsSize = 16384;
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_FORK_SERVER_PROTOCOL_H_
@@ -13,22 +13,34 @@
 // limitations under the License.
 
 #include <fcntl.h>
+#include <unistd.h>
 
 #include <cstdint>
 #include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./runner/driver/runner_driver.h"
 #include "./runner/runner_provider.h"
+#include "./runner/runner_stats.h"
 #include "./snap/gen/relocatable_snap_generator.h"
+#include "./snap/gen/runner_base_address.h"
+#include "./snap/gen/snap_generator.h"
 #include "./snap/testing/snap_test_snaps.h"
+#include "./snap/testing/snap_test_snapshots.h"
+#include "./snap/testing/snap_test_types.h"
 #include "./util/file_util.h"
+#include "./util/mmapped_memory_ptr.h"
 #include "./util/path_util.h"
 #include "./util/testing/status_macros.h"
 #include "./util/testing/status_matchers.h"
@@ -39,6 +51,7 @@ namespace {
 
 using ::silifuzz::testing::StatusIs;
 using snapshot_types::PlaybackOutcome;
+using ::testing::ElementsAre;
 using ::testing::HasSubstr;
 using ::testing::IsEmpty;
 using ::testing::Not;
@@ -164,5 +177,180 @@ TEST(RunnerTest, EmptyCorpus) {
   ASSERT_OK(driver.Run(opts));
 }
 
+TEST(RunnerTest, CoschedGroup) {
+  // Each member of the group runs one of two copies of the same snap.
+  std::vector<Snapshot> snapified_corpus;
+  for (const char* id : {"member_0", "member_1"}) {
+    Snapshot snapshot =
+        MakeSnapRunnerTestSnapshot(TestSnapshot::kEndsAsExpected);
+    snapshot.set_id(id);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified,
+                         Snapify(snapshot, SnapifyOptions::V2InputRunOpts()));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, snapified_corpus);
+  ASSERT_OK_AND_ASSIGN(auto corpus_path, CreateTempFile("CoschedGroup", ""));
+  ASSERT_TRUE(SetContents(corpus_path, {buffer.get(),
+                                        MmappedMemorySize(buffer)}));
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), corpus_path,
+      [&corpus_path] { unlink(corpus_path.c_str()); });
+
+  // A zero-filled page is a new group.
+  ASSERT_OK_AND_ASSIGN(auto group_path, CreateTempFile("CoschedGroup", ""));
+  ASSERT_EQ(truncate(group_path.c_str(), getpagesize()), 0);
+
+  // Member 1 runs far fewer iterations than member 0. Member 0 must carry
+  // on alone once member 1 leaves instead of waiting for the group timeout.
+  auto run_member = [&](size_t index, int num_iterations) {
+    auto opts = RunnerOptions::Default();
+    opts.set_cosched_group(group_path, 2, index)
+        .set_collect_stats(true)
+        .set_extra_argv({"--num_iterations", std::to_string(num_iterations)});
+    return driver.RunAll(opts);
+  };
+  absl::StatusOr<std::vector<RunnerDriver::RunResult>> member_1_results;
+  const absl::Time start_time = absl::Now();
+  std::thread member_1(
+      [&] { member_1_results = run_member(1, /*num_iterations=*/10); });
+  auto member_0_results = run_member(0, /*num_iterations=*/100000);
+  member_1.join();
+  const absl::Duration elapsed = absl::Now() - start_time;
+  unlink(group_path.c_str());
+
+  for (const auto* results : {&member_0_results, &member_1_results}) {
+    ASSERT_OK(*results);
+    ASSERT_EQ(results->value().size(), 1);
+    EXPECT_TRUE(results->value().front().success());
+  }
+  const RunnerStats& stats = *member_0_results->front().stats();
+  EXPECT_EQ(stats.num_executions, 100000);
+  // Below RunnerMainOptions::kCoschedGroupTimeoutSeconds.
+  EXPECT_LT(elapsed, absl::Seconds(10));
+}
+
+TEST(RunnerTest, CoschedGroupLargerThanCorpus) {
+  std::vector<Snapshot> snapified_corpus;
+  ASSERT_OK_AND_ASSIGN(
+      Snapshot snapified,
+      Snapify(MakeSnapRunnerTestSnapshot(TestSnapshot::kEndsAsExpected),
+              SnapifyOptions::V2InputRunOpts()));
+  snapified_corpus.push_back(std::move(snapified));
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, snapified_corpus);
+  ASSERT_OK_AND_ASSIGN(auto corpus_path,
+                       CreateTempFile("CoschedGroupLargerThanCorpus", ""));
+  ASSERT_TRUE(SetContents(corpus_path, {buffer.get(),
+                                        MmappedMemorySize(buffer)}));
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), corpus_path,
+      [&corpus_path] { unlink(corpus_path.c_str()); });
+  ASSERT_OK_AND_ASSIGN(auto group_path,
+                       CreateTempFile("CoschedGroupLargerThanCorpus", ""));
+  ASSERT_EQ(truncate(group_path.c_str(), getpagesize()), 0);
+
+  // Member 0 gets an empty slice of the one-snap corpus and exits cleanly.
+  // Member 1 then runs the snap without waiting for the group timeout.
+  const absl::Time start_time = absl::Now();
+  for (size_t index : {0, 1}) {
+    auto opts = RunnerOptions::Default();
+    opts.set_cosched_group(group_path, 2, index)
+        .set_extra_argv({"--num_iterations", "10"});
+    ASSERT_OK_AND_ASSIGN(auto results, driver.RunAll(opts));
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_TRUE(results.front().success());
+  }
+  unlink(group_path.c_str());
+  // Below RunnerMainOptions::kCoschedGroupTimeoutSeconds.
+  EXPECT_LT(absl::Now() - start_time, absl::Seconds(10));
+}
+
+TEST(RunnerTest, SkipsConflictingSnap) {
+  std::vector<Snapshot> snapified_corpus;
+  for (const char* id : {"conflicting", "good"}) {
+    Snapshot snapshot =
+        MakeSnapRunnerTestSnapshot(TestSnapshot::kEndsAsExpected);
+    snapshot.set_id(id);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified,
+                         Snapify(snapshot, SnapifyOptions::V2InputRunOpts()));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+  // A read-only page inside the runner binary region.
+  Snapshot& conflicting = snapified_corpus.front();
+  const Snapshot::MemoryMapping runner_page_mapping =
+      Snapshot::MemoryMapping::MakeSized(SILIFUZZ_RUNNER_BASE_ADDRESS,
+                                         conflicting.page_size(),
+                                         MemoryPerms::R());
+  ASSERT_OK(conflicting.can_add_memory_mapping(runner_page_mapping));
+  conflicting.add_memory_mapping(runner_page_mapping);
+  conflicting.add_memory_bytes(Snapshot::MemoryBytes(
+      SILIFUZZ_RUNNER_BASE_ADDRESS,
+      Snapshot::ByteData(conflicting.page_size(), '\0')));
+
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, snapified_corpus);
+  ASSERT_OK_AND_ASSIGN(auto corpus_path,
+                       CreateTempFile("SkipsConflictingSnap", ""));
+  ASSERT_TRUE(SetContents(corpus_path, {buffer.get(),
+                                        MmappedMemorySize(buffer)}));
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), corpus_path,
+      [&corpus_path] { unlink(corpus_path.c_str()); });
+
+  // The rest of the corpus runs, and the skipped snap is reported.
+  auto opts = RunnerOptions::Default();
+  opts.set_collect_stats(true).set_extra_argv({"--num_iterations", "10"});
+  ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+  EXPECT_THAT(result.skipped_snapshot_ids(), ElementsAre("conflicting"));
+  ASSERT_TRUE(result.stats().has_value());
+  EXPECT_EQ(result.stats()->num_skipped_snaps, 1);
+  EXPECT_EQ(result.stats()->num_executions, 10);
+
+  // Requesting the skipped snap alone is an error of the snap, not a crash of
+  // the runner, also with text results.
+  EXPECT_THAT(driver.PlayOne("conflicting"),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       HasSubstr("skipped")));
+  EXPECT_THAT(
+      driver.Run(RunnerOptions::PlayOptions("conflicting")
+                     .set_text_results(true)),
+      StatusIs(absl::StatusCode::kFailedPrecondition, HasSubstr("skipped")));
+  EXPECT_THAT(driver.MakeOne("conflicting"),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(RunnerTest, ConflictingReadOnlyMappings) {
+  // Two copies of the same snap share their read-only code mapping, which
+  // the runner must not silently replace however the mapping is created.
+  std::vector<Snapshot> snapified_corpus;
+  for (const char* id : {"copy_0", "copy_1"}) {
+    Snapshot snapshot =
+        MakeSnapRunnerTestSnapshot(TestSnapshot::kEndsAsExpected);
+    snapshot.set_id(id);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified,
+                         Snapify(snapshot, SnapifyOptions::V2InputRunOpts()));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, snapified_corpus);
+  ASSERT_OK_AND_ASSIGN(auto corpus_path,
+                       CreateTempFile("ConflictingReadOnlyMappings", ""));
+  ASSERT_TRUE(SetContents(corpus_path, {buffer.get(),
+                                        MmappedMemorySize(buffer)}));
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), corpus_path,
+      [&corpus_path] { unlink(corpus_path.c_str()); });
+
+  for (bool lazy : {false, true}) {
+    std::vector<std::string> extra_argv = {"--num_iterations", "1"};
+    if (lazy) extra_argv.push_back("--lazy_mapping");
+    auto opts = RunnerOptions::Default();
+    opts.set_extra_argv(extra_argv);
+    EXPECT_FALSE(driver.Run(opts).ok()) << "lazy = " << lazy;
+  }
+}
+
 }  // namespace
 }  // namespace silifuzz
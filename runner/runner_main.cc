@@ -23,22 +23,37 @@
 //  Link with :loading_snap_corpus. Then pass the file name containing a
 //  relocatable corpus as a command line argument.
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 #include "third_party/lss/lss/linux_syscall_support.h"
+#include "./runner/cosched_group.h"
 #include "./runner/default_snap_corpus.h"
 #include "./runner/runner.h"
 #include "./runner/runner_flags.h"
+#include "./runner/runner_fork_server_protocol.h"
+#include "./runner/runner_stats.h"
 #include "./util/arch.h"
+#include "./util/byte_io.h"
 #include "./util/checks.h"
+#include "./util/itoa.h"
 
 namespace silifuzz {
 
 namespace {
 
+int ForkServerMain(char* program_name);
+
 int Main(int argc, char* argv[]) {
   int flags_end = ParseRunnerFlags(argc, argv);
   if (flags_end == -1) {
@@ -50,13 +65,26 @@ int Main(int argc, char* argv[]) {
     ShowUsage(argv[0]);
     return EXIT_SUCCESS;
   }
+  if (FLAGS_fork_server) {
+    if (argc != 2) {
+      LOG_ERROR("fork_server cannot be used with other arguments");
+      return EXIT_FAILURE;
+    }
+    return ForkServerMain(argv[0]);
+  }
 
   RunnerMainOptions options;
-  options.corpus = LoadCorpus(flags_end < argc ? argv[flags_end] : nullptr);
+  const char* corpus_path = flags_end < argc ? argv[flags_end] : nullptr;
+  options.corpus = LoadCorpus(corpus_path);
   if (options.corpus == nullptr) {
     LOG_ERROR("No corpus file name was specified");
     return EXIT_FAILURE;
   }
+  if (corpus_path != nullptr) {
+    // Keep the corpus file open for mapping images of read-only mappings.
+    // Baked-in corpora have no images, so a failure here is not an error.
+    options.corpus_fd = open(corpus_path, O_RDONLY);
+  }
   if (options.corpus->snaps.size == 0) {
     // Treat an empty corpus file as valid an exit immediately.
     LOG_INFO("The corpus is empty, exiting");
@@ -91,18 +119,145 @@ int Main(int argc, char* argv[]) {
   }
   options.batch_size = FLAGS_batch_size;
   options.schedule_size = FLAGS_schedule_size;
+  options.schedule_policy = FLAGS_schedule_policy;
+  options.l2_cache_fraction_percent = FLAGS_l2_cache_fraction_percent;
   options.sequential_mode = FLAGS_sequential_mode;
+  options.max_failures = FLAGS_max_failures;
+  options.lazy_mapping = FLAGS_lazy_mapping;
+  if (FLAGS_max_pages_to_add > 0 && (!FLAGS_make || FLAGS_enable_tracer)) {
+    LOG_ERROR("max_pages_to_add requires make mode without enable_tracer");
+    return EXIT_FAILURE;
+  }
+  options.max_pages_to_add = FLAGS_max_pages_to_add;
+  if (FLAGS_stats_path != nullptr) {
+    options.stats = MapRunnerStatsFile(FLAGS_stats_path);
+    if (options.stats == nullptr) {
+      return EXIT_FAILURE;
+    }
+  }
+  if (FLAGS_results_path != nullptr) {
+    // The driver may truncate the file between runs in server mode.
+    options.results_fd = open(FLAGS_results_path, O_WRONLY | O_APPEND);
+    if (options.results_fd < 0) {
+      LOG_ERROR("open(", FLAGS_results_path, "): ", ErrnoStr(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (FLAGS_cosched_group_path != nullptr) {
+    if (FLAGS_cosched_group_index >= FLAGS_cosched_group_size) {
+      LOG_ERROR("cosched_group_index must be less than cosched_group_size");
+      return EXIT_FAILURE;
+    }
+    if (FLAGS_make || FLAGS_sequential_mode || FLAGS_server ||
+        FLAGS_snap_id != nullptr) {
+      LOG_ERROR(
+          "cosched_group_path cannot be used with make mode, sequential mode, "
+          "server mode or snap_id");
+      return EXIT_FAILURE;
+    }
+    options.cosched_group = MapCoschedGroupFile(FLAGS_cosched_group_path);
+    if (options.cosched_group == nullptr) {
+      return EXIT_FAILURE;
+    }
+    options.cosched_group_size = FLAGS_cosched_group_size;
+    options.cosched_group_index = FLAGS_cosched_group_index;
+    options.cosched_group_timeout_ticks =
+        RunnerMainOptions::kCoschedGroupTimeoutSeconds * TickCounterFrequency();
+  }
 
   // These cannot be set together.
-  if (FLAGS_make && FLAGS_sequential_mode) {
-    LOG_FATAL("Cannot set both make and sequential mode");
+  if (FLAGS_make + FLAGS_sequential_mode + FLAGS_server > 1) {
+    LOG_FATAL("Only one of make, sequential and server mode can be set");
   }
 
   return (FLAGS_make              ? MakerMain(options)
           : FLAGS_sequential_mode ? RunnerMainSequential(options)
+          : FLAGS_server          ? RunnerServerMain(options)
                                   : RunnerMain(options));
 }
 
+// Maximum number of arguments in a fork server request.
+constexpr int kMaxForkRequestArgs = 256;
+
+// Runs in a child of the fork server. Detaches the child from the server's
+// protocol channels, lets the driver apply resource limits and then runs the
+// child like a runner started with `argc` and `argv`.
+int ForkedRunnerMain(int argc, char* argv[]) {
+  // Do not outlive the server, which does not outlive the driver.
+  CHECK_EQ(prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0), 0);
+  close(STDIN_FILENO);
+  CHECK_EQ(dup2(STDERR_FILENO, STDOUT_FILENO), STDOUT_FILENO);
+  // The server reports our pid once we have stopped. The driver resumes us.
+  CHECK_EQ(kill(getpid(), SIGSTOP), 0);
+  FLAGS_fork_server = false;
+  return Main(argc, argv);
+}
+
+// Forks a runner for each request read from stdin until EOF. See
+// runner_fork_server_protocol.h for details. Returns in the children with
+// their exit codes, and in the server when it is done.
+//
+// The children fork before parsing their flags and loading their corpus, so
+// a forked run only saves the execve(2) and the startup of the static binary.
+// Forking after the corpus is loaded would not help the snapshot maker, which
+// passes a new single-snapshot corpus with every request.
+int ForkServerMain(char* program_name) {
+  VLOG_INFO(1, "Running in fork server mode");
+  // Requests are kept in static storage, which children inherit.
+  static char args[kMaxForkRequestArgsSize];
+  static char* child_argv[kMaxForkRequestArgs + 2];
+  for (uint64_t num_requests = 0;; ++num_requests) {
+    RunnerForkRequest request;
+    const ssize_t bytes_read = Read(STDIN_FILENO, &request, sizeof(request));
+    if (bytes_read == 0) {
+      // The driver closed the request channel.
+      VLOG_INFO(1, "Served ", IntStr(num_requests), " requests");
+      return EXIT_SUCCESS;
+    }
+    if (bytes_read != sizeof(request) ||
+        request.args_size > kMaxForkRequestArgsSize) {
+      LOG_FATAL("Cannot read request: ", IntStr(bytes_read), " bytes read");
+    }
+    if (Read(STDIN_FILENO, args, request.args_size) !=
+            static_cast<ssize_t>(request.args_size) ||
+        (request.args_size > 0 && args[request.args_size - 1] != '\0')) {
+      LOG_FATAL("Cannot read request arguments");
+    }
+
+    int child_argc = 0;
+    child_argv[child_argc++] = program_name;
+    for (size_t i = 0; i < request.args_size; i += strlen(&args[i]) + 1) {
+      if (child_argc > kMaxForkRequestArgs) {
+        LOG_FATAL("Too many request arguments");
+      }
+      child_argv[child_argc++] = &args[i];
+    }
+    child_argv[child_argc] = nullptr;
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+      LOG_FATAL("fork: ", ErrnoStr(errno));
+    }
+    if (pid == 0) {
+      return ForkedRunnerMain(child_argc, child_argv);
+    }
+
+    // Wait until the child is ready to be resumed, or died trying.
+    int status;
+    CHECK_EQ(waitpid(pid, &status, WUNTRACED), pid);
+    uint64_t response = pid;
+    CHECK_EQ(Write(STDOUT_FILENO, &response, sizeof(response)),
+             sizeof(response));
+    if (WIFSTOPPED(status)) {
+      CHECK_EQ(waitpid(pid, &status, 0), pid);
+    }
+    response = status;
+    CHECK_EQ(Write(STDOUT_FILENO, &response, sizeof(response)),
+             sizeof(response));
+  }
+}
+
 }  // namespace
 }  // namespace silifuzz
 
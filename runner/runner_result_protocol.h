@@ -0,0 +1,114 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_RESULT_PROTOCOL_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_RESULT_PROTOCOL_H_
+
+#include <cstdint>
+
+namespace silifuzz {
+
+// Binary encoding of the Snap execution results that a runner reports to
+// RunnerDriver. It carries the same information as the
+// proto.SnapshotExecutionResult text protos the runner prints on stdout, but
+// registers and memory contents are written verbatim, so that the runner does
+// not have to escape them and the reader does not have to parse them.
+//
+// A runner started with --results_path appends one record per reported result
+// to that file instead of printing text protos. A record consists of
+//   - a RunnerResultHeader,
+//   - header.snapshot_id_size bytes of snapshot id,
+//   - header.gregs_size bytes of serialized GRegSet,
+//   - header.fpregs_size bytes of serialized FPRegSet,
+//   - header.num_memory_ranges times a RunnerResultMemoryRange followed by
+//     range.num_bytes bytes of memory contents.
+// Each item is padded with zeros to a multiple of kRunnerResultAlignment
+// bytes, so that headers can be accessed in place when the record is too.
+// header.record_size includes the padding. All integers are little-endian.
+//
+// Before any results, the file holds one skip record for each Snap that the
+// runner skipped at startup because its mappings conflict with the runner
+// itself. A skip record consists of a RunnerSkipHeader followed by
+// header.snapshot_id_size bytes of snapshot id, padded like above.
+
+inline constexpr uint64_t kRunnerResultMagic = 0x31746c7573655253;  // SResult1
+inline constexpr uint64_t kRunnerSkipMagic = 0x3170696b53726e52;    // RnrSkip1
+
+// Alignment of the items of a record.
+inline constexpr uint64_t kRunnerResultAlignment = 8;
+
+// Returns `size` rounded up to a multiple of kRunnerResultAlignment.
+constexpr uint64_t RunnerResultPadded(uint64_t size) {
+  return (size + kRunnerResultAlignment - 1) & ~(kRunnerResultAlignment - 1);
+}
+
+// Values of RunnerResultHeader::endpoint_type.
+enum class RunnerResultEndpointType : uint64_t {
+  kNone = 0,         // The runner could not determine the endpoint.
+  kInstruction = 1,  // See snapshot_types::EndpointType::kInstruction.
+  kSignal = 2,       // See snapshot_types::EndpointType::kSignal.
+};
+
+struct RunnerResultHeader {
+  // Always kRunnerResultMagic.
+  uint64_t magic;
+
+  // Size of the whole record in bytes, including this header.
+  uint64_t record_size;
+
+  // RunSnapOutcome of the execution and the CPU it ran on.
+  int64_t outcome;
+  int64_t cpu_id;
+
+  // Actual endpoint of the execution. The signal fields are only set for
+  // kSignal. instruction_address is the sig_instruction_address() of a
+  // signal endpoint.
+  uint64_t endpoint_type;
+  uint64_t sig_num;
+  uint64_t sig_cause;
+  uint64_t sig_address;
+  uint64_t instruction_address;
+
+  // Sizes of the items following the header, see above.
+  uint64_t snapshot_id_size;
+  uint64_t gregs_size;
+  uint64_t fpregs_size;
+  uint64_t num_memory_ranges;
+};
+
+// Header of actual writable memory contents at the end of the execution.
+struct RunnerResultMemoryRange {
+  uint64_t start_address;
+  uint64_t num_bytes;
+};
+
+// Header of a skip record.
+struct RunnerSkipHeader {
+  // Always kRunnerSkipMagic.
+  uint64_t magic;
+
+  // Size of the whole record in bytes, including this header.
+  uint64_t record_size;
+
+  // Size of the snapshot id following the header.
+  uint64_t snapshot_id_size;
+};
+
+static_assert(sizeof(RunnerResultHeader) % kRunnerResultAlignment == 0);
+static_assert(sizeof(RunnerResultMemoryRange) % kRunnerResultAlignment == 0);
+static_assert(sizeof(RunnerSkipHeader) % kRunnerResultAlignment == 0);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_RESULT_PROTOCOL_H_
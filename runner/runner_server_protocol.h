@@ -0,0 +1,55 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_SERVER_PROTOCOL_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_SERVER_PROTOCOL_H_
+
+#include <cstdint>
+
+namespace silifuzz {
+
+// Protocol between a runner in server mode (--server) and RunnerServer.
+//
+// The server maps its corpus once and then reads RunnerServerCommand structs
+// from stdin until it sees EOF. For each command it writes a response to
+// stdout that consists of zero or more length-prefixed failure records (see
+// RunnerMainOptions::max_failures), followed by kEndOfResponse in place of a
+// record length and the exit code (see runner.cc) that a runner executing
+// just this command would have returned, as a 64-bit integer. All integers
+// are little-endian. When the server is started with --results_path, the
+// failure records are written to that file in the format of
+// runner_result_protocol.h instead and the response only consists of
+// kEndOfResponse and the exit code.
+
+// Asks the server to execute Snaps from its corpus.
+struct RunnerServerCommand {
+  // Maximum number of Snap executions. 0 means the --num_iterations value
+  // the server was started with.
+  uint64_t num_iterations;
+
+  // Seed for the Snap schedule. 0 means a seed derived from the server's
+  // --seed and the number of commands executed so far.
+  uint64_t seed;
+
+  // The command stops once ReadTickCounter() reaches this value, with the
+  // same exit code as a timeout. 0 means no deadline.
+  uint64_t deadline_ticks;
+};
+
+// Value in place of a record length that marks the end of a response.
+inline constexpr uint64_t kEndOfResponse = ~uint64_t{0};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_SERVER_PROTOCOL_H_
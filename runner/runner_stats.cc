@@ -0,0 +1,56 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/runner_stats.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "./util/checks.h"
+#include "./util/itoa.h"
+
+namespace silifuzz {
+
+void InitRunnerStats(RunnerStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->magic = RunnerStats::kMagic;
+  stats->struct_size = sizeof(RunnerStats);
+  stats->start_ticks = ReadTickCounter();
+  stats->last_update_ticks = stats->start_ticks;
+}
+
+RunnerStats* MapRunnerStatsFile(const char* path) {
+  int fd = open(path, O_RDWR);
+  if (fd < 0) {
+    LOG_ERROR("open(", path, "): ", ErrnoStr(errno));
+    return nullptr;
+  }
+  void* addr = mmap(nullptr, sizeof(RunnerStats), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file is closed.
+  CHECK_EQ(close(fd), 0);
+  if (addr == MAP_FAILED) {
+    LOG_ERROR("mmap(", path, "): ", ErrnoStr(errno));
+    return nullptr;
+  }
+  RunnerStats* stats = reinterpret_cast<RunnerStats*>(addr);
+  InitRunnerStats(stats);
+  return stats;
+}
+
+}  // namespace silifuzz
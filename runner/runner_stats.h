@@ -0,0 +1,152 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_STATS_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace silifuzz {
+
+// Returns the current value of a free running, constant rate counter: the TSC
+// on x86_64 and the virtual counter on aarch64. Values are only meaningful as
+// differences within the same process on the same machine.
+inline uint64_t ReadTickCounter() {
+#if defined(__x86_64__)
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+#error "Unsupported architecture"
+#endif
+}
+
+// Execution statistics maintained by the runner in a page of memory shared
+// with its parent. The layout is fixed so that processes built from the same
+// source can exchange it without any serialization. The runner is the only
+// writer. Each field is updated with a single aligned 64-bit store, so a
+// concurrent reader never sees a torn value, but different fields may be
+// observed at slightly different points of the execution.
+struct RunnerStats {
+  // "RunStats" in little-endian.
+  static constexpr uint64_t kMagic = 0x73746174536e7552ULL;
+
+  // Phases of a single Snap execution.
+  enum Phase {
+    kPrepareMemory = 0,  // Restoring writable memory.
+    kRun = 1,            // Running Snap code until it exits.
+    kVerify = 2,         // Comparing the end state with the expected one.
+    kNumPhases,
+  };
+
+  // Number of outcome counters. Must be at least the number of
+  // RunSnapOutcome values.
+  static constexpr size_t kNumOutcomes = 8;
+
+  // Number of buckets in run_ticks_histogram. Bucket i counts executions whose
+  // kRun phase took [2^i, 2^(i+1)) ticks. The last bucket also counts all
+  // longer executions.
+  static constexpr size_t kNumHistogramBuckets = 32;
+
+  // Records one Snap execution that spent `phase_ticks[i]` ticks in phase i
+  // and ended with `outcome`.
+  void RecordExecution(const uint64_t (&ticks)[kNumPhases], int outcome) {
+    for (size_t i = 0; i < kNumPhases; ++i) {
+      phase_ticks[i] += ticks[i];
+    }
+    if (outcome >= 0 && static_cast<size_t>(outcome) < kNumOutcomes) {
+      ++outcome_counts[outcome];
+    }
+    const uint64_t run_ticks = ticks[kRun] | 1;
+    size_t bucket = 63 - __builtin_clzll(run_ticks);
+    if (bucket >= kNumHistogramBuckets) {
+      bucket = kNumHistogramBuckets - 1;
+    }
+    ++run_ticks_histogram[bucket];
+    ++num_executions;
+    last_update_ticks = ReadTickCounter();
+  }
+
+  // Returns true iff this looks like a valid RunnerStats, i.e. a runner
+  // initialized it.
+  bool IsValid() const {
+    return magic == kMagic && struct_size == sizeof(RunnerStats);
+  }
+
+  // Always kMagic once initialized by the runner.
+  uint64_t magic;
+
+  // sizeof(RunnerStats) for checking the layout is in sync with the code.
+  uint32_t struct_size;
+
+  // Make the unused space in this struct explicit.
+  uint32_t padding;
+
+  // Tick counter value when the runner started executing Snaps.
+  uint64_t start_ticks;
+
+  // Tick counter value at the last update. This serves as a heartbeat.
+  uint64_t last_update_ticks;
+
+  // Number of Snap executions.
+  uint64_t num_executions;
+
+  // Total ticks spent in each Phase.
+  uint64_t phase_ticks[kNumPhases];
+
+  // Number of executions per RunSnapOutcome.
+  uint64_t outcome_counts[kNumOutcomes];
+
+  // Histogram of kRun phase durations. See kNumHistogramBuckets.
+  uint64_t run_ticks_histogram[kNumHistogramBuckets];
+
+  // Ticks spent mapping the corpus at startup.
+  uint64_t map_corpus_ticks;
+
+  // Resident set size in bytes right after mapping the corpus.
+  uint64_t map_corpus_rss_bytes;
+
+  // Number of Snaps whose read-only contents were set up on first use in lazy
+  // mapping mode. See RunnerMainOptions::lazy_mapping.
+  uint64_t num_lazily_mapped_snaps;
+
+  // Number of Snaps skipped at startup because their mappings conflict with
+  // the runner itself. See MapCorpus().
+  uint64_t num_skipped_snaps;
+
+  // Ticks spent waiting for the other members of the co-scheduling group.
+  // See RunnerMainOptions::cosched_group.
+  uint64_t cosched_wait_ticks;
+};
+
+// The runner and its parent share a single page.
+static_assert(sizeof(RunnerStats) <= 4096);
+
+// Initializes `stats` for a new runner session.
+void InitRunnerStats(RunnerStats* stats);
+
+// Maps the first page of the file at `path` as a shared RunnerStats and
+// initializes it. Returns nullptr and logs an error on failure.
+//
+// This makes syscalls and must be called before entering the seccomp sandbox.
+RunnerStats* MapRunnerStatsFile(const char* path);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_STATS_H_
@@ -14,6 +14,8 @@
 
 #include "./runner/runner.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>  // EXIT_SUCCESS
 
 #include "./runner/runner_util.h"
@@ -22,6 +24,8 @@
 #include "./snap/testing/snap_test_snaps.h"
 #include "./snap/testing/snap_test_types.h"
 #include "./util/checks.h"
+#include "./util/checksum.h"
+#include "./util/mem_util.h"
 #include "./util/nolibc_gunit.h"
 
 namespace silifuzz {
@@ -49,6 +53,88 @@ TEST(Runner, MemoryMismatch) {
       RunSnapOutcome::kMemoryMismatch);
 }
 
+// Returns a copy of `snap` whose expected end state memory is stored as plain
+// byte arrays. If `corrupt` is true, one byte of the expected end state is
+// flipped. The end state checksums of the writable mappings are recomputed
+// from the expected bytes, as the generator would for a snapshot recorded on
+// a CPU that corrupted that byte.
+Snap CopyWithEndStateChecksums(const Snap& snap, bool corrupt) {
+  constexpr size_t kMaxArraySize = 16;
+  constexpr size_t kMaxEndStateBytes = 1 << 16;
+  static Snap::MemoryBytes end_state_memory_bytes[kMaxArraySize];
+  static Snap::MemoryMapping memory_mappings[kMaxArraySize];
+  static uint8_t byte_values[kMaxEndStateBytes];
+  CHECK_GT(snap.end_state_memory_bytes.size, 0);
+  CHECK_LE(snap.end_state_memory_bytes.size, kMaxArraySize);
+  CHECK_LE(snap.memory_mappings.size, kMaxArraySize);
+
+  size_t num_bytes = 0;
+  for (size_t i = 0; i < snap.end_state_memory_bytes.size; ++i) {
+    const Snap::MemoryBytes& memory_bytes = snap.end_state_memory_bytes[i];
+    const size_t size = memory_bytes.size();
+    CHECK_LE(num_bytes + size, kMaxEndStateBytes);
+    uint8_t* values = &byte_values[num_bytes];
+    if (memory_bytes.repeating()) {
+      MemSet(values, memory_bytes.data.byte_run.value, size);
+    } else {
+      MemCopy(values, memory_bytes.data.byte_values.elements, size);
+    }
+    end_state_memory_bytes[i] = memory_bytes;
+    end_state_memory_bytes[i].flags &= ~Snap::MemoryBytes::kRepeating;
+    end_state_memory_bytes[i].data.byte_values = {.size = size,
+                                                  .elements = values};
+    num_bytes += size;
+  }
+  if (corrupt) {
+    // Flip a byte away from the start of the range.
+    byte_values[num_bytes / 2] ^= 1;
+  }
+
+  for (size_t i = 0; i < snap.memory_mappings.size; ++i) {
+    Snap::MemoryMapping& memory_mapping = memory_mappings[i];
+    memory_mapping = snap.memory_mappings[i];
+    if (!memory_mapping.writable()) continue;
+    // The checksum must be present for the runner to rely on it.
+    CHECK_NE(memory_mapping.end_state_checksum, 0);
+    const uint64_t mapping_limit =
+        memory_mapping.start_address + memory_mapping.num_bytes;
+    MemoryChecksum checksum;
+    for (size_t j = 0; j < snap.end_state_memory_bytes.size; ++j) {
+      const Snap::MemoryBytes& memory_bytes = end_state_memory_bytes[j];
+      if (memory_bytes.start_address < memory_mapping.start_address ||
+          memory_bytes.start_address >= mapping_limit) {
+        continue;
+      }
+      checksum.AddData(memory_bytes.data.byte_values.elements,
+                       memory_bytes.size());
+    }
+    memory_mapping.end_state_checksum = checksum.Value();
+  }
+
+  Snap copy = snap;
+  copy.memory_mappings = {.size = snap.memory_mappings.size,
+                          .elements = memory_mappings};
+  copy.end_state_memory_bytes = {.size = snap.end_state_memory_bytes.size,
+                                 .elements = end_state_memory_bytes};
+  return copy;
+}
+
+TEST(Runner, EndStateChecksum) {
+  const Snap& snap = GetSnapRunnerTestSnap(TestSnapshot::kEndsAsExpected);
+  // Recomputed checksums of the unchanged end state match the generated ones.
+  const Snap copy = CopyWithEndStateChecksums(snap, /*corrupt=*/false);
+  for (size_t i = 0; i < snap.memory_mappings.size; ++i) {
+    CHECK_EQ(copy.memory_mappings[i].end_state_checksum,
+             snap.memory_mappings[i].end_state_checksum);
+  }
+  CHECK_EQ(RunSnap(copy).outcome, RunSnapOutcome::kAsExpected);
+
+  // A single byte that differs from the expected end state is caught even
+  // though the checksum of the mapping is present.
+  const Snap corrupted = CopyWithEndStateChecksums(snap, /*corrupt=*/true);
+  CHECK_EQ(RunSnap(corrupted).outcome, RunSnapOutcome::kMemoryMismatch);
+}
+
 }  // namespace
 }  // namespace silifuzz
 
@@ -62,4 +148,5 @@ NOLIBC_TEST_MAIN({
   RUN_TEST(Runner, EndsAsExpected);
   RUN_TEST(Runner, RegsMismatch);
   RUN_TEST(Runner, MemoryMismatch);
+  RUN_TEST(Runner, EndStateChecksum);
 })
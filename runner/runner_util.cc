@@ -67,6 +67,32 @@ size_t ReadProcMapsEntries(ProcMapsEntry* proc_maps_entries,
                        max_proc_maps_entries);
 }
 
+size_t ReadResidentSetSize() {
+  // /proc/self/statm is a single line of page counts: size resident shared
+  // text lib data dt.
+  char statm_buffer[256];
+  int fd = open("/proc/self/statm", O_RDONLY);
+  if (fd < 0) {
+    LOG_ERROR("open(/proc/self/statm): ", ErrnoStr(errno));
+    return 0;
+  }
+  const ssize_t statm_size = Read(fd, statm_buffer, sizeof(statm_buffer));
+  CHECK_EQ(close(fd), 0);
+  ssize_t i = 0;
+  while (i < statm_size && statm_buffer[i] != ' ') ++i;
+  ++i;  // Skip the space.
+  if (i >= statm_size) {
+    LOG_ERROR("Cannot parse /proc/self/statm");
+    return 0;
+  }
+  size_t resident_pages = 0;
+  for (; i < statm_size && statm_buffer[i] >= '0' && statm_buffer[i] <= '9';
+       ++i) {
+    resident_pages = resident_pages * 10 + (statm_buffer[i] - '0');
+  }
+  return resident_pages * getpagesize();
+}
+
 bool SnapOverlapsWithProcMapsEntries(const Snap& snap,
                                      const ProcMapsEntry* proc_maps_entries,
                                      size_t num_proc_maps_entries) {
@@ -91,6 +117,14 @@ bool SnapOverlapsWithProcMapsEntries(const Snap& snap,
 
 void LogToStdout(const char* data) { Write(STDOUT_FILENO, data, strlen(data)); }
 
+void LogRecordToStdout(const char* data) {
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+                "Record length must be little-endian");
+  const uint64_t size = strlen(data);
+  Write(STDOUT_FILENO, &size, sizeof(size));
+  Write(STDOUT_FILENO, data, size);
+}
+
 #define ALLOW_SYSCALL(name)                                              \
   BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)), \
       BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_##name, 0, 1),             \
@@ -109,8 +143,29 @@ void LogToStdout(const char* data) { Write(STDOUT_FILENO, data, strlen(data)); }
       BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, AUDIT_ARCH_CURRENT, 1, 0),       \
       BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL)
 
-void EnterSeccompStrictMode(bool allow_kill_syscall) {
-  CHECK_EQ(close(STDIN_FILENO), 0);
+// Like ALLOW_SYSCALL() but only when `enabled`. Otherwise the syscall number
+// is compared against a value no syscall has.
+#define ALLOW_SYSCALL_IF(name, enabled)                                   \
+  BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),  \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (enabled) ? SYS_##name : ~0U, 0, \
+               1),                                                        \
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
+
+// Like ALLOW_SYSCALL_IF() but also requires the first syscall argument to
+// be `arg0`. Only the low 32 bits of the argument are compared.
+#define ALLOW_SYSCALL_WITH_ARG0_IF(name, arg0, enabled)                   \
+  BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),  \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (enabled) ? SYS_##name : ~0U, 0, \
+               3),                                                        \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                  \
+               offsetof(struct seccomp_data, args[0])),                   \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (arg0), 0, 1),                  \
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
+
+void EnterSeccompStrictMode(bool allow_kill_syscall, bool allow_stdin_read) {
+  if (!allow_stdin_read) {
+    CHECK_EQ(close(STDIN_FILENO), 0);
+  }
   if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
     LOG_FATAL("prctl(PR_SET_NO_NEW_PRIVS) failed: ", ErrnoStr(errno));
   }
@@ -126,37 +181,23 @@ void EnterSeccompStrictMode(bool allow_kill_syscall) {
   // 2:
   //  <check exit_group>
   // 3:
-  //  <check kill>
+  //  <check kill if allowed>
+  // 4:
+  //  <check read from stdin if allowed>
   // return SECCOMP_KILL
-  if (allow_kill_syscall) {
-    struct sock_filter kWriteExitKillFilter[] = {
-        VALIDATE_ARCH(),
-        ALLOW_SYSCALL(write),
-        ALLOW_SYSCALL(exit_group),
-        ALLOW_SYSCALL(kill),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL),
-    };
-    struct sock_fprog filterprog = {
-        .len = sizeof(kWriteExitKillFilter) / sizeof(kWriteExitKillFilter[0]),
-        .filter = kWriteExitKillFilter};
-    if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, (uintptr_t)&filterprog, 0,
-              0) < 0) {
-      LOG_FATAL("prctl(SECCOMP_MODE_FILTER): ", ErrnoStr(errno));
-    }
-  } else {
-    struct sock_filter kWriteExitFilter[] = {
-        VALIDATE_ARCH(),
-        ALLOW_SYSCALL(write),
-        ALLOW_SYSCALL(exit_group),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL),
-    };
-    struct sock_fprog filterprog = {
-        .len = sizeof(kWriteExitFilter) / sizeof(kWriteExitFilter[0]),
-        .filter = kWriteExitFilter};
-    if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, (uintptr_t)&filterprog, 0,
-              0) < 0) {
-      LOG_FATAL("prctl(SECCOMP_MODE_FILTER): ", ErrnoStr(errno));
-    }
+  struct sock_filter filter[] = {
+      VALIDATE_ARCH(),
+      ALLOW_SYSCALL(write),
+      ALLOW_SYSCALL(exit_group),
+      ALLOW_SYSCALL_IF(kill, allow_kill_syscall),
+      ALLOW_SYSCALL_WITH_ARG0_IF(read, STDIN_FILENO, allow_stdin_read),
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL),
+  };
+  struct sock_fprog filterprog = {
+      .len = sizeof(filter) / sizeof(filter[0]), .filter = filter};
+  if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, (uintptr_t)&filterprog, 0,
+            0) < 0) {
+    LOG_FATAL("prctl(SECCOMP_MODE_FILTER): ", ErrnoStr(errno));
   }
 }
 
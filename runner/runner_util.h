@@ -37,6 +37,10 @@ bool SnapOverlapsWithProcMapsEntries(const Snap& snap,
                                      const ProcMapsEntry* proc_maps_entries,
                                      size_t num_proc_maps_entries);
 
+// Returns the resident set size of this process in bytes as reported by
+// /proc/self/statm. Returns 0 and logs an error if it cannot be read.
+size_t ReadResidentSetSize();
+
 // Converts the EndSpot to the corresponding Endpoint.
 // Returns std::nullopt and logs an error when no conversion is possible.
 std::optional<snapshot_types::Endpoint> EndSpotToEndpoint(
@@ -45,12 +49,19 @@ std::optional<snapshot_types::Endpoint> EndSpotToEndpoint(
 // Writes a null-terminated string to the standard output.
 void LogToStdout(const char* data);
 
+// Like LogToStdout() but precedes `data` with its length in bytes (excluding
+// the terminating null) as a 64-bit little-endian integer, so that a reader
+// can split a stream of records.
+void LogRecordToStdout(const char* data);
+
 // Closes unused FDs and enters a seccomp sandbox. The sandbox allows only
 // exit_group(2), write(2) by default. This sandbox configuration is similar to
 // seccomp-strict but still allows rdtsc and send SIGSYS when a blocked
 // syscall is invoked.
 // When `allow_kill_syscall` is set also allows kill(2).
-void EnterSeccompStrictMode(bool allow_kill_syscall = false);
+// When `allow_stdin_read` is set, keeps stdin open and allows read(2) from it.
+void EnterSeccompStrictMode(bool allow_kill_syscall = false,
+                            bool allow_stdin_read = false);
 
 }  // namespace silifuzz
 
@@ -0,0 +1,261 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/snap_batch_scheduler.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+
+#include "./snap/snap.h"
+#include "./util/atoi.h"
+#include "./util/byte_io.h"
+#include "./util/checks.h"
+#include "./util/cpu_id.h"
+#include "./util/itoa.h"
+#include "./util/strcat.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Reads contents of sysfs file `path` into `buffer` of `size` bytes and
+// strips the trailing newline. Returns the length of the contents or -1 if
+// the file cannot be read.
+ssize_t ReadSysfsFile(const char* path, char* buffer, size_t size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  ssize_t length = Read(fd, buffer, size);
+  CHECK_EQ(close(fd), 0);
+  if (length <= 0) {
+    return -1;
+  }
+  if (buffer[length - 1] == '\n') {
+    --length;
+  }
+  return length;
+}
+
+// Reads `file` in the sysfs directory describing cache `index` of `cpu`.
+// See ReadSysfsFile() for details.
+ssize_t ReadCacheIndexFile(int cpu, int index, const char* file, char* buffer,
+                           size_t size) {
+  // The temporaries created by StrCat() and IntStr() live until the end of
+  // the full expression, so the path must be used right here.
+  return ReadSysfsFile(
+      StrCat<128>({"/sys/devices/system/cpu/cpu", IntStr(cpu), "/cache/index",
+                   IntStr(index), "/", file}),
+      buffer, size);
+}
+
+// Parses a sysfs cache size like "1024K" or "2M". Returns 0 on error.
+size_t ParseCacheSize(const char* str, size_t length) {
+  size_t digits = 0;
+  while (digits < length && str[digits] >= '0' && str[digits] <= '9') {
+    ++digits;
+  }
+  uint64_t value;
+  if (digits == 0 || !DecToU64(str, digits, &value)) {
+    return 0;
+  }
+  if (digits == length) {
+    return value;
+  }
+  if (digits + 1 != length) {
+    return 0;
+  }
+  switch (str[digits]) {
+    case 'K':
+      return value << 10;
+    case 'M':
+      return value << 20;
+    case 'G':
+      return value << 30;
+    default:
+      return 0;
+  }
+}
+
+}  // namespace
+
+bool SchedulePolicyFromName(const char* name, SchedulePolicy* policy) {
+  if (strcmp(name, "uniform") == 0) {
+    *policy = SchedulePolicy::kUniform;
+  } else if (strcmp(name, "footprint") == 0) {
+    *policy = SchedulePolicy::kFootprint;
+  } else if (strcmp(name, "round_robin") == 0) {
+    *policy = SchedulePolicy::kRoundRobin;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* SchedulePolicyName(SchedulePolicy policy) {
+  switch (policy) {
+    case SchedulePolicy::kUniform:
+      return "uniform";
+    case SchedulePolicy::kFootprint:
+      return "footprint";
+    case SchedulePolicy::kRoundRobin:
+      return "round_robin";
+  }
+  return "unknown";
+}
+
+size_t SnapFootprint(const Snap& snap) {
+  size_t footprint = 2 * sizeof(Snap::RegisterState);
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    footprint += memory_mapping.num_bytes;
+  }
+  // Initial values of writable memory are read before every execution.
+  // Repeating byte runs do not take any space.
+  for (const auto& memory_bytes : snap.memory_bytes) {
+    if (memory_bytes.writable() && !memory_bytes.repeating()) {
+      footprint += memory_bytes.size();
+    }
+  }
+  return footprint;
+}
+
+size_t GetL2CacheSize(int cpu) {
+  if (cpu == kAnyCPUId) {
+    cpu = 0;
+  }
+  for (int index = 0;; ++index) {
+    char buffer[32];
+    ssize_t length =
+        ReadCacheIndexFile(cpu, index, "level", buffer, sizeof(buffer));
+    if (length < 0) {
+      // No more cache descriptions.
+      return 0;
+    }
+    if (length != 1 || buffer[0] != '2') {
+      continue;
+    }
+    length = ReadCacheIndexFile(cpu, index, "type", buffer, sizeof(buffer));
+    if (length < 0 || (strncmp(buffer, "Unified", length) != 0 &&
+                       strncmp(buffer, "Data", length) != 0)) {
+      continue;
+    }
+    length = ReadCacheIndexFile(cpu, index, "size", buffer, sizeof(buffer));
+    if (length < 0) {
+      return 0;
+    }
+    return ParseCacheSize(buffer, length);
+  }
+}
+
+SnapBatchScheduler::SnapBatchScheduler(const SnapCorpus& corpus,
+                                       SchedulePolicy policy,
+                                       size_t max_batch_size,
+                                       size_t footprint_budget,
+                                       std::mt19937_64& gen)
+    : corpus_(corpus),
+      policy_(policy),
+      max_batch_size_(max_batch_size),
+      footprint_budget_(footprint_budget),
+      gen_(gen) {
+  CHECK_GT(corpus_.snaps.size, 0);
+  CHECK_GT(max_batch_size_, 0);
+  if (policy_ == SchedulePolicy::kRoundRobin) {
+    StartNewPass();
+  }
+}
+
+void SnapBatchScheduler::StartNewPass() {
+  const size_t num_snaps = corpus_.snaps.size;
+  std::uniform_int_distribution<size_t> dist(0, num_snaps - 1);
+  pass_offset_ = dist(gen_);
+  // Any stride co-prime to the corpus size visits every Snap once. Pick a
+  // random one so that different passes use different orders. Stride 1 is
+  // co-prime to everything, so this terminates.
+  do {
+    pass_stride_ = dist(gen_) + 1;
+  } while (std::gcd(pass_stride_, num_snaps) != 1);
+  pass_position_ = 0;
+}
+
+size_t SnapBatchScheduler::NextSnapIndex() {
+  const size_t num_snaps = corpus_.snaps.size;
+  if (policy_ != SchedulePolicy::kRoundRobin) {
+    std::uniform_int_distribution<size_t> dist(0, num_snaps - 1);
+    return dist(gen_);
+  }
+  if (pass_position_ == num_snaps) {
+    StartNewPass();
+  }
+  // Compute (offset + position * stride) mod num_snaps without overflow.
+  const unsigned __int128 product =
+      static_cast<unsigned __int128>(pass_position_) * pass_stride_;
+  const size_t index = (pass_offset_ + product % num_snaps) % num_snaps;
+  ++pass_position_;
+  return index;
+}
+
+size_t SnapBatchScheduler::NextBatch(size_t* batch) {
+  size_t batch_size = 0;
+  size_t footprint = 0;
+  if (policy_ == SchedulePolicy::kUniform) {
+    // The footprint does not affect the batch, it is only logged.
+    const bool compute_footprint = VLOG_IS_ON(2);
+    for (; batch_size < max_batch_size_; ++batch_size) {
+      batch[batch_size] = NextSnapIndex();
+      if (compute_footprint) {
+        footprint += SnapFootprint(*corpus_.snaps[batch[batch_size]]);
+      }
+    }
+  } else {
+    while (batch_size < max_batch_size_) {
+      // Do not let a round-robin batch span two passes. Otherwise it could
+      // contain the same Snap twice.
+      if (policy_ == SchedulePolicy::kRoundRobin && batch_size > 0 &&
+          pass_position_ == corpus_.snaps.size) {
+        break;
+      }
+      const size_t index = NextSnapIndex();
+      const size_t snap_footprint = SnapFootprint(*corpus_.snaps[index]);
+      // Always take the first Snap even if it does not fit by itself.
+      if (batch_size > 0 && footprint + snap_footprint > footprint_budget_) {
+        // Do not lose a Snap of the current round-robin pass.
+        if (policy_ == SchedulePolicy::kRoundRobin) {
+          --pass_position_;
+        }
+        break;
+      }
+      batch[batch_size++] = index;
+      footprint += snap_footprint;
+    }
+  }
+  last_batch_footprint_ = footprint;
+  return batch_size;
+}
+
+size_t SnapBatchScheduler::PickFromBatch(size_t schedule_index,
+                                         size_t batch_size) {
+  if (policy_ == SchedulePolicy::kRoundRobin) {
+    return schedule_index % batch_size;
+  }
+  std::uniform_int_distribution<size_t> dist(0, batch_size - 1);
+  return dist(gen_);
+}
+
+}  // namespace silifuzz
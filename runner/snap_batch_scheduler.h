@@ -0,0 +1,128 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_SNAP_BATCH_SCHEDULER_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_SNAP_BATCH_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include "./snap/snap.h"
+
+namespace silifuzz {
+
+// Policy used by SnapBatchScheduler to pick Snaps into a batch.
+enum class SchedulePolicy : int {
+  // Batches have a fixed number of Snaps picked uniformly at random.
+  kUniform = 0,
+
+  // Snaps are picked uniformly at random until the sum of their footprints
+  // reaches a byte budget.
+  kFootprint = 1,
+
+  // Like kFootprint but Snaps are picked from a random permutation of the
+  // corpus so that every Snap is picked exactly once every pass over the
+  // corpus. A batch does not span two passes. The schedule of a batch cycles
+  // through all its Snaps.
+  kRoundRobin = 2,
+};
+
+// Parses `name` ("uniform", "footprint" or "round_robin") into `policy`.
+// Returns false if `name` is not a valid policy name.
+bool SchedulePolicyFromName(const char* name, SchedulePolicy* policy);
+
+// Returns the name of `policy`.
+const char* SchedulePolicyName(SchedulePolicy policy);
+
+// Returns an estimate of the number of bytes of memory a single execution of
+// `snap` touches. This includes all memory mappings of the Snap, the initial
+// byte values copied into writable memory before execution and the initial
+// and expected register states.
+size_t SnapFootprint(const Snap& snap);
+
+// Returns the size in bytes of the unified or data L2 cache of `cpu` as
+// reported by sysfs, or 0 if it cannot be determined. If `cpu` is kAnyCPUId,
+// cpu 0 is used.
+//
+// This opens files and must be called before entering the seccomp sandbox.
+size_t GetL2CacheSize(int cpu);
+
+// Selects batches of Snaps from a corpus for RunnerMain() and picks Snaps
+// from a batch for the execution schedule. All state is kept inline, so that
+// this can be used in the nolibc runner, which cannot do dynamic allocation.
+//
+// This class is thread-compatible.
+class SnapBatchScheduler {
+ public:
+  // Constructs a scheduler for `corpus` using `policy`. Batches contain at
+  // most `max_batch_size` Snaps. Unless `policy` is kUniform, batches are also
+  // limited to `footprint_budget` bytes as computed by SnapFootprint() but
+  // always contain at least one Snap. All random choices use `gen`.
+  //
+  // REQUIRES: `corpus` is not empty and outlives this. `max_batch_size` is
+  // greater than 0.
+  SnapBatchScheduler(const SnapCorpus& corpus, SchedulePolicy policy,
+                     size_t max_batch_size, size_t footprint_budget,
+                     std::mt19937_64& gen);
+  ~SnapBatchScheduler() = default;
+
+  // Not copyable or movable as this holds a reference to a random number
+  // generator.
+  SnapBatchScheduler(const SnapBatchScheduler&) = delete;
+  SnapBatchScheduler& operator=(const SnapBatchScheduler&) = delete;
+  SnapBatchScheduler(SnapBatchScheduler&&) = delete;
+  SnapBatchScheduler& operator=(SnapBatchScheduler&&) = delete;
+
+  // Stores indices of the Snaps in the next batch into `batch`, which must
+  // have room for `max_batch_size` elements. Returns the number of Snaps
+  // in the batch, which is between 1 and `max_batch_size`.
+  size_t NextBatch(size_t* batch);
+
+  // Returns the position in a batch of `batch_size` Snaps of the Snap to be
+  // executed at step `schedule_index` of the schedule for the batch.
+  size_t PickFromBatch(size_t schedule_index, size_t batch_size);
+
+  // Returns the total footprint of the last batch returned by NextBatch().
+  // With kUniform, the footprint is only computed if VLOG_IS_ON(2) and is 0
+  // otherwise.
+  size_t last_batch_footprint() const { return last_batch_footprint_; }
+
+ private:
+  // Returns the index of the next Snap to be added to a batch.
+  size_t NextSnapIndex();
+
+  // Starts a new pass over the corpus in round-robin mode.
+  void StartNewPass();
+
+  const SnapCorpus& corpus_;
+  const SchedulePolicy policy_;
+  const size_t max_batch_size_;
+  const size_t footprint_budget_;
+  std::mt19937_64& gen_;
+
+  // Round-robin state. The permutation of a pass is
+  // (pass_offset_ + i * pass_stride_) mod corpus size, with i ranging over
+  // [0, corpus size), where pass_stride_ is co-prime to the corpus size.
+  size_t pass_offset_ = 0;
+  size_t pass_stride_ = 1;
+  size_t pass_position_ = 0;
+
+  // See last_batch_footprint().
+  size_t last_batch_footprint_ = 0;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_SNAP_BATCH_SCHEDULER_H_
@@ -0,0 +1,160 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/snap_batch_scheduler.h"
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include "./snap/snap.h"
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+
+// ========================================================================= //
+
+namespace silifuzz {
+namespace {
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kNumSnaps = 12;
+
+// A corpus of kNumSnaps Snaps. Snap i has a single mapping of i+1 pages.
+class TestCorpus {
+ public:
+  TestCorpus() {
+    for (size_t i = 0; i < kNumSnaps; ++i) {
+      mappings_[i] = {.start_address = 0x10000 * (i + 1),
+                      .num_bytes = kPageSize * (i + 1),
+                      .perms = PROT_READ | PROT_EXEC};
+      snaps_[i] = {};
+      snaps_[i].id = "test";
+      snaps_[i].memory_mappings = {.size = 1, .elements = &mappings_[i]};
+      snap_ptrs_[i] = &snaps_[i];
+    }
+    corpus_ = {};
+    corpus_.snaps = {.size = kNumSnaps, .elements = snap_ptrs_};
+  }
+
+  const SnapCorpus& corpus() const { return corpus_; }
+
+ private:
+  Snap::MemoryMapping mappings_[kNumSnaps];
+  Snap snaps_[kNumSnaps];
+  const Snap* snap_ptrs_[kNumSnaps];
+  SnapCorpus corpus_;
+};
+
+TEST(SnapBatchScheduler, SchedulePolicyNames) {
+  for (SchedulePolicy policy :
+       {SchedulePolicy::kUniform, SchedulePolicy::kFootprint,
+        SchedulePolicy::kRoundRobin}) {
+    SchedulePolicy parsed;
+    CHECK(SchedulePolicyFromName(SchedulePolicyName(policy), &parsed));
+    CHECK(parsed == policy);
+  }
+  SchedulePolicy parsed;
+  CHECK(!SchedulePolicyFromName("bogus", &parsed));
+}
+
+TEST(SnapBatchScheduler, SnapFootprint) {
+  TestCorpus test_corpus;
+  const Snap& snap = *test_corpus.corpus().snaps[2];
+  CHECK_EQ(SnapFootprint(snap),
+           3 * kPageSize + 2 * sizeof(Snap::RegisterState));
+}
+
+TEST(SnapBatchScheduler, Uniform) {
+  TestCorpus test_corpus;
+  std::mt19937_64 gen(1);
+  constexpr size_t kMaxBatchSize = 5;
+  SnapBatchScheduler scheduler(test_corpus.corpus(), SchedulePolicy::kUniform,
+                               kMaxBatchSize, 0, gen);
+  size_t batch[kMaxBatchSize];
+  for (int i = 0; i < 10; ++i) {
+    CHECK_EQ(scheduler.NextBatch(batch), kMaxBatchSize);
+    for (size_t j = 0; j < kMaxBatchSize; ++j) {
+      CHECK_LT(batch[j], kNumSnaps);
+      CHECK_LT(scheduler.PickFromBatch(j, kMaxBatchSize), kMaxBatchSize);
+    }
+  }
+}
+
+TEST(SnapBatchScheduler, Footprint) {
+  TestCorpus test_corpus;
+  std::mt19937_64 gen(1);
+  constexpr size_t kMaxBatchSize = kNumSnaps;
+  constexpr size_t kBudget = 10 * kPageSize;
+  SnapBatchScheduler scheduler(test_corpus.corpus(), SchedulePolicy::kFootprint,
+                               kMaxBatchSize, kBudget, gen);
+  size_t batch[kMaxBatchSize];
+  for (int i = 0; i < 100; ++i) {
+    const size_t batch_size = scheduler.NextBatch(batch);
+    CHECK_GE(batch_size, 1);
+    size_t footprint = 0;
+    for (size_t j = 0; j < batch_size; ++j) {
+      CHECK_LT(batch[j], kNumSnaps);
+      footprint += SnapFootprint(*test_corpus.corpus().snaps[batch[j]]);
+    }
+    CHECK_EQ(footprint, scheduler.last_batch_footprint());
+    // A single Snap may exceed the budget by itself.
+    if (batch_size > 1) {
+      CHECK_LE(footprint, kBudget);
+    }
+  }
+}
+
+TEST(SnapBatchScheduler, RoundRobinCoversCorpus) {
+  TestCorpus test_corpus;
+  std::mt19937_64 gen(1);
+  constexpr size_t kMaxBatchSize = kNumSnaps;
+  constexpr size_t kBudget = 8 * kPageSize;
+  SnapBatchScheduler scheduler(test_corpus.corpus(),
+                               SchedulePolicy::kRoundRobin, kMaxBatchSize,
+                               kBudget, gen);
+  size_t batch[kMaxBatchSize];
+  // Each pass picks every Snap exactly once.
+  for (int pass = 0; pass < 3; ++pass) {
+    size_t counts[kNumSnaps] = {};
+    size_t num_picked = 0;
+    while (num_picked < kNumSnaps) {
+      const size_t batch_size = scheduler.NextBatch(batch);
+      CHECK_GE(batch_size, 1);
+      for (size_t j = 0; j < batch_size; ++j) {
+        ++counts[batch[j]];
+        CHECK_EQ(scheduler.PickFromBatch(j, batch_size), j);
+      }
+      num_picked += batch_size;
+    }
+    CHECK_EQ(num_picked, kNumSnaps);
+    for (size_t j = 0; j < kNumSnaps; ++j) {
+      CHECK_EQ(counts[j], 1);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+// ========================================================================= //
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(SnapBatchScheduler, SchedulePolicyNames);
+  RUN_TEST(SnapBatchScheduler, SnapFootprint);
+  RUN_TEST(SnapBatchScheduler, Uniform);
+  RUN_TEST(SnapBatchScheduler, Footprint);
+  RUN_TEST(SnapBatchScheduler, RoundRobinCoversCorpus);
+})
@@ -84,6 +84,11 @@ absl::StatusOr<Endpoint> RepairEndPoint(const Endpoint& actual_endpoint,
     absl::StrAppend(&msg, " Endpoint = {", EnumStr(actual_endpoint.sig_num()),
                     "/", EnumStr(actual_endpoint.sig_cause()), "}");
   }
+  if (stop_reason == MakerStopReason::kTimeBudget) {
+    // Whether a snapshot runs out of its time budget depends on the load of
+    // the machine.
+    return absl::DeadlineExceededError(msg);
+  }
   return absl::InternalError(msg);
 }
 
@@ -132,9 +137,12 @@ absl::StatusOr<Snapshot> SnapMaker::Make(const Snapshot& snapshot) {
 absl::StatusOr<Snapshot> SnapMaker::RecordEndState(const Snapshot& snapshot) {
   ASSIGN_OR_RETURN_IF_NOT_OK(
       Snapshot snapified, Snapify(snapshot, SnapifyOptions::V2InputMakeOpts()));
+  // This needs a runner of its own, because the snapified snapshot is not
+  // the one that the runners of MakeLoop() had mapped.
   ASSIGN_OR_RETURN_IF_NOT_OK(
       RunnerDriver recorder,
       RunnerDriverFromSnapshot(snapified, opts_.runner_path));
+  recorder.set_use_fork_server(opts_.use_fork_server);
   ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult record_result,
                              recorder.MakeOne(snapified.id()));
   if (record_result.success()) {
@@ -168,6 +176,7 @@ absl::Status SnapMaker::Verify(const Snapshot& snapshot) {
   ASSIGN_OR_RETURN_IF_NOT_OK(
       RunnerDriver verifier,
       RunnerDriverFromSnapshot(snapified, opts_.runner_path));
+  verifier.set_use_fork_server(opts_.use_fork_server);
 
   // TODO(ksteuck): [as-needed] Consider VerifyDisjointly()-like functionality
   // to ensure that the snapshot does not touch any runner memory regions.
@@ -229,6 +238,22 @@ absl::Status SnapMaker::AddWritableMemoryForAddress(
   return absl::OkStatus();
 }
 
+absl::StatusOr<int> SnapMaker::AddPagesAddedByRunner(
+    Snapshot* snapshot, const Snapshot::EndState& actual_end_state) {
+  int num_pages = 0;
+  for (const Snapshot::MemoryBytes& memory_bytes :
+       actual_end_state.memory_bytes()) {
+    for (snapshot_types::Address addr = memory_bytes.start_address();
+         addr < memory_bytes.limit_address(); addr += snapshot->page_size()) {
+      if (snapshot->mapped_memory_map().Contains(addr)) continue;
+      VLOG_INFO(1, "Runner added a page for ", HexStr(addr));
+      RETURN_IF_NOT_OK(AddWritableMemoryForAddress(snapshot, addr));
+      ++num_pages;
+    }
+  }
+  return num_pages;
+}
+
 absl::StatusOr<Endpoint> SnapMaker::MakeLoop(Snapshot* snapshot,
                                              MakerStopReason* stop_reason) {
   VLOG_INFO(1, "MakeLoop()");
@@ -240,9 +265,21 @@ absl::StatusOr<Endpoint> SnapMaker::MakeLoop(Snapshot* snapshot,
     ASSIGN_OR_RETURN_IF_NOT_OK(
         RunnerDriver runner_driver,
         RunnerDriverFromSnapshot(*snapshot, opts_.runner_path));
+    runner_driver.set_use_fork_server(opts_.use_fork_server);
+    // The runner adds pages for page faults itself, which saves starting a
+    // runner per page. It reports them as end state memory outside of the
+    // snapshot's mappings.
     absl::StatusOr<RunnerDriver::RunResult> make_result_or =
-        runner_driver.MakeOne(snapshot->id());
+        runner_driver.MakeOne(snapshot->id(),
+                              opts_.max_pages_to_add - pages_added);
     RETURN_IF_NOT_OK(make_result_or.status());
+    if (make_result_or->player_result().actual_end_state.has_value()) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(
+          int runner_pages_added,
+          AddPagesAddedByRunner(
+              snapshot, *make_result_or->player_result().actual_end_state));
+      pages_added += runner_pages_added;
+    }
     const Snapshot::Endpoint& ep =
         make_result_or->player_result().actual_end_state->endpoint();
     switch (make_result_or->player_result().outcome) {
@@ -55,6 +55,10 @@ class SnapMaker {
     // details.
     bool x86_filter_split_lock = false;
 
+    // If true, runners are forked by a fork server instead of being exec'd
+    // for every run. See RunnerOptions::use_fork_server().
+    bool use_fork_server = false;
+
     absl::Status Validate() const {
       if (runner_path.empty()) {
         return absl::InvalidArgumentError("runner_path must be non-empty");
@@ -118,6 +122,13 @@ class SnapMaker {
   absl::Status AddWritableMemoryForAddress(Snapshot* snapshot,
                                            snapshot_types::Address addr);
 
+  // Adds the pages that the runner added to repair page faults to the
+  // snapshot. These are the pages of `actual_end_state` memory that the
+  // snapshot does not map.
+  // RETURNS: The number of pages added.
+  absl::StatusOr<int> AddPagesAddedByRunner(
+      Snapshot* snapshot, const Snapshot::EndState& actual_end_state);
+
   // C-tor args.
   Options opts_;
 };
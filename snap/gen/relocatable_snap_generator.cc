@@ -14,8 +14,10 @@
 
 #include "./snap/gen/relocatable_snap_generator.h"
 
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -31,6 +33,7 @@
 #include "./common/snapshot.h"
 #include "./snap/gen/relocatable_data_block.h"
 #include "./snap/gen/repeating_byte_runs.h"
+#include "./snap/gen/snap_checksum.h"
 #include "./snap/snap.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
@@ -119,9 +122,17 @@ class Traversal {
                                     const Snapshot::ByteData& byte_data);
 
   // Processes `memory_mappings` for `pass`. Allocates a ref for the
-  // elements of the Snap::MemoryMapping array and returns it.
+  // elements of the Snap::MemoryMapping array and returns it. Also allocates
+  // images of read-only mappings if requested by options. The end state
+  // checksums of the mappings are computed from `end_state_memory_bytes`.
   RelocatableDataBlock::Ref Process(
-      PassType pass, const Snapshot::MemoryMappingList& memory_mappings);
+      PassType pass, const Snapshot::MemoryMappingList& memory_mappings,
+      const Snapshot::MemoryBytesList& end_state_memory_bytes);
+
+  // Copies the parts of `memory_bytes` that overlap images of the current
+  // Snap's read-only mappings into the images.
+  // REQUIRES: Called in the generation pass.
+  void CopyToImages(const Snapshot::MemoryBytes& memory_bytes);
 
   // Processes a single Snapshot::MemoryBytes object `memory_bytes` for
   // `pass` using a preallocated ref from caller. This uses `mapped_memory_map`
@@ -187,6 +198,20 @@ class Traversal {
 
   // Hash map for de-duping byte data.
   ByteDataRefMap byte_data_ref_map_;
+
+  // Page-aligned image of a read-only memory mapping.
+  struct MappingImage {
+    uint64_t start_address;
+    uint64_t num_bytes;
+    RelocatableDataBlock::Ref ref;
+  };
+
+  // Images of read-only mappings of the Snap being processed.
+  std::vector<MappingImage> snap_images_;
+
+  // Images of read-only mappings of all Snaps. This comes last in the corpus
+  // so that page alignment does not add gaps between other parts.
+  RelocatableDataBlock image_block_;
 };
 
 RelocatableDataBlock::Ref Traversal::Process(
@@ -216,22 +241,50 @@ RelocatableDataBlock::Ref Traversal::Process(
 }
 
 RelocatableDataBlock::Ref Traversal::Process(
-    PassType pass, const Snapshot::MemoryMappingList& memory_mappings) {
+    PassType pass, const Snapshot::MemoryMappingList& memory_mappings,
+    const Snapshot::MemoryBytesList& end_state_memory_bytes) {
   // Allocate space for elements of SnapArray<MemoryMapping>.
   const RelocatableDataBlock::Ref snap_memory_mappings_array_elements_ref =
       memory_mapping_block_.AllocateObjectsOfType<Snap::MemoryMapping>(
           memory_mappings.size());
 
+  snap_images_.clear();
+  if (options_.read_only_mapping_images) {
+    for (const auto& memory_mapping : memory_mappings) {
+      if (memory_mapping.perms().Has(MemoryPerms::kWritable)) continue;
+      // The runner mmap()s images by file offset, which needs page alignment.
+      snap_images_.push_back(MappingImage{
+          .start_address = memory_mapping.start_address(),
+          .num_bytes = memory_mapping.num_bytes(),
+          .ref = image_block_.Allocate(memory_mapping.num_bytes(),
+                                       getpagesize()),
+      });
+    }
+  }
+
   if (pass == PassType::kGeneration) {
     RelocatableDataBlock::Ref snap_memory_mapping_ref =
         snap_memory_mappings_array_elements_ref;
     for (const auto& memory_mapping : memory_mappings) {
+      uint64_t image_offset = 0;
+      for (const MappingImage& image : snap_images_) {
+        if (image.start_address == memory_mapping.start_address()) {
+          // Unspecified bytes are zeros like in an anonymous mapping.
+          memset(image.ref.contents(), 0, image.num_bytes);
+          // The corpus is generated for load address 0, so the load address
+          // is also the file offset.
+          image_offset = image.ref.load_address();
+        }
+      }
       new (
           snap_memory_mapping_ref.contents_as_pointer_of<Snap::MemoryMapping>())
           Snap::MemoryMapping{
               .start_address = memory_mapping.start_address(),
               .num_bytes = memory_mapping.num_bytes(),
               .perms = memory_mapping.perms().ToMProtect(),
+              .image_offset = image_offset,
+              .end_state_checksum = EndStateMappingChecksum(
+                  memory_mapping, end_state_memory_bytes),
           };
       snap_memory_mapping_ref += sizeof(Snap::MemoryMapping);
     }
@@ -240,6 +293,21 @@ RelocatableDataBlock::Ref Traversal::Process(
   return snap_memory_mappings_array_elements_ref;
 }
 
+void Traversal::CopyToImages(const Snapshot::MemoryBytes& memory_bytes) {
+  const uint64_t start_address = memory_bytes.start_address();
+  const uint64_t limit_address = memory_bytes.limit_address();
+  for (const MappingImage& image : snap_images_) {
+    const uint64_t overlap_start =
+        std::max(start_address, image.start_address);
+    const uint64_t overlap_limit =
+        std::min(limit_address, image.start_address + image.num_bytes);
+    if (overlap_start >= overlap_limit) continue;
+    memcpy(image.ref.contents() + (overlap_start - image.start_address),
+           memory_bytes.byte_values().data() + (overlap_start - start_address),
+           overlap_limit - overlap_start);
+  }
+}
+
 void Traversal::ProcessAllocated(PassType pass,
                                  const Snapshot::MemoryBytes& memory_bytes,
                                  const MappedMemoryMap& mapped_memory_map,
@@ -247,8 +315,24 @@ void Traversal::ProcessAllocated(PassType pass,
   const bool compress_repeating_bytes =
       options_.compress_repeating_bytes &&
       IsRepeatingByteRun(memory_bytes.byte_values());
+  if (pass == PassType::kGeneration) {
+    CopyToImages(memory_bytes);
+  }
+
+  // Byte values inside a single image are not stored again. They refer to
+  // the copy in the image instead.
+  auto image = std::find_if(
+      snap_images_.begin(), snap_images_.end(), [&](const MappingImage& i) {
+        return memory_bytes.start_address() >= i.start_address &&
+               memory_bytes.limit_address() <= i.start_address + i.num_bytes;
+      });
   RelocatableDataBlock::Ref byte_values_elements_ref;
-  if (!compress_repeating_bytes) {
+  if (compress_repeating_bytes) {
+    // Nothing to store.
+  } else if (image != snap_images_.end()) {
+    byte_values_elements_ref =
+        image->ref + (memory_bytes.start_address() - image->start_address);
+  } else {
     byte_values_elements_ref = Process(pass, memory_bytes.byte_values());
   }
 
@@ -307,11 +391,11 @@ void Traversal::ProcessAllocated(PassType pass, const Snapshot& snapshot,
            static_cast<int>(architecture_id_));
   size_t id_size = snapshot.id().size() + 1;  // NUL character terminator.
   RelocatableDataBlock::Ref id_ref = string_block_.Allocate(id_size, 1);
+  const Snapshot::EndState& end_state = snapshot.expected_end_states()[0];
   RelocatableDataBlock::Ref memory_mappings_elements_ref =
-      Process(pass, snapshot.memory_mappings());
+      Process(pass, snapshot.memory_mappings(), end_state.memory_bytes());
   RelocatableDataBlock::Ref memory_bytes_elements_ref =
       Process(pass, snapshot.memory_bytes(), snapshot.mapped_memory_map());
-  const Snapshot::EndState& end_state = snapshot.expected_end_states()[0];
   RelocatableDataBlock::Ref end_state_memory_bytes_elements_ref =
       Process(pass, end_state.memory_bytes(), snapshot.mapped_memory_map());
 
@@ -399,6 +483,7 @@ void Traversal::Process(PassType pass, const std::vector<Snapshot>& snapshots) {
   main_block_.Allocate(byte_data_block_);
   main_block_.Allocate(string_block_);
   main_block_.Allocate(register_state_block_);
+  main_block_.Allocate(image_block_);
 
   if (pass == PassType::kGeneration) {
     new (corpus_ref.contents()) SnapCorpus{
@@ -406,6 +491,7 @@ void Traversal::Process(PassType pass, const std::vector<Snapshot>& snapshots) {
         .corpus_type_size = sizeof(SnapCorpus),
         .snap_type_size = sizeof(Snap),
         .register_state_type_size = sizeof(Snap::RegisterState),
+        .memory_mapping_type_size = sizeof(Snap::MemoryMapping),
         .architecture_id = static_cast<uint8_t>(architecture_id_),
         .padding = {},
         .snaps =
@@ -449,6 +535,7 @@ void Traversal::PrepareSnapGeneration(char* content_buffer,
   prepare_sub_data_block(byte_data_block_);
   prepare_sub_data_block(string_block_);
   prepare_sub_data_block(register_state_block_);
+  prepare_sub_data_block(image_block_);
 
   // Reset main block again for generation pass.
   main_block_.ResetSizeAndAlignment();
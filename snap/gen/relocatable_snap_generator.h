@@ -58,6 +58,8 @@ namespace silifuzz {
 // +---------------------------+
 // | Snap::RegisterState array |
 // +---------------------------+
+// | mapping images (optional) |
+// +---------------------------+
 //
 // The parts are aligned with respect to their individual requirements and the
 // whole corpus is loaded with alignment not smaller than the maximum alignment
@@ -95,11 +97,23 @@ namespace silifuzz {
 // These are the registers that specify the entry and exit state of each Snap.
 // This data is stored out-of-line from the Snap structure so that relocating
 // the Snap doesn't dirty the pages containg register data.
+//
+// 9. Mapping images.
+// Page-aligned images of the initial contents of read-only memory mappings,
+// which runners can mmap() directly from the corpus file so that all runners
+// on a machine share the same physical pages. Byte data of read-only memory
+// bytes inside an image point into the image instead of the byte array.
+// Images are only generated if requested by options. Snap::MemoryMapping
+// refers to its image by file offset. This part is last so that its page
+// alignment does not add gaps elsewhere.
 
 // Options passed to relocatable Snap corpus generator.
 struct RelocatableSnapGeneratorOptions {
   // If true, apply run-length compression to memory bytes data.
   bool compress_repeating_bytes = true;
+
+  // If true, generate page-aligned images of read-only memory mappings.
+  bool read_only_mapping_images = false;
 };
 
 // Generates a relocatable Snap corpus for `architecture_id` from `snapshots`
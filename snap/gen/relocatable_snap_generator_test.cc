@@ -48,8 +48,10 @@ namespace {
 // Generates a relocatable corpus from source `snapshots` and relocates it
 // to the mmap buffer address.
 MmappedMemoryPtr<const SnapCorpus> GenerateRelocatedCorpus(
-    ArchitectureId architecture_id, const std::vector<Snapshot>& snapshots) {
-  auto relocatable = GenerateRelocatableSnaps(architecture_id, snapshots);
+    ArchitectureId architecture_id, const std::vector<Snapshot>& snapshots,
+    const RelocatableSnapGeneratorOptions& options = {}) {
+  auto relocatable =
+      GenerateRelocatableSnaps(architecture_id, snapshots, options);
   SnapRelocator::Error error;
   auto relocated_corpus =
       SnapRelocator::RelocateCorpus(std::move(relocatable), &error);
@@ -124,6 +126,61 @@ TEST(RelocatableSnapGenerator, AllRunnerTestSnaps) {
   }
 }
 
+TEST(RelocatableSnapGenerator, ReadOnlyMappingImages) {
+  std::vector<Snapshot> snapified_corpus;
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts();
+  for (TestSnapshot type :
+       {TestSnapshot::kEndsAsExpected, TestSnapshot::kMemoryMismatch}) {
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot(type);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+
+  auto relocated_corpus = GenerateRelocatedCorpus(
+      Host::architecture_id, snapified_corpus,
+      RelocatableSnapGeneratorOptions{.read_only_mapping_images = true});
+  const char* corpus_start =
+      reinterpret_cast<const char*>(relocated_corpus.get());
+  const size_t page_size = getpagesize();
+  for (size_t i = 0; i < snapified_corpus.size(); ++i) {
+    const Snap& snap = *relocated_corpus->snaps.at(i);
+    // Images do not change the Snap otherwise.
+    VerifyTestSnap(snapified_corpus[i], snap, opts);
+
+    int num_images = 0;
+    for (const auto& memory_mapping : snap.memory_mappings) {
+      if (memory_mapping.writable()) {
+        EXPECT_EQ(memory_mapping.image_offset, 0);
+        continue;
+      }
+      ASSERT_NE(memory_mapping.image_offset, 0);
+      EXPECT_EQ(memory_mapping.image_offset % page_size, 0);
+      ++num_images;
+    }
+    EXPECT_GT(num_images, 0);
+
+    // Read-only bytes are found in the images.
+    for (const auto& memory_bytes : snap.memory_bytes) {
+      if (memory_bytes.writable() || memory_bytes.repeating()) continue;
+      const Snap::MemoryMapping* mapping = nullptr;
+      for (const auto& memory_mapping : snap.memory_mappings) {
+        if (memory_bytes.start_address >= memory_mapping.start_address &&
+            memory_bytes.start_address < memory_mapping.start_address +
+                                             memory_mapping.num_bytes) {
+          mapping = &memory_mapping;
+        }
+      }
+      ASSERT_NE(mapping, nullptr);
+      const char* image_bytes =
+          corpus_start + mapping->image_offset +
+          (memory_bytes.start_address - mapping->start_address);
+      EXPECT_EQ(memcmp(image_bytes, memory_bytes.data.byte_values.elements,
+                       memory_bytes.size()),
+                0);
+    }
+  }
+}
+
 // Test that duplicated byte data are merged to a single copy.
 TEST(RelocatableSnapGenerator, DedupeMemoryBytes) {
   Snapshot snapshot = CreateTestSnapshot(TestSnapshot::kEndsAsExpected);
@@ -0,0 +1,47 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./snap/gen/snap_checksum.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "./common/memory_perms.h"
+#include "./common/snapshot.h"
+#include "./util/checksum.h"
+
+namespace silifuzz {
+
+uint64_t EndStateMappingChecksum(
+    const Snapshot::MemoryMapping& memory_mapping,
+    const Snapshot::MemoryBytesList& end_state_memory_bytes) {
+  if (!memory_mapping.perms().Has(MemoryPerms::kWritable)) {
+    return 0;
+  }
+  MemoryChecksum checksum;
+  for (const auto& memory_bytes : end_state_memory_bytes) {
+    const Snapshot::Address start = std::max(memory_bytes.start_address(),
+                                             memory_mapping.start_address());
+    const Snapshot::Address limit = std::min(memory_bytes.limit_address(),
+                                             memory_mapping.limit_address());
+    if (start >= limit) continue;
+    const size_t offset = start - memory_bytes.start_address();
+    checksum.AddData(memory_bytes.byte_values().data() + offset,
+                     limit - start);
+  }
+  return checksum.Value();
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,34 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_SNAP_GEN_SNAP_CHECKSUM_H_
+#define THIRD_PARTY_SILIFUZZ_SNAP_GEN_SNAP_CHECKSUM_H_
+
+#include <cstdint>
+
+#include "./common/snapshot.h"
+
+namespace silifuzz {
+
+// Returns the checksum of the byte values of `end_state_memory_bytes` that
+// lie within `memory_mapping`, taken in order. This is the value stored in
+// Snap::MemoryMapping::end_state_checksum for a writable mapping. Returns 0
+// for a mapping that is not writable.
+uint64_t EndStateMappingChecksum(
+    const Snapshot::MemoryMapping& memory_mapping,
+    const Snapshot::MemoryBytesList& end_state_memory_bytes);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_SNAP_GEN_SNAP_CHECKSUM_H_
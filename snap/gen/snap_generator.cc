@@ -33,6 +33,7 @@
 #include "./common/memory_perms.h"
 #include "./common/snapshot.h"
 #include "./snap/gen/repeating_byte_runs.h"
+#include "./snap/gen/snap_checksum.h"
 #include "./snap/snap.h"
 #include "./util/checks.h"
 #include "./util/ucontext/serialize.h"
@@ -142,7 +143,8 @@ absl::Status SnapGenerator<Arch>::GenerateSnap(const std::string &name,
 
   // Generate all out-of-line MemoryMappings
   const std::string memory_mappings_var_name =
-      GenerateMemoryMappingList(snapified.memory_mappings());
+      GenerateMemoryMappingList(snapified.memory_mappings(),
+                                end_state.memory_bytes());
 
   const std::string registers_name = GenerateRegisters(snapified.registers());
 
@@ -189,6 +191,7 @@ void SnapGenerator<Arch>::GenerateSnapArray(
       "extern const SnapCorpus %s = { .magic = 0x%lx, .corpus_type_size = "
       "sizeof(SnapCorpus), .snap_type_size = sizeof(Snap), "
       ".register_state_type_size = sizeof(Snap::RegisterState), "
+      ".memory_mapping_type_size = sizeof(Snap::MemoryMapping), "
       ".architecture_id = %d, .padding = {}, .snaps = { .size = %zd, .elements "
       "= %s, }, };",
       name, kSnapCorpusMagic, Arch::architecture_id, snap_var_name_list.size(),
@@ -318,7 +321,8 @@ std::string SnapGenerator<Arch>::GenerateMemoryBytesList(
 
 template <typename Arch>
 std::string SnapGenerator<Arch>::GenerateMemoryMappingList(
-    const Snapshot::MemoryMappingList &memory_mapping_list) {
+    const Snapshot::MemoryMappingList &memory_mapping_list,
+    const Snapshot::MemoryBytesList &end_state_memory_bytes) {
   std::string memory_mapping_list_var_name =
       LocalVarName("local_memory_mapping");
 
@@ -329,8 +333,11 @@ std::string SnapGenerator<Arch>::GenerateMemoryMappingList(
     Print("{ .start_address=", AddressString(memory_mapping.start_address()),
           ",");
     Print(absl::StrFormat(".num_bytes = %lluULL,", memory_mapping.num_bytes()));
-    PrintLn(absl::StrFormat(".perms = 0x%x, },",
-                            memory_mapping.perms().ToMProtect()));
+    Print(absl::StrFormat(".perms = 0x%x,",
+                          memory_mapping.perms().ToMProtect()));
+    PrintLn(absl::StrFormat(
+        ".end_state_checksum = 0x%xULL, },",
+        EndStateMappingChecksum(memory_mapping, end_state_memory_bytes)));
   }
   PrintLn("};");
   return memory_mapping_list_var_name;
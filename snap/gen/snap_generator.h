@@ -192,10 +192,12 @@ class SnapGenerator {
       const MappedMemoryMap &mapped_memory_map, const SnapifyOptions &opts);
 
   // Generates code to assign a variable with an array of Snap::MemoryMapping
-  // for 'memory_mapping_list'. Returns variable name of the Snap::MemoryMapping
-  // array.
+  // for 'memory_mapping_list'. The end state checksums of the mappings are
+  // computed from 'end_state_memory_bytes'. Returns variable name of the
+  // Snap::MemoryMapping array.
   std::string GenerateMemoryMappingList(
-      const Snapshot::MemoryMappingList &memory_mapping_list);
+      const Snapshot::MemoryMappingList &memory_mapping_list,
+      const Snapshot::MemoryBytesList &end_state_memory_bytes);
 
   // Generates a GRegSet expression correspoding to the 'gregs_byte_data', which
   // is in the same format as returned by Snapshot::ReigsterState::gregs().
@@ -130,6 +130,21 @@ struct Snap {
     // Bit mask of memory protections. Same as those used in mprotect().
     // This information is duplicated in MemoryBytes above.
     int32_t perms;
+
+    // Offset of a page-aligned image of the initial contents of this mapping
+    // from the start of a relocatable corpus, or 0 if there is no image. Only
+    // read-only mappings have images. A runner can mmap() the image from the
+    // corpus file instead of copying the contents. This is not a pointer
+    // and is not relocated.
+    uint64_t image_offset = 0;
+
+    // Checksum of the expected byte values of end_state_memory_bytes within
+    // this mapping, taken in order, as computed by MemoryChecksum. This lets
+    // the runner verify the end state of a writable mapping by reading only
+    // live memory, and confines byte comparison to a mapping that fails the
+    // check. Zero means there is no checksum, which is always the case for
+    // mappings that are not writable.
+    uint64_t end_state_checksum = 0;
   };
 
   // Identifier for this snapshot.
@@ -202,12 +217,16 @@ struct SnapCorpus {
   // The expected size of the register state.
   uint32_t register_state_type_size;
 
+  // The expected sizeof(Snap::MemoryMapping). Snap::MemoryMapping can change
+  // without changing sizeof(Snap), which only holds an array of them.
+  uint32_t memory_mapping_type_size;
+
   // The architechture these snaps run on.
   // The runner should check that this equals Host::architecture_id.
   uint8_t architecture_id;
 
   // Make the unused space in this struct explicit.
-  uint8_t padding[3];
+  uint8_t padding[7];
 
   // The corpus data.
   Snap::Array<const Snap*> snaps;
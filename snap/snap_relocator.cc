@@ -15,6 +15,7 @@
 #include "./snap/snap_relocator.h"
 
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include <cstddef>
 #include <cstdint>
@@ -116,6 +117,25 @@ SnapRelocator::Error SnapRelocator::RelocateMemoryBytesArray(
   return Error::kOk;
 }
 
+SnapRelocator::Error SnapRelocator::ValidateMappingImages(
+    const Snap::Array<Snap::MemoryMapping>& memory_mappings) {
+  const uint64_t corpus_size = limit_address_ - start_address_;
+  for (const auto& memory_mapping : memory_mappings) {
+    if (memory_mapping.image_offset == 0) continue;
+    // Images are mmap()'ed by file offset.
+    if (memory_mapping.image_offset % getpagesize() != 0) {
+      return Error::kAlignment;
+    }
+    uint64_t image_limit;
+    if (__builtin_add_overflow(memory_mapping.image_offset,
+                               memory_mapping.num_bytes, &image_limit) ||
+        image_limit > corpus_size) {
+      return Error::kOutOfBound;
+    }
+  }
+  return Error::kOk;
+}
+
 SnapRelocator::Error SnapRelocator::RelocateCorpus() {
   // We know the pointer is in bounds, but check that the struct fits in memory
   // and is aligned.
@@ -137,6 +157,9 @@ SnapRelocator::Error SnapRelocator::RelocateCorpus() {
   if (corpus.register_state_type_size != sizeof(Snap::RegisterState)) {
     return Error::kBadData;
   }
+  if (corpus.memory_mapping_type_size != sizeof(Snap::MemoryMapping)) {
+    return Error::kBadData;
+  }
 
   RETURN_IF_RELOCATION_FAILED(AdjustArray(corpus.snaps));
   for (size_t i = 0; i < corpus.snaps.size; ++i) {
@@ -148,6 +171,7 @@ SnapRelocator::Error SnapRelocator::RelocateCorpus() {
     Snap& snap = *const_cast<Snap*>(corpus.snaps[i]);
     RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.id));
     RETURN_IF_RELOCATION_FAILED(AdjustArray(snap.memory_mappings));
+    RETURN_IF_RELOCATION_FAILED(ValidateMappingImages(snap.memory_mappings));
 
     // Adjust register pointers.
     RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.registers));
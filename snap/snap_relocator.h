@@ -94,6 +94,11 @@ class SnapRelocator {
   Error RelocateMemoryBytesArray(
       Snap::Array<Snap::MemoryBytes>& memory_bytes_array);
 
+  // Checks that images of `memory_mappings`, if any, are page-aligned and
+  // inside the corpus.
+  Error ValidateMappingImages(
+      const Snap::Array<Snap::MemoryMapping>& memory_mappings);
+
   // Relocates corpus by adjusting all pointers inside the corpus.
   // REQUIRES: Only called once.
   // RETURNS: whether relocation succeeded. If it failed, contents of
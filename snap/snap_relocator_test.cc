@@ -14,6 +14,7 @@
 
 #include "./snap/snap_relocator.h"
 
+#include <cstdint>
 #include <cstring>
 #include <limits>
 #include <vector>
@@ -105,6 +106,36 @@ TEST_F(SnapRelocatorTest, ArrayElementAddressOverflow) {
   ExpectRelocationResultIs(SnapRelocator::Error::kOutOfBound);
 }
 
+TEST_F(SnapRelocatorTest, MemoryMappingTypeSizeMismatch) {
+  corpus_->memory_mapping_type_size = sizeof(Snap::MemoryMapping) - 16;
+  ExpectRelocationResultIs(SnapRelocator::Error::kBadData);
+}
+
+TEST_F(SnapRelocatorTest, OldLayoutCorpus) {
+  // Header of corpora built before SnapCorpus::memory_mapping_type_size was
+  // added, when Snap::MemoryMapping was smaller.
+  struct OldSnapCorpus {
+    uint64_t magic;
+    uint32_t corpus_type_size;
+    uint32_t snap_type_size;
+    uint32_t register_state_type_size;
+    uint8_t architecture_id;
+    uint8_t padding[3];
+    Snap::Array<const Snap*> snaps;
+  };
+  const OldSnapCorpus old_corpus = {
+      .magic = kSnapCorpusMagic,
+      .corpus_type_size = sizeof(OldSnapCorpus),
+      .snap_type_size = sizeof(Snap),
+      .register_state_type_size = sizeof(Snap::RegisterState),
+      .architecture_id = corpus_->architecture_id,
+      .padding = {},
+      .snaps = corpus_->snaps,
+  };
+  memcpy(relocatable_.get(), &old_corpus, sizeof(old_corpus));
+  ExpectRelocationResultIs(SnapRelocator::Error::kBadData);
+}
+
 }  // namespace
 
 }  // namespace silifuzz
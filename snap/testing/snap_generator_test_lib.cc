@@ -28,6 +28,7 @@
 #include "./snap/gen/snap_generator.h"
 #include "./snap/snap.h"
 #include "./util/checks.h"
+#include "./util/checksum.h"
 #include "./util/mem_util.h"
 #include "./util/ucontext/serialize.h"
 
@@ -44,12 +45,30 @@ void VerifySnapField(absl::string_view name, const T1& expect, const T2& got) {
 }
 
 // Verifies Snapshot::MemoryMapping -> Snap::MemoryMapping conversion.
-void VerifySnapMemoryMapping(const Snapshot::MemoryMapping& mapping,
-                             const Snap::MemoryMapping& snap_mapping) {
+// The end state checksum must cover the parts of `end_state_memory_bytes`
+// within a writable mapping.
+void VerifySnapMemoryMapping(
+    const Snapshot::MemoryMapping& mapping,
+    const Snapshot::MemoryBytesList& end_state_memory_bytes,
+    const Snap::MemoryMapping& snap_mapping) {
   VerifySnapField("start_address", mapping.start_address(),
                   snap_mapping.start_address);
   VerifySnapField("num_bytes", mapping.num_bytes(), snap_mapping.num_bytes);
   CHECK(MemoryPerms::FromMProtect(snap_mapping.perms) == mapping.perms());
+  uint64_t end_state_checksum = 0;
+  if (mapping.perms().Has(MemoryPerms::kWritable)) {
+    MemoryChecksum checksum;
+    for (const auto& memory_bytes : end_state_memory_bytes) {
+      if (memory_bytes.start_address() >= mapping.start_address() &&
+          memory_bytes.limit_address() <= mapping.limit_address()) {
+        checksum.AddData(memory_bytes.byte_values().data(),
+                         memory_bytes.num_bytes());
+      }
+    }
+    end_state_checksum = checksum.Value();
+  }
+  VerifySnapField("end_state_checksum", end_state_checksum,
+                  snap_mapping.end_state_checksum);
 }
 
 // Verifies Snapshot::ByteData -> Snap::Array<uint8_t> conversion.
@@ -131,12 +150,13 @@ void VerifySnapMemoryBytesArray(
 // conversion.
 void VerifySnapMemoryMappingArray(
     absl::string_view name, const Snapshot::MemoryMappingList& memory_mappings,
+    const Snapshot::MemoryBytesList& end_state_memory_bytes,
     const Snap::Array<Snap::MemoryMapping>& snap_memory_mappings) {
   VerifySnapField(absl::StrCat(name, " size"), memory_mappings.size(),
                   snap_memory_mappings.size);
   size_t snap_array_index = 0;
   for (const auto& memory_mapping : memory_mappings) {
-    VerifySnapMemoryMapping(memory_mapping,
+    VerifySnapMemoryMapping(memory_mapping, end_state_memory_bytes,
                             snap_memory_mappings.elements[snap_array_index]);
     snap_array_index++;
   }
@@ -153,16 +173,16 @@ void VerifyTestSnap(const Snapshot& snapshot, const Snap& snap,
   const Snapshot& snapified_snapshot = snapified_snapshot_or.value();
 
   VerifySnapField("id", snapified_snapshot.id(), snap.id);
-  VerifySnapMemoryMappingArray("memory_mappings",
-                               snapified_snapshot.memory_mappings(),
-                               snap.memory_mappings);
+  CHECK_EQ(snapified_snapshot.expected_end_states().size(), 1);
+  const Snapshot::EndState& end_state =
+      snapified_snapshot.expected_end_states()[0];
+  VerifySnapMemoryMappingArray(
+      "memory_mappings", snapified_snapshot.memory_mappings(),
+      end_state.memory_bytes(), snap.memory_mappings);
   VerifySnapMemoryBytesArray("memory_bytes", snapified_snapshot.memory_bytes(),
                              snap.memory_bytes,
                              snapified_snapshot.mapped_memory_map());
   VerifySnapRegisterState(snapified_snapshot.registers(), *snap.registers);
-  CHECK_EQ(snapified_snapshot.expected_end_states().size(), 1);
-  const Snapshot::EndState& end_state =
-      snapified_snapshot.expected_end_states()[0];
   const Snapshot::Endpoint& endpoint = end_state.endpoint();
   CHECK(endpoint.type() == Snapshot::Endpoint::kInstruction);
   VerifySnapField("end_state_instruction_address",
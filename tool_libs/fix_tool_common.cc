@@ -50,6 +50,8 @@ absl::StatusOr<Snapshot> RemakeAndVerify(const Snapshot& snapshot,
   SnapMaker::Options snap_maker_options;
   snap_maker_options.runner_path = RunnerLocation();
   snap_maker_options.x86_filter_split_lock = options.x86_filter_split_lock;
+  // The fix tool makes millions of snapshots with several short runs each.
+  snap_maker_options.use_fork_server = true;
   SnapMaker maker = SnapMaker(snap_maker_options);
   absl::StatusOr<Snapshot> made_snapshot_or = maker.Make(snapshot);
   RETURN_IF_NOT_OK(made_snapshot_or.status());
@@ -71,6 +73,38 @@ absl::StatusOr<Snapshot> RemakeAndVerify(const Snapshot& snapshot,
   return recorded_snapshot;
 }
 
+// Implements FixupSnapshot() except for updating counters. The message of a
+// rejection names the counter that CountFixupResult() increments for it.
+absl::StatusOr<Snapshot> FixupSnapshotImpl(
+    const Snapshot& input, const FixupSnapshotOptions& options) {
+  absl::StatusOr<Snapshot> remade_snapshot_or = RemakeAndVerify(input, options);
+  if (!remade_snapshot_or.ok()) {
+    const absl::Status& status = remade_snapshot_or.status();
+    return absl::Status(status.code(), absl::StrCat("Make:", status.message()));
+  }
+
+  int num_end_states = remade_snapshot_or->expected_end_states().size();
+  if (num_end_states > 1) {
+    return absl::InternalError(
+        absl::StrCat("multi-state-test:", num_end_states));
+  }
+
+  if (num_end_states == 0) {
+    return absl::InternalError(
+        absl::StrCat("zero-end-states-test:", num_end_states));
+  }
+  // Sanity check the only expected end state -- it must have the current
+  // platform.
+  if (!remade_snapshot_or->expected_end_states()[0].has_platform(
+          CurrentPlatformId())) {
+    return absl::InternalError(
+        absl::StrCat("invalid-platform-id:", ShortHostname()));
+  }
+  // Snapshot has passed all tests and transformations.
+  remade_snapshot_or->NormalizeAll();
+  return remade_snapshot_or;
+}
+
 }  // namespace
 
 bool NormalizeSnapshot(Snapshot& snapshot, FixToolCounters* counters) {
@@ -166,33 +200,18 @@ bool RewriteInitialState(Snapshot& snapshot, FixToolCounters* counters) {
 absl::StatusOr<Snapshot> FixupSnapshot(const Snapshot& input,
                                        const FixupSnapshotOptions& options,
                                        PlatformFixToolCounters* counters) {
-  absl::StatusOr<Snapshot> remade_snapshot_or = RemakeAndVerify(input, options);
-  if (!remade_snapshot_or.ok()) {
-    counters->IncCounter("ERROR-Make:", remade_snapshot_or.status().message());
-    return remade_snapshot_or.status();
-  }
-
-  int num_end_states = remade_snapshot_or->expected_end_states().size();
-  if (num_end_states > 1) {
-    counters->IncCounter("ERROR-multi-state-test:", num_end_states);
-    return absl::InternalError("multi-state-test");
-  }
+  absl::StatusOr<Snapshot> result = FixupSnapshotImpl(input, options);
+  CountFixupResult(result, counters);
+  return result;
+}
 
-  if (num_end_states == 0) {
-    counters->IncCounter("ERROR-zero-end-states-test:", num_end_states);
-    return absl::InternalError("zero-end-states-test");
+void CountFixupResult(const absl::StatusOr<Snapshot>& result,
+                      PlatformFixToolCounters* counters) {
+  if (result.ok()) {
+    counters->IncCounter("INFO-ALL-OK:", result->expected_end_states().size());
+  } else {
+    counters->IncCounter("ERROR-", result.status().message());
   }
-  // Sanity check the only expected end state -- it must have the current
-  // platform.
-  if (!remade_snapshot_or->expected_end_states()[0].has_platform(
-          CurrentPlatformId())) {
-    counters->IncCounter("ERROR-invalid-platform-id:", ShortHostname());
-    return absl::InternalError("invalid-platform-id");
-  }
-  // Snapshot has passed all tests and transformations.
-  remade_snapshot_or->NormalizeAll();
-  counters->IncCounter("INFO-ALL-OK:", num_end_states);
-  return remade_snapshot_or;
 }
 
 }  // namespace fix_tool_internal
@@ -101,11 +101,19 @@ struct FixupSnapshotOptions {
 // If `x86_filter_split_lock` is true, snapshots containing instructions that
 // access memory across cache line boundaries are filtered. This option is
 // x86-only and has no effect on other platforms.
-// Returns the fixed-up snapshot or an error status.
+// Returns the fixed-up snapshot or an error status whose message names the
+// rejection reason.
 absl::StatusOr<Snapshot> FixupSnapshot(const Snapshot& input,
                                        const FixupSnapshotOptions& options,
                                        PlatformFixToolCounters* counters);
 
+// Updates fix tool statistics in `*counters` for `result` returned by
+// FixupSnapshot(). FixupSnapshot() calls this itself. Callers that reuse an
+// earlier result, e.g. from a MakeResultCache, call this to count the result
+// like FixupSnapshot() did.
+void CountFixupResult(const absl::StatusOr<Snapshot>& result,
+                      PlatformFixToolCounters* counters);
+
 }  // namespace fix_tool_internal
 }  // namespace silifuzz
 
@@ -0,0 +1,184 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/make_result_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_proto.h"
+#include "./proto/snapshot.pb.h"
+#include "./util/byte_io.h"
+#include "./util/cache_entry.h"
+#include "./util/checks.h"
+#include "./util/checksum.h"
+#include "./util/platform.h"
+
+namespace silifuzz {
+
+namespace {
+
+constexpr uint64_t kEntryMagic = 0x65686361434d4653;  // "SFMCache"
+
+// Adds the contents of file `path` to `checksum`. Reading the whole file
+// rather than its size and modification time catches rebuilds that keep both,
+// and keeps the version of a binary that is copied elsewhere.
+absl::Status AddFileToChecksum(const std::string& path,
+                               MemoryChecksum& checksum) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  absl::Cleanup fd_closer = [fd] { close(fd); };
+  char buffer[1 << 16];
+  ssize_t n;
+  while ((n = Read(fd, buffer, sizeof(buffer))) > 0) {
+    checksum.AddData(buffer, n);
+  }
+  if (n < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("read(", path, ")"));
+  }
+  return absl::OkStatus();
+}
+
+// Returns true if a rejection with `status` is not a deterministic outcome of
+// making the snapshot, e.g. because the runner could not be started
+// (UnavailableError), was killed by a signal (AbortedError) or the snapshot
+// ran away (DeadlineExceededError).
+bool IsTransient(const absl::Status& status) {
+  return absl::IsUnavailable(status) || absl::IsResourceExhausted(status) ||
+         absl::IsDeadlineExceeded(status) || absl::IsCancelled(status) ||
+         absl::IsAborted(status);
+}
+
+}  // namespace
+
+MakeResultCache::MakeResultCache(absl::string_view dir, PlatformId platform,
+                                 absl::string_view maker_version)
+    : root_(dir),
+      dir_(absl::StrCat(dir, "/", ShortPlatformName(platform), "-",
+                        maker_version)) {}
+
+std::optional<MakeResultCache> MakeResultCache::Open(
+    absl::string_view dir, absl::string_view runner_path,
+    absl::string_view maker_config) {
+  if (dir.empty()) {
+    return std::nullopt;
+  }
+  absl::StatusOr<std::string> maker_version =
+      MakerVersion(runner_path, maker_config);
+  if (!maker_version.ok()) {
+    LOG_ERROR("Make result cache disabled: ", maker_version.status().message());
+    return std::nullopt;
+  }
+  return MakeResultCache(dir, CurrentPlatformId(), *maker_version);
+}
+
+absl::StatusOr<std::string> MakeResultCache::MakerVersion(
+    absl::string_view runner_path, absl::string_view maker_config) {
+  MemoryChecksum checksum;
+  RETURN_IF_NOT_OK(AddFileToChecksum("/proc/self/exe", checksum));
+  RETURN_IF_NOT_OK(AddFileToChecksum(std::string(runner_path), checksum));
+  return absl::StrCat(maker_config, "-",
+                      absl::Hex(checksum.Value(), absl::kZeroPad16));
+}
+
+std::string MakeResultCache::EntryPath(absl::string_view id) const {
+  // Fan entries out over subdirectories so that no directory gets too large
+  // for a corpus of millions of snapshots.
+  return absl::StrCat(dir_, "/", id.substr(0, 2), "/", id, ".v", kVersion,
+                      ".result");
+}
+
+std::optional<absl::StatusOr<Snapshot>> MakeResultCache::Read(
+    absl::string_view id) const {
+  absl::StatusOr<std::string> entry =
+      ReadCacheEntry(EntryPath(id), kEntryMagic, kVersion);
+  if (!entry.ok()) {
+    if (!absl::IsNotFound(entry.status())) {
+      LOG_ERROR(entry.status().message());
+    }
+    return std::nullopt;
+  }
+
+  // The payload is the status code followed by the serialized proto.Snapshot
+  // if the code is OK or the status message otherwise.
+  uint64_t status_code;
+  std::optional<absl::StatusOr<Snapshot>> result;
+  if (entry->size() >= sizeof(status_code)) {
+    memcpy(&status_code, entry->data(), sizeof(status_code));
+    const absl::string_view payload =
+        absl::string_view(*entry).substr(sizeof(status_code));
+    if (status_code != 0) {
+      result =
+          absl::Status(static_cast<absl::StatusCode>(status_code), payload);
+    } else {
+      proto::Snapshot proto;
+      if (proto.ParseFromArray(payload.data(), payload.size())) {
+        absl::StatusOr<Snapshot> snapshot = SnapshotProto::FromProto(proto);
+        if (snapshot.ok()) {
+          result = std::move(snapshot);
+        }
+      }
+    }
+  }
+  if (!result.has_value()) {
+    // Remove the entry so that it gets written again.
+    const std::string path = EntryPath(id);
+    LOG_ERROR("Invalid cache entry ", path);
+    unlink(path.c_str());
+  }
+  return result;
+}
+
+absl::Status MakeResultCache::Write(
+    absl::string_view id, const absl::StatusOr<Snapshot>& result) const {
+  if (!result.ok() && IsTransient(result.status())) {
+    return absl::OkStatus();
+  }
+  const uint64_t status_code = static_cast<uint64_t>(result.status().code());
+  std::string payload(reinterpret_cast<const char*>(&status_code),
+                      sizeof(status_code));
+  if (result.ok()) {
+    proto::Snapshot proto;
+    SnapshotProto::ToProto(*result, &proto);
+    if (!proto.AppendToString(&payload)) {
+      return absl::InternalError("Cannot serialize snapshot");
+    }
+  } else {
+    const absl::string_view message = result.status().message();
+    payload.append(message.data(), message.size());
+  }
+
+  const std::string path = EntryPath(id);
+  RETURN_IF_NOT_OK(MakeCacheDirectory(root_));
+  RETURN_IF_NOT_OK(MakeCacheDirectory(dir_));
+  RETURN_IF_NOT_OK(MakeCacheDirectory(path.substr(0, path.find_last_of('/'))));
+  return WriteCacheEntry(path, kEntryMagic, kVersion, payload);
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,101 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TOOL_LIBS_MAKE_RESULT_CACHE_H_
+#define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_MAKE_RESULT_CACHE_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
+#include "./util/platform.h"
+
+namespace silifuzz {
+
+// On-disk cache of snapshot make results, so that the fix tools only make
+// the blobs that earlier runs have not made yet.
+//
+// Entries are keyed by snapshot ID, which is a hash of the instruction bytes
+// (see InstructionsToSnapshotId()). Each entry holds either the made snapshot
+// or the status the snapshot was rejected with. Entries are kept in a
+// separate directory per platform and maker version, so a result is never
+// returned to a maker that could have made it differently. Like CorpusCache,
+// entries are written and read with WriteCacheEntry() and ReadCacheEntry(),
+// and invalid entries are removed when read.
+//
+// Entries are never evicted. The directory can be wiped at any time.
+//
+// This class is thread-safe.
+class MakeResultCache {
+ public:
+  // Version of the entry format. Bump it when the format changes.
+  static constexpr uint64_t kVersion = 2;
+
+  // Caches results made on `platform` by `maker_version` in a subdirectory of
+  // `dir`. Directories are created when the first entry is written.
+  MakeResultCache(absl::string_view dir, PlatformId platform,
+                  absl::string_view maker_version);
+
+  // Copyable and movable by default.
+  MakeResultCache(const MakeResultCache&) = default;
+  MakeResultCache& operator=(const MakeResultCache&) = default;
+  MakeResultCache(MakeResultCache&&) = default;
+  MakeResultCache& operator=(MakeResultCache&&) = default;
+
+  // Returns the cache in `dir` for the maker in this executable, which runs
+  // the runner binary at `runner_path` with options named by `maker_config`.
+  // See MakerVersion(). Returns std::nullopt if `dir` is empty or the maker
+  // version cannot be determined, in which case caching is disabled.
+  static std::optional<MakeResultCache> Open(absl::string_view dir,
+                                             absl::string_view runner_path,
+                                             absl::string_view maker_config);
+
+  // Returns the version of the maker in this executable, which runs the
+  // runner binary at `runner_path`. The version is a checksum of the contents
+  // of both binaries. `maker_config` names the maker options of the caller so
+  // that tools making snapshots differently do not share entries.
+  static absl::StatusOr<std::string> MakerVersion(
+      absl::string_view runner_path, absl::string_view maker_config);
+
+  // Returns the cached make result for snapshot `id`: either the made
+  // snapshot or the status it was rejected with. Returns std::nullopt if
+  // there is no valid entry. An invalid entry is removed.
+  std::optional<absl::StatusOr<Snapshot>> Read(absl::string_view id) const;
+
+  // Writes `result` as the make result for snapshot `id`, replacing any
+  // existing entry. Only deterministic outcomes are cached. Rejections with
+  // a status that may be transient are not, e.g. UnavailableError when the
+  // runner could not be started, AbortedError when it was killed by a signal
+  // and DeadlineExceededError when the snapshot ran away.
+  absl::Status Write(absl::string_view id,
+                     const absl::StatusOr<Snapshot>& result) const;
+
+  // Returns the path of the entry for snapshot `id`.
+  std::string EntryPath(absl::string_view id) const;
+
+ private:
+  // Directory passed to the constructor.
+  std::string root_;
+
+  // Directory of the entries of this platform and maker version.
+  std::string dir_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TOOL_LIBS_MAKE_RESULT_CACHE_H_
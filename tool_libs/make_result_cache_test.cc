@@ -0,0 +1,167 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/make_result_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <optional>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_test_util.h"
+#include "./util/file_util.h"
+#include "./util/platform.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+
+namespace silifuzz {
+namespace {
+
+using silifuzz::testing::IsOkAndHolds;
+using silifuzz::testing::StatusIs;
+using ::testing::Ne;
+
+std::string TempDir(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(MakeResultCache, MakerVersion) {
+  ASSERT_OK_AND_ASSIGN(std::string version,
+                       MakeResultCache::MakerVersion("/proc/self/exe", "a"));
+  EXPECT_THAT(MakeResultCache::MakerVersion("/proc/self/exe", "a"),
+              IsOkAndHolds(version));
+  EXPECT_THAT(MakeResultCache::MakerVersion("/proc/self/exe", "b"),
+              IsOkAndHolds(Ne(version)));
+  EXPECT_THAT(MakeResultCache::MakerVersion("/nonexistent", "a"),
+              StatusIs(absl::StatusCode::kNotFound));
+
+  // The version changes with the contents of the runner, even if its size
+  // and modification time stay the same.
+  const std::string runner = TempDir("MakerVersionRunner");
+  const struct timespec times[2] = {{.tv_sec = 1}, {.tv_sec = 1}};
+  ASSERT_TRUE(SetContents(runner, "runner 1"));
+  ASSERT_EQ(utimensat(AT_FDCWD, runner.c_str(), times, 0), 0);
+  ASSERT_OK_AND_ASSIGN(std::string old_version,
+                       MakeResultCache::MakerVersion(runner, "a"));
+  ASSERT_TRUE(SetContents(runner, "runner 2"));
+  ASSERT_EQ(utimensat(AT_FDCWD, runner.c_str(), times, 0), 0);
+  EXPECT_THAT(MakeResultCache::MakerVersion(runner, "a"),
+              IsOkAndHolds(Ne(old_version)));
+
+  // It does not change when the runner is copied.
+  const std::string copy = TempDir("MakerVersionRunnerCopy");
+  ASSERT_TRUE(SetContents(copy, "runner 1"));
+  EXPECT_THAT(MakeResultCache::MakerVersion(copy, "a"),
+              IsOkAndHolds(old_version));
+}
+
+TEST(MakeResultCache, Open) {
+  EXPECT_FALSE(MakeResultCache::Open("", "/proc/self/exe", "a").has_value());
+  EXPECT_FALSE(
+      MakeResultCache::Open(TempDir("Open"), "/nonexistent", "a").has_value());
+
+  std::optional<MakeResultCache> cache =
+      MakeResultCache::Open(TempDir("Open"), "/proc/self/exe", "a");
+  ASSERT_TRUE(cache.has_value());
+  ASSERT_OK(cache->Write("0123", absl::InvalidArgumentError("rejected")));
+  std::optional<MakeResultCache> reopened =
+      MakeResultCache::Open(TempDir("Open"), "/proc/self/exe", "a");
+  ASSERT_TRUE(reopened.has_value());
+  EXPECT_TRUE(reopened->Read("0123").has_value());
+}
+
+TEST(MakeResultCache, ReadWrite) {
+  MakeResultCache cache(TempDir("ReadWrite"), PlatformId::kIntelSkylake, "v1");
+  EXPECT_FALSE(cache.Read("0123").has_value());
+
+  const Snapshot snapshot = CreateTestSnapshot(TestSnapshot::kEndsAsExpected);
+  ASSERT_OK(cache.Write("0123", snapshot.Copy()));
+  std::optional<absl::StatusOr<Snapshot>> result = cache.Read("0123");
+  ASSERT_TRUE(result.has_value());
+  ASSERT_OK(*result);
+  EXPECT_EQ(**result, snapshot);
+
+  // Rejections are cached with their status.
+  ASSERT_OK(cache.Write("4567", absl::InternalError("Cannot fix")));
+  result = cache.Read("4567");
+  ASSERT_TRUE(result.has_value());
+  EXPECT_THAT(*result, StatusIs(absl::StatusCode::kInternal, "Cannot fix"));
+
+  // Entries can be replaced.
+  ASSERT_OK(cache.Write("4567", snapshot.Copy()));
+  result = cache.Read("4567");
+  ASSERT_TRUE(result.has_value());
+  ASSERT_OK(*result);
+  EXPECT_EQ(**result, snapshot);
+
+  // Transient rejections are not cached. Neither are runner kills and
+  // runaways, which do not depend on the snapshot alone.
+  ASSERT_OK(cache.Write("89ab", absl::UnavailableError("runner")));
+  EXPECT_FALSE(cache.Read("89ab").has_value());
+  ASSERT_OK(cache.Write("89ab", absl::AbortedError("killed by signal")));
+  EXPECT_FALSE(cache.Read("89ab").has_value());
+  ASSERT_OK(cache.Write("89ab", absl::DeadlineExceededError("runaway")));
+  EXPECT_FALSE(cache.Read("89ab").has_value());
+}
+
+TEST(MakeResultCache, PlatformAndMakerVersion) {
+  const std::string dir = TempDir("PlatformAndMakerVersion");
+  MakeResultCache cache(dir, PlatformId::kIntelSkylake, "v1");
+  ASSERT_OK(cache.Write("0123", absl::InternalError("Cannot fix")));
+  EXPECT_TRUE(cache.Read("0123").has_value());
+
+  // Results made on other platforms or by other makers are not visible.
+  MakeResultCache other_platform(dir, PlatformId::kAmdRome, "v1");
+  EXPECT_FALSE(other_platform.Read("0123").has_value());
+  MakeResultCache other_version(dir, PlatformId::kIntelSkylake, "v2");
+  EXPECT_FALSE(other_version.Read("0123").has_value());
+}
+
+TEST(MakeResultCache, InvalidEntry) {
+  MakeResultCache cache(TempDir("InvalidEntry"), PlatformId::kIntelSkylake,
+                        "v1");
+  ASSERT_OK(cache.Write("0123", absl::InternalError("Cannot fix")));
+
+  // Corrupt the status message.
+  const std::string path = cache.EntryPath("0123");
+  const int fd = open(path.c_str(), O_WRONLY);
+  ASSERT_NE(fd, -1);
+  struct stat stat_buf;
+  ASSERT_EQ(fstat(fd, &stat_buf), 0);
+  ASSERT_EQ(pwrite(fd, "X", 1, stat_buf.st_size - 1), 1);
+  close(fd);
+  EXPECT_FALSE(cache.Read("0123").has_value());
+
+  // The invalid entry is gone.
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+
+  // Truncated entries are invalid too.
+  ASSERT_OK(cache.Write("0123", absl::InternalError("Cannot fix")));
+  ASSERT_EQ(truncate(path.c_str(), 8), 0);
+  EXPECT_FALSE(cache.Read("0123").has_value());
+}
+
+}  // namespace
+}  // namespace silifuzz
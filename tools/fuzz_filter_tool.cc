@@ -20,12 +20,14 @@
 
 #include "./tools/fuzz_filter_tool.h"
 
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "./common/raw_insns_util.h"
 #include "./common/snapshot.h"
@@ -33,13 +35,49 @@
 #include "./common/snapshot_util.h"
 #include "./runner/runner_provider.h"
 #include "./runner/snap_maker.h"
+#include "./tool_libs/make_result_cache.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
 
 namespace silifuzz {
 
+namespace {
+
+// Makes `input_snapshot` with an end state and verifies it. Returns the made
+// snapshot or the status it was rejected with. In both cases sets
+// `last_snapshot` to the last snapshot made before returning, or leaves it
+// unchanged if none was made. A rejected snapshot shows the end state that
+// caused its rejection.
+absl::StatusOr<Snapshot> MakeAndVerify(const Snapshot& input_snapshot,
+                                       Snapshot* last_snapshot) {
+  SnapMaker::Options opts;
+  opts.runner_path = RunnerLocation();
+  opts.num_verify_attempts = 1;
+  opts.x86_filter_split_lock = true;
+  opts.use_fork_server = true;
+  SnapMaker maker(opts);
+
+  ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot made_snapshot,
+                             maker.Make(input_snapshot));
+  *last_snapshot = made_snapshot.Copy();
+  ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot recorded_snapshot,
+                             maker.RecordEndState(made_snapshot));
+  *last_snapshot = recorded_snapshot.Copy();
+  DCHECK_EQ(recorded_snapshot.expected_end_states().size(), 1);
+  const auto& ep = recorded_snapshot.expected_end_states()[0].endpoint();
+  if (ep.type() != snapshot_types::Endpoint::kInstruction) {
+    return absl::InternalError(absl::StrCat(
+        "Cannot fix ", EnumStr(ep.sig_cause()), "/", EnumStr(ep.sig_num())));
+  }
+  RETURN_IF_NOT_OK(maker.Verify(recorded_snapshot));
+  return recorded_snapshot;
+}
+
+}  // namespace
+
 bool FilterToolMain(absl::string_view id, absl::string_view raw_insns_bytes,
-                    absl::string_view output_snapshot_file) {
+                    absl::string_view output_snapshot_file,
+                    absl::string_view make_result_cache_dir) {
   absl::StatusOr<Snapshot> input_snapshot_or =
       InstructionsToSnapshot<Host>(raw_insns_bytes);
   if (!input_snapshot_or.ok()) {
@@ -48,49 +86,39 @@ bool FilterToolMain(absl::string_view id, absl::string_view raw_insns_bytes,
   }
   Snapshot input_snapshot = std::move(input_snapshot_or).value();
   input_snapshot.set_id(std::string(id));
-  auto WriteOutputFile = [&output_snapshot_file](
-                             absl::Status s, const Snapshot& output_snapshot) {
-    if (!s.ok()) {
-      LOG_ERROR(s.message());
-    }
-    if (!output_snapshot_file.empty()) {
-      WriteSnapshotToFileOrDie(output_snapshot, output_snapshot_file);
-    }
-    return false;
-  };
-
-  SnapMaker::Options opts;
-  opts.runner_path = RunnerLocation();
-  opts.num_verify_attempts = 1;
-  opts.x86_filter_split_lock = true;
-  SnapMaker maker(opts);
 
-  absl::StatusOr<Snapshot> made_snapshot_or = maker.Make(input_snapshot);
-  if (!made_snapshot_or.ok()) {
-    return WriteOutputFile(made_snapshot_or.status(), input_snapshot);
+  const std::optional<MakeResultCache> cache = MakeResultCache::Open(
+      make_result_cache_dir, RunnerLocation(), "fuzz_filter_tool");
+  const Snapshot::Id cache_id = InstructionsToSnapshotId(raw_insns_bytes);
+  std::optional<absl::StatusOr<Snapshot>> cached;
+  if (cache.has_value()) {
+    cached = cache->Read(cache_id);
+    VLOG_INFO(1, "Make result cache ", cached.has_value() ? "hit" : "miss");
   }
-  Snapshot made_snapshot = std::move(made_snapshot_or).value();
+  const bool cache_hit = cached.has_value();
 
-  absl::StatusOr<Snapshot> recorded_snapshot_or =
-      maker.RecordEndState(made_snapshot);
-  if (!recorded_snapshot_or.ok()) {
-    return WriteOutputFile(recorded_snapshot_or.status(), made_snapshot);
+  // The cache only keeps the status of rejected snapshots, so a rejection
+  // read from it is written out as the input snapshot.
+  Snapshot output_snapshot = input_snapshot.Copy();
+  absl::StatusOr<Snapshot> result =
+      cache_hit ? *std::move(cached)
+                : MakeAndVerify(input_snapshot, &output_snapshot);
+  if (cache.has_value() && !cache_hit) {
+    if (absl::Status s = cache->Write(cache_id, result); !s.ok()) {
+      LOG_ERROR(s.message());
+    }
   }
-  Snapshot recorded_snapshot = std::move(recorded_snapshot_or).value();
-
-  WriteOutputFile(absl::OkStatus(), recorded_snapshot);
-  DCHECK_EQ(recorded_snapshot.expected_end_states().size(), 1);
-  const auto& ep = recorded_snapshot.expected_end_states()[0].endpoint();
-  if (ep.type() != snapshot_types::Endpoint::kInstruction) {
-    LOG_ERROR("Cannot fix ", EnumStr(ep.sig_cause()), "/",
-              EnumStr(ep.sig_num()));
-    return false;
+  if (result.ok()) {
+    // Cached snapshots may have been made from a file with another name.
+    result->set_id(std::string(id));
+  } else {
+    LOG_ERROR(result.status().message());
   }
-  absl::Status verify_status = maker.Verify(recorded_snapshot);
-  if (!verify_status.ok()) {
-    LOG_ERROR(verify_status.message());
+  if (!output_snapshot_file.empty()) {
+    WriteSnapshotToFileOrDie(result.ok() ? *result : output_snapshot,
+                             output_snapshot_file);
   }
-  return verify_status.ok();
+  return result.ok();
 }
 
 }  // namespace silifuzz
@@ -28,8 +28,18 @@
 
 namespace silifuzz {
 
+// Returns true iff `raw_insns_bytes` can be made into a snapshot that ends
+// as expected. If `output_snapshot_file` is not empty, writes the made
+// snapshot to it. If the snapshot is rejected, writes the last snapshot made
+// before the rejection instead, e.g. one whose recorded end state shows the
+// signal that caused it, or the input snapshot if none was made. If
+// `make_result_cache_dir` is not empty, reuses the make result of an earlier
+// run in that directory. See MakeResultCache. The cache only keeps the status
+// of rejected snapshots, so a rejection read from it writes the input
+// snapshot.
 bool FilterToolMain(absl::string_view id, absl::string_view raw_insns_bytes,
-                    absl::string_view output_snapshot_file = "");
+                    absl::string_view output_snapshot_file = "",
+                    absl::string_view make_result_cache_dir = "");
 
 }
 
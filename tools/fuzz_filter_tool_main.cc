@@ -22,6 +22,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/strings/string_view.h"
 #include "./tools/fuzz_filter_tool.h"
@@ -30,6 +31,11 @@
 #include "./util/proto_util.h"
 #include "./util/tool_util.h"
 
+ABSL_FLAG(std::string, make_result_cache_dir, "",
+          "If not empty, a directory in which to cache make results across "
+          "runs.  Inputs made by earlier runs on the same platform with the "
+          "same binaries are not made again.");
+
 int main(int argc, char** argv) {
   std::vector<char*> non_flag_args = absl::ParseCommandLine(argc, argv);
   if (non_flag_args.size() < 2) {
@@ -44,7 +50,8 @@ int main(int argc, char** argv) {
     LOG_ERROR(bytes.status().message());
     return 1;
   }
-  bool success = silifuzz::FilterToolMain(silifuzz::Basename(non_flag_args[1]),
-                                          *bytes, output_snapshot_file);
+  bool success = silifuzz::FilterToolMain(
+      silifuzz::Basename(non_flag_args[1]), *bytes, output_snapshot_file,
+      absl::GetFlag(FLAGS_make_result_cache_dir));
   return silifuzz::ToExitCode(success);
 }
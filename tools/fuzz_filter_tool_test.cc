@@ -23,8 +23,16 @@
 
 #include "./tools/fuzz_filter_tool.h"
 
+#include <cstdlib>
+#include <string>
+
 #include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "./common/snapshot.h"
 #include "./common/snapshot_test_config.h"
+#include "./common/snapshot_util.h"
+#include "./util/proto_util.h"
+#include "./util/testing/status_macros.h"
 
 namespace silifuzz {
 
@@ -49,6 +57,18 @@ std::string GetTestInstructions(TestSnapshot test) {
 
 #define EXPECT_FILTER_REJECT(insn) EXPECT_FALSE(FilterToolMain("Test", insn))
 
+// Returns instructions that are rejected by verification, after their end
+// state was recorded, because they read a counter that changes between runs.
+std::string NonDeterministicInstructions() {
+#if defined(__x86_64__)
+  // rdtsc
+  return FromBytes({0x0f, 0x31});
+#elif defined(__aarch64__)
+  // mrs     x1, cntvct_el0
+  return FromInts({0xd53be041});
+#endif
+}
+
 constexpr bool WillRepairTraps() {
 #if defined(__x86_64__)
   // x86_64 tries to repair instruction sequences that jump into padding bytes.
@@ -78,6 +98,46 @@ TEST(FuzzFilterTool, Syscall) {
   EXPECT_FILTER_REJECT(GetTestInstructions(TestSnapshot::kSyscall));
 }
 
+TEST(FuzzFilterTool, MakeResultCache) {
+  const std::string cache_dir =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/MakeResultCache");
+  const std::string nop = GetTestInstructions(TestSnapshot::kEndsAsExpected);
+  const std::string syscall = GetTestInstructions(TestSnapshot::kSyscall);
+  // Results and made snapshots are the same whether they are made or read
+  // from the cache.
+  std::string outputs[2];
+  for (int i = 0; i < 2; ++i) {
+    const std::string output_file =
+        absl::StrCat(getenv("TEST_TMPDIR"), "/MakeResultCacheOutput");
+    EXPECT_TRUE(FilterToolMain("Test", nop, output_file, cache_dir));
+    ASSERT_OK_AND_ASSIGN(outputs[i], ReadFile(output_file));
+    EXPECT_FALSE(FilterToolMain("Test", syscall, output_file, cache_dir));
+  }
+  EXPECT_EQ(outputs[0], outputs[1]);
+}
+
+TEST(FuzzFilterTool, RejectedOutputSnapshot) {
+  const std::string cache_dir =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/RejectedOutputSnapshot");
+  const std::string output_file =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/RejectedOutputSnapshotOutput");
+  const std::string insns = NonDeterministicInstructions();
+
+  // Without the cache and on a cache miss, the snapshot with the recorded end
+  // state is written.
+  EXPECT_FALSE(FilterToolMain("Test", insns, output_file));
+  ASSERT_OK_AND_ASSIGN(Snapshot uncached, ReadSnapshotFromFile(output_file));
+  EXPECT_OK(uncached.IsComplete());
+  EXPECT_FALSE(FilterToolMain("Test", insns, output_file, cache_dir));
+  ASSERT_OK_AND_ASSIGN(Snapshot missed, ReadSnapshotFromFile(output_file));
+  EXPECT_OK(missed.IsComplete());
+
+  // The cache only keeps the status, so a hit writes the input snapshot.
+  EXPECT_FALSE(FilterToolMain("Test", insns, output_file, cache_dir));
+  ASSERT_OK_AND_ASSIGN(Snapshot hit, ReadSnapshotFromFile(output_file));
+  EXPECT_FALSE(hit.IsComplete().ok());
+}
+
 #if defined(__x86_64__)
 
 // Mostly to check that FromBytes can produce something that will be accepted.
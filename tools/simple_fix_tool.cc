@@ -14,30 +14,49 @@
 
 #include "./tools/simple_fix_tool.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
-#include "absl/container/flat_hash_map.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "external/centipede/blob_file.h"
 #include "./common/raw_insns_util.h"
 #include "./common/snapshot.h"
+#include "./common/snapshot_proto.h"
+#include "./proto/snapshot.pb.h"
+#include "./runner/runner_provider.h"
 #include "./snap/gen/relocatable_snap_generator.h"
-#include "./tool_libs/corpus_partitioner_lib.h"
 #include "./tool_libs/fix_tool_common.h"
+#include "./tool_libs/make_result_cache.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 #include "./tool_libs/snap_group.h"
-#include "./util/span_util.h"
+#include "./util/byte_io.h"
+#include "./util/checks.h"
+#include "./util/owned_file_descriptor.h"
 
 namespace silifuzz {
 namespace fix_tool_internal {
@@ -45,63 +64,61 @@ namespace {
 
 // Counter the number of blobs processed by workers, including ones that are
 // rejected. This is used for tracking progress of simple fix tool. This is a
-// global atomic variable so accessing it can create cache contention among
-// workers. Contention is alleviated by updating this infrequently.
+// global atomic variable. Workers update it once per made blob, which is rare
+// enough not to cause noticeable cache contention.
 std::atomic<size_t> num_blobs_processed = 0;
 
-// Arguments for a make worker thread.
-// This is used for both input and output.
-struct FixToolWorkerArgs {
-  // A worker needs to reference simple fix tool options.
-  // The worker does not own the option.
-  const SimpleFixToolOptions* options;
-  absl::Span<const std::string> blobs;
-  std::vector<Snapshot> good_snapshots;
-  SimpleFixToolCounters counters;
-};
-
-void FixToolWorker(FixToolWorkerArgs& args) {
-  auto current_platform = CurrentPlatformId();
-  CHECK(current_platform != PlatformId::kUndefined);
-  PlatformFixToolCounters platform_counters(ShortPlatformName(current_platform),
-                                            &args.counters);
-  // To reduce contention of the global blob count, we batch the update.
-  // We update the global count for at least this amount.
-  constexpr size_t kMinCountUpdateSize = 100;
-  size_t count_update = 0;
-
-  for (const std::string& blob : args.blobs) {
-    // Update global blobs count.
-    if (++count_update >= kMinCountUpdateSize) {
-      num_blobs_processed.fetch_add(count_update);
-      count_update = 0;
-    }
-
-    absl::StatusOr<Snapshot> snapshot = InstructionsToSnapshot<Host>(blob);
-    if (!snapshot.ok()) {
-      args.counters.Increment(
-          "silifuzz-ERROR-FixToolWorker:instructions-to-snapshot-failed");
-      continue;
-    }
-    snapshot->set_id(InstructionsToSnapshotId(blob));
-    if (!NormalizeSnapshot(snapshot.value(), &args.counters)) {
-      continue;
-    }
-    RewriteInitialState(snapshot.value(), &args.counters);
-    const FixupSnapshotOptions options;
-    auto remade_snapshot_or =
-        FixupSnapshot(snapshot.value(), options, &platform_counters);
-    if (!remade_snapshot_or.ok()) {
-      continue;
+// Makes a snapshot with end states for the current platform from raw
+// instructions in `blob`. Returns std::nullopt if the snapshot is rejected.
+// Reuses the result of an earlier run from `cache` unless it is nullptr.
+// Updates fix tool statistics in `counters` and `platform_counters`.
+std::optional<Snapshot> MakeSnapshotFromBlob(
+    const std::string& blob, const MakeResultCache* cache,
+    SimpleFixToolCounters* counters,
+    PlatformFixToolCounters* platform_counters) {
+  const Snapshot::Id id = InstructionsToSnapshotId(blob);
+  if (cache != nullptr) {
+    if (std::optional<absl::StatusOr<Snapshot>> cached = cache->Read(id)) {
+      counters->Increment("silifuzz-INFO-MakeResultCache:hit");
+      // Count the result as if FixupSnapshot() returned it.
+      CountFixupResult(*cached, platform_counters);
+      if (!cached->ok()) {
+        return std::nullopt;
+      }
+      counters->Increment("silifuzz-INFO-FixToolWorker:success");
+      return *std::move(*cached);
     }
-    args.good_snapshots.push_back(std::move(remade_snapshot_or.value()));
-    args.counters.Increment("silifuzz-INFO-FixToolWorker:success");
+    counters->Increment("silifuzz-INFO-MakeResultCache:miss");
   }
 
-  num_blobs_processed.fetch_add(count_update);
+  absl::StatusOr<Snapshot> snapshot = InstructionsToSnapshot<Host>(blob);
+  if (!snapshot.ok()) {
+    counters->Increment(
+        "silifuzz-ERROR-FixToolWorker:instructions-to-snapshot-failed");
+    return std::nullopt;
+  }
+  snapshot->set_id(id);
+  if (!NormalizeSnapshot(snapshot.value(), counters)) {
+    return std::nullopt;
+  }
+  RewriteInitialState(snapshot.value(), counters);
+  const FixupSnapshotOptions options;
+  auto remade_snapshot_or =
+      FixupSnapshot(snapshot.value(), options, platform_counters);
+  if (cache != nullptr && !cache->Write(id, remade_snapshot_or).ok()) {
+    counters->Increment("silifuzz-ERROR-MakeResultCache:write-failed");
+  }
+  if (!remade_snapshot_or.ok()) {
+    return std::nullopt;
+  }
+  counters->Increment("silifuzz-INFO-FixToolWorker:success");
+  return std::move(remade_snapshot_or).value();
 }
 
-void MakeProgressMonitor(size_t num_blobs, std::atomic<bool>& stop) {
+// Prints the number of blobs processed by workers out of `num_blobs` until
+// `stop` is set. `num_blobs` may grow while blobs are being read.
+void MakeProgressMonitor(const std::atomic<size_t>& num_blobs,
+                         std::atomic<bool>& stop) {
   absl::Time start = absl::Now();
   absl::Duration interval = absl::Seconds(1);
   absl::Time next_checkpoint = start + interval;
@@ -111,7 +128,7 @@ void MakeProgressMonitor(size_t num_blobs, std::atomic<bool>& stop) {
     // Print progress at checkpoint or exit.
     if (stop_monitoring || absl::Now() >= next_checkpoint) {
       std::cout << "Make snapshot count: " << num_blobs_processed.load()
-                << " of " << num_blobs << std::endl;
+                << " of " << num_blobs.load() << std::endl;
       if (stop_monitoring) {
         break;  // exit progress monitor.
       } else {
@@ -123,173 +140,281 @@ void MakeProgressMonitor(size_t num_blobs, std::atomic<bool>& stop) {
   }
 }
 
-}  // namespace
-
-std::vector<std::string> ReadUniqueCentipedeBlobs(
-    const std::vector<std::string>& inputs, SimpleFixToolCounters* counters) {
-  std::vector<std::string> blobs;
-
-  // Centipede generates fuzzing corpus using multiple workers in parallel.
-  // It is common for the generated corpus to have duplicates.
-  // Record unique snapshot names seen so far to de-dupe blobs.
-  absl::flat_hash_set<Snapshot::Id> id_seen;
+// Set of snapshot IDs of the blobs read so far. Centipede generates fuzzing
+// corpus using multiple workers in parallel. It is common for the generated
+// corpus to have duplicates.
+//
+// This class is thread-safe.
+class SeenSnapshotIds {
+ public:
+  // Adds `id` and returns true if it was not in the set yet.
+  bool Insert(const Snapshot::Id& id) {
+    absl::MutexLock lock(&mu_);
+    return ids_.insert(id).second;
+  }
 
-  for (const std::string& input : inputs) {
-    auto reader = centipede::DefaultBlobFileReaderFactory();
-    if (!reader->Open(input).ok()) {
-      counters->Increment("silifuzz-ERROR-Read:open-blob-reader-failed");
-      continue;
-    }
+ private:
+  absl::Mutex mu_;
+  absl::flat_hash_set<Snapshot::Id> ids_ ABSL_GUARDED_BY(mu_);
+};
 
-    // TODO(dougkwan): Parallelize this to speed up blob reading.
-    absl::Status status;
-    absl::Span<uint8_t> blob;
-    while ((status = reader->Read(blob)).ok()) {
-      const std::string id = InstructionsToSnapshotId(
-          {reinterpret_cast<const char*>(blob.data()), blob.size()});
-      auto [_, inserted] = id_seen.insert(id);
-      if (inserted) {
-        blobs.push_back(std::string(blob.begin(), blob.end()));
-      } else {
-        counters->Increment("silifuzz-INFO-Read:duplicate-blobs");
-      }
-    }
+// Reads the blob file `input` and calls `consume` with each blob whose
+// snapshot ID is not in `seen_ids` yet. This reads as many blobs as
+// possible. Updates statistics in `counters`.
+template <typename ConsumeFunc>
+void ReadUniqueCentipedeBlobFile(const std::string& input,
+                                 SeenSnapshotIds& seen_ids,
+                                 ConsumeFunc consume,
+                                 SimpleFixToolCounters* counters) {
+  auto reader = centipede::DefaultBlobFileReaderFactory();
+  if (!reader->Open(input).ok()) {
+    counters->Increment("silifuzz-ERROR-Read:open-blob-reader-failed");
+    return;
+  }
 
-    // Log if loop exited not because of EOF.
-    if (!absl::IsOutOfRange(status)) {
-      counters->Increment("silifuzz-ERROR-Read:read-blob-failed");
+  absl::Status status;
+  absl::Span<uint8_t> blob;
+  while ((status = reader->Read(blob)).ok()) {
+    const std::string id = InstructionsToSnapshotId(
+        {reinterpret_cast<const char*>(blob.data()), blob.size()});
+    if (seen_ids.Insert(id)) {
+      consume(std::string(blob.begin(), blob.end()));
+    } else {
+      counters->Increment("silifuzz-INFO-Read:duplicate-blobs");
     }
+  }
 
-    if (!reader->Close().ok()) {
-      counters->Increment("silifuzz-ERROR-Read:close-blob-reader-failed");
-    }
+  // Log if loop exited not because of EOF.
+  if (!absl::IsOutOfRange(status)) {
+    counters->Increment("silifuzz-ERROR-Read:read-blob-failed");
   }
 
-  return blobs;
+  if (!reader->Close().ok()) {
+    counters->Increment("silifuzz-ERROR-Read:close-blob-reader-failed");
+  }
 }
 
-std::vector<Snapshot> MakeSnapshotsFromBlobs(
-    const SimpleFixToolOptions& options, const std::vector<std::string>& blobs,
-    SimpleFixToolCounters* counters) {
-  const size_t num_workers = options.parallelism
-                                 ? options.parallelism
-                                 : std::thread::hardware_concurrency();
-  const std::vector<absl::Span<const std::string>> blob_spans =
-      PartitionEvenly(blobs, num_workers);
+// A queue of at most `capacity` items passed from producer threads to
+// consumer threads. Push() blocks while the queue is full and Pop() while it
+// is empty. Once each of the `num_producers` producers has called Close(),
+// Pop() returns std::nullopt after the last item.
+//
+// This class is thread-safe.
+template <typename T>
+class BoundedQueue {
+ public:
+  BoundedQueue(size_t capacity, size_t num_producers)
+      : capacity_(capacity), num_producers_(num_producers) {}
+
+  // Not copyable or movable.
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  void Push(T item) {
+    absl::MutexLock lock(&mu_);
+    auto has_room = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return items_.size() < capacity_;
+    };
+    mu_.Await(absl::Condition(&has_room));
+    items_.push_back(std::move(item));
+  }
 
-  // Start progress monitor.
-  std::atomic<bool> stop_progress_monitor = false;
-  std::thread progress_monitor = std::thread(MakeProgressMonitor, blobs.size(),
-                                             std::ref(stop_progress_monitor));
+  // Tells consumers that one of the producers is done.
+  void Close() {
+    absl::MutexLock lock(&mu_);
+    CHECK_GT(num_producers_, 0);
+    --num_producers_;
+  }
 
-  // Prepare args.
-  std::vector<FixToolWorkerArgs> worker_args;
-  worker_args.reserve(num_workers);
-  for (size_t i = 0; i < num_workers; ++i) {
-    FixToolWorkerArgs args;
-    args.options = &options;
-    args.blobs = blob_spans[i];
-    worker_args.push_back(std::move(args));
+  std::optional<T> Pop() {
+    absl::MutexLock lock(&mu_);
+    auto has_item_or_done = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return !items_.empty() || num_producers_ == 0;
+    };
+    mu_.Await(absl::Condition(&has_item_or_done));
+    if (items_.empty()) {
+      return std::nullopt;
+    }
+    T item = std::move(items_.front());
+    items_.pop_front();
+    return item;
   }
 
-  // Start workers.
-  std::vector<std::thread> workers;
-  for (size_t i = 0; i < num_workers; ++i) {
-    workers.emplace_back(FixToolWorker, std::ref(worker_args[i]));
+ private:
+  const size_t capacity_;
+  absl::Mutex mu_;
+  std::deque<T> items_ ABSL_GUARDED_BY(mu_);
+  size_t num_producers_ ABSL_GUARDED_BY(mu_);
+};
+
+// Capacity of the queues between stages per worker thread.
+constexpr size_t kQueueCapacityPerWorker = 64;
+
+// Makes the blobs from `blobs` into snapshots and pushes the successfully
+// made ones to `made_snapshots` until `blobs` is drained. Uses `cache` unless
+// it is nullptr. Updates fix tool statistics in `counters`.
+void StreamingFixToolWorker(BoundedQueue<std::string>& blobs,
+                            BoundedQueue<Snapshot>& made_snapshots,
+                            const MakeResultCache* cache,
+                            SimpleFixToolCounters* counters) {
+  auto current_platform = CurrentPlatformId();
+  CHECK(current_platform != PlatformId::kUndefined);
+  PlatformFixToolCounters platform_counters(ShortPlatformName(current_platform),
+                                            counters);
+  while (std::optional<std::string> blob = blobs.Pop()) {
+    std::optional<Snapshot> snapshot =
+        MakeSnapshotFromBlob(*blob, cache, counters, &platform_counters);
+    num_blobs_processed.fetch_add(1, std::memory_order_relaxed);
+    if (snapshot.has_value()) {
+      made_snapshots.Push(*std::move(snapshot));
+    }
   }
+  made_snapshots.Close();
+}
 
-  size_t num_good_snapshots = 0;
-  // Wait for workers to finish.
-  for (int i = 0; i < num_workers; ++i) {
-    workers[i].join();
+// Snapshots of an output shard spilled to a file until all snapshots are
+// made. Records in the file are serialized proto.Snapshots prefixed by their
+// sizes as 64-bit integers. The file is unlinked as soon as it is created, so
+// that it does not outlive the tool even if the tool crashes.
+class ShardSpillFile {
+ public:
+  // Creates an anonymous spill file in the directory of `path_prefix`.
+  static absl::StatusOr<std::unique_ptr<ShardSpillFile>> Create(
+      absl::string_view path_prefix) {
+    std::string path = absl::StrCat(path_prefix, ".spill.XXXXXX");
+    const int fd = mkstemp(path.data());
+    if (fd < 0) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("mkstemp(", path, ")"));
+    }
+    OwnedFileDescriptor owned_fd = WrapFileDescriptor(fd);
+    if (unlink(path.c_str()) != 0) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("unlink(", path, ")"));
+    }
+    return absl::WrapUnique(new ShardSpillFile(std::move(owned_fd)));
+  }
 
-    // It is now safe to access worker args for this worker.
-    counters->Merge(worker_args[i].counters);
-    num_good_snapshots += worker_args[i].good_snapshots.size();
+  // Not copyable or movable.
+  ShardSpillFile(const ShardSpillFile&) = delete;
+  ShardSpillFile& operator=(const ShardSpillFile&) = delete;
+
+  // Appends `snapshot` to the file. Updates fix tool statistics in
+  // `counters`.
+  void Append(const Snapshot& snapshot, SimpleFixToolCounters* counters) {
+    proto::Snapshot proto;
+    SnapshotProto::ToProto(snapshot, &proto);
+    std::string record;
+    if (!proto.SerializeToString(&record)) {
+      counters->Increment("silifuzz-ERROR-Output:serialize-failed");
+      return;
+    }
+    const uint64_t size = record.size();
+    if (Write(*fd_, &size, sizeof(size)) != sizeof(size) ||
+        Write(*fd_, record.data(), record.size()) != record.size()) {
+      write_failed_ = true;
+    }
+    ++num_snapshots_;
   }
 
-  // Collect made snapshots and bad snapshot id.
-  std::vector<Snapshot> made_snapshots;
-  made_snapshots.reserve(num_good_snapshots);
-  for (auto& work_arg : worker_args) {
-    std::move(work_arg.good_snapshots.begin(), work_arg.good_snapshots.end(),
-              std::back_inserter(made_snapshots));
-    work_arg.good_snapshots.clear();
+  // Returns all snapshots appended to the file. Updates fix tool statistics
+  // in `counters`.
+  std::vector<Snapshot> ReadAll(SimpleFixToolCounters* counters) {
+    std::vector<Snapshot> snapshots;
+    if (write_failed_ || lseek(*fd_, 0, SEEK_SET) != 0) {
+      counters->Increment("silifuzz-ERROR-Output:spill-write-failed");
+      return snapshots;
+    }
+    snapshots.reserve(num_snapshots_);
+    uint64_t size;
+    std::string record;
+    while (Read(*fd_, &size, sizeof(size)) == sizeof(size)) {
+      record.resize(size);
+      proto::Snapshot proto;
+      if (Read(*fd_, record.data(), size) != size ||
+          !proto.ParseFromString(record)) {
+        break;
+      }
+      absl::StatusOr<Snapshot> snapshot = SnapshotProto::FromProto(proto);
+      if (!snapshot.ok()) {
+        break;
+      }
+      snapshots.push_back(*std::move(snapshot));
+    }
+    if (snapshots.size() != num_snapshots_) {
+      counters->Increment("silifuzz-ERROR-Output:spill-read-failed");
+    }
+    return snapshots;
   }
 
-  stop_progress_monitor.store(true);
-  progress_monitor.join();
+ private:
+  explicit ShardSpillFile(OwnedFileDescriptor fd) : fd_(std::move(fd)) {}
+
+  OwnedFileDescriptor fd_;
+  bool write_failed_ = false;
+  size_t num_snapshots_ = 0;
+};
 
-  return made_snapshots;
+// Returns the path of output shard `index`.
+std::string OutputFilePath(absl::string_view output_path_prefix, int index) {
+  return absl::StrFormat("%s.%05d", output_path_prefix, index);
 }
 
-std::vector<std::vector<Snapshot>> PartitionSnapshots(
-    const SimpleFixToolOptions& options, int num_groups,
-    std::vector<Snapshot>& snapshots) {
-  // Create snapshot summaries for partitioner.
-  SnapshotGroup::SnapshotSummaryList ungrouped;
-  ungrouped.reserve(snapshots.size());
-  for (auto& snapshot : snapshots) {
-    ungrouped.emplace_back(snapshot);
+// Writes `snapshots` into a relocatable corpus at `path`. Updates fix tool
+// statistics in `counters`.
+void WriteOutputFile(const std::vector<Snapshot>& snapshots,
+                     const std::string& path,
+                     SimpleFixToolCounters* counters) {
+  // Runners map read-only pages of these corpora directly from the files.
+  const RelocatableSnapGeneratorOptions generator_options{
+      .read_only_mapping_images = true};
+  auto relocatable = GenerateRelocatableSnaps(Host::architecture_id, snapshots,
+                                              generator_options);
+  std::ofstream os(path);
+  if (!os.is_open()) {
+    counters->Increment("silifuzz-ERROR-Output:open-failed");
+    return;
   }
-
-  // Run iterative partitioner.
-  auto partitions = PartitionCorpus(
-      num_groups, options.num_partitioning_iterations, ungrouped);
-
-  // Build Snapshot ID -> Group index map.
-  absl::flat_hash_map<Snapshot::Id, int> group_map;
-  group_map.reserve(snapshots.size());
-  for (int i = 0; i < partitions.snapshot_groups().size(); ++i) {
-    const std::vector<Snapshot::Id> id_list =
-        partitions.snapshot_groups()[i].id_list();
-    for (const std::string& id : id_list) {
-      group_map[id] = i;
-    }
+  os.write(relocatable.get(), MmappedMemorySize(relocatable));
+  if (os.fail()) {
+    counters->Increment("silifuzz-ERROR-Output:write-failed.");
   }
+  os.close();
+}
 
-  // Reserve memory in output.
-  std::vector<std::vector<Snapshot>> groups(
-      partitions.snapshot_groups().size());
-  for (int i = 0; i < partitions.snapshot_groups().size(); ++i) {
-    groups[i].reserve(partitions.snapshot_groups()[i].size());
-  }
-  std::vector<Snapshot> ungrouped_snapshots;
-  ungrouped_snapshots.reserve(ungrouped.size());
-
-  // Move grouped snapshots to output.
-  for (auto& snapshot : snapshots) {
-    auto it = group_map.find(snapshot.id());
-    if (it != group_map.end()) {
-      groups[it->second].push_back(std::move(snapshot));
-    } else {
-      ungrouped_snapshots.push_back(std::move(snapshot));
-    }
+// Returns the group out of `num_groups` that IncrementalPartitioner tries
+// first for snapshot `id`. This is a 64-bit FNV-1a hash of `id`, which unlike
+// std::hash is the same in every build, so shard assignment does not depend
+// on the order in which snapshots are made.
+int PreferredGroup(const Snapshot::Id& id, int num_groups) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char c : id) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
   }
-  snapshots.swap(ungrouped_snapshots);
+  return hash % num_groups;
+}
+
+}  // namespace
 
-  return groups;
+IncrementalPartitioner::IncrementalPartitioner(int num_groups) {
+  CHECK_GT(num_groups, 0);
+  for (int i = 0; i < num_groups; ++i) {
+    // Same conflict resolution as PartitionCorpus().
+    groups_.push_back(
+        SnapshotGroup(SnapshotGroup::kAllowWriteConflictsWithSamePerm));
+  }
 }
 
-void WriteOutputFiles(const std::vector<std::vector<Snapshot>>& shards,
-                      absl::string_view output_path_prefix,
-                      SimpleFixToolCounters* counters) {
-  for (int i = 0; i < shards.size(); ++i) {
-    auto relocatable =
-        GenerateRelocatableSnaps(Host::architecture_id, shards[i]);
-    const std::string file_name =
-        absl::StrFormat("%s.%05d", output_path_prefix, i);
-    std::ofstream os(file_name);
-    if (!os.is_open()) {
-      counters->Increment("silifuzz-ERROR-Output:open-failed");
-      continue;
-    }
-    os.write(relocatable.get(), MmappedMemorySize(relocatable));
-    if (os.fail()) {
-      counters->Increment("silifuzz-ERROR-Output:write-failed.");
+std::optional<int> IncrementalPartitioner::Add(const Snapshot& snapshot) {
+  const SnapshotGroup::SnapshotSummary summary(snapshot);
+  const int num_groups = groups_.size();
+  const int preferred_group = PreferredGroup(snapshot.id(), num_groups);
+  for (int i = 0; i < num_groups; ++i) {
+    const int group = (preferred_group + i) % num_groups;
+    if (groups_[group].CanAddSnapshot(summary).ok()) {
+      groups_[group].AddSnapshot(summary);
+      return group;
     }
-    os.close();
   }
+  return std::nullopt;
 }
 
 }  // namespace fix_tool_internal
@@ -298,19 +423,130 @@ void FixupCorpus(const SimpleFixToolOptions& options,
                  const std::vector<std::string>& inputs,
                  absl::string_view output_path_prefix, size_t num_output_shards,
                  fix_tool_internal::SimpleFixToolCounters* counters) {
-  const std::vector<std::string> blobs =
-      ReadUniqueCentipedeBlobs(inputs, counters);
-  std::vector<Snapshot> made_snapshots =
-      MakeSnapshotsFromBlobs(options, blobs, counters);
-
-  std::vector<std::vector<Snapshot>> shards =
-      fix_tool_internal::PartitionSnapshots(options, num_output_shards,
-                                            made_snapshots);
-  counters->IncrementBy("silifuzz-ERROR-Partition:cannot-group",
-                        made_snapshots.size());
-  made_snapshots.clear();  // discard any left-over snapshots.
-
-  WriteOutputFiles(shards, output_path_prefix, counters);
+  using fix_tool_internal::BoundedQueue;
+  using fix_tool_internal::ShardSpillFile;
+  using fix_tool_internal::SimpleFixToolCounters;
+  std::vector<std::unique_ptr<ShardSpillFile>> spill_files;
+  for (size_t i = 0; i < num_output_shards; ++i) {
+    absl::StatusOr<std::unique_ptr<ShardSpillFile>> spill_file =
+        ShardSpillFile::Create(
+            fix_tool_internal::OutputFilePath(output_path_prefix, i));
+    if (!spill_file.ok()) {
+      LOG_ERROR("Cannot create spill file: ", spill_file.status().message());
+      counters->Increment("silifuzz-ERROR-Output:spill-create-failed");
+      return;
+    }
+    spill_files.push_back(*std::move(spill_file));
+  }
+
+  // hardware_concurrency() returns 0 if it cannot tell. Without makers, the
+  // readers would block forever on a full queue.
+  const size_t num_workers = std::max<size_t>(
+      1, options.parallelism ? options.parallelism
+                             : std::thread::hardware_concurrency());
+  const size_t num_readers = std::max<size_t>(
+      1, std::min<size_t>(inputs.size(), num_workers));
+  const size_t queue_capacity =
+      fix_tool_internal::kQueueCapacityPerWorker * num_workers;
+
+  // Readers -> makers.
+  BoundedQueue<std::string> blobs(queue_capacity, num_readers);
+  // Makers -> partitioner.
+  BoundedQueue<Snapshot> made_snapshots(queue_capacity, num_workers);
+
+  std::atomic<size_t> num_blobs_read = 0;
+  std::atomic<bool> stop_progress_monitor = false;
+  std::thread progress_monitor =
+      std::thread(fix_tool_internal::MakeProgressMonitor,
+                  std::cref(num_blobs_read), std::ref(stop_progress_monitor));
+
+  // Read input files in parallel. Each reader takes the next unread file.
+  fix_tool_internal::SeenSnapshotIds seen_ids;
+  std::atomic<size_t> next_input = 0;
+  std::vector<SimpleFixToolCounters> reader_counters(num_readers);
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < num_readers; ++i) {
+    readers.emplace_back([&, i] {
+      for (size_t input = next_input++; input < inputs.size();
+           input = next_input++) {
+        fix_tool_internal::ReadUniqueCentipedeBlobFile(
+            inputs[input], seen_ids,
+            [&](std::string blob) {
+              ++num_blobs_read;
+              blobs.Push(std::move(blob));
+            },
+            &reader_counters[i]);
+      }
+      blobs.Close();
+    });
+  }
+
+  const std::optional<MakeResultCache> cache = MakeResultCache::Open(
+      options.make_result_cache_dir, RunnerLocation(), "simple_fix_tool");
+  std::vector<SimpleFixToolCounters> worker_counters(num_workers);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.emplace_back(fix_tool_internal::StreamingFixToolWorker,
+                         std::ref(blobs), std::ref(made_snapshots),
+                         cache.has_value() ? &*cache : nullptr,
+                         &worker_counters[i]);
+  }
+
+  // Partition snapshots as they are made and spill them to their shards.
+  fix_tool_internal::IncrementalPartitioner partitioner(num_output_shards);
+  while (std::optional<Snapshot> snapshot = made_snapshots.Pop()) {
+    const std::optional<int> shard = partitioner.Add(*snapshot);
+    if (!shard.has_value()) {
+      counters->Increment("silifuzz-ERROR-Partition:cannot-group");
+      continue;
+    }
+    spill_files[*shard]->Append(*snapshot, counters);
+  }
+
+  for (size_t i = 0; i < num_readers; ++i) {
+    readers[i].join();
+    counters->Merge(reader_counters[i]);
+  }
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers[i].join();
+    counters->Merge(worker_counters[i]);
+  }
+  stop_progress_monitor.store(true);
+  progress_monitor.join();
+
+  // Convert shards into relocatable corpora in parallel. Each writer takes
+  // the next unwritten shard and holds only its snapshots in memory. Shards
+  // cannot be written while snapshots are still being made: any snapshot may
+  // land in any shard, and relocatable corpus generation needs all snapshots
+  // of a shard at once. Spilling is what overlaps with making.
+  const size_t num_writers = std::min(num_workers, num_output_shards);
+  std::atomic<size_t> next_shard = 0;
+  std::vector<SimpleFixToolCounters> writer_counters(num_writers);
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < num_writers; ++i) {
+    writers.emplace_back([&, i] {
+      for (size_t shard = next_shard++; shard < num_output_shards;
+           shard = next_shard++) {
+        std::vector<Snapshot> snapshots =
+            spill_files[shard]->ReadAll(&writer_counters[i]);
+        spill_files[shard].reset();
+        // Snapshots arrive in the order they are made. Sort them so that the
+        // same inputs give the same output files.
+        std::sort(snapshots.begin(), snapshots.end(),
+                  [](const Snapshot& a, const Snapshot& b) {
+                    return a.id() < b.id();
+                  });
+        fix_tool_internal::WriteOutputFile(
+            snapshots,
+            fix_tool_internal::OutputFilePath(output_path_prefix, shard),
+            &writer_counters[i]);
+      }
+    });
+  }
+  for (size_t i = 0; i < num_writers; ++i) {
+    writers[i].join();
+    counters->Merge(writer_counters[i]);
+  }
 }
 
 }  // namespace silifuzz
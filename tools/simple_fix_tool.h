@@ -17,18 +17,23 @@
 // consisting of raw instruction sequences from Centipede, converts these into
 // snapshots with undefined end states, runs the Snap maker to make Snapshots
 // complete, partitions snapshots into shards and creates a relocatable corpus.
-// As everything is done in memory, there is a limit on of corpus size. The
-// limit may change in the future if we implement streaming for intermediate
-// results in and out of a file system.
+// These stages run concurrently and pass blobs and snapshots through bounded
+// queues. Made snapshots are spilled to per-shard files, so only the snapshots
+// of the shards being converted into relocatable corpora are in memory at the
+// same time.
 
 #ifndef THIRD_PARTY_SILIFUZZ_TOOLS_SIMPLE_FIX_TOOL_H_
 #define THIRD_PARTY_SILIFUZZ_TOOLS_SIMPLE_FIX_TOOL_H_
 
 #include <cstddef>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
+#include "./tool_libs/snap_group.h"
 
 namespace silifuzz {
 
@@ -37,9 +42,6 @@ struct SimpleFixToolOptions {
   SimpleFixToolOptions() = default;
   ~SimpleFixToolOptions() = default;
 
-  // Number of corpus partitioning iterations.
-  int num_partitioning_iterations = 10;
-
   // Number of parallel worker threads.  If it is 0, the maximum hardware
   // parallelism is used.
   int parallelism = 0;
@@ -47,14 +49,21 @@ struct SimpleFixToolOptions {
   // If true, filter Snap containing lock instructions that access memory
   // across cache line boundary. This has no effect on platforms other than x86.
   bool x86_filter_split_lock = true;
+
+  // If not empty, make results are cached in this directory so that later
+  // runs only make blobs that have not been made before. See MakeResultCache.
+  std::string make_result_cache_dir;
 };
 
 // Converts raw instructions blobs in `inputs` into snapshots of the
 // current architecture. Runs the snapshots through the maker to generate
 // end states for them. Partitions successfully made snapshots into
 // `num_output_shards` shards and outputs snapified snapshots as a sharded
-// relocatable corpus. pdates fix tool statistics in
-// `counters`.
+// relocatable corpus. Input files are read, and snapshots are made, by
+// `options.parallelism` threads each. Made snapshots are kept in unlinked
+// temporary files next to the output files until all are made. Shards are
+// assigned as by IncrementalPartitioner, and snapshots are sorted by ID
+// within each shard. Updates fix tool statistics in `counters`.
 void FixupCorpus(const SimpleFixToolOptions& options,
                  const std::vector<std::string>& inputs,
                  absl::string_view output_path_prefix, size_t num_output_shards,
@@ -63,37 +72,31 @@ void FixupCorpus(const SimpleFixToolOptions& options,
 // ----------------------- implementation details ------------------
 namespace fix_tool_internal {
 
-// Read unique blobs from files in `inputs`. Returns a vector of blobs. This
-// reads as many blobs as possible.  It there is an error while reading a blob
-// file, the rest of the file is ignored and reading continues. Updates
-// statstics in `counters`.
-std::vector<std::string> ReadUniqueCentipedeBlobs(
-    const std::vector<std::string>& inputs, SimpleFixToolCounters* counters);
-
-// Makes `blobs` with `parallelism` into complete snapshots with end states
-// for the current platform on which this runs. Return a vector of made
-// snapshots. The make process is controlled by `options`. Updates fix tool
-// statistics in `counters`.
-std::vector<Snapshot> MakeSnapshotsFromBlobs(
-    const SimpleFixToolOptions& options, const std::vector<std::string>& blobs,
-    SimpleFixToolCounters* counters);
-
-// Parititions and moves `snapshots` into `num_groups` groups,
-// each of which contains snapshots with no memory mapping conflicts.
-// The partition process is controlled by `options`.
-// Returns a vector of groups (vector<Snapshot>). Snapshots that
-// cannot be grouped and moved will remain in `snapshots`. Also updates fix
-// tool statistics in `counters`.
-std::vector<std::vector<Snapshot>> PartitionSnapshots(
-    const SimpleFixToolOptions& options, int num_groups,
-    std::vector<Snapshot>& snapshots);
-
-// Writes snapshots in `shards` into relocatable corpora. Each corpus has
-// a path `output_path_prefix` + '.' + <shard index>. Updates fix tool
-// statistics in `counters`.
-void WriteOutputFiles(const std::vector<std::vector<Snapshot>>& shards,
-                      absl::string_view output_path_prefix,
-                      SimpleFixToolCounters* counters);
+// Assigns snapshots to `num_groups` groups one at a time, as they are made,
+// so that the snapshots in each group have no memory mapping conflicts. Each
+// snapshot goes into a group picked by a hash of its ID, or into the next one
+// that it fits in if it conflicts with that group. The group of a snapshot
+// thus depends on the order of Add() calls only if it has conflicts.
+//
+// This class is thread-compatible.
+class IncrementalPartitioner {
+ public:
+  explicit IncrementalPartitioner(int num_groups);
+
+  // Not copyable or movable.
+  IncrementalPartitioner(const IncrementalPartitioner&) = delete;
+  IncrementalPartitioner& operator=(const IncrementalPartitioner&) = delete;
+
+  // Adds `snapshot` to a group and returns its index. Returns std::nullopt if
+  // `snapshot` conflicts with all groups.
+  std::optional<int> Add(const Snapshot& snapshot);
+
+  // Returns the groups.
+  const std::vector<SnapshotGroup>& groups() const { return groups_; }
+
+ private:
+  std::vector<SnapshotGroup> groups_;
+};
 
 }  // namespace fix_tool_internal
 
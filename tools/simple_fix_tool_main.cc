@@ -27,6 +27,7 @@
 #include "absl/flags/parse.h"
 #include "absl/log/flags.h"
 #include "absl/log/initialize.h"
+#include "absl/log/log.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 #include "./tools/simple_fix_tool.h"
 
@@ -35,8 +36,9 @@ ABSL_FLAG(std::string, output_path_prefix, "",
           "A shard index is appended to each output shard file.");
 ABSL_FLAG(int, num_output_shards, 1, "number of shards in the output corpus");
 
-ABSL_FLAG(int, num_partitioning_iterations, 10,
-          "Number of times the corpus partitioner runs");
+ABSL_FLAG(int, num_partitioning_iterations, 0,
+          "Deprecated and ignored. Snapshots are partitioned incrementally as "
+          "they are made.");
 
 ABSL_FLAG(int, parallelism, 0,
           "Number of parallel worker threads.  If it is 0, the simple fix tool "
@@ -46,6 +48,11 @@ ABSL_FLAG(bool, x86_filter_split_lock, true,
           "On x86, filter snaps with lock instructions accessing memory across "
           "cache line boundaries.");
 
+ABSL_FLAG(std::string, make_result_cache_dir, "",
+          "If not empty, a directory in which to cache make results across "
+          "runs.  Blobs made by earlier runs on the same platform with the "
+          "same binaries are not made again.");
+
 namespace silifuzz {
 namespace {
 
@@ -63,11 +70,15 @@ int SimpleFixToolMain(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
+  if (absl::GetFlag(FLAGS_num_partitioning_iterations) != 0) {
+    LOG(WARNING) << "--num_partitioning_iterations is deprecated and has no "
+                    "effect";
+  }
+
   SimpleFixToolOptions options;
-  options.num_partitioning_iterations =
-      absl::GetFlag(FLAGS_num_partitioning_iterations);
   options.parallelism = absl::GetFlag(FLAGS_parallelism);
   options.x86_filter_split_lock = absl::GetFlag(FLAGS_x86_filter_split_lock);
+  options.make_result_cache_dir = absl::GetFlag(FLAGS_make_result_cache_dir);
 
   fix_tool_internal::SimpleFixToolCounters counters;
   FixupCorpus(options, inputs, absl::GetFlag(FLAGS_output_path_prefix),
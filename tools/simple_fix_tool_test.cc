@@ -14,21 +14,31 @@
 
 #include "./tools/simple_fix_tool.h"
 
-#include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>  // NOLINT(build/c++17)
+#include <fstream>
+#include <iterator>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/cleanup/cleanup.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "external/centipede/blob_file.h"
+#include "./common/raw_insns_util.h"
+#include "./common/snapshot.h"
 #include "./snap/snap_relocator.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 #include "./util/checks.h"
@@ -38,8 +48,8 @@
 #include "./util/testing/status_matchers.h"
 
 using centipede::DefaultBlobFileAppenderFactory;
-using testing::SizeIs;
-using testing::UnorderedElementsAre;
+using testing::HasSubstr;
+using testing::Not;
 
 namespace silifuzz {
 
@@ -54,6 +64,17 @@ std::string GetNOP() {
 #endif
 }
 
+// Returns an undefined instruction, which the maker rejects.
+std::string GetUndefinedInstruction() {
+#if defined(__x86_64__)
+  return std::string("\x0f\x0b");  // UD2
+#elif defined(__aarch64__)
+  return std::string("\x00\x00\x00\x00", 4);  // UDF #0
+#else
+#error "Please define an undefined instruction for this arch"
+#endif
+}
+
 absl::StatusOr<std::string> CreateTempBlobFile(
     std::vector<std::string>& blobs) {
   auto filename_or = CreateTempFile("SimpleFixToolTest");
@@ -73,47 +94,92 @@ absl::StatusOr<std::string> CreateTempBlobFile(
   return filename;
 }
 
+// Returns blobs of NOP sequences of lengths 0 to `num_blobs` - 1. These get
+// different snapshot IDs.
+std::vector<std::string> NOPBlobs(int num_blobs) {
+  const std::string nop = GetNOP();
+  std::string insns;
+  std::vector<std::string> blobs;
+  for (int i = 0; i < num_blobs; ++i, insns += nop) {
+    blobs.push_back(insns);
+  }
+  return blobs;
+}
+
+std::string ShardFileName(absl::string_view output_path_prefix, int i) {
+  return absl::StrFormat("%s.%05d", output_path_prefix, i);
+}
+
+// Returns the contents of the relocatable corpus at `path` and the number of
+// snaps in it.
+absl::StatusOr<std::pair<std::string, int>> ReadShard(const std::string& path) {
+  std::ifstream is(path, std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(is)),
+                       std::istreambuf_iterator<char>());
+  if (is.bad() || contents.empty()) {
+    return absl::NotFoundError(absl::StrCat("cannot read ", path));
+  }
+  void* relocatable = mmap(nullptr, contents.size(), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (relocatable == MAP_FAILED) {
+    return absl::InternalError("mmap failed");
+  }
+  memcpy(relocatable, contents.data(), contents.size());
+  auto mapped = MakeMmappedMemoryPtr<char>(
+      reinterpret_cast<char*>(relocatable), contents.size());
+  SnapRelocator::Error error;
+  MmappedMemoryPtr<const SnapCorpus> corpus =
+      SnapRelocator::RelocateCorpus(std::move(mapped), &error);
+  if (error != SnapRelocator::Error::kOk) {
+    return absl::InternalError(absl::StrCat("cannot relocate ", path));
+  }
+  const int num_snaps = corpus->snaps.size;
+  return std::make_pair(std::move(contents), num_snaps);
+}
+
 }  // namespace
 
 namespace fix_tool_internal {
 namespace {
 
-// Test that we can read from multiple blob inputs and de-dupe.
-TEST(SimpleFixTool, ReadUniqueCentipedeBlobs) {
-  // Create 2 blobs file that contains duplicates.
-
-  std::vector<std::string> blobs_1{"one", "two"};
-  ASSERT_OK_AND_ASSIGN(std::string blob_file_1, CreateTempBlobFile(blobs_1));
-  absl::Cleanup delete_file_1 = absl::MakeCleanup(
-      [blob_file_1] { std::filesystem::remove(blob_file_1); });
-
-  std::vector<std::string> blobs_2{"two", "three", "three"};
-  ASSERT_OK_AND_ASSIGN(std::string blob_file_2, CreateTempBlobFile(blobs_2));
-  absl::Cleanup delete_file_2 = absl::MakeCleanup(
-      [blob_file_2] { std::filesystem::remove(blob_file_2); });
+// Test that snapshots are spread over groups without conflicts.
+TEST(SimpleFixTool, IncrementalPartitioner) {
+  const std::string nop = GetNOP();
+  std::vector<Snapshot> snapshots;
+  std::string insns = nop;
+  for (int i = 0; i < 8; ++i, insns += nop) {
+    ASSERT_OK_AND_ASSIGN(Snapshot snapshot,
+                         InstructionsToSnapshot<Host>(insns));
+    snapshot.set_id(InstructionsToSnapshotId(insns));
+    snapshots.push_back(std::move(snapshot));
+  }
 
-  const std::vector inputs{blob_file_1, blob_file_2};
-  SimpleFixToolCounters counters;
-  std::vector<std::string> blobs = ReadUniqueCentipedeBlobs(inputs, &counters);
-  EXPECT_THAT(blobs, SizeIs(3));
-  EXPECT_THAT(blobs, UnorderedElementsAre("one", "two", "three"));
-}
+  IncrementalPartitioner partitioner(2);
+  std::vector<int> groups;
+  for (const Snapshot& snapshot : snapshots) {
+    const std::optional<int> group = partitioner.Add(snapshot);
+    ASSERT_TRUE(group.has_value());
+    groups.push_back(*group);
+  }
+  EXPECT_EQ(partitioner.groups()[0].size() + partitioner.groups()[1].size(),
+            snapshots.size());
 
-// Test snapshot making.
-TEST(SimpleFixTool, MakeSnapshotsFromBlobs) {
-  // Create Blobs with NOP sequences of different lengths.
-  const std::string nop = GetNOP();
-  constexpr int kNumBlobs = 10;
-  std::string insns;
-  std::vector<std::string> blobs;
-  for (int i = 0; i < kNumBlobs; ++i, insns += nop) {
-    blobs.push_back(insns);
+  // Snapshots without conflicts go into the same groups regardless of the
+  // order in which they are added.
+  IncrementalPartitioner reverse_partitioner(2);
+  for (int i = snapshots.size() - 1; i >= 0; --i) {
+    EXPECT_EQ(reverse_partitioner.Add(snapshots[i]), groups[i]);
   }
 
-  SimpleFixToolCounters counters;
-  std::vector<Snapshot> made_snapshots =
-      MakeSnapshotsFromBlobs({}, blobs, &counters);
-  EXPECT_THAT(made_snapshots, SizeIs(kNumBlobs));
+  // A copy of a snapshot conflicts with the original, so it goes into the
+  // other group. Another copy conflicts with both.
+  Snapshot copy = snapshots[0].Copy();
+  copy.set_id("copy");
+  const std::optional<int> copy_group = partitioner.Add(copy);
+  ASSERT_TRUE(copy_group.has_value());
+  EXPECT_NE(*copy_group, groups[0]);
+  copy.set_id("another copy");
+  EXPECT_FALSE(partitioner.Add(copy).has_value());
 }
 
 }  // namespace
@@ -126,7 +192,6 @@ TEST(SimpleFixTool, FixCorpus) {
   constexpr int kNumBlobFiles = 3;
   constexpr int kNumBlobsPerFile = 4;
 
-  std::string insns;
   std::vector<std::string> blob_files;
   absl::Cleanup remove_blob_files = absl::MakeCleanup([&blob_files] {
     for (const auto& blob_file : blob_files) {
@@ -134,60 +199,145 @@ TEST(SimpleFixTool, FixCorpus) {
     }
   });
 
-  // Generate NOP sequences of different lengths. These will get different
-  // snapshot IDs.
-  const std::string nop = GetNOP();
+  // Spread NOP sequences of different lengths over the files.
+  const std::vector<std::string> all_blobs =
+      NOPBlobs(kNumBlobFiles * kNumBlobsPerFile);
   for (int i = 0; i < kNumBlobFiles; ++i) {
-    std::vector<std::string> blobs;
-    for (int j = 0; j < kNumBlobsPerFile; ++j, insns += nop) {
-      blobs.push_back(insns);
-    }
+    std::vector<std::string> blobs(
+        all_blobs.begin() + i * kNumBlobsPerFile,
+        all_blobs.begin() + (i + 1) * kNumBlobsPerFile);
     ASSERT_OK_AND_ASSIGN(auto blob_file, CreateTempBlobFile(blobs));
     blob_files.push_back(blob_file);
   }
 
-  absl::string_view tmpdir = Dirname(blob_files[0]);
+  const std::string tmpdir(Dirname(blob_files[0]));
   const std::string output_path_prefix =
       absl::StrCat(tmpdir, "/simple_fix_tool_test-", getpid());
   constexpr int kNumShards = 4;
-  fix_tool_internal::SimpleFixToolCounters counters;
-  FixupCorpus({}, blob_files, output_path_prefix, kNumShards, &counters);
+  absl::Cleanup delete_output_files = absl::MakeCleanup([&output_path_prefix] {
+    for (int i = 0; i < kNumShards; ++i) {
+      std::filesystem::remove(ShardFileName(output_path_prefix, i));
+    }
+  });
 
-  auto shard_file_name = [&output_path_prefix](int i) {
-    return absl::StrFormat("%s.%05d", output_path_prefix, i);
-  };
+  // Fix the corpus twice to check that the output does not depend on the
+  // order in which the snapshots are made.
+  std::vector<std::string> first_shards;
+  for (int run = 0; run < 2; ++run) {
+    SimpleFixToolOptions options;
+    options.parallelism = run == 0 ? 1 : 4;
+    fix_tool_internal::SimpleFixToolCounters counters;
+    FixupCorpus(options, blob_files, output_path_prefix, kNumShards,
+                &counters);
 
-  absl::Cleanup delete_output_files = absl::MakeCleanup([&shard_file_name] {
+    // Snapshots are NOP sequences of different lengths. There should not be
+    // any memory conflicts. We expect them to be all present in the final
+    // relocatable corpus.
+    int num_snaps = 0;
     for (int i = 0; i < kNumShards; ++i) {
-      std::filesystem::remove(shard_file_name(i));
+      ASSERT_OK_AND_ASSIGN(auto shard,
+                           ReadShard(ShardFileName(output_path_prefix, i)));
+      num_snaps += shard.second;
+      if (run == 0) {
+        first_shards.push_back(std::move(shard.first));
+      } else {
+        EXPECT_EQ(shard.first, first_shards[i]) << "shard " << i;
+      }
     }
-  });
+    EXPECT_EQ(num_snaps, kNumBlobFiles * kNumBlobsPerFile);
+  }
 
-  // Read relocatable corpus
-  int num_snaps = 0;
-  for (int i = 0; i < kNumShards; ++i) {
-    int fd = open(shard_file_name(i).c_str(), O_RDONLY);
-    ASSERT_NE(fd, -1);
-    off_t file_size = std::filesystem::file_size(shard_file_name(i));
-    ASSERT_NE(file_size, -1);
-    void* relocatable =
-        mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-    ASSERT_NE(relocatable, MAP_FAILED);
-    auto mapped = MakeMmappedMemoryPtr<char>(
-        reinterpret_cast<char*>(relocatable), file_size);
-    EXPECT_EQ(close(fd), 0);
-    SnapRelocator::Error error;
-    MmappedMemoryPtr<const SnapCorpus> corpus =
-        SnapRelocator::RelocateCorpus(std::move(mapped), &error);
-    ASSERT_TRUE(error == SnapRelocator::Error::kOk);
-    num_snaps += corpus->snaps.size;
+  // Spill files are unlinked as soon as they are created.
+  for (const auto& entry : std::filesystem::directory_iterator(tmpdir)) {
+    const std::string path = entry.path().string();
+    if (absl::StartsWith(path, output_path_prefix)) {
+      EXPECT_THAT(path, Not(HasSubstr(".spill")));
+    }
   }
+}
 
-  // Snapshots are NOP sequences of different lengths.  There should not be any
-  // memory conflicts. We expect them to be all present in the final relocatable
-  // corpus.
-  EXPECT_EQ(num_snaps, kNumBlobFiles * kNumBlobsPerFile);
+// Test that duplicate blobs within and across input files are made once.
+TEST(SimpleFixTool, FixCorpusDeduplicatesBlobs) {
+  const std::vector<std::string> blobs = NOPBlobs(3);
+  std::vector<std::string> blobs_1{blobs[0], blobs[1]};
+  ASSERT_OK_AND_ASSIGN(std::string blob_file_1, CreateTempBlobFile(blobs_1));
+  absl::Cleanup delete_file_1 = absl::MakeCleanup(
+      [blob_file_1] { std::filesystem::remove(blob_file_1); });
+
+  std::vector<std::string> blobs_2{blobs[1], blobs[2], blobs[2]};
+  ASSERT_OK_AND_ASSIGN(std::string blob_file_2, CreateTempBlobFile(blobs_2));
+  absl::Cleanup delete_file_2 = absl::MakeCleanup(
+      [blob_file_2] { std::filesystem::remove(blob_file_2); });
+
+  const std::string output_path_prefix = absl::StrCat(
+      Dirname(blob_file_1), "/simple_fix_tool_dedup_test-", getpid());
+  absl::Cleanup delete_output_file = absl::MakeCleanup(
+      [&output_path_prefix] {
+        std::filesystem::remove(ShardFileName(output_path_prefix, 0));
+      });
+  fix_tool_internal::SimpleFixToolCounters counters;
+  FixupCorpus({}, {blob_file_1, blob_file_2}, output_path_prefix, 1,
+              &counters);
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-Read:duplicate-blobs"), 2);
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-FixToolWorker:success"), 3);
+  ASSERT_OK_AND_ASSIGN(auto shard,
+                       ReadShard(ShardFileName(output_path_prefix, 0)));
+  EXPECT_EQ(shard.second, 3);
+}
+
+// Test that a second run reuses the make results of the first one and counts
+// them like the first run did.
+TEST(SimpleFixTool, FixCorpusWithCache) {
+  constexpr int kNumBlobs = 5;
+  std::vector<std::string> blobs = NOPBlobs(kNumBlobs - 1);
+  blobs.push_back(GetUndefinedInstruction());
+  ASSERT_OK_AND_ASSIGN(std::string blob_file, CreateTempBlobFile(blobs));
+  absl::Cleanup delete_file =
+      absl::MakeCleanup([blob_file] { std::filesystem::remove(blob_file); });
+
+  const std::string output_path_prefix = absl::StrCat(
+      Dirname(blob_file), "/simple_fix_tool_cache_test-", getpid());
+  absl::Cleanup delete_output_file = absl::MakeCleanup(
+      [&output_path_prefix] {
+        std::filesystem::remove(ShardFileName(output_path_prefix, 0));
+      });
+  SimpleFixToolOptions options;
+  options.make_result_cache_dir =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/FixCorpusWithCache");
+
+  fix_tool_internal::SimpleFixToolCounters first_counters;
+  FixupCorpus(options, {blob_file}, output_path_prefix, 1, &first_counters);
+  EXPECT_EQ(first_counters.GetValue("silifuzz-INFO-MakeResultCache:miss"),
+            kNumBlobs);
+  EXPECT_EQ(first_counters.GetValue("silifuzz-INFO-FixToolWorker:success"),
+            kNumBlobs - 1);
+  ASSERT_OK_AND_ASSIGN(auto first_shard,
+                       ReadShard(ShardFileName(output_path_prefix, 0)));
+  EXPECT_EQ(first_shard.second, kNumBlobs - 1);
+
+  fix_tool_internal::SimpleFixToolCounters second_counters;
+  FixupCorpus(options, {blob_file}, output_path_prefix, 1, &second_counters);
+  EXPECT_EQ(second_counters.GetValue("silifuzz-INFO-MakeResultCache:hit"),
+            kNumBlobs);
+  EXPECT_EQ(second_counters.GetValue("silifuzz-INFO-MakeResultCache:miss"), 0);
+  ASSERT_OK_AND_ASSIGN(auto second_shard,
+                       ReadShard(ShardFileName(output_path_prefix, 0)));
+  EXPECT_EQ(second_shard.first, first_shard.first);
+
+  // Apart from the cache counters, including the per-reason rejection
+  // counters, both runs count the same.
+  std::vector<std::string> counter_names = first_counters.GetCounterNames();
+  for (const std::string& name : second_counters.GetCounterNames()) {
+    counter_names.push_back(name);
+  }
+  for (const std::string& name : counter_names) {
+    if (!absl::StartsWith(name, "silifuzz-INFO-MakeResultCache:")) {
+      EXPECT_EQ(second_counters.GetValue(name), first_counters.GetValue(name))
+          << name;
+    }
+  }
 }
+
 }  // namespace
 
 }  // namespace silifuzz
@@ -0,0 +1,161 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/cache_entry.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./util/byte_io.h"
+#include "./util/checksum.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Header at the start of each cache entry, followed by the payload.
+struct EntryHeader {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t payload_size;
+  uint64_t payload_checksum;
+};
+
+// Syncs the directory containing `path`.
+absl::Status SyncParentDirectory(const std::string& path) {
+  const size_t slash = path.rfind('/');
+  std::string dir = ".";
+  if (slash != std::string::npos) {
+    // Keep the slash of the root directory.
+    dir = path.substr(0, std::max<size_t>(slash, 1));
+  }
+  const int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", dir, ")"));
+  }
+  absl::Cleanup dir_closer = [dir_fd] { close(dir_fd); };
+  if (fsync(dir_fd) != 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("fsync(", dir, ")"));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status MakeCacheDirectory(absl::string_view path) {
+  const std::string path_str(path);
+  if (mkdir(path_str.c_str(), 0755) != 0 && errno != EEXIST) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("mkdir(", path, ")"));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WriteFileAtomically(absl::string_view path, const void* data,
+                                 size_t size) {
+  std::string temp_path = absl::StrCat(path, ".XXXXXX");
+  const int temp_fd = mkstemp(temp_path.data());
+  if (temp_fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("mkstemp(", path, ")"));
+  }
+  bool renamed = false;
+  absl::Cleanup temp_cleaner = [temp_fd, &temp_path, &renamed] {
+    close(temp_fd);
+    if (!renamed) unlink(temp_path.c_str());
+  };
+  if (Write(temp_fd, data, size) != static_cast<ssize_t>(size)) {
+    return absl::ErrnoToStatus(errno, "write()");
+  }
+  if (fchmod(temp_fd, 0644) != 0) {
+    return absl::ErrnoToStatus(errno, "fchmod()");
+  }
+  // Sync the data before the rename, so that a crash cannot leave a renamed
+  // but empty or partial file.
+  if (fsync(temp_fd) != 0) {
+    return absl::ErrnoToStatus(errno, "fsync()");
+  }
+  const std::string path_str(path);
+  if (rename(temp_path.c_str(), path_str.c_str()) != 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("rename(", path, ")"));
+  }
+  renamed = true;
+  // Sync the directory, so that the rename is durable before any file
+  // written after this one, e.g. metadata describing this file.
+  return SyncParentDirectory(path_str);
+}
+
+absl::Status WriteCacheEntry(absl::string_view path, uint64_t magic,
+                             uint64_t version, absl::string_view payload) {
+  const EntryHeader header = {
+      .magic = magic,
+      .version = version,
+      .payload_size = payload.size(),
+      .payload_checksum = ComputeMemoryChecksum(payload.data(), payload.size()),
+  };
+  std::string entry(reinterpret_cast<const char*>(&header), sizeof(header));
+  entry.append(payload.data(), payload.size());
+  return WriteFileAtomically(path, entry.data(), entry.size());
+}
+
+absl::StatusOr<std::string> ReadCacheEntry(absl::string_view path,
+                                           uint64_t magic, uint64_t version) {
+  const std::string path_str(path);
+  const int fd = open(path_str.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  absl::Cleanup fd_closer = [fd] { close(fd); };
+
+  struct stat stat_buf;
+  std::string entry;
+  if (fstat(fd, &stat_buf) == 0) {
+    entry.resize(stat_buf.st_size);
+    if (Read(fd, entry.data(), entry.size()) !=
+        static_cast<ssize_t>(entry.size())) {
+      entry.clear();
+    }
+  }
+
+  EntryHeader header;
+  bool valid = entry.size() >= sizeof(header);
+  if (valid) {
+    memcpy(&header, entry.data(), sizeof(header));
+    valid = header.magic == magic && header.version == version &&
+            header.payload_size == entry.size() - sizeof(header) &&
+            ComputeMemoryChecksum(entry.data() + sizeof(header),
+                                  header.payload_size) ==
+                header.payload_checksum;
+  }
+  if (!valid) {
+    // Remove the entry so that it gets written again.
+    unlink(path_str.c_str());
+    return absl::DataLossError(absl::StrCat("Invalid cache entry ", path));
+  }
+  return entry.substr(sizeof(header));
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,59 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_CACHE_ENTRY_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_CACHE_ENTRY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace silifuzz {
+
+// Helpers for on-disk caches shared by concurrent processes, like CorpusCache
+// and MakeResultCache.
+
+// Creates directory `path` unless it exists.
+absl::Status MakeCacheDirectory(absl::string_view path);
+
+// Writes `size` bytes at `data` to file `path`, replacing any existing file.
+// The data is written to a temp file in the same directory, which is renamed
+// into place, so readers and concurrent writers never see a partial file
+// under `path`. The file and the directory are synced, so the new file is
+// durable when this returns, even if the system crashes.
+absl::Status WriteFileAtomically(absl::string_view path, const void* data,
+                                 size_t size);
+
+// Writes `payload` as the cache entry at `path`, replacing any existing
+// entry. The entry is written atomically as by WriteFileAtomically(), with a
+// header holding `magic`, `version`, the payload size and a checksum of the
+// payload.
+absl::Status WriteCacheEntry(absl::string_view path, uint64_t magic,
+                             uint64_t version, absl::string_view payload);
+
+// Returns the payload of the cache entry at `path` written by
+// WriteCacheEntry() with `magic` and `version`.
+//
+// RETURNS NotFoundError if there is no entry or DataLossError if the entry is
+// invalid, e.g. truncated or of another version, in which case it is removed.
+absl::StatusOr<std::string> ReadCacheEntry(absl::string_view path,
+                                           uint64_t magic, uint64_t version);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_CACHE_ENTRY_H_
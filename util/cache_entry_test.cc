@@ -0,0 +1,101 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/cache_entry.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+
+namespace silifuzz {
+namespace {
+
+using silifuzz::testing::IsOkAndHolds;
+using silifuzz::testing::StatusIs;
+
+constexpr uint64_t kMagic = 0x1234;
+
+std::string TempPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(CacheEntry, ReadWrite) {
+  const std::string path = TempPath("ReadWrite");
+  EXPECT_THAT(ReadCacheEntry(path, kMagic, 1),
+              StatusIs(absl::StatusCode::kNotFound));
+
+  ASSERT_OK(WriteCacheEntry(path, kMagic, 1, "payload"));
+  EXPECT_THAT(ReadCacheEntry(path, kMagic, 1), IsOkAndHolds("payload"));
+
+  // Entries can be replaced, also with an empty payload.
+  ASSERT_OK(WriteCacheEntry(path, kMagic, 1, ""));
+  EXPECT_THAT(ReadCacheEntry(path, kMagic, 1), IsOkAndHolds(""));
+}
+
+TEST(CacheEntry, InvalidEntry) {
+  const std::string path = TempPath("InvalidEntry");
+
+  // Entries of other versions are invalid and removed.
+  ASSERT_OK(WriteCacheEntry(path, kMagic, 1, "payload"));
+  EXPECT_THAT(ReadCacheEntry(path, kMagic, 2),
+              StatusIs(absl::StatusCode::kDataLoss));
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+
+  // Corrupt the payload.
+  ASSERT_OK(WriteCacheEntry(path, kMagic, 1, "payload"));
+  const int fd = open(path.c_str(), O_WRONLY);
+  ASSERT_NE(fd, -1);
+  struct stat stat_buf;
+  ASSERT_EQ(fstat(fd, &stat_buf), 0);
+  ASSERT_EQ(pwrite(fd, "X", 1, stat_buf.st_size - 1), 1);
+  close(fd);
+  EXPECT_THAT(ReadCacheEntry(path, kMagic, 1),
+              StatusIs(absl::StatusCode::kDataLoss));
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+
+  // Truncated entries are invalid too.
+  ASSERT_OK(WriteCacheEntry(path, kMagic, 1, "payload"));
+  ASSERT_EQ(truncate(path.c_str(), 8), 0);
+  EXPECT_THAT(ReadCacheEntry(path, kMagic, 1),
+              StatusIs(absl::StatusCode::kDataLoss));
+}
+
+TEST(CacheEntry, WriteFileAtomically) {
+  const std::string dir = TempPath("WriteFileAtomically");
+  ASSERT_OK(MakeCacheDirectory(dir));
+  ASSERT_OK(MakeCacheDirectory(dir));
+  const std::string path = absl::StrCat(dir, "/file");
+  ASSERT_OK(WriteFileAtomically(path, "data", 4));
+  struct stat stat_buf;
+  ASSERT_EQ(stat(path.c_str(), &stat_buf), 0);
+  EXPECT_EQ(stat_buf.st_size, 4);
+
+  // Writes into a missing directory fail without leaving files behind.
+  EXPECT_THAT(WriteFileAtomically(absl::StrCat(dir, "/missing/file"), "", 0),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -0,0 +1,159 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/checksum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace silifuzz {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Loads a little-endian value from a possibly unaligned address.
+// All supported architectures are little-endian.
+inline uint64_t Load64(const uint8_t* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline uint32_t Load32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = RotateLeft(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t value) {
+  acc ^= Round(0, value);
+  return acc * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+MemoryChecksum::MemoryChecksum(uint64_t seed)
+    : seed_(seed),
+      total_size_(0),
+      acc_{seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1},
+      buffer_size_(0) {}
+
+void MemoryChecksum::ConsumeStripe(const uint8_t* data) {
+  acc_[0] = Round(acc_[0], Load64(data));
+  acc_[1] = Round(acc_[1], Load64(data + 8));
+  acc_[2] = Round(acc_[2], Load64(data + 16));
+  acc_[3] = Round(acc_[3], Load64(data + 24));
+}
+
+void MemoryChecksum::AddData(const void* data, size_t size) {
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data);
+  total_size_ += size;
+
+  // Complete any partial stripe left over from the previous call.
+  if (buffer_size_ != 0) {
+    const size_t fill = kStripeSize - buffer_size_;
+    if (size < fill) {
+      memcpy(buffer_ + buffer_size_, ptr, size);
+      buffer_size_ += size;
+      return;
+    }
+    memcpy(buffer_ + buffer_size_, ptr, fill);
+    ConsumeStripe(buffer_);
+    buffer_size_ = 0;
+    ptr += fill;
+    size -= fill;
+  }
+
+  for (; size >= kStripeSize; ptr += kStripeSize, size -= kStripeSize) {
+    ConsumeStripe(ptr);
+  }
+
+  memcpy(buffer_, ptr, size);
+  buffer_size_ = size;
+}
+
+void MemoryChecksum::AddRepeatedByte(uint8_t value, size_t size) {
+  uint8_t stripe[kStripeSize];
+  memset(stripe, value, sizeof(stripe));
+  while (size > 0) {
+    const size_t chunk_size = size < kStripeSize ? size : kStripeSize;
+    AddData(stripe, chunk_size);
+    size -= chunk_size;
+  }
+}
+
+uint64_t MemoryChecksum::Value() const {
+  uint64_t hash;
+  if (total_size_ >= kStripeSize) {
+    hash = RotateLeft(acc_[0], 1) + RotateLeft(acc_[1], 7) +
+           RotateLeft(acc_[2], 12) + RotateLeft(acc_[3], 18);
+    for (uint64_t acc : acc_) {
+      hash = MergeRound(hash, acc);
+    }
+  } else {
+    hash = seed_ + kPrime5;
+  }
+  hash += total_size_;
+
+  // Mix in the bytes of the incomplete stripe.
+  const uint8_t* ptr = buffer_;
+  size_t size = buffer_size_;
+  for (; size >= sizeof(uint64_t); ptr += sizeof(uint64_t),
+                                   size -= sizeof(uint64_t)) {
+    hash ^= Round(0, Load64(ptr));
+    hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (size >= sizeof(uint32_t)) {
+    hash ^= static_cast<uint64_t>(Load32(ptr)) * kPrime1;
+    hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+    ptr += sizeof(uint32_t);
+    size -= sizeof(uint32_t);
+  }
+  for (; size > 0; ++ptr, --size) {
+    hash ^= static_cast<uint64_t>(*ptr) * kPrime5;
+    hash = RotateLeft(hash, 11) * kPrime1;
+  }
+
+  // Final avalanche.
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+uint64_t ComputeMemoryChecksum(const void* data, size_t size, uint64_t seed) {
+  MemoryChecksum checksum(seed);
+  checksum.AddData(data, size);
+  return checksum.Value();
+}
+
+}  // namespace silifuzz
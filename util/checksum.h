@@ -0,0 +1,81 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_CHECKSUM_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_CHECKSUM_H_
+#include <cstddef>
+#include <cstdint>
+
+namespace silifuzz {
+
+// Computes a 64-bit non-cryptographic checksum of a byte stream. The result is
+// identical to XXH64 with the same seed. The byte stream can be fed in
+// arbitrarily sized pieces; the result only depends on the concatenation of
+// all the pieces.
+//
+// Like mem_util, this is compiled into integer code only on x86_64 so that
+// it does not perturb the floating point/vector unit between snapshot
+// executions. The four independent accumulators allow the CPU to overlap
+// multiplications without SIMD instructions.
+//
+// This class is thread-compatible.
+class MemoryChecksum {
+ public:
+  explicit MemoryChecksum(uint64_t seed = 0);
+  ~MemoryChecksum() = default;
+
+  // Copyable and movable by default.
+  MemoryChecksum(const MemoryChecksum&) = default;
+  MemoryChecksum& operator=(const MemoryChecksum&) = default;
+  MemoryChecksum(MemoryChecksum&&) = default;
+  MemoryChecksum& operator=(MemoryChecksum&&) = default;
+
+  // Adds `size` bytes at `data` to the byte stream.
+  void AddData(const void* data, size_t size);
+
+  // Adds `size` copies of byte `value` to the byte stream.
+  void AddRepeatedByte(uint8_t value, size_t size);
+
+  // Returns the checksum of all bytes added so far. This does not change the
+  // state and more bytes can be added afterwards.
+  uint64_t Value() const;
+
+ private:
+  // Number of bytes consumed by one round of the four accumulators.
+  static constexpr size_t kStripeSize = 4 * sizeof(uint64_t);
+
+  // Consumes one stripe of kStripeSize bytes at `data`.
+  void ConsumeStripe(const uint8_t* data);
+
+  // Seed value passed to the constructor.
+  uint64_t seed_;
+
+  // Total number of bytes added.
+  uint64_t total_size_;
+
+  // Accumulators.
+  uint64_t acc_[4];
+
+  // Bytes of an incomplete stripe, waiting for more data.
+  uint8_t buffer_[kStripeSize];
+  size_t buffer_size_;
+};
+
+// Convenience function. Returns the checksum of `size` bytes at `data`.
+uint64_t ComputeMemoryChecksum(const void* data, size_t size,
+                               uint64_t seed = 0);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_CHECKSUM_H_
@@ -0,0 +1,92 @@
+// Copyright 2022 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/checksum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+
+// ========================================================================= //
+
+namespace silifuzz {
+namespace {
+
+TEST(MemoryChecksum, KnownValues) {
+  // Reference values of XXH64 with seed 0.
+  CHECK_EQ(ComputeMemoryChecksum("", 0), 0xef46db3751d8e999ULL);
+  CHECK_EQ(ComputeMemoryChecksum("a", 1), 0xd24ec4f1a98c6e5bULL);
+  CHECK_EQ(ComputeMemoryChecksum("abc", 3), 0x44bc2cf5ad770999ULL);
+  const char kLongString[] = "Nobody inspects the spammish repetition";
+  CHECK_EQ(ComputeMemoryChecksum(kLongString, strlen(kLongString)),
+           0xfbcea83c8a378bf1ULL);
+}
+
+TEST(MemoryChecksum, PiecewiseAddData) {
+  constexpr size_t kDataSize = 1000;
+  uint8_t data[kDataSize];
+  for (size_t i = 0; i < kDataSize; ++i) {
+    data[i] = static_cast<uint8_t>(i * 7);
+  }
+  const uint64_t expected = ComputeMemoryChecksum(data, kDataSize);
+
+  // Result must not depend on how the data are split.
+  for (size_t piece_size = 1; piece_size < 70; ++piece_size) {
+    MemoryChecksum checksum;
+    for (size_t i = 0; i < kDataSize; i += piece_size) {
+      const size_t size =
+          piece_size < kDataSize - i ? piece_size : kDataSize - i;
+      checksum.AddData(data + i, size);
+    }
+    CHECK_EQ(checksum.Value(), expected);
+  }
+}
+
+TEST(MemoryChecksum, AddRepeatedByte) {
+  constexpr size_t kDataSize = 100;
+  uint8_t data[kDataSize];
+  memset(data, 0x5a, kDataSize);
+
+  MemoryChecksum checksum;
+  checksum.AddData(data, 3);
+  checksum.AddRepeatedByte(0x5a, kDataSize - 3);
+  CHECK_EQ(checksum.Value(), ComputeMemoryChecksum(data, kDataSize));
+}
+
+TEST(MemoryChecksum, DetectsChange) {
+  constexpr size_t kDataSize = 64;
+  uint8_t data[kDataSize];
+  memset(data, 0, kDataSize);
+  const uint64_t original = ComputeMemoryChecksum(data, kDataSize);
+  for (size_t i = 0; i < kDataSize; ++i) {
+    data[i] ^= 1;
+    CHECK_NE(ComputeMemoryChecksum(data, kDataSize), original);
+    data[i] ^= 1;
+  }
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+// ========================================================================= //
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(MemoryChecksum, KnownValues);
+  RUN_TEST(MemoryChecksum, PiecewiseAddData);
+  RUN_TEST(MemoryChecksum, AddRepeatedByte);
+  RUN_TEST(MemoryChecksum, DetectsChange);
+})
@@ -40,7 +40,7 @@ ABSL_CONST_INIT absl::once_flag global_init_once_;
 }  // namespace
 
 Subprocess::Subprocess(const Options& options)
-    : child_pid_(-1), child_stdout_(-1), options_(options) {
+    : child_pid_(-1), child_stdout_(-1), child_stdin_(-1), options_(options) {
   absl::call_once(global_init_once_, GlobalInit);
 }
 
@@ -48,6 +48,14 @@ Subprocess::~Subprocess() {
   if (child_stdout_ != -1) {
     close(child_stdout_);
   }
+  CloseStdin();
+}
+
+void Subprocess::CloseStdin() {
+  if (child_stdin_ != -1) {
+    close(child_stdin_);
+    child_stdin_ = -1;
+  }
 }
 
 absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
@@ -55,9 +63,15 @@ absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
   // Note that we assume that there are no other threads, thus we don't have to
   // do crazy stuff like using socket pairs or avoiding libc locks.
 
-  // [0] is read end, [1] is write end.
+  // [0] is read end, [1] is write end. Both ends are close-on-exec so that
+  // they do not leak into other children started concurrently, which would
+  // delay EOF. dup2() below clears the flag on the child's copies.
   int stdout_pipe[2] = {-1, -1};
-  CHECK_NE(pipe(stdout_pipe), -1);
+  CHECK_NE(pipe2(stdout_pipe, O_CLOEXEC), -1);
+  int stdin_pipe[2] = {-1, -1};
+  if (options_.pipe_stdin_) {
+    CHECK_NE(pipe2(stdin_pipe, O_CLOEXEC), -1);
+  }
 
   auto argv_exec = std::make_unique<const char*[]>(argv.size() + 1);
   for (int argc = 0; argc < argv.size(); ++argc) {
@@ -88,6 +102,9 @@ absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
       CHECK_EQ(prctl(PR_SET_PDEATHSIG, options_.parent_death_signal_), 0);
     }
     dup2(stdout_pipe[1], STDOUT_FILENO);
+    if (options_.pipe_stdin_) {
+      dup2(stdin_pipe[0], STDIN_FILENO);
+    }
     switch (options_.map_stderr_) {
       case kNoMapping:
         // Same stderr as the parent.
@@ -126,6 +143,10 @@ absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
     // Parent
     close(stdout_pipe[1]);
     child_stdout_ = stdout_pipe[0];
+    if (options_.pipe_stdin_) {
+      close(stdin_pipe[0]);
+      child_stdin_ = stdin_pipe[1];
+    }
     return absl::OkStatus();
   }
 }
@@ -134,6 +155,7 @@ int Subprocess::Communicate(std::string* stdout_output) {
   if (child_pid_ == -1 || child_stdout_ == -1) {
     LOG_FATAL("Must call Start() first.");
   }
+  CloseStdin();
 
   while (true) {
     char buffer[4096] = {0};
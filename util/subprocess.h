@@ -81,6 +81,13 @@ class Subprocess {
       return *this;
     }
 
+    // If true, the child's stdin is a pipe that the parent can write to
+    // through stdin_fd(). Otherwise, the child inherits the parent's stdin.
+    Options& PipeStdin(bool v) {
+      pipe_stdin_ = v;
+      return *this;
+    }
+
    private:
     friend class Subprocess;  // for rlimit_tuples_ and itimer_vals_ access.
 
@@ -95,6 +102,9 @@ class Subprocess {
     // process dies.
     int parent_death_signal_ = 0;
 
+    // Connect the child's stdin to a pipe.
+    bool pipe_stdin_ = false;
+
     // Represents setrlimit(2) args.
     struct RLimitTuple {
       int resource = 0;
@@ -128,12 +138,25 @@ class Subprocess {
   absl::Status Start(const std::vector<std::string>& argv);
 
   // Consumes the stdout of the process and waits for it to exit.
-  // Returns the process exit status.
+  // Returns the process exit status. Closes stdin_fd() first if it is open.
   int Communicate(std::string* stdout_output);
 
   // Returns the child process PID or -1 when no process is running.
   pid_t pid() const { return child_pid_; }
 
+  // Returns the parent's end of the child's stdin pipe or -1 if there is none.
+  // See Options::PipeStdin().
+  int stdin_fd() const { return child_stdin_; }
+
+  // Returns the parent's end of the child's stdout pipe or -1 if there is
+  // none. This allows the parent to consume stdout incrementally before
+  // calling Communicate().
+  int stdout_fd() const { return child_stdout_; }
+
+  // Closes the parent's end of the child's stdin pipe, which makes the child
+  // see EOF on stdin.
+  void CloseStdin();
+
  private:
   static void GlobalInit();
   // PID of the child process.
@@ -142,6 +165,9 @@ class Subprocess {
   // File descriptor for our end of the child's stdout pipe.
   int child_stdout_;
 
+  // File descriptor for our end of the child's stdin pipe.
+  int child_stdin_;
+
   // C-tor parameter.
   Options options_;
 };
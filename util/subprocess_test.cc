@@ -15,6 +15,7 @@
 #include "./util/subprocess.h"
 
 #include <sys/resource.h>
+#include <unistd.h>
 
 #include <cstdlib>
 #include <thread>  // NOLINT
@@ -76,6 +77,20 @@ TEST(Subprocess, StderrMapToDevNull) {
   EXPECT_THAT(stdout, IsEmpty());
 }
 
+TEST(Subprocess, PipeStdin) {
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.PipeStdin(true);
+  Subprocess sp(opts);
+  ASSERT_OK(sp.Start({"/bin/cat"}));
+  ASSERT_NE(sp.stdin_fd(), -1);
+  ASSERT_EQ(write(sp.stdin_fd(), "stdin", 5), 5);
+  // Communicate() closes stdin so that cat sees EOF.
+  std::string stdout;
+  EXPECT_EQ(sp.Communicate(&stdout), 0);
+  EXPECT_EQ(stdout, "stdin");
+  EXPECT_EQ(sp.stdin_fd(), -1);
+}
+
 TEST(Subprocess, NoExecutable) {
   Subprocess::Options opts = Subprocess::Options::Default();
   opts.MapStderr(Subprocess::kMapToStdout);
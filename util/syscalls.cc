@@ -24,6 +24,8 @@
 #include <sys/prctl.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cstdint>
@@ -32,8 +34,24 @@
 
 extern "C" {
 
+int clock_gettime(clockid_t clockid, struct timespec *tp) {
+  static_assert(sizeof(struct kernel_timespec) == sizeof(struct timespec));
+  return sys_clock_gettime(clockid,
+                           reinterpret_cast<struct kernel_timespec *>(tp));
+}
+
 int close(int fd) { return sys_close(fd); }
 
+// Not all architectures have dup2(2), so this uses dup3(2), which fails
+// instead of doing nothing when both descriptors are the same.
+int dup2(int oldfd, int newfd) {
+  if (oldfd == newfd) {
+    // dup2() only checks that `oldfd` is valid in this case.
+    return sys_fcntl(oldfd, F_GETFD, 0) == -1 ? -1 : newfd;
+  }
+  return sys_dup3(oldfd, newfd, 0);
+}
+
 // _exit() calls sys_exit_group() instead of sys_exit(). sys_exit() just
 // terminates the current thread where as sys_exit_group() terminates the thread
 // group of the current process. This is what a user expects when calling
@@ -43,6 +61,8 @@ void _exit(int status) {
   __builtin_unreachable();
 }
 
+pid_t fork(void) { return sys_fork(); }
+
 gid_t getegid(void) { return sys_getegid(); }
 
 uid_t geteuid(void) { return sys_geteuid(); }
@@ -108,6 +128,10 @@ int sigaltstack(const stack_t *ss, stack_t *old_ss) {
   return sys_sigaltstack(ss, old_ss);
 }
 
+pid_t waitpid(pid_t pid, int *wstatus, int options) {
+  return sys_wait4(pid, wstatus, options, nullptr);
+}
+
 ssize_t write(int fd, const void *buf, size_t count) {
   return sys_write(fd, buf, count);
 }
@@ -20,6 +20,8 @@
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cerrno>
@@ -77,6 +79,18 @@ class TempFilePath {
 // In all tests below, use linux_syscall_support functions direct for unless
 // it is for the syscall being tested.
 
+TEST(Syscalls, clock_gettime) {
+  struct timespec before, after;
+  errno = 0;
+  CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &before), 0);
+  CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &after), 0);
+  CHECK_EQ(errno, 0);
+  CHECK(after.tv_sec > before.tv_sec ||
+        (after.tv_sec == before.tv_sec && after.tv_nsec >= before.tv_nsec));
+  CHECK_EQ(clock_gettime(-1, &before), -1);
+  CHECK_EQ(errno, EINVAL);
+}
+
 TEST(Syscalls, close) {
   int fd = sys_open("/dev/zero", O_RDONLY, 0);
   CHECK_NE(fd, -1);
@@ -86,6 +100,41 @@ TEST(Syscalls, close) {
   CHECK_EQ(errno, 0);
 }
 
+TEST(Syscalls, dup2) {
+  int fd = sys_open("/dev/zero", O_RDONLY, 0);
+  CHECK_NE(fd, -1);
+  int newfd = sys_open("/dev/null", O_RDONLY, 0);
+  CHECK_NE(newfd, -1);
+  errno = 0;
+  CHECK_EQ(dup2(fd, newfd), newfd);
+  CHECK_EQ(errno, 0);
+  // `newfd` now reads from /dev/zero.
+  char c = 1;
+  CHECK_EQ(sys_read(newfd, &c, 1), 1);
+  CHECK_EQ(c, 0);
+
+  // Duplicating a descriptor onto itself does nothing.
+  CHECK_EQ(dup2(fd, fd), fd);
+  CHECK_EQ(sys_close(newfd), 0);
+  CHECK_EQ(dup2(newfd, newfd), -1);
+  CHECK_EQ(errno, EBADF);
+  CHECK_EQ(sys_close(fd), 0);
+}
+
+TEST(Syscalls, fork) {
+  errno = 0;
+  pid_t pid = fork();
+  CHECK_NE(pid, -1);
+  if (pid == 0) {
+    sys_exit_group(42);
+  }
+  CHECK_EQ(errno, 0);
+  int status;
+  CHECK_EQ(sys_wait4(pid, &status, 0, nullptr), pid);
+  CHECK(WIFEXITED(status));
+  CHECK_EQ(WEXITSTATUS(status), 42);
+}
+
 TEST(Syscalls, getegid) { CHECK_EQ(getegid(), sys_getegid()); }
 
 TEST(Syscalls, geteuid) { CHECK_EQ(geteuid(), sys_geteuid()); }
@@ -320,6 +369,24 @@ TEST(Syscalls, sigaltstack) {
   CHECK_EQ(ss_check.ss_flags, 0);
 }
 
+TEST(Syscalls, waitpid) {
+  pid_t pid = sys_fork();
+  CHECK_NE(pid, -1);
+  if (pid == 0) {
+    sys_exit_group(7);
+  }
+  int status;
+  errno = 0;
+  CHECK_EQ(waitpid(pid, &status, 0), pid);
+  CHECK_EQ(errno, 0);
+  CHECK(WIFEXITED(status));
+  CHECK_EQ(WEXITSTATUS(status), 7);
+
+  // There are no more children to wait for.
+  CHECK_EQ(waitpid(-1, &status, 0), -1);
+  CHECK_EQ(errno, ECHILD);
+}
+
 TEST(Syscalls, write) {
   TempFilePath temp("write");
   int fd = sys_open(temp.path(), kDefaultOpenFlags, kDefaultCreationMode);
@@ -347,7 +414,10 @@ TEST(Syscalls, write) {
 // ========================================================================= //
 
 NOLIBC_TEST_MAIN({
+  RUN_TEST(Syscalls, clock_gettime);
   RUN_TEST(Syscalls, close);
+  RUN_TEST(Syscalls, dup2);
+  RUN_TEST(Syscalls, fork);
   RUN_TEST(Syscalls, getegid);
   RUN_TEST(Syscalls, geteuid);
   RUN_TEST(Syscalls, getpid);
@@ -360,5 +430,6 @@ NOLIBC_TEST_MAIN({
   RUN_TEST(Syscalls, prctl);
   RUN_TEST(Syscalls, read);
   RUN_TEST(Syscalls, sigaltstack);
+  RUN_TEST(Syscalls, waitpid);
   RUN_TEST(Syscalls, write);
 })